@@ -0,0 +1,1714 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/*
+ * Benchmarks for the jsonapi library. Each benchmark is run for a fixed 
+ * number of iterations and the average time per iteration is reported.
+ */
+
+#include "jsonapi.h"
+#include "jsonbind.h"
+#include "jsondocument.h"
+#include "jsoncache.h"
+#include "jsoncbor.h"
+#include "jsonholder.h"
+#include "jsonmsgpack.h"
+#include "jsonparse.h"
+#include "jsonpatch.h"
+#include "jsonschema.h"
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+typedef void (*BenchFunc)(int iterations);
+
+struct Benchmark {
+    const char *name;
+    void (*setup)();    // run before timing starts, may be NULL
+    BenchFunc func;
+    int iterations;
+};
+
+static size_t sink;  // keeps results alive so the work is not optimized away
+
+/**
+ * Add a key/value pair to an object.
+ *
+ * @param[in] obj the object
+ * @param[in] key the key
+ * @param[in] val the value, owned by obj from now on
+ */
+
+static void
+AddTuple(JSONValue *obj, const char *key, JSONValue *val)
+{
+    JSONTuple *tuple = new JSONTuple();
+
+    tuple->SetKey(key);
+    tuple->SetValue(val);
+    obj->Append(tuple);
+}
+
+
+/**
+ * Build a response template of about size bytes when serialized. It is 
+ * an object with a few header fields and an array of records.
+ *
+ * @param[in] size approximate size in bytes of the template as JSON.
+ *
+ * @return the template, owned by the caller.
+ */
+
+static JSONValue *
+MakeTemplate(size_t size)
+{
+    JSONObject *root = new JSONObject();
+    JSONArray *records = new JSONArray();
+    std::string str;
+    size_t count = 1;
+    char buf[64];
+
+    AddTuple(root, "status", new JSONString("pending"));
+    AddTuple(root, "requestId", new JSONNumber(0));
+    AddTuple(root, "records", records);
+    for (size_t i = 0; i < count; i++) {
+        JSONObject *rec = new JSONObject();
+        JSONArray *tags = new JSONArray();
+
+        AddTuple(rec, "id", new JSONNumber(i));
+        snprintf(buf, sizeof(buf), "record number %lu", (unsigned long) i);
+        AddTuple(rec, "name", new JSONString(buf));
+        AddTuple(rec, "score", new JSONDouble(i * 0.5));
+        AddTuple(rec, "active", new JSONBoolean((i & 1) == 0));
+        AddTuple(rec, "owner", new JSONNull());
+        tags->Append(new JSONString("alpha"));
+        tags->Append(new JSONString("beta"));
+        tags->Append(new JSONString("gamma"));
+        AddTuple(rec, "tags", tags);
+        records->Append(rec);
+        if (i == 0) {
+            rec->ToJSON(str);
+            count = size / (str.size() + 1);
+        }
+    }
+    return root;
+}
+
+
+/**
+ * Patch the few fields of a response that differ per request.
+ *
+ * @param[in] doc the response
+ * @param[in] n the request number
+ */
+
+static void
+Patch(JSONDocument &doc, int n)
+{
+    JSONValue *val;
+
+    val = doc.GetMutable(std::vector<int>{0});
+    static_cast<JSONString *>(val)->Set("done");
+    val = doc.GetMutable(std::vector<int>{1});
+    static_cast<JSONNumber *>(val)->Set(n);
+    val = doc.GetMutable(std::vector<int>{2, n % 100, 1});
+    static_cast<JSONString *>(val)->Set("patched");
+}
+
+
+static JSONDocument *base;
+
+/**
+ * Build the 1 MB template used by the clone benchmarks.
+ */
+
+static void
+SetupTemplate()
+{
+    if (base == NULL) {
+        base = new JSONDocument(MakeTemplate(1024 * 1024));
+    }
+}
+
+
+/**
+ * Clone the template by deep copy (the only way to clone it before
+ * documents could share subtrees), patch and serialize it.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchDeepCopy(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONDocument doc(base->GetRoot()->Copy());
+        std::string str;
+
+        Patch(doc, i);
+        doc.ToJSON(str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Clone the template with JSONDocument::Clone(), patch and serialize it.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchClone(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONDocument doc = base->Clone();
+        std::string str;
+
+        Patch(doc, i);
+        doc.ToJSON(str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Clone the template with JSONDocument::Clone() and patch it, without
+ * serializing, to show the cost of the clone itself.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchCloneNoSerialize(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONDocument doc = base->Clone();
+
+        Patch(doc, i);
+        sink += doc.GetRoot()->GetSize();
+    }
+}
+
+
+static JSONDocument *large;
+static std::vector<JSONPatch *> patches;
+
+/**
+ * Build the 10 MB document used by the patch and snapshot benchmarks.
+ */
+
+static void
+SetupLarge()
+{
+    if (large == NULL) {
+        large = new JSONDocument(MakeTemplate(10 * 1024 * 1024));
+    }
+}
+
+
+/**
+ * Build a 10 MB document and compile the patches applied to it. Each
+ * patch checks the status, replaces the name of a record and appends a
+ * tag to it.
+ */
+
+static void
+SetupPatches()
+{
+    JSONValue *records;
+    char buf[64];
+
+    SetupLarge();
+    records = static_cast<JSONTuple *>(large->GetRoot()->Get(2))->GetValue();
+    for (int i = 0; i < 10000; i++) {
+        JSONArray *ops = new JSONArray();
+        JSONObject *op;
+        int rec = (int) ((i * 7919L) % records->GetSize());
+
+        op = new JSONObject();
+        AddTuple(op, "op", new JSONString("test"));
+        AddTuple(op, "path", new JSONString("/status"));
+        AddTuple(op, "value", new JSONString("pending"));
+        ops->Append(op);
+        op = new JSONObject();
+        AddTuple(op, "op", new JSONString("replace"));
+        snprintf(buf, sizeof(buf), "/records/%d/name", rec);
+        AddTuple(op, "path", new JSONString(buf));
+        AddTuple(op, "value", new JSONString("patched"));
+        ops->Append(op);
+        op = new JSONObject();
+        AddTuple(op, "op", new JSONString("add"));
+        snprintf(buf, sizeof(buf), "/records/%d/tags/-", rec);
+        AddTuple(op, "path", new JSONString(buf));
+        AddTuple(op, "value", new JSONString("delta"));
+        ops->Append(op);
+
+        JSONPatch *patch = new JSONPatch();
+        patch->Compile(ops);
+        patches.push_back(patch);
+        delete ops;
+    }
+}
+
+
+/**
+ * Apply compiled patches, in place, to the 10 MB document.
+ *
+ * @param[in] iterations number of patches to apply.
+ */
+
+static void
+BenchPatch(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        sink += patches[i % patches.size()]->Apply(*large);
+    }
+}
+
+
+static char snapshot[] = "/tmp/jsonapibenchXXXXXX";
+
+/**
+ * Save the 10 MB document to a snapshot file.
+ */
+
+static void
+SetupSnapshot()
+{
+    int fd;
+
+    if (snapshot[strlen(snapshot) - 1] != 'X') {
+        return;     // already saved
+    }
+    SetupLarge();
+    if ((fd = mkstemp(snapshot)) >= 0) {
+        close(fd);
+        large->SaveSnapshot(snapshot);
+    }
+}
+
+
+/**
+ * Load the snapshot of the 10 MB document and look up a record in it,
+ * checking the checksum of the file.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchSnapshotVerify(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONTape tape;
+
+        if (tape.LoadSnapshot(snapshot, true)) {
+            JSONTapeValue root = tape.GetRoot();
+            sink += root.Get(root.FindKey("records")).GetValue().GetSize();
+        }
+    }
+}
+
+
+/**
+ * Load the snapshot of the 10 MB document and look up a record in it,
+ * without checking the checksum.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchSnapshot(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONTape tape;
+
+        if (tape.LoadSnapshot(snapshot, false)) {
+            JSONTapeValue root = tape.GetRoot();
+            sink += root.Get(root.FindKey("records")).GetValue().GetSize();
+        }
+    }
+}
+
+
+static std::string sharedName;
+
+/**
+ * Save the 10 MB document to a shared memory object.
+ */
+
+static void
+SetupShared()
+{
+    if (!sharedName.empty()) {
+        return;
+    }
+    SetupLarge();
+    sharedName = "/jsonapibench-" + std::to_string(getpid());
+    JSONTape::RemoveShared(sharedName.c_str());
+    large->SaveShared(sharedName.c_str());
+}
+
+
+/**
+ * Attach the shared memory object holding the 10 MB document and look 
+ * up a record in it, as each worker process of a host does.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchAttachShared(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONTape tape;
+
+        if (tape.AttachShared(sharedName.c_str(), false)) {
+            JSONTapeValue root = tape.GetRoot();
+            sink += root.Get(root.FindKey("records")).GetValue().GetSize();
+        }
+    }
+}
+
+
+static JSONValue *telemetry;
+static std::string telemetryPacked;
+static std::string templatePacked;
+
+/**
+ * Build a small telemetry message and encode it and the 1 MB template as 
+ * MessagePack, reporting the size of both encodings.
+ */
+
+static void
+SetupMsgPack()
+{
+    JSONArray *samples;
+    std::string str;
+
+    if (telemetry != NULL) {
+        return;
+    }
+    SetupTemplate();
+    telemetry = new JSONObject();
+    samples = new JSONArray();
+    AddTuple(telemetry, "device", new JSONString("sensor-0042"));
+    AddTuple(telemetry, "seq", new JSONNumber(123456));
+    AddTuple(telemetry, "time", new JSONNumber(1700000000));
+    AddTuple(telemetry, "ok", new JSONBoolean(true));
+    AddTuple(telemetry, "temp", new JSONDouble(21.5));
+    AddTuple(telemetry, "samples", samples);
+    for (int i = 0; i < 8; i++) {
+        samples->Append(new JSONNumber(i * 37));
+    }
+    JSONMsgPack::Encode(telemetry, telemetryPacked);
+    telemetry->ToJSON(str);
+    printf("telemetry message: %lu bytes JSON, %lu bytes msgpack\n", 
+        (unsigned long) str.size(), (unsigned long) telemetryPacked.size());
+    JSONMsgPack::Encode(base->GetRoot(), templatePacked);
+    base->ToJSON(str);
+    printf("1MB template: %lu bytes JSON, %lu bytes msgpack\n", 
+        (unsigned long) str.size(), (unsigned long) templatePacked.size());
+}
+
+
+/**
+ * Serialize the telemetry message as JSON, for comparison.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTelemetryToJSON(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        telemetry->ToJSON(str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Encode the telemetry message as MessagePack.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTelemetryEncode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        JSONMsgPack::Encode(telemetry, str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Decode the MessagePack encoding of the telemetry message.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTelemetryDecode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONValue *val;
+        size_t used;
+
+        if (JSONMsgPack::Decode(telemetryPacked.data(), 
+            telemetryPacked.size(), &val, &used) && val) {
+            sink += used;
+            delete val;
+        }
+    }
+}
+
+
+/**
+ * Serialize the 1 MB template as JSON, for comparison.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTemplateToJSON(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        base->ToJSON(str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Encode the 1 MB template as MessagePack.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTemplateEncode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        JSONMsgPack::Encode(base->GetRoot(), str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Decode the MessagePack encoding of the 1 MB template.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTemplateDecode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONValue *val;
+        size_t used;
+
+        if (JSONMsgPack::Decode(templatePacked.data(), 
+            templatePacked.size(), &val, &used) && val) {
+            sink += used;
+            delete val;
+        }
+    }
+}
+
+
+static std::string templateCbor;
+
+/**
+ * Encode the 1 MB template as CBOR, reporting the size of the encoding.
+ */
+
+static void
+SetupCbor()
+{
+    if (templateCbor.empty()) {
+        SetupTemplate();
+        JSONCbor::Encode(base->GetRoot(), templateCbor);
+        printf("1MB template: %lu bytes CBOR\n", 
+            (unsigned long) templateCbor.size());
+    }
+}
+
+
+/**
+ * Encode the 1 MB template as CBOR.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchCborEncode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        JSONCbor::Encode(base->GetRoot(), str);
+        sink += str.size();
+    }
+}
+
+
+/**
+ * Decode the CBOR encoding of the 1 MB template into a tree.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchCborDecode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONValue *val;
+        size_t used;
+
+        if (JSONCbor::Decode(templateCbor.data(), templateCbor.size(), 
+            &val, &used) && val) {
+            sink += used;
+            delete val;
+        }
+    }
+}
+
+
+/**
+ * An event handler that counts strings, standing in for a caller that
+ * processes values without building a tree.
+ */
+
+class CountStrings : public JSONEventHandler
+{
+public:
+    bool String(const char *str, size_t len) {sink += len; return true;}
+};
+
+
+/**
+ * Decode the CBOR encoding of the 1 MB template as events.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchCborEvents(int iterations)
+{
+    CountStrings handler;
+    JSONCborDecoder decoder(&handler);
+
+    for (int i = 0; i < iterations; i++) {
+        sink += decoder.Feed(templateCbor.data(), templateCbor.size());
+    }
+}
+
+
+static JSONParseCache *cache;
+static std::string cacheInput;
+
+/**
+ * Fill a parse cache with a document of about 4 KB, the size of a typical
+ * client configuration.
+ */
+
+static void
+SetupCache()
+{
+    JSONValue *val;
+    JSONDocument doc;
+
+    if (cache == NULL) {
+        val = MakeTemplate(4096);
+        val->ToJSON(cacheInput);
+        delete val;
+        cache = new JSONParseCache(64 * 1024 * 1024);
+        cache->Get(cacheInput, doc);
+    }
+}
+
+
+/**
+ * Look up the cached document, as a request carrying it would.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchCacheHit(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONDocument doc;
+
+        cache->Get(cacheInput, doc);
+        sink += doc.GetRoot() != NULL;
+    }
+}
+
+
+static std::vector<JSONString *> messages;
+
+/**
+ * Make 1000 log messages, each with line breaks and non-ASCII characters,
+ * so that serializing them has escaping and UTF-8 conversion to do.
+ */
+
+static void
+SetupMessages()
+{
+    if (messages.empty()) {
+        for (int i = 0; i < 1000; i++) {
+            std::string msg("r\xc3\xa9sum\xc3\xa9 upload failed\n  at line ");
+
+            msg += std::to_string(i);
+            msg += "\n  retrying in 5s, caf\xc3\xa9 \xe2\x82\xac price unchanged";
+            messages.push_back(new JSONString(msg));
+        }
+    }
+}
+
+
+/**
+ * Serialize the log messages, as a service returning the same messages
+ * to every client would.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchMessagesToJSON(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        for (size_t j = 0; j < messages.size(); j++) {
+            messages[j]->ToJSON(str);
+        }
+        sink += str.size();
+    }
+}
+
+
+static JSONValue *rows;
+static JSONValue *shapedRows;
+static std::vector<JSONValue *> rowList;
+static std::vector<JSONValue *> shapedRowList;
+
+/**
+ * Parse 1000 rows of 16 columns, once with objects and once with 
+ * records (see JSONShapeTable), and report the memory each tree uses.
+ */
+
+static void
+SetupRows()
+{
+    JSONShapeTable shapes;
+    JsonParse parser;
+    std::string input("[");
+
+    if (rows) {
+        return;
+    }
+    for (int i = 0; i < 1000; i++) {
+        input += i ? ", {" : "{";
+        for (int j = 0; j < 16; j++) {
+            input += (j ? ", \"column" : "\"column") + std::to_string(j) + 
+                "\": " + std::to_string(i * 16 + j);
+        }
+        input += "}";
+    }
+    input += "]";
+    parser.SetDirect(true);
+    parser.SetInput(input);
+    parser.Parse();
+    rows = JSONAPI::GetRootObject(&parser);
+    parser.SetShapes(&shapes);
+    parser.SetInput(input);
+    parser.Parse();
+    shapedRows = JSONAPI::GetRootObject(&parser);
+    for (int i = 0; i < rows->GetSize(); i++) {
+        rowList.push_back(rows->Get(i));
+        shapedRowList.push_back(shapedRows->Get(i));
+    }
+    printf("    rows as objects: %zu bytes, as records: %zu bytes\n",
+        rows->MemoryUsage().GetTotal(), shapedRows->MemoryUsage().GetTotal());
+}
+
+
+/**
+ * Find the last column of every row.
+ *
+ * @param[in] list the rows.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+FindColumn(const std::vector<JSONValue *> &list, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < list.size(); j++) {
+            sink += list[j]->FindKey("column15");
+        }
+    }
+}
+
+
+static void
+BenchRowsFind(int iterations)
+{
+    FindColumn(rowList, iterations);
+}
+
+
+static void
+BenchShapedRowsFind(int iterations)
+{
+    FindColumn(shapedRowList, iterations);
+}
+
+
+static JSONValue *wide;
+static JSONValue *sortedWide;
+static std::vector<std::string> wideKeys;
+
+/**
+ * Parse an object of 1000 keys, and make a sorted copy of it (see 
+ * JSONObject::SortKeys()).
+ */
+
+static void
+SetupWide()
+{
+    JsonParse parser;
+    std::string input("{");
+
+    if (wide) {
+        return;
+    }
+    for (int i = 0; i < 1000; i++) {
+        wideKeys.push_back("setting" + std::to_string((i * 7919) % 1000));
+        input += (i ? ", \"" : "\"") + wideKeys.back() + "\": " + 
+            std::to_string(i);
+    }
+    input += "}";
+    parser.SetDirect(true);
+    parser.SetInput(input);
+    parser.Parse();
+    wide = JSONAPI::GetRootObject(&parser);
+    sortedWide = wide->Copy();
+    static_cast<JSONObject *>(sortedWide)->SortKeys();
+    printf("    1000 keys as an object: %zu bytes, sorted: %zu bytes\n",
+        wide->MemoryUsage().GetTotal(), sortedWide->MemoryUsage().GetTotal());
+}
+
+
+/**
+ * Look up the value of every key of the wide object.
+ *
+ * @param[in] obj the object.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+FindWide(const JSONValue *obj, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        for (size_t j = 0; j < wideKeys.size(); j++) {
+            const JSONValue *tuple = obj->Get(obj->FindKey(wideKeys[j]));
+
+            sink += static_cast<const JSONTuple *>(tuple)->GetValue()->GetType();
+        }
+    }
+}
+
+
+static void
+BenchWideFind(int iterations)
+{
+    FindWide(wide, iterations);
+}
+
+
+static void
+BenchSortedWideFind(int iterations)
+{
+    FindWide(sortedWide, iterations);
+}
+
+
+static std::vector<int64_t> bulkNumbers;
+static std::vector<std::string> bulkKeys;
+
+/**
+ * Make the 1000000 numbers and 100000 keys the bulk benchmarks build 
+ * arrays and objects of.
+ */
+
+static void
+SetupBulk()
+{
+    char buf[32];
+
+    if (!bulkNumbers.empty()) {
+        return;
+    }
+    for (int i = 0; i < 1000000; i++) {
+        bulkNumbers.push_back((i * 7919L) % 65536);
+    }
+    for (int i = 0; i < 100000; i++) {
+        snprintf(buf, sizeof(buf), "key%06d", i);
+        bulkKeys.push_back(buf);
+    }
+}
+
+
+/**
+ * Build an array of 1000000 numbers one value at a time.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchBulkArrayAppend(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONArray array;
+
+        for (size_t j = 0; j < bulkNumbers.size(); j++) {
+            array.Append(new JSONNumber(bulkNumbers[j]));
+        }
+        sink += array.GetSize();
+    }
+}
+
+
+/**
+ * Build an array of 1000000 numbers from a range.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchBulkArrayRange(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONArray array;
+
+        array.Append(bulkNumbers.begin(), bulkNumbers.end());
+        sink += array.GetSize();
+    }
+}
+
+
+/**
+ * Build a packed array of 1000000 numbers from a span.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchBulkArrayPacked(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONPackedArray array;
+
+        array.Reserve(bulkNumbers.size());
+        array.AppendIntegers(JSONSpan<const int64_t>(bulkNumbers.data(), 
+            bulkNumbers.size()));
+        sink += array.GetCount();
+    }
+}
+
+
+/**
+ * Build an object of 100000 keys one tuple at a time.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchBulkObjectAppend(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONObject obj;
+
+        for (size_t j = 0; j < bulkKeys.size(); j++) {
+            JSONTuple *tuple = new JSONTuple();
+
+            tuple->SetKey(bulkKeys[j]);
+            tuple->SetValue(new JSONNumber(j));
+            obj.Append(tuple);
+        }
+        sink += obj.GetSize();
+    }
+}
+
+
+/**
+ * Build an object of 100000 keys by making its members in place.
+ *
+ * @param[in] sorted whether to build a sorted object.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BuildObject(bool sorted, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JSONObject obj;
+
+        if (sorted) {
+            obj.SortKeys();
+            obj.Reserve(bulkKeys.size());
+        }
+        for (size_t j = 0; j < bulkKeys.size(); j++) {
+            obj.EmplaceMember<JSONNumber>(bulkKeys[j], (long) j);
+        }
+        sink += obj.GetSize();
+    }
+}
+
+
+static void
+BenchBulkObjectEmplace(int iterations)
+{
+    BuildObject(false, iterations);
+}
+
+
+static void
+BenchBulkObjectSorted(int iterations)
+{
+    BuildObject(true, iterations);
+}
+
+
+/**
+ * The telemetry message as a struct.
+ */
+
+struct Telemetry
+{
+    std::string device;
+    long seq;
+    long time;
+    bool ok;
+    double temp;
+    std::vector<long> samples;
+};
+
+JSON_BIND_BEGIN(Telemetry)
+    JSON_BIND_FIELD(device)
+    JSON_BIND_FIELD(seq)
+    JSON_BIND_FIELD(time)
+    JSON_BIND_FIELD(ok)
+    JSON_BIND_FIELD(temp)
+    JSON_BIND_FIELD(samples)
+JSON_BIND_END()
+
+static std::string telemetryJSON;
+static Telemetry telemetryStruct;
+
+/**
+ * Encode the telemetry message as JSON text, with JSONBind so that 
+ * strings have no quotes of their own.
+ */
+
+static void
+SetupBind()
+{
+    if (telemetryJSON.empty()) {
+        telemetryStruct.device = "sensor-0042";
+        telemetryStruct.seq = 123456;
+        telemetryStruct.time = 1700000000;
+        telemetryStruct.ok = true;
+        telemetryStruct.temp = 21.5;
+        for (int i = 0; i < 8; i++) {
+            telemetryStruct.samples.push_back(i * 37);
+        }
+        JSONBind::Encode(telemetryStruct, telemetryJSON);
+    }
+}
+
+
+/**
+ * Parse the telemetry message into a JSONValue tree, and copy its fields
+ * into a struct, as was done before JSONBind.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTelemetryParse(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JsonParse parser;
+        Telemetry msg;
+
+        parser.SetDirect(true);
+        parser.SetInput(telemetryJSON);
+        if (parser.Parse()) {
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+            JSONValue *samples;
+
+            msg.device = static_cast<JSONString *>(static_cast<JSONTuple *>(
+                val->Get(val->FindKey("device")))->GetValue())->Get();
+            msg.seq = static_cast<JSONNumber *>(static_cast<JSONTuple *>(
+                val->Get(val->FindKey("seq")))->GetValue())->Get();
+            samples = static_cast<JSONTuple *>(
+                val->Get(val->FindKey("samples")))->GetValue();
+            for (JSONValue *sample : *samples) {
+                msg.samples.push_back(static_cast<JSONNumber *>(sample)->Get());
+            }
+            sink += msg.seq + msg.samples.size();
+        }
+    }
+}
+
+
+/**
+ * Decode the telemetry message straight into the struct.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTelemetryBind(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        Telemetry msg;
+
+        if (JSONBind::Decode(telemetryJSON, msg)) {
+            sink += msg.seq + msg.samples.size();
+        }
+    }
+}
+
+
+/**
+ * Encode the struct as JSON text.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchTelemetryBindEncode(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        std::string str;
+
+        JSONBind::Encode(telemetryStruct, str);
+        sink += str.size();
+    }
+}
+
+
+static JSONSchema telemetrySchema;
+static std::string telemetryInvalid;
+
+/**
+ * Compile a schema for the telemetry message, and make a message that
+ * breaks it in its second member.
+ */
+
+static void
+SetupSchema()
+{
+    SetupBind();
+    if (!telemetrySchema.IsCompiled()) {
+        telemetrySchema.Compile(std::string("{\"type\": \"object\", "
+            "\"properties\": {\"device\": {\"type\": \"string\", "
+            "\"maxLength\": 64}, \"seq\": {\"type\": \"integer\", "
+            "\"minimum\": 0}, \"time\": {\"type\": \"integer\"}, "
+            "\"ok\": {\"type\": \"boolean\"}, \"temp\": {\"type\": \"number\", "
+            "\"minimum\": -50, \"maximum\": 150}, \"samples\": {\"type\": "
+            "\"array\", \"items\": {\"type\": \"integer\"}, \"maxItems\": 64}}, "
+            "\"required\": [\"device\", \"seq\", \"time\"], "
+            "\"additionalProperties\": false}"));
+        telemetryInvalid = telemetryJSON;
+        telemetryInvalid.replace(telemetryInvalid.find("123456"), 6, "-1");
+    }
+}
+
+
+/**
+ * Validate the telemetry message text, without parsing it into a tree.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchSchemaText(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        sink += telemetrySchema.Validate(telemetryJSON.data(), 
+            telemetryJSON.size());
+    }
+}
+
+
+/**
+ * Validate the tree of the telemetry message.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchSchemaTree(int iterations)
+{
+    JsonParse parser;
+
+    parser.SetDirect(true);
+    parser.SetInput(telemetryJSON);
+    parser.Parse();
+
+    std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+
+    for (int i = 0; i < iterations; i++) {
+        sink += telemetrySchema.Validate(val.get());
+    }
+}
+
+
+/**
+ * Parse a message into a tree, and validate the tree, as is needed 
+ * without a schema set on the parser.
+ *
+ * @param[in] str the message.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+ParseThenValidate(std::string &str, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JsonParse parser;
+
+        parser.SetDirect(true);
+        parser.SetInput(str);
+        if (parser.Parse()) {
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+
+            sink += telemetrySchema.Validate(val.get());
+        }
+    }
+}
+
+
+/**
+ * Parse a message with the schema set on the parser, which validates 
+ * it before building the tree.
+ *
+ * @param[in] str the message.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+ParseWithSchema(std::string &str, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JsonParse parser;
+
+        parser.SetDirect(true);
+        parser.SetSchema(&telemetrySchema);
+        parser.SetInput(str);
+        if (parser.Parse()) {
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+
+            sink += val->GetSize();
+        }
+    }
+}
+
+
+static void
+BenchSchemaParseThen(int iterations)
+{
+    ParseThenValidate(telemetryJSON, iterations);
+}
+
+
+static void
+BenchSchemaParseWith(int iterations)
+{
+    ParseWithSchema(telemetryJSON, iterations);
+}
+
+
+static void
+BenchSchemaRejectThen(int iterations)
+{
+    ParseThenValidate(telemetryInvalid, iterations);
+}
+
+
+static void
+BenchSchemaRejectWith(int iterations)
+{
+    ParseWithSchema(telemetryInvalid, iterations);
+}
+
+
+static std::string samplesInput;
+static JSONValue *samples;
+static JSONValue *packedSamples;
+
+/**
+ * Parse an array of 100000 integers, once as a generic array and once 
+ * packed.
+ */
+
+static void
+SetupSamples()
+{
+    JsonParse parser;
+
+    if (samples) {
+        return;
+    }
+    samplesInput = "[";
+    for (int i = 0; i < 100000; i++) {
+        samplesInput += (i ? ", " : "") + std::to_string((i * 7919) % 65536 - 32768);
+    }
+    samplesInput += "]";
+    parser.SetDirect(true);
+    parser.SetInput(samplesInput);
+    parser.Parse();
+    samples = JSONAPI::GetRootObject(&parser);
+    parser.SetPackArrays(true);
+    parser.SetInput(samplesInput);
+    parser.Parse();
+    packedSamples = JSONAPI::GetRootObject(&parser);
+    printf("    100000 integers as an array: %zu bytes, packed: %zu bytes\n",
+        samples->MemoryUsage().GetTotal(), 
+        packedSamples->MemoryUsage().GetTotal());
+}
+
+
+/**
+ * Parse the samples.
+ *
+ * @param[in] pack whether to pack the array.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+ParseSamples(bool pack, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JsonParse parser;
+
+        parser.SetDirect(true);
+        parser.SetPackArrays(pack);
+        parser.SetInput(samplesInput);
+        parser.Parse();
+
+        std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+
+        sink += val->GetType();
+    }
+}
+
+
+static void
+BenchSamplesParse(int iterations)
+{
+    ParseSamples(false, iterations);
+}
+
+
+static void
+BenchSamplesParsePacked(int iterations)
+{
+    ParseSamples(true, iterations);
+}
+
+
+/**
+ * Sum the samples, visiting the JSONNumber elements of the array.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchSamplesSum(int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        long sum = 0;
+
+        for (const JSONValue *val : *static_cast<const JSONValue *>(samples)) {
+            sum += static_cast<const JSONNumber *>(val)->Get();
+        }
+        sink += sum;
+    }
+}
+
+
+/**
+ * Sum the samples, through the span of the packed array.
+ *
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+BenchSamplesSumPacked(int iterations)
+{
+    const JSONPackedArray *array = static_cast<JSONPackedArray *>(packedSamples);
+
+    for (int i = 0; i < iterations; i++) {
+        long sum = 0;
+
+        for (int64_t val : array->GetIntegers()) {
+            sum += val;
+        }
+        sink += sum;
+    }
+}
+
+
+static std::string templateInput;
+
+/**
+ * Make the JSON of the 1 MB template, for the lazy parse benchmarks.
+ */
+
+static void
+SetupLazy()
+{
+    if (templateInput.empty()) {
+        std::unique_ptr<JSONValue> val(MakeTemplate(1024 * 1024));
+
+        val->ToJSON(templateInput);
+    }
+}
+
+
+/**
+ * Parse the template and read the status of the response and the name 
+ * of one of its records, as a handler interested in a few fields does.
+ *
+ * @param[in] lazy whether to convert the tree lazily.
+ * @param[in] iterations number of times to run.
+ */
+
+static void
+ParseSparse(bool lazy, int iterations)
+{
+    for (int i = 0; i < iterations; i++) {
+        JsonParse parser;
+
+        parser.SetLazy(lazy);
+        parser.SetInput(templateInput);
+        parser.Parse();
+
+        std::unique_ptr<const JSONValue> root(JSONAPI::GetRootObject(&parser));
+        const JSONValue *status = static_cast<const JSONTuple *>(
+            root->Get(root->FindKey("status")))->GetValue();
+        const JSONValue *records = static_cast<const JSONTuple *>(
+            root->Get(root->FindKey("records")))->GetValue();
+        const JSONValue *rec = records->Get(i % 100);
+
+        sink += status->GetType() + rec->Get(rec->FindKey("name"))->GetType();
+    }
+}
+
+
+static void
+BenchParseSparse(int iterations)
+{
+    ParseSparse(false, iterations);
+}
+
+
+static void
+BenchParseSparseLazy(int iterations)
+{
+    ParseSparse(true, iterations);
+}
+
+
+static JSONDocument config;
+static JSONDocumentHolder *configHolder;
+static std::shared_mutex configLock;
+static const int ConfigReaders = 8;
+
+/**
+ * Make a configuration document of 64 settings.
+ */
+
+static void
+SetupConfig()
+{
+    std::string input("{");
+    JsonParse parser;
+
+    if (configHolder) {
+        return;
+    }
+    for (int i = 0; i < 64; i++) {
+        input += (i ? ", \"setting" : "\"setting") + std::to_string(i) + 
+            "\": {\"value\": " + std::to_string(i) + ", \"enabled\": true}";
+    }
+    input += "}";
+    parser.SetDirect(true);
+    parser.SetInput(input);
+    parser.Parse();
+    config.SetRoot(JSONAPI::GetRootObject(&parser));
+    configHolder = new JSONDocumentHolder(config);
+}
+
+
+/**
+ * Read a setting, as the readers of the configuration do.
+ *
+ * @param[in] root the configuration.
+ *
+ * @return the value of the setting.
+ */
+
+static long
+ReadSetting(const JSONValue *root)
+{
+    const JSONValue *setting = static_cast<const JSONTuple *>(
+        root->Get(root->FindKey("setting3")))->GetValue();
+
+    return static_cast<const JSONNumber *>(static_cast<const JSONTuple *>(
+        setting->Get(setting->FindKey("value")))->GetValue())->Get();
+}
+
+
+/**
+ * Run readers of the configuration on several threads, while a writer 
+ * publishes a new version every 100 microseconds.
+ *
+ * @param[in] read reads a setting, returns its value.
+ * @param[in] write publishes a new version.
+ * @param[in] iterations number of reads by each reader.
+ */
+
+template<typename R, typename W>
+static void
+RunConfigReaders(R read, W write, int iterations)
+{
+    std::atomic<bool> done(false);
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> readers;
+    std::thread writer([&]() {
+        while (!done.load()) {
+            write();
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    });
+
+    for (int t = 0; t < ConfigReaders; t++) {
+        readers.emplace_back([&]() {
+            size_t sum = 0;
+
+            for (int i = 0; i < iterations; i++) {
+                sum += read();
+            }
+            total += sum;
+        });
+    }
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+    done = true;
+    writer.join();
+    sink += total;
+}
+
+
+/**
+ * Read the configuration under a reader-writer lock.
+ *
+ * @param[in] iterations number of reads by each reader.
+ */
+
+static void
+BenchConfigLocked(int iterations)
+{
+    RunConfigReaders([]() {
+        std::shared_lock<std::shared_mutex> lock(configLock);
+
+        return ReadSetting(config.GetRoot());
+    }, []() {
+        JSONDocument next = config.Clone();
+        std::unique_lock<std::shared_mutex> lock(configLock);
+
+        config = next;
+    }, iterations);
+}
+
+
+/**
+ * Read the configuration from a JSONDocumentHolder.
+ *
+ * @param[in] iterations number of reads by each reader.
+ */
+
+static void
+BenchConfigHolder(int iterations)
+{
+    RunConfigReaders([]() {
+        JSONDocumentHolder::ReadGuard guard(*configHolder);
+
+        return ReadSetting(guard.GetRoot());
+    }, []() {
+        configHolder->Publish(configHolder->Get());
+    }, iterations);
+}
+
+
+static Benchmark benchmarks[] = {
+    {"clone+patch+serialize 1MB, deep copy", SetupTemplate, BenchDeepCopy, 20},
+    {"clone+patch+serialize 1MB, Clone()", SetupTemplate, BenchClone, 20},
+    {"clone+patch 1MB, Clone()", SetupTemplate, BenchCloneNoSerialize, 10000},
+    {"apply JSON patch 10MB", SetupPatches, BenchPatch, 10000},
+    {"load snapshot 10MB, verified", SetupSnapshot, BenchSnapshotVerify, 100},
+    {"load snapshot 10MB", SetupSnapshot, BenchSnapshot, 1000},
+    {"attach shared 10MB", SetupShared, BenchAttachShared, 1000},
+    {"telemetry to JSON", SetupMsgPack, BenchTelemetryToJSON, 100000},
+    {"telemetry to msgpack", SetupMsgPack, BenchTelemetryEncode, 100000},
+    {"telemetry from msgpack", SetupMsgPack, BenchTelemetryDecode, 100000},
+    {"1MB template to JSON", SetupMsgPack, BenchTemplateToJSON, 20},
+    {"1MB template to msgpack", SetupMsgPack, BenchTemplateEncode, 20},
+    {"1MB template from msgpack", SetupMsgPack, BenchTemplateDecode, 20},
+    {"1MB template to CBOR", SetupCbor, BenchCborEncode, 20},
+    {"1MB template from CBOR", SetupCbor, BenchCborDecode, 20},
+    {"1MB template from CBOR, events only", SetupCbor, BenchCborEvents, 20},
+    {"parse cache hit 4KB", SetupCache, BenchCacheHit, 100000},
+    {"1000 escaped strings to JSON", SetupMessages, BenchMessagesToJSON, 10000},
+    {"find key in 1000 objects", SetupRows, BenchRowsFind, 10000},
+    {"find key in 1000 records", SetupRows, BenchShapedRowsFind, 10000},
+    {"get 1000 keys of an object", SetupWide, BenchWideFind, 100},
+    {"get 1000 keys of a sorted object", SetupWide, BenchSortedWideFind, 100},
+    {"build 1000000 numbers, Append", SetupBulk, BenchBulkArrayAppend, 5},
+    {"build 1000000 numbers, range", SetupBulk, BenchBulkArrayRange, 5},
+    {"build 1000000 numbers, packed", SetupBulk, BenchBulkArrayPacked, 5},
+    {"build 100000 keys, Append", SetupBulk, BenchBulkObjectAppend, 5},
+    {"build 100000 keys, EmplaceMember", SetupBulk, BenchBulkObjectEmplace, 5},
+    {"build 100000 keys, sorted", SetupBulk, BenchBulkObjectSorted, 5},
+    {"telemetry from JSON, parse and copy", SetupBind, BenchTelemetryParse, 100000},
+    {"telemetry from JSON, JSONBind", SetupBind, BenchTelemetryBind, 100000},
+    {"telemetry to JSON, JSONBind", SetupBind, BenchTelemetryBindEncode, 100000},
+    {"validate telemetry JSON with schema", SetupSchema, BenchSchemaText, 100000},
+    {"validate telemetry tree with schema", SetupSchema, BenchSchemaTree, 100000},
+    {"parse telemetry, then validate tree", SetupSchema, BenchSchemaParseThen, 100000},
+    {"parse telemetry with schema", SetupSchema, BenchSchemaParseWith, 100000},
+    {"reject invalid telemetry, parse then validate", SetupSchema, BenchSchemaRejectThen, 100000},
+    {"reject invalid telemetry with schema", SetupSchema, BenchSchemaRejectWith, 100000},
+    {"parse 100000 integers", SetupSamples, BenchSamplesParse, 20},
+    {"parse 100000 integers, packed", SetupSamples, BenchSamplesParsePacked, 20},
+    {"sum 100000 integers", SetupSamples, BenchSamplesSum, 1000},
+    {"sum 100000 integers, packed", SetupSamples, BenchSamplesSumPacked, 1000},
+    {"1MB template, parse and read 2 fields", SetupLazy, BenchParseSparse, 20},
+    {"1MB template, parse and read 2 fields, lazy", SetupLazy, BenchParseSparseLazy, 20},
+    {"read config, 8 threads, rwlock", SetupConfig, BenchConfigLocked, 1000000},
+    {"read config, 8 threads, holder", SetupConfig, BenchConfigHolder, 1000000},
+};
+
+int
+main(int argc, char *argv[])
+{
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        Benchmark &b = benchmarks[i];
+
+        if (argc > 1 && strstr(b.name, argv[1]) == NULL) {
+            continue;
+        }
+        if (b.setup) {
+            b.setup();
+        }
+        auto start = std::chrono::steady_clock::now();
+        b.func(b.iterations);
+        auto end = std::chrono::steady_clock::now();
+        double usec = std::chrono::duration<double, std::micro>(end - start).count();
+        printf("%-45s %12.1f us/iter\n", b.name, usec / b.iterations);
+    }
+    delete base;
+    delete large;
+    delete telemetry;
+    delete cache;
+    delete rows;
+    delete shapedRows;
+    delete wide;
+    delete sortedWide;
+    delete samples;
+    delete packedSamples;
+    delete configHolder;
+    if (snapshot[strlen(snapshot) - 1] != 'X') {
+        unlink(snapshot);
+    }
+    if (!sharedName.empty()) {
+        JSONTape::RemoveShared(sharedName.c_str());
+    }
+    for (size_t i = 0; i < patches.size(); i++) {
+        delete patches[i];
+    }
+    return sink == 0;
+}
@@ -105,3 +105,77 @@ Context::Current()
     return ret;
 }
 
+
+
+/** 
+ * push a public array or object onto the value stack. Used when the
+ * parser builds JSONValue objects directly, see JsonParse::SetDirect().
+ *
+ * @param[in] obj object to push
+ * 
+ * @return true always
+ */
+
+bool
+Context::PushValue(JSONValue *obj)
+{
+    m_values.push_front(obj);
+    return true;
+}
+
+
+/**
+ * Remove the top element from the value stack.
+ *
+ * @return object that was on the stack, or NULL if none.
+ */
+
+JSONValue *
+Context::PopValue()
+{
+    JSONValue *obj = NULL;
+
+    if (!m_values.empty()) {
+        obj = m_values.front();
+        m_values.pop_front();
+    }
+    return obj;
+}
+
+
+/**
+ * Return the current top of the value stack.
+ *
+ * @return the current top of stack object, or NULL.
+ */
+
+JSONValue *
+Context::CurrentValue()
+{
+    JSONValue *ret = NULL;
+
+    if (!m_values.empty()) {
+        ret = m_values.front();
+    }
+    return ret;
+}
+
+
+/**
+ * Return the element of the value stack at the given depth.
+ *
+ * @param[in] depth 0 for the top of stack, 1 for the element below it, etc.
+ *
+ * @return the object at that depth, or NULL if depth is out of range.
+ */
+
+JSONValue *
+Context::GetValueAt(int depth)
+{
+    JSONValue *ret = NULL;
+
+    if (depth >= 0 && depth < (int) m_values.size()) {
+        ret = m_values[depth];
+    }
+    return ret;
+}
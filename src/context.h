@@ -54,14 +54,24 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <deque>
 #include "jsonobj.h"
 
+class JSONValue;
+
 class Context 
 {
 public:
     bool Push(JsonNode *obj);
     JsonNode *Pop();
     JsonNode *Current();
+    bool PushValue(JSONValue *obj);
+    JSONValue *PopValue();
+    JSONValue *CurrentValue();
+    int GetValueDepth() {return m_values.size();}
+    JSONValue *GetValueAt(int depth);
 private:
-    std::deque <JsonNode *> m_stack;
+    std::deque <JsonNode *, 
+        JsonAllocatorAdapter<JsonNode *, JsonMemoryCategory_Buffers> > m_stack;
+    std::deque <JSONValue *, 
+        JsonAllocatorAdapter<JSONValue *, JsonMemoryCategory_Buffers> > m_values;
 };
 
 #endif
@@ -51,7 +51,219 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "jsonobj.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <memory.h>
+#include <algorithm>
+#include <charconv>
+#include <thread>
+#include <vector>
+
+/**
+ * The internal tree of a lazy parse (see JsonParse::SetLazy()). It is 
+ * kept for as long as an object or array converted from it still has 
+ * elements left to convert, each of which holds a reference to it.
+ */
+
+class JsonLazyTree
+{
+public:
+    JsonLazyTree(JsonNode *root, JSONAllocator *allocator) :
+        m_root(root), m_allocator(allocator), m_refs(1) {}
+    ~JsonLazyTree() {delete m_root;}
+    static void *operator new(size_t size)
+        {return JSONMemory::Allocate(size, JsonMemoryCategory_Nodes);}
+    static void operator delete(void *p, size_t size)
+        {JSONMemory::Free(p, size, JsonMemoryCategory_Nodes);}
+    JSONAllocator *GetAllocator() {return m_allocator;}
+    void Ref() {m_refs.fetch_add(1, std::memory_order_relaxed);}
+    void Unref() 
+    {
+        if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+private:
+    JsonNode *m_root;
+    JSONAllocator *m_allocator;     // the tree was parsed with
+    std::atomic<long> m_refs;
+};
+
+/**
+ * The internal node of an object or array whose elements have not been 
+ * converted yet, see JSONValue::Materialize().
+ */
+
+class JsonLazyNode
+{
+public:
+    JsonLazyNode(JsonLazyTree *tree, JsonNode *node) : 
+        m_tree(tree), m_node(node) {m_tree->Ref();}
+    ~JsonLazyNode() {m_tree->Unref();}
+    static void *operator new(size_t size)
+        {return JSONMemory::Allocate(size, JsonMemoryCategory_Nodes);}
+    static void operator delete(void *p, size_t size)
+        {JSONMemory::Free(p, size, JsonMemoryCategory_Nodes);}
+    JsonLazyTree *GetTree() {return m_tree;}
+    JsonNode *GetNode() {return m_node;}
+private:
+    JsonLazyTree *m_tree;
+    JsonNode *m_node;
+};
+
+// marks a value whose elements a thread is converting, or counting, 
+// see ClaimLazy()
+
+static char lazyBusyTag;
+static JsonLazyNode *const lazyBusy = 
+    reinterpret_cast<JsonLazyNode *>(&lazyBusyTag);
+
+/**
+ * Take the internal node of a value whose elements have not been 
+ * converted yet, so that the calling thread alone uses it, until it 
+ * stores it back, or NULL once it has converted them. The node is 
+ * replaced by lazyBusy meanwhile, and a thread that finds it so waits
+ * for it to be put back, so only threads looking into the same value 
+ * at once wait for each other.
+ *
+ * @param[in] lazy the m_lazy of the value.
+ *
+ * @return the node, or NULL if the elements have been converted.
+ */
+
+static JsonLazyNode *
+ClaimLazy(std::atomic<JsonLazyNode *> &lazy)
+{
+    JsonLazyNode *node = lazy.load(std::memory_order_acquire);
+
+    for (;;) {
+        if (node == NULL) {
+            break;
+        }
+        if (node == lazyBusy) {
+            std::this_thread::yield();
+            node = lazy.load(std::memory_order_acquire);
+            continue;
+        }
+        if (lazy.compare_exchange_weak(node, lazyBusy, 
+            std::memory_order_acquire, std::memory_order_acquire)) {
+            break;
+        }
+    }
+    return node;
+}
+
+/**
+ * Holds the node claimed by ClaimLazy() for as long as it is in scope,
+ * and stores it back when it goes out of scope, unless it was released, 
+ * so that an exception thrown while the node is claimed leaves the value 
+ * as it found it rather than marked busy for good.
+ */
+
+class JsonLazyClaim
+{
+public:
+    explicit JsonLazyClaim(std::atomic<JsonLazyNode *> &lazy) 
+        : m_lazy(lazy), m_node(ClaimLazy(lazy)) {}
+    ~JsonLazyClaim() 
+    {
+        if (m_node) {
+            m_lazy.store(m_node, std::memory_order_release);
+        }
+    }
+    JsonLazyNode *Get() const {return m_node;}
+
+    // the elements are converted: mark the value so and drop the node
+
+    void Release() 
+    {
+        m_lazy.store(NULL, std::memory_order_release);
+        delete m_node;
+        m_node = NULL;
+    }
+private:
+    JsonLazyClaim(const JsonLazyClaim &);
+    JsonLazyClaim &operator=(const JsonLazyClaim &);
+    std::atomic<JsonLazyNode *> &m_lazy;
+    JsonLazyNode *m_node;
+};
+
+/**
+ * Scramble the bits of a 64-bit value (the finalizer of splitmix64), so 
+ * that hashes built from it can be combined by simple arithmetic.
+ *
+ * @param[in] x the value.
+ *
+ * @return the mixed value.
+ */
+
+static uint64_t
+HashMix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+
+/**
+ * Hash a sequence of bytes (64-bit FNV-1a).
+ *
+ * @param[in] p the bytes.
+ * @param[in] len the number of bytes.
+ *
+ * @return the hash.
+ */
+
+static uint64_t
+HashBytes(const char *p, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char) p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+
+/**
+ * Hash an integer, as JSONNumber::HashNode() does.
+ *
+ * @param[in] val the integer.
+ *
+ * @return the hash.
+ */
+
+static uint64_t
+HashInteger(int64_t val)
+{
+    return HashMix(HashMix((uint64_t) val) + JsonType_Number);
+}
+
+
+/**
+ * Hash a double, as JSONDouble::HashNode() does.
+ *
+ * @param[in] val the double.
+ *
+ * @return the hash.
+ */
+
+static uint64_t
+HashDouble(double val)
+{
+    uint64_t bits;
+
+    if (val == 0.0) {
+        val = 0.0;      // -0.0 == 0.0
+    }
+    memcpy(&bits, &val, sizeof(bits));
+    return HashMix(HashMix(bits) + JsonType_Double);
+}
 
 /**
  * Get the JSONAPI singleton.
@@ -75,6 +287,16 @@ JSONAPI::GetInstance()
  * Given a parsed JSON input, get the object/array in a form compatible
  * with JSONAPI.
  *
+ * If the parse was done in direct mode (see JsonParse::SetDirect()), the 
+ * tree built by the parser is handed over without conversion, and 
+ * subsequent calls return NULL until the next parse. Otherwise the tree
+ * is allocated from the allocator of the parser, see 
+ * JsonParse::SetAllocator(). If the parser has a shape table (see 
+ * JsonParse::SetShapes()), the objects of the tree are returned as 
+ * records. If the parser is lazy (see JsonParse::SetLazy()), only the
+ * root is converted, and the parser is left without its tree; records 
+ * and packed arrays are made by converting the whole tree, though.
+ *
  * @param[in] parse a parsed JSON string/input.
  * 
  * @return a JSONValue pointer representing the object/array, or NULL.
@@ -83,11 +305,26 @@ JSONAPI::GetInstance()
 JSONValue *
 JSONAPI::GetRootObject(JsonParse *parse)
 {
+    JSONAllocatorScope scope(parse->GetAllocator());
     JSONValue *val = (JSONValue *) NULL;
 
-    JsonNode *node = parse->GetRoot();
-    if (node) {
-        val = JSONAPI::GetInstance()->ToJsonValue(node);
+    if (parse->GetDirect()) {
+        val = parse->ReleaseValue();
+    } else if (parse->GetLazy() && parse->GetRoot()) {
+        JsonNode *node = parse->GetRoot();
+        JsonLazyTree *tree = new JsonLazyTree(parse->ReleaseRoot(), 
+            parse->GetAllocator());
+
+        val = JSONAPI::GetInstance()->ToJsonValue(node, tree);
+        tree->Unref();
+    } else if (parse->GetRoot()) {
+        val = JSONAPI::GetInstance()->ToJsonValue(parse->GetRoot());
+    }
+    if (val && parse->GetPackArrays()) {
+        val = JSONPackedArray::Pack(val);
+    }
+    if (val && parse->GetShapes()) {
+        val = parse->GetShapes()->Compact(val);
     }
     return val;
 }
@@ -97,7 +334,9 @@ JSONAPI::GetRootObject(JsonParse *parse)
  * Constructor. Set the appropriate type.
  */
 
-JSONObject::JSONObject() 
+JSONObject::JSONObject() :
+    m_sorted(false),
+    m_escapedKeys(false)
 {
     m_type = JsonType_Object;
 }
@@ -115,356 +354,456 @@ JSONObject::JSONObject()
 std::string &
 JSONObject::ToJSON(std::string &str)
 {       
-    std::string ret;
-    ret += "{";
-    for (int i = 0; i < GetSize(); i++) {
-        Get(i)->ToJSON(ret);
-        if (GetSize() > 1 && i != GetSize() - 1) {
-            ret += ",";
+    iterator iter;
+
+    str += "{";
+    for (iter = begin(); iter != end(); ++iter) {
+        if (iter != begin()) {
+            str += ",";
         }
+        (*iter)->ToJSON(str);
     }
-    ret += "}";
-    str += ret;
+    str += "}";
     return str;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Make a shallow copy of the object. Its tuples are shared with
+ * the copy, not copied.
+ *
+ * @return the copy.
  */
 
-JSONArray::JSONArray() 
+JSONValue *
+JSONObject::CopyNode()
 {
-    m_type = JsonType_Array;
+    JSONObject *copy = new JSONObject();
+
+    copy->ShareElements(this);
+    if (m_sorted) {
+        copy->m_sorted = true;
+        copy->IndexKeys();
+    }
+    return copy;
 }
 
 
 /**
- * Convert a JSON array to it's string version. Concatenate the
- * result to the passed in string reference.
+ * Get the key of a tuple as it is sorted by: its text, without its 
+ * quotes and with its escapes decoded (see JsonStr::Text()), so that a 
+ * key sorts and is found the same however it is spelled.
  *
- * @param[in] str the currently formed JSON string
+ * @param[in] tuple the tuple.
+ * @param[out] scratch holds the text of a key with escapes.
+ * @param[in] escaped false if no key of the object has escapes, so that
+ *            none need be looked for.
  *
- * @return the JSON array as a string, concatenated to str.
+ * @return the key, empty if tuple is not a tuple.
  */
 
-std::string &
-JSONArray::ToJSON(std::string &str)
-{       
-    std::string ret = "[";
-    for (int i = 0; i < GetSize(); i++) {
-        ret = Get(i)->ToJSON(ret);
-        if (GetSize() > 1 && i != GetSize() - 1) {
-            ret += ",";
+static std::string_view
+SortKey(const JSONValue *tuple, std::string &scratch, bool escaped)
+{
+    std::string_view key;
+
+    if (tuple->GetType() == JsonType_Tuple) {
+        key = static_cast<const JSONTuple *>(tuple)->GetKeyView();
+        if (key.size() >= 2 && key.front() == '"' && key.back() == '"') {
+            if (escaped && memchr(key.data() + 1, '\\', key.size() - 2)) {
+                return JsonStr::Text(key, scratch);
+            }
+            key = key.substr(1, key.size() - 2);
         }
     }
-    ret += "]";
-    str += ret;
-    return str;
+    return key;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Compare a key with escapes with the text of a key.
+ *
+ * @param[in] stored the key, as the parser stores it.
+ * @param[in] key the text.
+ *
+ * @return true if the text of stored is key.
  */
 
-JSONString::JSONString(std::string &str) 
+static bool
+EscapedKeyEquals(std::string_view stored, std::string_view key)
 {
-    m_type = JsonType_String;
-    m_value = str;
+    std::string scratch;
+
+    return JsonStr::Text(stored, scratch) == key;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Find out whether the key of a tuple has escapes, see SortKey().
+ *
+ * @param[in] tuple the tuple.
+ *
+ * @return true if it has.
  */
 
-JSONString::JSONString(const char *str) 
+static bool
+HasEscapedKey(const JSONValue *tuple)
 {
-    m_type = JsonType_String;
-    m_value = str; 
+    std::string_view key;
+
+    if (tuple->GetType() != JsonType_Tuple) {
+        return false;
+    }
+    key = static_cast<const JSONTuple *>(tuple)->GetKeyView();
+    return memchr(key.data(), '\\', key.size()) != NULL;
 }
 
 
 /**
- * Return the value of the string object with escapes processed.
- *
- * For example, "Hello\nWorld" --> "Hello\\nWorld"
+ * Sort the tuples of the object by key, and keep them sorted from now 
+ * on. The sort is stable, so tuples with the same key keep their order.
+ */
+
+void
+JSONObject::SortKeys()
+{
+    std::string sa, sb;
+    bool escaped;
+
+    Materialize();
+    escaped = std::any_of(m_elements.begin(), m_elements.end(), 
+        HasEscapedKey);
+    m_elements.sort([&sa, &sb, escaped](const JSONValue *a, const JSONValue *b) {
+        return SortKey(a, sa, escaped) < SortKey(b, sb, escaped);
+    });
+    m_sorted = true;
+    IndexKeys();
+}
+
+
+/**
+ * Sort the tuples of every object of a tree, see SortKeys(). Objects 
+ * shared with another document are replaced by private copies first, as
+ * GetMutable() does, since they must not be modified.
  *
- * @return the JSON string with escapes processed.
+ * @param[in] val the root of the tree, which must not be shared itself,
+ *            see JSONDocument::GetMutableRoot().
  */
 
-std::string
-JSONString::ProcessEscapes(std::string &in)
-{       
-    int len = in.size();
-    std::string tmp("");
+void
+JSONObject::SortAllKeys(JSONValue *val)
+{
+    JsonElementList::iterator iter;
+    JsonType type = val->GetType();
 
-    if (len == 0) {
-        return tmp;
-    }
+    if (type == JsonType_Tuple) {
+        JSONValue *child = static_cast<JSONTuple *>(val)->GetMutableValue();
 
-    char *buf = (char *) malloc(len * 2 + 1); 
-    char *buf2 = (char *) malloc(len + 1);
-    memset(buf2, '\0', len + 1); 
-    strncpy(buf2, in.c_str(), len); 
-    char *p = buf;
-    char *q = buf2;
-    int i = 0;
-    while(i < len) {
-        if (*q == '\f') {
-            *p++ = '\\';
-            *p++ = 'f';
-        } else if (*q == '\n') {
-            *p++ = '\\';
-            *p++ = 'n';
-        } else if (*q == '\r') {
-            *p++ = '\\';
-            *p++ = 'r';
-        } else if (*q == '\t') {
-            *p++ = '\\';
-            *p++ = 't';
-        } else if (*q == '\b') {
-            *p++ = '\\';
-            *p++ = 'b';
-        } else {
-            *p++ = *q;
+        if (child) {
+            SortAllKeys(child);
         }
-        q++;
-        i++;
+        return;
+    }
+    if (type != JsonType_Object && type != JsonType_Array && 
+        type != JsonType_Record) {
+        return;
+    }
+    val->Materialize();
+    for (iter = val->m_elements.begin(); 
+         iter != val->m_elements.end(); ++iter) {
+        *iter = Unshare(*iter);
+        SortAllKeys(*iter);
+    }
+    if (type == JsonType_Object) {
+        static_cast<JSONObject *>(val)->SortKeys();
     }
-    *p = '\0';
-    tmp = buf;
-    free(buf);
-    free(buf2);
-    return tmp;
 }
 
 
-extern "C" {
-char *FromUTF8ToStr(char *u, int *len);
-char *FromStrToUTF8(char *p, int *lenout);
-int IsMultibyteUTF8(char *p, int *lenout);
-}
-
 /**
- * Given a UTF-8 byte buffer, store as std::string. Any multi-byte 
- * UTF-8 sequences are converted to \uxxxx format. If such UTF-8
- * sequences are > 3 bytes in length, an error is returned.
+ * Make room for tuples in a sorted object, so that adding them does not
+ * grow the array of its tuples again and again. The tuples themselves 
+ * are linked in a list, which has no room to make; an object that is 
+ * not sorted is left as is.
  *
- * @param[in] str byte stream to be converted to a UTF-8 string.
- *            We assume the string is NULL terminated (NULL is 
- *            valid UTF-8, after all).
- * 
- * @return true on success, false on failure (unsupported UTF-8 len)
- *         or some other failure.
+ * @param[in] count the number of tuples.
  */
 
-bool 
-JSONString::SetAsUTF8(const char *str)
+void
+JSONObject::Reserve(size_t count)
 {
-    char *buf = NULL;
-    char *p = const_cast<char *>(str);
-    char *q;
-    bool ret = false;
-    int curLen;
-    int len;
-
-    if (!p) {
-        goto out;
+    if (m_sorted) {
+        m_index.reserve(count);
     }
+}
 
-    curLen = 0;
-    buf = NULL;
-    q = buf; 
 
-    while (*p) {
-        char *u;
-        u = FromUTF8ToStr(p, &len);
-        if (u != (char *) NULL) {
-            char *t;
-            // allocate a new buffer
-            t = (char *) malloc(curLen + len);
-            len--;
-            // copy old buffer over
-            if (buf) {
-                memcpy(t, buf, curLen);
-            }
-            // copy the UTF-8 byte stream
-            memcpy(t + curLen, u, len);
-            // new buffer len += size of byte stream
-            curLen += len;
-            // point q at next insertion point
-            q = t + curLen;
-            // free the old buffer, point at new one
-            if (buf) {
-                free(buf);
-            }
-            buf = t;
-            p+=len;
-        }
-        else {
-            goto out;
-        }
-    }
-    if (q) {
-        *q = '\0';
-        ret = true;
-        Set(buf);
-        free(buf);
-    }
-out:
-    return ret;
+/**
+ * Rebuild the array of the tuples of a sorted object from its list.
+ */
+
+void
+JSONObject::IndexKeys()
+{
+    m_index.assign(m_elements.begin(), m_elements.end());
+    m_escapedKeys = std::any_of(m_index.begin(), m_index.end(), 
+        HasEscapedKey);
 }
 
 
 /**
- * Get string as a UTF-8 byte stream. Any portions of the string
- * that are in the form of \\uxxxx will be converted to UTF-8 
- * bytes in the returned result.
- * 
- * @return UTF-8 byte stream, NULL terminated. NULL on failure.
- * 
+ * Find the first tuple with a key in a sorted object.
+ *
+ * @param[in] key the key, without quotes.
+ *
+ * @return the offset of the tuple, or -1 if there is no such key.
  */
 
-char *
-JSONString::GetAsUTF8()
+int
+JSONObject::FindSorted(std::string_view key) const
 {
-    char *ret = NULL;
-    char *p;
-    char *q;
-    char *u;
-    int len;
-    std::string value;
+    std::string scratch;
+    bool escaped = m_escapedKeys;
+
+    // an object with no escaped key, the usual one, compares its keys as
+    // they are, without looking for escapes
+
+    auto iter = escaped ?
+        std::lower_bound(m_index.begin(), m_index.end(), key,
+        [&scratch](const JSONValue *tuple, std::string_view k) {
+            return SortKey(tuple, scratch, true) < k;
+        }) :
+        std::lower_bound(m_index.begin(), m_index.end(), key,
+        [&scratch](const JSONValue *tuple, std::string_view k) {
+            return SortKey(tuple, scratch, false) < k;
+        });
+
+    if (iter == m_index.end() || SortKey(*iter, scratch, escaped) != key) {
+        return -1;
+    }
+    return iter - m_index.begin();
+}
 
-    /* any \uabcd will be at most 3 bytes in size, so we can allocate
-       the entire buffer now and know we have enough space. */
 
-    value = Get();
-    p = const_cast<char *>(value.c_str());
-    if (!p) {
-        goto out;
-    }
+/**
+ * Add a tuple to a sorted object, after the tuples with a key less than
+ * or equal to its own.
+ *
+ * @param[in] tuple the tuple.
+ *
+ * @return the offset of the tuple.
+ */
 
-    q = ret = (char *) malloc(Get().length() + 1);
-    if (!ret) {
-        goto out;
+int
+JSONObject::InsertSorted(JSONValue *tuple)
+{
+    std::string scratch, other;
+    bool escaped = m_escapedKeys = m_escapedKeys || HasEscapedKey(tuple);
+    std::string_view key = SortKey(tuple, scratch, escaped);
+    auto pos = std::upper_bound(m_index.begin(), m_index.end(), key,
+        [&other, escaped](std::string_view k, const JSONValue *elem) {
+            return k < SortKey(elem, other, escaped);
+        });
+    int offset = pos - m_index.begin();
+    JsonElementList::iterator iter;
+
+    if (pos == m_index.end()) {
+        iter = m_elements.end();
+    } else {
+        iter = std::next(m_elements.begin(), offset);
     }
+    m_elements.insert(iter, tuple);
+    m_index.insert(pos, tuple);
+    return offset;
+}
 
-    while (*p) {
-        if (*p == '\\' && *(p+1) == 'u') {
-            p += 2;
-            u = FromStrToUTF8(p, &len);
-            if (!u) {
-                free(ret);
-                ret = NULL;
-                goto out;
-            } else {
-                // copy to the buffer
-                memcpy(q, u, len);
-                q += len;
-                // skip the 4 bytes of the UTF-8 portion
-                p += 4;
-            }            
-        } else {
-            // nothing special, just copy
-            *q++ = *p++;
+
+/**
+ * Add the memory used by the object, and the array of its tuples if it 
+ * is sorted, to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JSONObject::AddMemoryUsage(JSONMemoryUsage &usage) const
+{
+    JSONValue::AddMemoryUsage(usage);
+    usage.containers += m_index.capacity() * sizeof(JSONValue *);
+}
+
+
+/**
+ * Constructor. 
+ *
+ * @param[in] shape the keys of the record. The record takes over the 
+ *            reference to it (see JSONShape::Ref()).
+ */
+
+JSONRecord::JSONRecord(JSONShape *shape) :
+    m_shape(shape)
+{
+    m_type = JsonType_Record;
+}
+
+
+/**
+ * Convert the record to JSON, as the object with the same keys and 
+ * values would be.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the record as a string, concatenated to str.
+ */
+
+std::string &
+JSONRecord::ToJSON(std::string &str)
+{
+    bool first = true;
+
+    str += "{";
+    for (const auto &member : Members()) {
+        if (!first) {
+            str += ",";
         }
+        first = false;
+        str += "\"";
+        str += member.key;
+        str += "\": ";
+        member.value->ToJSON(str);
     }
-    *q = '\0';
-out: 
-    return ret;
+    str += "}";
+    return str;
 }
 
 
 /**
- * Given a string, convert any multibyte UTF-8 sequences to 
- * form \\uabcd. If the UTF-8 is 1 byte encoding, just leave
- * it as is, because ascii is same as UTF-8. 
- * 
- * @return string with multibyte UTF-8 encoded as \\uabcd, NULL 
-           terminated. NULL on failure.
- * 
+ * Make an object with the keys and values of the record. The values are
+ * shared with the record, not copied.
+ *
+ * @return the object.
  */
 
-char *
-JSONString::ConvertUTF8Multibyte()
+JSONObject *
+JSONRecord::ToObject()
 {
-    char *ret = NULL;
-    char *p;
-    char *q;
-    char *u;
-    int len;
-    int skiplen;
-    std::string value;
+    JSONObject *obj = new JSONObject();
+    size_t i = 0;
 
-    value = Get();
-    p = const_cast<char *>(value.c_str());
-    if (!p) {
-        goto out;
+    for (JSONValue *val : *this) {
+        JSONTuple *tuple = new JSONTuple();
+
+        tuple->SetKey(m_shape->GetKey(i++));
+        tuple->SetValue(val->Ref());
+        obj->Append(tuple);
     }
+    return obj;
+}
 
-    /* any \uabcd will be at most 7 bytes in size, so we can allocate
-       the entire buffer now worse case size and know we have enough 
-       space. */
 
-    q = ret = (char *) malloc(Get().length() * 7);
-    if (!ret) {
-        goto out;
+/**
+ * Compare the record with an object. They are equal if the object has 
+ * the keys of the record, and the same value for each.
+ *
+ * @param[in] obj the object.
+ *
+ * @return true if they are equal.
+ */
+
+bool
+JSONRecord::EqualsObject(const JSONValue &obj) const
+{
+    if (obj.GetType() != JsonType_Object || obj.GetSize() != GetSize()) {
+        return false;
     }
+    std::vector<const JSONValue *> values(begin(), end());
 
-    while (*p) {
-        if (IsMultibyteUTF8(p, &skiplen)) {
-            u = FromUTF8ToStr(p, &len);
-            if (!u) {
-                free(ret);
-                ret = NULL;
-                goto out;
-            } else {
-                // copy to the buffer
-                len -= 1;
-                memcpy(q, u, len);
-                q += len;
-                // skip the UTF-8 portion
-                p += skiplen;
-            }            
-        } else {
-            // nothing special, just copy
-            *q++ = *p++;
+    for (const JSONValue *val : obj) {
+        const JSONTuple *tuple = static_cast<const JSONTuple *>(val);
+        int index = m_shape->Find(tuple->GetKeyView());
+
+        if (index < 0 || GetKey(index) != tuple->GetKey() || 
+            tuple->GetValue() == NULL || 
+            !values[index]->Equals(*tuple->GetValue())) {
+            return false;
         }
     }
-    *q = '\0';
-out: 
-    return ret;
+    return true;
 }
 
 
 /**
- * Convert a JSON string object to it's string version. Concatenate the
- * result to the passed in string reference.
+ * Make a shallow copy of the record. Its shape and values are shared with
+ * the copy, not copied.
  *
- * @param[in] str the currently formed JSON string
+ * @return the copy.
+ */
+
+JSONValue *
+JSONRecord::CopyNode()
+{
+    JSONRecord *copy = new JSONRecord(m_shape->Ref());
+
+    copy->ShareElements(this);
+    return copy;
+}
+
+
+/**
+ * Compare the record with another. Records with the same shape are 
+ * compared value by value, others key by key.
  *
- * @return the JSON string object as a string, concatenated to str.
+ * @param[in] other the record to compare with.
+ *
+ * @return true if the records are equal.
  */
 
-std::string &
-JSONString::ToJSON(std::string &str)
-{       
-    std::string ret;
+bool
+JSONRecord::EqualsNode(const JSONValue &other) const
+{
+    const JSONRecord &record = static_cast<const JSONRecord &>(other);
+    const_iterator a, b;
+    int i = 0;
 
-    str += std::string("\"") + ConvertUTF8Multibyte() + std::string("\"");
-    return str;
+    if (GetSize() != record.GetSize()) {
+        return false;
+    }
+    for (a = begin(), b = record.begin(); a != end(); ++a, ++b, i++) {
+        const JSONValue *val = *b;
+
+        if (m_shape != record.m_shape && GetKey(i) != record.GetKey(i)) {
+            int index = record.m_shape->Find(GetKeyView(i));
+
+            if (index < 0 || GetKey(i) != record.GetKey(index)) {
+                return false;
+            }
+            val = record.Get(index);
+        }
+        if (!(*a)->Equals(*val)) {
+            return false;
+        }
+    }
+    return true;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Compute the hash of the record, which is that of the object with the
+ * same keys and values.
+ *
+ * @return the hash.
  */
 
-JSONNumber::JSONNumber() 
+uint64_t
+JSONRecord::HashNode() const
 {
-    m_type = JsonType_Number;
+    uint64_t h = JsonType_Object;
+
+    for (const auto &member : Members()) {
+        h += HashMix(HashBytes(member.key.data(), member.key.size()) + 
+            HashMix(member.value->Hash()) + JsonType_Tuple);
+    }
+    return HashMix(h + GetSize());
 }
 
 
@@ -472,359 +811,2619 @@ JSONNumber::JSONNumber()
  * Constructor. Set the appropriate type.
  */
 
-JSONNumber::JSONNumber(long number) 
+JSONArray::JSONArray() 
 {
-    m_type = JsonType_Number;
-    m_value = number;
+    m_type = JsonType_Array;
 }
 
 
 /**
- * Convert a JSON number object to it's string version. Concatenate the
+ * Convert a JSON array to it's string version. Concatenate the
  * result to the passed in string reference.
  *
  * @param[in] str the currently formed JSON string
  *
- * @return the JSON string object as a string, concatenated to str.
+ * @return the JSON array as a string, concatenated to str.
  */
 
 std::string &
-JSONNumber::ToJSON(std::string &str)
+JSONArray::ToJSON(std::string &str)
 {       
-    char buf[128];
+    iterator iter;
 
-    snprintf(buf, sizeof buf - 1, "%ld", Get());
-    std::string ret(buf); 
-    str += ret;
+    str += "[";
+    for (iter = begin(); iter != end(); ++iter) {
+        if (iter != begin()) {
+            str += ",";
+        }
+        (*iter)->ToJSON(str);
+    }
+    str += "]";
     return str;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Make a shallow copy of the array. Its elements are shared with
+ * the copy, not copied.
+ *
+ * @return the copy.
  */
 
-JSONDouble::JSONDouble() 
+JSONValue *
+JSONArray::CopyNode()
 {
-    m_type = JsonType_Double;
+    JSONArray *copy = new JSONArray();
+
+    copy->ShareElements(this);
+    return copy;
+}
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] elementType JsonType_Number for an array of integers, 
+ *            JsonType_Double for an array of doubles.
+ */
+
+JSONPackedArray::JSONPackedArray(JsonType elementType) :
+    m_elementType(elementType == JsonType_Double ? JsonType_Double : 
+        JsonType_Number)
+{
+    m_type = JsonType_PackedArray;
+}
+
+
+/**
+ * Get the number of elements.
+ *
+ * @return the number of elements.
+ */
+
+size_t
+JSONPackedArray::GetCount() const
+{
+    return m_elementType == JsonType_Double ? m_doubles.size() : 
+        m_integers.size();
+}
+
+
+/**
+ * Get the elements of an array of integers, without copying them.
+ *
+ * @return the elements, none if the array holds doubles.
+ */
+
+JSONSpan<const int64_t>
+JSONPackedArray::GetIntegers() const
+{
+    return JSONSpan<const int64_t>(m_integers.data(), m_integers.size());
+}
+
+
+/**
+ * Get the elements of an array of doubles, without copying them.
+ *
+ * @return the elements, none if the array holds integers.
+ */
+
+JSONSpan<const double>
+JSONPackedArray::GetDoubles() const
+{
+    return JSONSpan<const double>(m_doubles.data(), m_doubles.size());
+}
+
+
+/**
+ * Add an integer to the end of an array of integers.
+ *
+ * @param[in] val the integer.
+ *
+ * @return true, or false if the array holds doubles.
+ */
+
+bool
+JSONPackedArray::AppendInteger(int64_t val)
+{
+    if (m_elementType != JsonType_Number) {
+        return false;
+    }
+    m_integers.push_back(val);
+    return true;
+}
+
+
+/**
+ * Add a double to the end of an array of doubles.
+ *
+ * @param[in] val the double.
+ *
+ * @return true, or false if the array holds integers.
+ */
+
+bool
+JSONPackedArray::AppendDouble(double val)
+{
+    if (m_elementType != JsonType_Double) {
+        return false;
+    }
+    m_doubles.push_back(val);
+    return true;
+}
+
+
+/**
+ * Add integers to the end of an array of integers.
+ *
+ * @param[in] vals the integers.
+ *
+ * @return true, or false if the array holds doubles.
+ */
+
+bool
+JSONPackedArray::AppendIntegers(JSONSpan<const int64_t> vals)
+{
+    if (m_elementType != JsonType_Number) {
+        return false;
+    }
+    m_integers.insert(m_integers.end(), vals.begin(), vals.end());
+    return true;
+}
+
+
+/**
+ * Add doubles to the end of an array of doubles.
+ *
+ * @param[in] vals the doubles.
+ *
+ * @return true, or false if the array holds integers.
+ */
+
+bool
+JSONPackedArray::AppendDoubles(JSONSpan<const double> vals)
+{
+    if (m_elementType != JsonType_Double) {
+        return false;
+    }
+    m_doubles.insert(m_doubles.end(), vals.begin(), vals.end());
+    return true;
 }
 
 
-/**
- * Constructor. Set the appropriate type.
- */
+/**
+ * Make room for elements, so that appending them does not reallocate.
+ *
+ * @param[in] count the number of elements.
+ */
+
+void
+JSONPackedArray::Reserve(size_t count)
+{
+    if (m_elementType == JsonType_Double) {
+        m_doubles.reserve(count);
+    } else {
+        m_integers.reserve(count);
+    }
+}
+
+
+/**
+ * Make a JSONNumber or JSONDouble holding an element.
+ *
+ * @param[in] index the index of the element.
+ *
+ * @return the new value, or NULL if index is out of range.
+ */
+
+JSONValue *
+JSONPackedArray::MakeElement(size_t index) const
+{
+    if (index >= GetCount()) {
+        return NULL;
+    }
+    if (m_elementType == JsonType_Double) {
+        return new JSONDouble(m_doubles[index]);
+    }
+    return new JSONNumber(m_integers[index]);
+}
+
+
+/**
+ * Make a generic array with the elements of this one, which can then be
+ * given elements of any type.
+ *
+ * @return the array.
+ */
+
+JSONArray *
+JSONPackedArray::ToArray() const
+{
+    JSONArray *array = new JSONArray();
+    size_t count = GetCount();
+
+    for (size_t i = 0; i < count; i++) {
+        array->Append(MakeElement(i));
+    }
+    return array;
+}
+
+
+/**
+ * Compare the packed array with a generic one. They are equal if the 
+ * elements of the array are integers, or doubles, equal to those of the 
+ * packed array.
+ *
+ * @param[in] array the array.
+ *
+ * @return true if they are equal.
+ */
+
+bool
+JSONPackedArray::EqualsArray(const JSONValue &array) const
+{
+    size_t i = 0;
+
+    if (array.GetType() != JsonType_Array || 
+        (size_t) array.GetSize() != GetCount()) {
+        return false;
+    }
+    for (const JSONValue *val : array) {
+        if (val->GetType() != m_elementType) {
+            return false;
+        }
+        if (m_elementType == JsonType_Double) {
+            if (static_cast<const JSONDouble *>(val)->Get() != m_doubles[i]) {
+                return false;
+            }
+        } else if (static_cast<const JSONNumber *>(val)->IsUnsigned() || 
+            static_cast<const JSONNumber *>(val)->Get() != m_integers[i]) {
+            return false;
+        }
+        i++;
+    }
+    return true;
+}
+
+
+/**
+ * Convert the packed array to JSON, as the generic array with the same
+ * elements would be.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the array as a string, concatenated to str.
+ */
+
+std::string &
+JSONPackedArray::ToJSON(std::string &str)
+{
+    size_t count = GetCount();
+    char buf[128];
+
+    str += "[";
+    for (size_t i = 0; i < count; i++) {
+        if (i) {
+            str += ",";
+        }
+        if (m_elementType == JsonType_Double) {
+            snprintf(buf, sizeof buf - 1, "%f", m_doubles[i]);
+            str += buf;
+        } else {
+            str.append(buf, std::to_chars(buf, buf + sizeof buf, 
+                m_integers[i]).ptr - buf);
+        }
+    }
+    str += "]";
+    return str;
+}
+
+
+/**
+ * Replace the arrays of a tree whose elements are all integers, or all 
+ * doubles, by packed arrays, bottom up. Values shared with another 
+ * document are left alone, since they must not be modified. Empty 
+ * arrays, and arrays mixing integers and doubles, stay generic.
+ *
+ * @param[in] val the root of the tree. If it is replaced, it is destroyed.
+ *
+ * @return the new root, which is val unless val itself was packed.
+ */
+
+JSONValue *
+JSONPackedArray::Pack(JSONValue *val)
+{
+    JSONValue *ret = val;
+
+    if (val) {
+        ret = PackNode(val);
+        if (ret) {
+            JSONValue::Unref(val);
+        } else {
+            ret = val;
+        }
+    }
+    return ret;
+}
+
+
+/**
+ * Pack the arrays below a value, and the value itself if it is an array
+ * of numbers.
+ *
+ * @param[in] val the value.
+ *
+ * @return the packed array replacing val, or NULL if val stays (the 
+ *         caller then still owns val, otherwise it must drop its 
+ *         reference).
+ */
+
+JSONValue *
+JSONPackedArray::PackNode(JSONValue *val)
+{
+    JsonElementList::iterator iter;
+    JSONPackedArray *ret = NULL;
+    JsonType type;
+
+    if (val->IsShared()) {
+        goto out;
+    }
+    if (val->GetType() == JsonType_Object) {
+        for (JSONValue *child : *val) {
+            JSONTuple *tuple = static_cast<JSONTuple *>(child);
+
+            if (tuple->GetValue()) {
+                JSONValue *packed = PackNode(tuple->GetValue());
+
+                if (packed) {
+                    tuple->SetValue(std::unique_ptr<JSONValue>(packed));
+                }
+            }
+        }
+        goto out;
+    }
+    if (val->GetType() != JsonType_Array && 
+        val->GetType() != JsonType_Record) {
+        goto out;
+    }
+
+    // replaced in place, Set() would walk the array for each element
+
+    val->Materialize();
+    for (iter = val->m_elements.begin(); 
+         iter != val->m_elements.end(); ++iter) {
+        JSONValue *packed = PackNode(*iter);
+
+        if (packed) {
+            JSONValue::Unref(*iter);
+            *iter = packed;
+        }
+    }
+    if (val->GetType() != JsonType_Array || val->m_elements.empty()) {
+        goto out;
+    }
+    type = val->m_elements.front()->GetType();
+    if (type != JsonType_Number && type != JsonType_Double) {
+        goto out;
+    }
+    for (JSONValue *child : *val) {
+        if (child->GetType() != type || (type == JsonType_Number && 
+            static_cast<JSONNumber *>(child)->IsUnsigned())) {
+            goto out;
+        }
+    }
+    ret = new JSONPackedArray(type);
+    ret->Reserve(val->m_elements.size());
+    for (JSONValue *child : *val) {
+        if (type == JsonType_Double) {
+            ret->m_doubles.push_back(static_cast<JSONDouble *>(child)->Get());
+        } else {
+            ret->m_integers.push_back(static_cast<JSONNumber *>(child)->Get());
+        }
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Make a copy of the packed array.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONPackedArray::CopyNode()
+{
+    JSONPackedArray *copy = new JSONPackedArray(m_elementType);
+
+    copy->m_integers = m_integers;
+    copy->m_doubles = m_doubles;
+    return copy;
+}
+
+
+/**
+ * Compare the packed array with another. Arrays of integers never equal
+ * arrays of doubles, unless both are empty.
+ *
+ * @param[in] other the packed array to compare with.
+ *
+ * @return true if the arrays are equal.
+ */
+
+bool
+JSONPackedArray::EqualsNode(const JSONValue &other) const
+{
+    const JSONPackedArray &array = static_cast<const JSONPackedArray &>(other);
+
+    if (GetCount() != array.GetCount()) {
+        return false;
+    }
+    if (m_elementType != array.m_elementType) {
+        return GetCount() == 0;
+    }
+    return m_integers == array.m_integers && m_doubles == array.m_doubles;
+}
+
+
+/**
+ * Compute the hash of the packed array, which is that of the generic 
+ * array with the same elements.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONPackedArray::HashNode() const
+{
+    uint64_t h = JsonType_Array;
+
+    for (int64_t val : m_integers) {
+        h = HashMix(h) + HashInteger(val);
+    }
+    for (double val : m_doubles) {
+        h = HashMix(h) + HashDouble(val);
+    }
+    return HashMix(h + GetCount());
+}
+
+
+/**
+ * Add the memory used by the packed array, and its buffer, to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JSONPackedArray::AddMemoryUsage(JSONMemoryUsage &usage) const
+{
+    JSONValue::AddMemoryUsage(usage);
+    usage.containers += m_integers.capacity() * sizeof(int64_t) + 
+        m_doubles.capacity() * sizeof(double);
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONString::JSONString(const std::string &str) :
+    m_wire(NULL)
+{
+    m_type = JsonType_String;
+    m_value = str;
+}
+
+
+/**
+ * Constructor. Set the appropriate type. The contents of str are moved
+ * into the object, rather than copied.
+ */
+
+JSONString::JSONString(JsonStr &&str) :
+    m_value(std::move(str)),
+    m_wire(NULL)
+{
+    m_type = JsonType_String;
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONString::JSONString(const char *str) :
+    m_wire(NULL)
+{
+    m_type = JsonType_String;
+    m_value = str; 
+}
+
+
+/**
+ * Move constructor. The string is taken from other, which is left empty.
+ *
+ * @param[in] other the string to move from.
+ */
+
+JSONString::JSONString(JSONString &&other) :
+    JSONValue(std::move(other)),
+    m_value(std::move(other.m_value)),
+    m_wire(other.m_wire.exchange(NULL))
+{
+}
+
+
+/**
+ * Move assignment. 
+ *
+ * @param[in] other the string to move from. It is left empty.
+ *
+ * @return this string.
+ */
+
+JSONString &
+JSONString::operator=(JSONString &&other)
+{
+    if (this != &other) {
+        JSONValue::operator=(std::move(other));
+        ClearWire();
+        m_value = std::move(other.m_value);
+        m_wire.store(other.m_wire.exchange(NULL), std::memory_order_relaxed);
+    }
+    return *this;
+}
+
+
+/**
+ * Return the value of the string object with escapes processed.
+ *
+ * For example, "Hello\nWorld" --> "Hello\\nWorld"
+ *
+ * @return the JSON string with escapes processed.
+ */
+
+std::string
+JSONString::ProcessEscapes(const JsonStr &in)
+{       
+    int len = in.size();
+    std::string tmp("");
+
+    if (len == 0) {
+        return tmp;
+    }
+
+    // a plain string has nothing to escape
+
+    if (in.IsPlain()) {
+        tmp.assign(in.c_str(), len);
+        return tmp;
+    }
+
+    char *buf = (char *) JSONMemory::AllocateBuffer(len * 2 + 1); 
+    char *buf2 = (char *) JSONMemory::AllocateBuffer(len + 1);
+    memset(buf2, '\0', len + 1); 
+    strncpy(buf2, in.c_str(), len); 
+    char *p = buf;
+    char *q = buf2;
+    int i = 0;
+    while(i < len) {
+        if (*q == '\f') {
+            *p++ = '\\';
+            *p++ = 'f';
+        } else if (*q == '\n') {
+            *p++ = '\\';
+            *p++ = 'n';
+        } else if (*q == '\r') {
+            *p++ = '\\';
+            *p++ = 'r';
+        } else if (*q == '\t') {
+            *p++ = '\\';
+            *p++ = 't';
+        } else if (*q == '\b') {
+            *p++ = '\\';
+            *p++ = 'b';
+        } else {
+            *p++ = *q;
+        }
+        q++;
+        i++;
+    }
+    *p = '\0';
+    tmp = buf;
+    JSONMemory::FreeBuffer(buf);
+    JSONMemory::FreeBuffer(buf2);
+    return tmp;
+}
+
+
+extern "C" {
+char *FromUTF8ToStr(char *u, int *len);
+char *FromStrToUTF8(char *p, int *lenout);
+int IsMultibyteUTF8(char *p, int *lenout);
+void JsonFreeBuffer(void *p);
+}
+
+/**
+ * Given a UTF-8 byte buffer, store as std::string. Any multi-byte 
+ * UTF-8 sequences are converted to \uxxxx format. If such UTF-8
+ * sequences are > 3 bytes in length, an error is returned.
+ *
+ * @param[in] str byte stream to be converted to a UTF-8 string.
+ *            We assume the string is NULL terminated (NULL is 
+ *            valid UTF-8, after all).
+ * 
+ * @return true on success, false on failure (unsupported UTF-8 len)
+ *         or some other failure.
+ */
+
+bool 
+JSONString::SetAsUTF8(const char *str)
+{
+    char *buf = NULL;
+    char *p = const_cast<char *>(str);
+    char *q;
+    bool ret = false;
+    int curLen;
+    int len;
+
+    if (!p) {
+        goto out;
+    }
+
+    curLen = 0;
+    buf = NULL;
+    q = buf; 
+
+    while (*p) {
+        char *u;
+        u = FromUTF8ToStr(p, &len);
+        if (u != (char *) NULL) {
+            char *t;
+            // allocate a new buffer
+            t = (char *) JSONMemory::AllocateBuffer(curLen + len);
+            len--;
+            // copy old buffer over
+            if (buf) {
+                memcpy(t, buf, curLen);
+            }
+            // copy the UTF-8 byte stream
+            memcpy(t + curLen, u, len);
+            JsonFreeBuffer(u);
+            // new buffer len += size of byte stream
+            curLen += len;
+            // point q at next insertion point
+            q = t + curLen;
+            // free the old buffer, point at new one
+            JSONMemory::FreeBuffer(buf);
+            buf = t;
+            p+=len;
+        }
+        else {
+            goto out;
+        }
+    }
+    if (q) {
+        *q = '\0';
+        ret = true;
+        Set(buf);
+    }
+out:
+    JSONMemory::FreeBuffer(buf);
+    return ret;
+}
+
+
+/**
+ * Get string as a UTF-8 byte stream. Any portions of the string
+ * that are in the form of \\uxxxx will be converted to UTF-8 
+ * bytes in the returned result.
+ * 
+ * @return UTF-8 byte stream, NULL terminated. NULL on failure.
+ * 
+ */
+
+char *
+JSONString::GetAsUTF8()
+{
+    char *ret = NULL;
+    char *p;
+    char *q;
+    char *u;
+    int len;
+    std::string value;
+
+    /* any \uabcd will be at most 3 bytes in size, so we can allocate
+       the entire buffer now and know we have enough space. */
+
+    value = Get();
+    p = const_cast<char *>(value.c_str());
+    if (!p) {
+        goto out;
+    }
+
+    q = ret = (char *) malloc(Get().length() + 1);
+    if (!ret) {
+        goto out;
+    }
+
+    while (*p) {
+        if (*p == '\\' && *(p+1) == 'u') {
+            p += 2;
+            u = FromStrToUTF8(p, &len);
+            if (!u) {
+                free(ret);
+                ret = NULL;
+                goto out;
+            } else {
+                // copy to the buffer
+                memcpy(q, u, len);
+                JsonFreeBuffer(u);
+                q += len;
+                // skip the 4 bytes of the UTF-8 portion
+                p += 4;
+            }            
+        } else {
+            // nothing special, just copy
+            *q++ = *p++;
+        }
+    }
+    *q = '\0';
+out: 
+    return ret;
+}
+
+
+/**
+ * Given a string, convert any multibyte UTF-8 sequences to 
+ * form \\uabcd. If the UTF-8 is 1 byte encoding, just leave
+ * it as is, because ascii is same as UTF-8. 
+ * 
+ * @return string with multibyte UTF-8 encoded as \\uabcd, NULL 
+           terminated, to be freed with free(). NULL on failure.
+ * 
+ */
+
+char *
+JSONString::ConvertUTF8Multibyte()
+{
+    char *ret = NULL;
+    char *p;
+    char *q;
+    char *u;
+    int len;
+    int skiplen;
+    std::string value;
+
+    value = Get();
+    p = const_cast<char *>(value.c_str());
+    if (!p) {
+        goto out;
+    }
+
+    /* any \uabcd will be at most 7 bytes in size, so we can allocate
+       the entire buffer now worse case size and know we have enough 
+       space. */
+
+    q = ret = (char *) malloc(value.length() * 7 + 1);
+    if (!ret) {
+        goto out;
+    }
+
+    while (*p) {
+        if (IsMultibyteUTF8(p, &skiplen)) {
+            u = FromUTF8ToStr(p, &len);
+            if (!u) {
+                free(ret);
+                ret = NULL;
+                goto out;
+            } else {
+                // copy to the buffer
+                len -= 1;
+                memcpy(q, u, len);
+                JsonFreeBuffer(u);
+                q += len;
+                // skip the UTF-8 portion
+                p += skiplen;
+            }            
+        } else {
+            // nothing special, just copy
+            *q++ = *p++;
+        }
+    }
+    *q = '\0';
+out: 
+    return ret;
+}
+
+
+/**
+ * Convert a JSON string object to it's string version. Concatenate the
+ * result to the passed in string reference.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the JSON string object as a string, concatenated to str.
+ */
+
+std::string &
+JSONString::ToJSON(std::string &str)
+{       
+    const char *p = m_value.c_str();
+    size_t len = m_value.size();
+
+    // a plain string has nothing to escape or convert, copy it as is.
+
+    if (!m_value.IsPlain()) {
+        p = GetWire(len);
+    }
+    str += '"';
+    str.append(p, len);
+    str += '"';
+    return str;
+}
+
+
+// a serialized form is its length followed by its bytes
+
+static const size_t WireHeader = sizeof(size_t);
+
+/**
+ * Get the serialized form of the string, escaped and with multibyte 
+ * UTF-8 converted, without the quotes. It is made the first time, and 
+ * kept until the string is changed. Strings that are shared between 
+ * documents may be serialized by several threads at once; if more than
+ * one makes it, the first one kept is used.
+ *
+ * @param[out] len the length of the serialized form.
+ *
+ * @return the serialized form, not NULL terminated.
+ */
+
+const char *
+JSONString::GetWire(size_t &len)
+{
+    char *wire = m_wire.load(std::memory_order_acquire);
+
+    if (!wire) {
+        char *converted = ConvertUTF8Multibyte();
+        std::string escaped;
+        const char *p = converted;
+        char *expected = NULL;
+
+        // UTF-8 that cannot be converted is written with escapes only
+
+        if (!p) {
+            escaped = Get();
+            p = escaped.c_str();
+        }
+        len = strlen(p);
+        wire = static_cast<char *>(JSONMemory::Allocate(WireHeader + len,
+            JsonMemoryCategory_Strings));
+        memcpy(wire, &len, WireHeader);
+        memcpy(wire + WireHeader, p, len);
+        free(converted);
+        if (!m_wire.compare_exchange_strong(expected, wire, 
+            std::memory_order_acq_rel, std::memory_order_acquire)) {
+            JSONMemory::Free(wire, WireHeader + len, 
+                JsonMemoryCategory_Strings);
+            wire = expected;
+        }
+    }
+    memcpy(&len, wire, WireHeader);
+    return wire + WireHeader;
+}
+
+
+/**
+ * Discard the serialized form of the string, if it has been made.
+ */
+
+void
+JSONString::ClearWire()
+{
+    char *wire = m_wire.exchange(NULL, std::memory_order_acq_rel);
+    size_t len;
+
+    if (wire) {
+        memcpy(&len, wire, WireHeader);
+        JSONMemory::Free(wire, WireHeader + len, JsonMemoryCategory_Strings);
+    }
+}
+
+
+/**
+ * Make a copy of the string.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONString::CopyNode()
+{
+    JSONString *copy = new JSONString();
+
+    copy->m_value = m_value;
+    return copy;
+}
+
+
+/**
+ * Compare the string with another of the same type.
+ *
+ * @param[in] other the value to compare with, of the same type.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONString::EqualsNode(const JSONValue &other) const
+{
+    return m_value == static_cast<const JSONString &>(other).m_value;
+}
+
+
+/**
+ * Compute the hash of the string.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONString::HashNode() const
+{
+    return HashMix(HashBytes(m_value.data(), m_value.size()) + JsonType_String);
+}
+
+
+/**
+ * Add the memory used by the string to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JSONString::AddMemoryUsage(JSONMemoryUsage &usage) const
+{
+    char *wire = m_wire.load(std::memory_order_acquire);
+    size_t len;
+
+    JSONValue::AddMemoryUsage(usage);
+    if (m_value.IsInline() == false) {
+        usage.strings += m_value.size() + 1;
+    }
+    if (wire) {
+        memcpy(&len, wire, WireHeader);
+        usage.strings += WireHeader + len;
+    }
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONNumber::JSONNumber() :
+    m_value(0),
+    m_unsigned(false)
+{
+    m_type = JsonType_Number;
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONNumber::JSONNumber(long number) :
+    m_value(number),
+    m_unsigned(false)
+{
+    m_type = JsonType_Number;
+}
+
+
+/**
+ * Set the number to an unsigned value. Values that do not fit in a long
+ * are kept as unsigned, so they can be told apart from negative values.
+ *
+ * @param[in] val the value.
+ */
+
+void
+JSONNumber::SetUnsigned(unsigned long val)
+{
+    m_value = (long) val;
+    m_unsigned = val > (unsigned long) LONG_MAX;
+}
+
+
+/**
+ * Convert a JSON number object to it's string version. Concatenate the
+ * result to the passed in string reference.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the JSON string object as a string, concatenated to str.
+ */
+
+std::string &
+JSONNumber::ToJSON(std::string &str)
+{       
+    char buf[128];
+
+    if (m_unsigned) {
+        snprintf(buf, sizeof buf - 1, "%lu", GetUnsigned());
+    } else {
+        snprintf(buf, sizeof buf - 1, "%ld", Get());
+    }
+    std::string ret(buf); 
+    str += ret;
+    return str;
+}
+
+
+/**
+ * Make a copy of the number.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONNumber::CopyNode()
+{
+    JSONNumber *copy = new JSONNumber(m_value);
+
+    copy->m_unsigned = m_unsigned;
+    return copy;
+}
+
+
+/**
+ * Compare the number with another of the same type.
+ *
+ * @param[in] other the value to compare with, of the same type.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONNumber::EqualsNode(const JSONValue &other) const
+{
+    const JSONNumber &number = static_cast<const JSONNumber &>(other);
+
+    return m_value == number.m_value && m_unsigned == number.m_unsigned;
+}
+
+
+/**
+ * Compute the hash of the number.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONNumber::HashNode() const
+{
+    return HashInteger(m_value);
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONDouble::JSONDouble() 
+{
+    m_type = JsonType_Double;
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONDouble::JSONDouble(double val) 
+{
+    m_type = JsonType_Double;
+    m_value = val;
+}
+
+
+/**
+ * Convert a JSON double to it's string version. Concatenate the
+ * result to the passed in string reference.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the JSON string object as a string, concatenated to str.
+ */
+
+std::string &
+JSONDouble::ToJSON(std::string &str)
+{       
+    char buf[128];
+
+    snprintf(buf, sizeof buf - 1, "%f", Get());
+    std::string ret(buf); 
+    str += ret;
+    return str;
+}
+
+
+/**
+ * Make a copy of the double.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONDouble::CopyNode()
+{
+    return new JSONDouble(m_value);
+}
+
+
+/**
+ * Compare the double with another of the same type.
+ *
+ * @param[in] other the value to compare with, of the same type.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONDouble::EqualsNode(const JSONValue &other) const
+{
+    return m_value == static_cast<const JSONDouble &>(other).m_value;
+}
+
+
+/**
+ * Compute the hash of the double.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONDouble::HashNode() const
+{
+    return HashDouble(m_value);
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONBoolean::JSONBoolean() 
+{
+    m_type = JsonType_Bool;
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONBoolean::JSONBoolean(bool val) 
+{
+    m_type = JsonType_Bool;
+    m_value = val;
+}
+
+
+/**
+ * Convert a JSON boolean to it's string version. Concatenate the
+ * result to the passed in string reference.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the JSON string object as a string, concatenated to str.
+ */
+
+std::string &
+JSONBoolean::ToJSON(std::string &str)
+{       
+    std::string ret;
+
+    ret = (Get() == true ? "true" : "false");
+    str += ret;
+    return str;
+}
+
+
+/**
+ * Make a copy of the boolean.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONBoolean::CopyNode()
+{
+    return new JSONBoolean(m_value);
+}
+
+
+/**
+ * Compare the boolean with another of the same type.
+ *
+ * @param[in] other the value to compare with, of the same type.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONBoolean::EqualsNode(const JSONValue &other) const
+{
+    return m_value == static_cast<const JSONBoolean &>(other).m_value;
+}
+
+
+/**
+ * Compute the hash of the boolean.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONBoolean::HashNode() const
+{
+    return HashMix((m_value ? 2 : 1) + JsonType_Bool);
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONTuple::JSONTuple() :
+    m_value(NULL)
+{
+    m_type = JsonType_Tuple;
+}
+
+
+/**
+ * Move constructor. The key and value are taken from other, which is
+ * left with an empty key and no value.
+ *
+ * @param[in] other the tuple to move from.
+ */
+
+JSONTuple::JSONTuple(JSONTuple &&other) :
+    JSONValue(std::move(other)),
+    m_key(std::move(other.m_key)),
+    m_value(other.m_value)
+{
+    other.m_value = NULL;
+}
+
+
+/**
+ * Move assignment. The current value is destroyed, and the key and value
+ * are taken from other.
+ *
+ * @param[in] other the tuple to move from.
+ *
+ * @return this tuple.
+ */
+
+JSONTuple &
+JSONTuple::operator=(JSONTuple &&other)
+{
+    if (this != &other) {
+        JSONValue::operator=(std::move(other));
+        m_key = std::move(other.m_key);
+        Unref(m_value);
+        m_value = other.m_value;
+        other.m_value = NULL;
+    }
+    return *this;
+}
+
+
+/**
+ * Set the value of the tuple, taking ownership of it. Any previous value
+ * is destroyed.
+ *
+ * @param[in] value the new value.
+ */
+
+void
+JSONTuple::SetValue(std::unique_ptr<JSONValue> value)
+{
+    Unref(m_value);
+    m_value = value.release();
+}
+
+
+/**
+ * Get the value of the tuple for modification. If the value is shared 
+ * with another document, it is replaced by a private copy first. Only 
+ * the value itself is copied, its children remain shared.
+ *
+ * @return the value, or NULL if the tuple has no value.
+ */
+
+JSONValue *
+JSONTuple::GetMutableValue()
+{
+    m_value = Unshare(m_value);
+    return m_value;
+}
+
+
+/**
+ * Remove the value from the tuple without destroying it, so that it 
+ * can be moved to another tuple, array, or document. If the value is 
+ * shared, a private copy is returned instead.
+ *
+ * @return the value, or an empty pointer if the tuple has no value.
+ */
+
+std::unique_ptr<JSONValue>
+JSONTuple::ReleaseValue()
+{
+    JSONValue *ret = GetMutableValue();
+
+    m_value = NULL;
+    return std::unique_ptr<JSONValue>(ret);
+}
+
+
+/**
+ * Convert a JSON tuple to it's string version. Concatenate the
+ * result to the passed in string reference.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the JSON string object as a string, concatenated to str.
+ */
+
+std::string &
+JSONTuple::ToJSON(std::string &str)
+{       
+    str += "\"";
+    str.append(GetKey().c_str(), GetKey().size());
+    str += "\": ";
+    GetValue()->ToJSON(str);
+    return str;
+}
+
+
+/**
+ * Make a shallow copy of the tuple. Its value is shared with
+ * the copy, not copied.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONTuple::CopyNode()
+{
+    JSONTuple *copy = new JSONTuple();
+
+    copy->m_key = m_key;
+    if (m_value) {
+        copy->m_value = m_value->Ref();
+    }
+    return copy;
+}
+
+
+/**
+ * Compare the tuple with another of the same type.
+ *
+ * @param[in] other the value to compare with, of the same type.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONTuple::EqualsNode(const JSONValue &other) const
+{
+    const JSONTuple &tuple = static_cast<const JSONTuple &>(other);
+
+    if (m_key != tuple.m_key) {
+        return false;
+    }
+    if (m_value == NULL || tuple.m_value == NULL) {
+        return m_value == tuple.m_value;
+    }
+    return m_value->Equals(*tuple.m_value);
+}
+
+
+/**
+ * Compute the hash of the tuple.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONTuple::HashNode() const
+{
+    uint64_t h = HashBytes(m_key.data(), m_key.size());
+
+    if (m_value) {
+        h += HashMix(m_value->Hash());
+    }
+    return HashMix(h + JsonType_Tuple);
+}
+
+
+/**
+ * Add the memory used by the tuple, its key and its value to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JSONTuple::AddMemoryUsage(JSONMemoryUsage &usage) const
+{
+    JSONValue::AddMemoryUsage(usage);
+    if (m_key.IsInline() == false) {
+        usage.strings += m_key.size() + 1;
+    }
+    if (m_value) {
+        usage += m_value->MemoryUsage();
+    }
+}
+
+
+/**
+ * Constructor. Set the appropriate type.
+ */
+
+JSONNull::JSONNull() 
+{
+    m_type = JsonType_Null;
+}
+
+
+/**
+ * Convert a JSON null to it's string version. Concatenate the
+ * result to the passed in string reference.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the JSON string object as a string, concatenated to str.
+ */
+
+std::string &
+JSONNull::ToJSON(std::string &str)
+{       
+    str += "null";
+    return str;
+}
+
+
+/**
+ * Make a copy of the null.
+ *
+ * @return the copy.
+ */
+
+JSONValue *
+JSONNull::CopyNode()
+{
+    return new JSONNull();
+}
+
+
+/**
+ * Compare the null with another of the same type.
+ *
+ * @param[in] other the value to compare with, of the same type.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONNull::EqualsNode(const JSONValue &other) const
+{
+    return true;
+}
+
+
+/**
+ * Compute the hash of the null.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONNull::HashNode() const
+{
+    return HashMix(JsonType_Null);
+}
+
+
+/**
+ * Get a value as a sorted object, see JSONObject::SortKeys().
+ *
+ * @param[in] val the value.
+ *
+ * @return the object, or NULL if val is not a sorted object.
+ */
+
+static JSONObject *
+SortedObject(const JSONValue *val)
+{
+    JSONObject *obj = NULL;
+
+    if (val->GetType() == JsonType_Object && 
+        static_cast<const JSONObject *>(val)->IsSorted()) {
+        obj = const_cast<JSONObject *>(static_cast<const JSONObject *>(val));
+    }
+    return obj;
+}
+
+
+/**
+ * Get the element of an object or array at specified offset. This walks
+ * the elements from the first one; use iterators (see begin()) to visit
+ * them all.
+ *
+ * @param[in] offset the offset in range [0, size - 1]
+ *
+ * @return on success, JSONValue pointer, otherwise NULL. 
+ */
+
+JSONValue *
+JSONValue::Get(int offset)
+{
+    JsonElementList::iterator iter;
+    JSONValue *p = NULL;
+    JSONObject *sorted = SortedObject(this);
+    int i;
+
+    Materialize();
+    if (sorted) {
+        if (offset >= 0 && offset < (int) sorted->m_index.size()) {
+            p = sorted->m_index[offset];
+        }
+        return p;
+    }
+    for (i = 0,iter = m_elements.begin(); 
+         iter != m_elements.end(); ++iter,i++) {
+        if (i == offset) {
+            p = (*iter);
+            break; 
+        }
+    }
+    return p;
+}
+
+
+/**
+ * Get the JSONValue at the specified offset, for reading.
+ *
+ * @param[in] offset the position of the value.
+ *
+ * @return the value, or NULL if there is none at offset.
+ */
+
+const JSONValue *
+JSONValue::Get(int offset) const
+{
+    JsonElementList::const_iterator iter;
+    const JSONObject *sorted = SortedObject(this);
+    int i;
+
+    Materialize();
+    if (sorted) {
+        if (offset >= 0 && offset < (int) sorted->m_index.size()) {
+            return sorted->m_index[offset];
+        }
+        return NULL;
+    }
+    for (i = 0, iter = m_elements.begin(); iter != m_elements.end(); 
+         ++iter, i++) {
+        if (i == offset) {
+            return *iter;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Get the keys and values of an object or a record, for use with 
+ * range-based for:
+ *
+ *     for (const auto &member : obj->Members()) {
+ *         ... member.key, member.value ...
+ *     }
+ *
+ * @return the members, none if the value is neither an object nor a 
+ *         record.
+ */
+
+JSONValue::MemberRange
+JSONValue::Members()
+{
+    const JSONShape *shape = NULL;
+    JsonElementList::iterator first;
+
+    Materialize();
+    first = m_elements.begin();
+    if (m_type == JsonType_Record) {
+        shape = static_cast<JSONRecord *>(this)->GetShape();
+    } else if (m_type != JsonType_Object) {
+        first = m_elements.end();
+    }
+    return MemberRange(JSONMemberIterator<JSONValue, JsonElementList::iterator>(
+            first, shape, 0), 
+        JSONMemberIterator<JSONValue, JsonElementList::iterator>(
+            m_elements.end(), shape, m_elements.size()));
+}
+
+
+/**
+ * Get the keys and values of an object or a record, for reading.
+ *
+ * @return the members, none if the value is neither an object nor a 
+ *         record.
+ */
+
+JSONValue::ConstMemberRange
+JSONValue::Members() const
+{
+    const JSONShape *shape = NULL;
+    JsonElementList::const_iterator first;
+
+    Materialize();
+    first = m_elements.begin();
+    if (m_type == JsonType_Record) {
+        shape = static_cast<const JSONRecord *>(this)->GetShape();
+    } else if (m_type != JsonType_Object) {
+        first = m_elements.end();
+    }
+    return ConstMemberRange(
+        JSONMemberIterator<const JSONValue, JsonElementList::const_iterator>(
+            first, shape, 0), 
+        JSONMemberIterator<const JSONValue, JsonElementList::const_iterator>(
+            m_elements.end(), shape, m_elements.size()));
+}
+
+
+/**
+ * Store the JSONValue at the specified offset in the object or array.
+ * The value previously at that offset is destroyed.
+ *
+ * @param[in] offset the position to store value at.
+ * @param[in] the value to store.
+ *
+ * @return on success true, otherwise false.
+ */
+
+bool
+JSONValue::Set(int offset, JSONValue *val)
+{
+    bool ret = true;
+
+    Materialize();
+    if (offset < 0 || offset >= (int) m_elements.size()) {
+        ret = false;
+        goto out;
+    }
+    Delete(offset);
+    Insert(offset, val);
+out:
+    return ret;
+}
+
+
+/**
+ * Store the JSONValue at the specified offset in the object or array,
+ * taking ownership of it. The value previously at that offset is 
+ * destroyed.
+ *
+ * @param[in] offset the position to store value at.
+ * @param[in] the value to store. Destroyed if offset is out of range.
+ *
+ * @return on success true, otherwise false.
+ */
+
+bool
+JSONValue::Set(int offset, std::unique_ptr<JSONValue> val)
+{
+    bool ret = Set(offset, val.get());
+
+    if (ret) {
+        val.release();
+    }
+    return ret;
+}
+
+
+/**
+ * Insert the value at the specified offset in the object or array. In a
+ * sorted object (see JSONObject::SortKeys()), a tuple goes where its key
+ * belongs instead. A JSONPackedArray takes no JSONValue elements.
+ *
+ * @param[in] offset the offset of the item after insertion, in the 
+ *            range [0, size]. 
+ * @param[in] val the value to insert. Not taken on failure.
+ *
+ * @return true on success, false on failure
+ */
+
+bool
+JSONValue::Insert(int offset, JSONValue *val)
+{
+    bool ret = true;
+    JsonElementList::iterator iter;
+    int i;
+
+    Materialize();
+    if (offset < 0 || offset > (int) m_elements.size() || 
+        m_type == JsonType_PackedArray) {
+        ret = false;
+        goto out;
+    }
+    if (SortedObject(this)) {
+        SortedObject(this)->InsertSorted(val);
+    } else if (offset == 0) {
+        Prepend(val);
+    } else if (offset == (int) m_elements.size()) {
+        Append(val);
+    } else {
+        for (i = 0,iter = m_elements.begin(); 
+            iter != m_elements.end(); ++iter,i++) {
+            if (i == offset) {
+                break; 
+            }
+        }
+        m_elements.insert(iter, val);
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Insert the value at the specified offset in the object or array,
+ * taking ownership of it.
+ *
+ * @param[in] offset the offset of the item after insertion, in the 
+ *            range [0, size]. 
+ * @param[in] val the value to insert. Destroyed if offset is out of range.
+ *
+ * @return true on success, false on failure
+ */
+
+bool
+JSONValue::Insert(int offset, std::unique_ptr<JSONValue> val)
+{
+    bool ret = Insert(offset, val.get());
+
+    if (ret) {
+        val.release();
+    }
+    return ret;
+}
+
+
+/** 
+ * Delete item at specified offset from the object or array. The item will
+ * be destroyed on removal. 
+ *
+ * @param[in] offset the offset of the item to be removed. 
+ *
+ * @return true on success, false on failure.
+ */
+
+bool
+JSONValue::Delete(int offset)
+{
+    bool ret = true;
+
+    Materialize();
+    if (offset < 0 || offset >= (int) m_elements.size()) {
+        ret = false;
+        goto out;
+    }
+    if (offset == 0) {
+        Unref(m_elements.front());
+        m_elements.pop_front();
+    } else if (offset == (int) m_elements.size() - 1) {
+        Unref(m_elements.back());
+        m_elements.pop_back();
+    } else {
+        JsonElementList::iterator iter;
+        int i;
+
+        for (i = 0,iter = m_elements.begin(); 
+            iter != m_elements.end(); ++iter,i++) {
+            if (i == offset) {
+                Unref(*iter);
+                m_elements.erase(iter);
+                break; 
+            }
+        }
+    }
+    if (SortedObject(this)) {
+        JSONObject *sorted = SortedObject(this);
+
+        sorted->m_index.erase(sorted->m_index.begin() + offset);
+    }
+out:
+    return ret;
+}
+
+
+/** 
+ * Remove item at specified offset from the object or array without 
+ * destroying it. Ownership passes to the caller, so the item (and any
+ * children) can be moved to another object, array or document without
+ * a copy. If the item is shared with another document, the caller gets
+ * a private (shallow) copy of it instead.
+ *
+ * @param[in] offset the offset of the item to be removed. 
+ *
+ * @return the item on success, an empty pointer on failure.
+ */
+
+std::unique_ptr<JSONValue>
+JSONValue::Detach(int offset)
+{
+    JSONValue *ret = NULL;
+
+    Materialize();
+    if (offset < 0 || offset >= (int) m_elements.size()) {
+        goto out;
+    }
+
+    if (offset == 0) {
+        ret = m_elements.front();
+        m_elements.pop_front();
+    } else if (offset == (int) m_elements.size() - 1) {
+        ret = m_elements.back();
+        m_elements.pop_back();
+    } else {
+        JsonElementList::iterator iter;
+        int i;
+
+        for (i = 0,iter = m_elements.begin(); 
+            iter != m_elements.end(); ++iter,i++) {
+            if (i == offset) {
+                ret = *iter;
+                m_elements.erase(iter);
+                break; 
+            }
+        }
+    }
+    if (SortedObject(this)) {
+        JSONObject *sorted = SortedObject(this);
+
+        sorted->m_index.erase(sorted->m_index.begin() + offset);
+    }
+    ret = Unshare(ret);
+out:
+    return std::unique_ptr<JSONValue>(ret);
+}
+
+
+/**
+ * Get the element at the specified offset for modification. If the 
+ * element is shared with another document, it is replaced by a private
+ * copy first. Only the element itself is copied, its children remain
+ * shared, so modifying a path from the root copies just the nodes on 
+ * that path.
+ *
+ * @param[in] offset the offset in range [0, size - 1]
+ *
+ * @return on success, JSONValue pointer, otherwise NULL. 
+ */
+
+JSONValue *
+JSONValue::GetMutable(int offset)
+{
+    JsonElementList::iterator iter;
+    JSONValue *p = NULL;
+    int i;
+
+    Materialize();
+    for (i = 0,iter = m_elements.begin(); 
+         iter != m_elements.end(); ++iter,i++) {
+        if (i == offset) {
+            p = Unshare(*iter);
+            *iter = p;
+            break; 
+        }
+    }
+    if (p && SortedObject(this)) {
+        SortedObject(this)->m_index[offset] = p;
+    }
+    return p;
+}
+
+
+/**
+ * Find the tuple with the specified key in an object. The keys of a 
+ * parsed object keep their quotes, so a key matches either as is or 
+ * enclosed in quotes, and a key with escapes matches by its text. In a 
+ * record, the offset is that of the value, 
+ * since a record has no tuples. A sorted object (see 
+ * JSONObject::SortKeys()) is searched by binary search.
+ *
+ * @param[in] key the key, without quotes.
+ *
+ * @return the offset of the tuple, or -1 if there is no such key.
+ */
+
+int
+JSONValue::FindKey(std::string_view key) const
+{
+    JsonElementList::const_iterator iter;
+    size_t len = key.size();
+    int ret = -1;
+    int i;
+
+    Materialize();
+    if (m_type == JsonType_Record) {
+        ret = static_cast<const JSONRecord *>(this)->GetShape()->Find(key);
+        goto out;
+    }
+    if (SortedObject(this)) {
+        ret = SortedObject(this)->FindSorted(key);
+        goto out;
+    }
+    if (m_type != JsonType_Object) {
+        goto out;
+    }
+    for (i = 0,iter = m_elements.begin(); 
+         iter != m_elements.end(); ++iter,i++) {
+        const JsonStr &k = static_cast<JSONTuple *>(*iter)->GetKey();
+
+        if (k.Equals(key.data(), len) || 
+            (k.size() == len + 2 && k.c_str()[0] == '"' && 
+             k.c_str()[len + 1] == '"' && 
+             memcmp(k.c_str() + 1, key.data(), len) == 0) ||
+            (k.size() > len + 2 && memchr(k.c_str(), '\\', k.size()) &&
+             EscapedKeyEquals(k.View(), key))) {
+            ret = i;
+            break;
+        }
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Make a deep copy of the value. Unlike a document clone, the copy 
+ * shares nothing with this value, so either can be modified freely.
+ *
+ * @return the copy (caller must delete).
+ */
+
+JSONValue *
+JSONValue::Copy()
+{
+    JSONValue *copy = CopyNode();
+
+    copy->UnshareTree();
+    return copy;
+}
+
+
+/**
+ * Replace every shared value below this one with a private copy.
+ */
+
+void
+JSONValue::UnshareTree()
+{
+    JsonElementList::iterator iter;
+    JSONValue *val;
+
+    Materialize();
+    for (iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+        *iter = Unshare(*iter);
+        (*iter)->UnshareTree();
+    }
+    if (SortedObject(this)) {
+        SortedObject(this)->IndexKeys();
+    }
+    if (m_type == JsonType_Tuple) {
+        val = static_cast<JSONTuple *>(this)->GetMutableValue();
+        if (val) {
+            val->UnshareTree();
+        }
+    }
+}
+
+
+/**
+ * Share the elements of another object or array with this one. Each 
+ * element gets an additional reference.
+ *
+ * @param[in] from the object or array whose elements are to be shared.
+ */
+
+void
+JSONValue::ShareElements(JSONValue *from)
+{
+    JsonElementList::iterator iter;
+
+    from->Materialize();
+    for (iter = from->m_elements.begin(); 
+         iter != from->m_elements.end(); ++iter) {
+        m_elements.push_back((*iter)->Ref());
+    }
+}
+
+
+/**
+ * Drop a reference to a value, destroying it when the last reference
+ * goes away.
+ *
+ * @param[in] val the value, may be NULL.
+ */
+
+void
+JSONValue::Unref(JSONValue *val)
+{
+    if (val && val->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete val;
+    }
+}
+
+
+/**
+ * Get a value that can be modified in place of one that may be shared.
+ * If val is shared, a (shallow) copy of it is returned, and the 
+ * reference the caller held to val is dropped. Otherwise val itself is
+ * returned.
+ *
+ * @param[in] val the value, may be NULL.
+ *
+ * @return val or a copy of it.
+ */
+
+JSONValue *
+JSONValue::Unshare(JSONValue *val)
+{
+    JSONValue *ret = val;
+
+    if (val && val->IsShared()) {
+        ret = val->CopyNode();
+        Unref(val);
+    }
+    return ret;
+}
+
+
+/**
+ * Add a reference to the value, for sharing it with another document.
+ *
+ * @return this value.
+ */
+
+JSONValue *
+JSONValue::Ref()
+{
+    if (m_refs.fetch_add(1, std::memory_order_relaxed) == 1) {
+        // not shared until now, so the cached hash may be stale
+        m_hash.store(0, std::memory_order_relaxed);
+    }
+    return this;
+}
+
+
+/**
+ * Compare this value with another one, recursively. Objects are equal
+ * if they have the same keys with equal values, regardless of the order
+ * of their tuples. A number and a double are never equal.
+ *
+ * @param[in] other the value to compare with.
+ *
+ * @return true if the values are equal.
+ */
+
+bool
+JSONValue::Equals(const JSONValue &other) const
+{
+    bool ret = true;
+
+    if (this == &other) {
+        goto out;
+    }
+    if (m_type != other.m_type) {
+
+        // a record equals the object with the same keys and values, a 
+        // packed array the array with the same elements
+
+        if (m_type == JsonType_Record) {
+            ret = static_cast<const JSONRecord *>(this)->EqualsObject(other);
+        } else if (other.m_type == JsonType_Record) {
+            ret = static_cast<const JSONRecord &>(other).EqualsObject(*this);
+        } else if (m_type == JsonType_PackedArray) {
+            ret = static_cast<const JSONPackedArray *>(this)->EqualsArray(other);
+        } else if (other.m_type == JsonType_PackedArray) {
+            ret = static_cast<const JSONPackedArray &>(other).EqualsArray(*this);
+        } else {
+            ret = false;
+        }
+        goto out;
+    }
+    if (IsShared() && other.IsShared()) {
+        uint64_t h1 = m_hash.load(std::memory_order_relaxed);
+        uint64_t h2 = other.m_hash.load(std::memory_order_relaxed);
+
+        if (h1 && h2 && h1 != h2) {
+            ret = false;
+            goto out;
+        }
+    }
+    ret = EqualsNode(other);
+out:
+    return ret;
+}
+
+
+/**
+ * Compute a 64-bit hash of the value, recursively. Equal values (see 
+ * Equals()) have equal hashes. The hash of a shared value is cached.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONValue::Hash() const
+{
+    uint64_t ret = 0;
+    bool shared = IsShared();
+
+    if (shared) {
+        ret = m_hash.load(std::memory_order_relaxed);
+    }
+    if (ret == 0) {
+        ret = HashNode();
+        if (shared) {
+            m_hash.store(ret, std::memory_order_relaxed);
+        }
+    }
+    return ret;
+}
+
+
+/**
+ * Get the memory used by a tree: its nodes, the heap buffers of its 
+ * strings and keys, and the list elements that link children to their
+ * containers. A subtree shared with other documents (see 
+ * JSONDocument::Clone()) is counted in full by each of them.
+ *
+ * @return the number of bytes, by category.
+ */
+
+JSONMemoryUsage
+JSONValue::MemoryUsage() const
+{
+    JSONMemoryUsage usage;
+
+    AddMemoryUsage(usage);
+    return usage;
+}
+
+
+/**
+ * Add the memory used by the node, and its elements, to a total. Derived
+ * classes that hold strings or other values add those.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JSONValue::AddMemoryUsage(JSONMemoryUsage &usage) const
+{
+    JsonElementList::const_iterator iter;
+
+    switch (m_type) {
+    case JsonType_Object:
+        usage.nodes += sizeof(JSONObject);
+        break;
+    case JsonType_Array:
+        usage.nodes += sizeof(JSONArray);
+        break;
+    case JsonType_Tuple:
+        usage.nodes += sizeof(JSONTuple);
+        break;
+    case JsonType_Record:
+        usage.nodes += sizeof(JSONRecord);
+        break;
+    case JsonType_PackedArray:
+        usage.nodes += sizeof(JSONPackedArray);
+        break;
+    case JsonType_String:
+        usage.nodes += sizeof(JSONString);
+        break;
+    case JsonType_Number:
+        usage.nodes += sizeof(JSONNumber);
+        break;
+    case JsonType_Double:
+        usage.nodes += sizeof(JSONDouble);
+        break;
+    case JsonType_Bool:
+        usage.nodes += sizeof(JSONBoolean);
+        break;
+    default:
+        usage.nodes += sizeof(JSONNull);
+        break;
+    }
+
+    // elements not converted yet are counted as they are in the internal
+    // tree, rather than converted to be counted.
+
+    if (m_lazy.load(std::memory_order_acquire)) {
+        JsonLazyClaim lazy(m_lazy);
 
-JSONDouble::JSONDouble(double val) 
-{
-    m_type = JsonType_Double;
-    m_value = val;
+        if (lazy.Get()) {
+            usage.nodes += sizeof(JsonLazyNode);
+            for (JsonNode *child : *lazy.Get()->GetNode()) {
+                usage.containers += JSONMemory::ListNodeSize;
+                child->AddMemoryUsage(usage);
+            }
+        }
+    }
+    for (iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+        usage.containers += JSONMemory::ListNodeSize;
+        (*iter)->AddMemoryUsage(usage);
+    }
 }
 
 
 /**
- * Convert a JSON double to it's string version. Concatenate the
- * result to the passed in string reference.
+ * Compare the elements of an object or array with those of another 
+ * value of the same type. Tuples are first compared pairwise, and if 
+ * the objects turn out to have their keys in a different order, the 
+ * remaining tuples are looked up by key.
  *
- * @param[in] str the currently formed JSON string
+ * @param[in] other the value to compare with, of the same type.
  *
- * @return the JSON string object as a string, concatenated to str.
+ * @return true if the values are equal.
  */
 
-std::string &
-JSONDouble::ToJSON(std::string &str)
-{       
-    char buf[128];
+bool
+JSONValue::EqualsNode(const JSONValue &other) const
+{
+    JsonElementList::const_iterator a, b, iter;
+    bool ret = false;
 
-    snprintf(buf, sizeof buf - 1, "%f", Get());
-    std::string ret(buf); 
-    str += ret;
-    return str;
+    Materialize();
+    other.Materialize();
+    if (m_elements.size() != other.m_elements.size()) {
+        goto out;
+    }
+    for (a = m_elements.begin(), b = other.m_elements.begin(); 
+         a != m_elements.end(); ++a, ++b) {
+        if (!(*a)->Equals(**b)) {
+            break;
+        }
+    }
+    if (a == m_elements.end()) {
+        ret = true;
+        goto out;
+    }
+    if (m_type != JsonType_Object) {
+        goto out;
+    }
+    for (; a != m_elements.end(); ++a) {
+        const JsonStr &key = static_cast<const JSONTuple *>(*a)->GetKey();
+
+        for (iter = b; iter != other.m_elements.end(); ++iter) {
+            if (static_cast<const JSONTuple *>(*iter)->GetKey() == key) {
+                break;
+            }
+        }
+        if (iter == other.m_elements.end() || !(*a)->Equals(**iter)) {
+            goto out;
+        }
+    }
+    ret = true;
+out:
+    return ret;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Compute the hash of the elements of an object or array. The hashes of
+ * the tuples of an object are summed so their order does not matter, 
+ * those of the elements of an array are chained.
+ *
+ * @return the hash.
  */
 
-JSONBoolean::JSONBoolean() 
+uint64_t
+JSONValue::HashNode() const
 {
-    m_type = JsonType_Bool;
+    JsonElementList::const_iterator iter;
+    uint64_t h = m_type;
+
+    Materialize();
+    for (iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+        if (m_type == JsonType_Object) {
+            h += (*iter)->Hash();
+        } else {
+            h = HashMix(h) + (*iter)->Hash();
+        }
+    }
+    return HashMix(h + m_elements.size());
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Default implementation of CopyNode (derived classes should override).
+ *
+ * @return a value of the same type sharing the elements of this one.
  */
 
-JSONBoolean::JSONBoolean(bool val) 
+JSONValue *
+JSONValue::CopyNode()
 {
-    m_type = JsonType_Bool;
-    m_value = val;
+    JSONValue *copy = new JSONValue();
+
+    copy->m_type = m_type;
+    copy->ShareElements(this);
+    return copy;
 }
 
 
 /**
- * Convert a JSON boolean to it's string version. Concatenate the
- * result to the passed in string reference.
+ * Add specified element at offset 0 in the object or array (where its 
+ * key belongs in a sorted object, see JSONObject::SortKeys()). A 
+ * JSONPackedArray takes no JSONValue elements.
  *
- * @param[in] str the currently formed JSON string
+ * @param[in] val the value to insert. Not taken on failure.
  *
- * @return the JSON string object as a string, concatenated to str.
+ * @return true on success, false on failure.
  */
 
-std::string &
-JSONBoolean::ToJSON(std::string &str)
-{       
-    std::string ret;
-
-    ret = (Get() == true ? "true" : "false");
-    str += ret;
-    return str;
+bool
+JSONValue::Prepend(JSONValue *val)
+{
+    Materialize();
+    if (m_type == JsonType_PackedArray) {
+        return false;
+    }
+    if (SortedObject(this)) {
+        SortedObject(this)->InsertSorted(val);
+        return true;
+    }
+    m_elements.push_front(val);
+    return true;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Add specified element at offset 0 in the object or array, taking 
+ * ownership of it.
+ *
+ * @param[in] val the value to insert. Destroyed on failure.
+ *
+ * @return true on success, false on failure.
  */
 
-JSONTuple::JSONTuple() 
+bool
+JSONValue::Prepend(std::unique_ptr<JSONValue> val)
 {
-    m_type = JsonType_Tuple;
+    bool ret = Prepend(val.get());
+
+    if (ret) {
+        val.release();
+    }
+    return ret;
 }
 
 
 /**
- * Convert a JSON tuple to it's string version. Concatenate the
- * result to the passed in string reference.
+ * Add the specified element to the end of the object or array (where 
+ * its key belongs in a sorted object, see JSONObject::SortKeys()). A 
+ * JSONPackedArray takes no JSONValue elements.
  *
- * @param[in] str the currently formed JSON string
+ * @param[in] val the value to insert. Not taken on failure.
  *
- * @return the JSON string object as a string, concatenated to str.
+ * @return the offset of the element, or -1 on failure.
  */
 
-std::string &
-JSONTuple::ToJSON(std::string &str)
-{       
-    std::string ret = "\"";
-    ret += GetKey();
-    ret += "\": ";
-    GetValue()->ToJSON(ret);
-    str += ret;
-    return str;
+int
+JSONValue::Append(JSONValue *val)
+{
+    Materialize();
+    if (m_type == JsonType_PackedArray) {
+        return -1;
+    }
+    if (SortedObject(this)) {
+        return SortedObject(this)->InsertSorted(val);
+    }
+    m_elements.push_back(val);
+    return m_elements.size() - 1;
 }
 
 
 /**
- * Constructor. Set the appropriate type.
+ * Add the specified element to the end of the object or array, taking 
+ * ownership of it.
+ *
+ * @param[in] val the value to insert. Destroyed on failure.
+ *
+ * @return the offset of the element, or -1 on failure.
  */
 
-JSONNull::JSONNull() 
+int
+JSONValue::Append(std::unique_ptr<JSONValue> val)
 {
-    m_type = JsonType_Null;
+    int ret = Append(val.get());
+
+    if (ret >= 0) {
+        val.release();
+    }
+    return ret;
 }
 
 
 /**
- * Convert a JSON null to it's string version. Concatenate the
- * result to the passed in string reference.
- *
- * @param[in] str the currently formed JSON string
+ * Default implementation of ToJSON (derived classes should override).
  *
- * @return the JSON string object as a string, concatenated to str.
+ * @param[in] str current value of JSON object in JSON format.
+ * 
+ * @return str + "Not implemented"
  */
 
 std::string &
-JSONNull::ToJSON(std::string &str)
+JSONValue::ToJSON(std::string &str)
 {       
-    str += "null";
+    str += "Not Implemented";
     return str;
 }
 
 
 /**
- * Get the element of an object or array at specified offset.
- *
- * @param[in] offset the offset in range [0, size - 1]
+ * Move constructor. The elements of other, if any, are taken over 
+ * without copying them, and other is left empty.
  *
- * @return on success, JSONValue pointer, otherwise NULL. 
+ * @param[in] other the value to move from.
  */
 
-JSONValue *
-JSONValue::Get(int offset)
+JSONValue::JSONValue(JSONValue &&other) :
+    m_type(other.m_type),
+    m_elements(std::move(other.m_elements)),
+    m_refs(1),
+    m_hash(0),
+    m_lazy(other.m_lazy.exchange(NULL))
 {
-    std::list<JSONValue *>::iterator iter;
-    JSONValue *p = NULL;
-    int i;
-
-    for (i = 0,iter = m_elements.begin(); 
-         iter != m_elements.end(); ++iter,i++) {
-        if (i == offset) {
-            p = (*iter);
-            break; 
-        }
-    }
-    return p;
+    other.m_elements.clear();
 }
 
 
 /**
- * Store the JSONValue at the specified offset in the object or array.
+ * Move assignment. Current elements are destroyed, and the elements of
+ * other are taken over without copying them.
  *
- * @param[in] offset the position to store value at.
- * @param[in] the value to store.
+ * @param[in] other the value to move from.
  *
- * @return on success true, otherwise false.
+ * @return this value.
  */
 
-bool
-JSONValue::Set(int offset, JSONValue *val)
+JSONValue &
+JSONValue::operator=(JSONValue &&other)
 {
-    bool ret = true;
-
-    if (offset < 0 || offset >= (int) m_elements.size()) {
-        ret = false;
-        goto out;
+    if (this != &other) {
+        DeleteElements();
+        m_type = other.m_type;
+        m_elements = std::move(other.m_elements);
+        other.m_elements.clear();
+        m_lazy.store(other.m_lazy.exchange(NULL), std::memory_order_relaxed);
+        m_hash.store(0, std::memory_order_relaxed);
     }
-    Delete(offset);
-    Insert(offset, val);
-out:
-    return ret;
+    return *this;
 }
 
 
 /**
- * Insert the value at the specified offset in the object or array.
- *
- * @param[in] offset the offset of the item after insertion.
- * @param[in] val the value to insert.
- *
- * @return true on success, false on failure
+ * Destroy all elements of an object or array (elements shared with 
+ * another document just lose a reference). Elements not converted yet
+ * are dropped without being converted.
  */
 
-bool
-JSONValue::Insert(int offset, JSONValue *val)
+void
+JSONValue::DeleteElements()
 {
-    bool ret = true;
-    std::list<JSONValue *>::iterator iter;
-    int i;
+    JsonElementList::iterator iter;
 
-    if (offset < 0 || offset >= (int) m_elements.size()) {
-        ret = false;
-        goto out;
-    }
-    if (offset == 0) {
-        Prepend(val);
-    } else if (offset == (int) m_elements.size() - 1) {
-        Append(val);
-    } else {
-        for (i = 0,iter = m_elements.begin(); 
-            iter != m_elements.end(); ++iter,i++) {
-            if (i == offset) {
-                break; 
-            }
-        }
+    delete m_lazy.exchange(NULL, std::memory_order_acquire);
+    for (iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
+        Unref(*iter);
     }
-    m_elements.insert(iter, val);
-out:
-    return ret;
+    m_elements.clear();
 }
 
 
-/** 
- * Delete item at specified offset from the object or array. The item will
- * be destroyed on removal. 
- *
- * @param[in] offset the offset of the item to be removed. 
- *
- * @return true on success, false on failure.
+/**
+ * Convert the elements of an object or array returned by a lazy parse 
+ * from the internal tree of the parse, see Materialize(). Their elements
+ * in turn are left to be converted when they are looked into. Converting
+ * is a change made to a value that is not seen by its readers, so it is
+ * done here for a const value too, once, by the first thread to get here;
+ * other threads looking into the same value wait for it, see ClaimLazy().
+ * If converting throws (e.g., std::bad_alloc), the elements converted so
+ * far are dropped and the value is left unconverted, to be tried again.
  */
 
-bool
-JSONValue::Delete(int offset)
+void
+JSONValue::MaterializeElements() const
 {
-    bool ret = true;
+    JSONValue *self = const_cast<JSONValue *>(this);
+    JsonLazyClaim lazy(m_lazy);
 
-    if (offset < 0 || offset >= (int) m_elements.size()) {
-        ret = false;
-        goto out;
-    }
+    if (lazy.Get()) {
+        JsonLazyTree *tree = lazy.Get()->GetTree();
+        JSONAllocatorScope scope(tree->GetAllocator());
 
-    if (offset == 0) {
-        m_elements.pop_front();
-    } else if (offset == (int) m_elements.size() - 1) {
-        m_elements.pop_back();
-    } else {
-        std::list<JSONValue *>::iterator iter;
-        int i;
+        try {
+            for (JsonNode *child : *lazy.Get()->GetNode()) {
+                std::unique_ptr<JSONValue> val(
+                    JSONAPI::GetInstance()->ToJsonValue(child, tree));
 
-        for (i = 0,iter = m_elements.begin(); 
-            iter != m_elements.end(); ++iter,i++) {
-            if (i == offset) {
-                m_elements.erase(iter);
-                break; 
+                self->m_elements.push_back(val.get());
+                val.release();
+            }
+        } catch (...) {
+            for (JSONValue *elem : self->m_elements) {
+                Unref(elem);
             }
+            self->m_elements.clear();
+            throw;
         }
+        lazy.Release();
     }
-out:
-    return ret;
 }
 
 
 /**
- * Add specified element at offset 0 in the object or array.
- *
- * @param[in] val the value to insert.
+ * Destroy a value. If the value is an object or array, destroy all of 
+ * its elements, too.
  */
 
-void
-JSONValue::Prepend(JSONValue *val)
+JSONValue::~JSONValue()
 {
-    m_elements.push_front(val);
+    DeleteElements();
 }
 
 
 /**
- * Add the specified element to the end of the object or array.
+ * Allocate a value from the current allocator, counting it in the live
+ * memory of the library (see JSONMemory).
+ *
+ * @param[in] size the size of the value.
  *
- * @param[in] val the value to insert.
+ * @return the memory.
  */
 
-void
-JSONValue::Append(JSONValue *val)
+void *
+JSONValue::operator new(size_t size)
 {
-    m_elements.push_back(val);
+    return JSONMemory::Allocate(size, JsonMemoryCategory_Nodes);
 }
 
 
 /**
- * Default implementation of ToJSON (derived classes should override).
+ * Free a value, giving it back to the allocator it came from.
  *
- * @param[in] str current value of JSON object in JSON format.
- * 
- * @return str + "Not implemented"
- */
-
-std::string &
-JSONValue::ToJSON(std::string &str)
-{       
-    str += "Not Implemented";
-    return str;
-}
-
-
-/**
- * Destroy a value. If the value is an object or array, destroy all of 
- * its elements, too.
+ * @param[in] p the memory.
+ * @param[in] size the size of the value.
  */
 
-JSONValue::~JSONValue()
+void
+JSONValue::operator delete(void *p, size_t size)
 {
-    std::list<JSONValue *>::iterator iter;
-
-    for (iter = m_elements.begin(); iter != m_elements.end(); ++iter) {
-        delete *iter;
-    }
-    m_elements.clear();
+    JSONMemory::Free(p, size, JsonMemoryCategory_Nodes);
 }
 
 
@@ -832,13 +3431,16 @@ JSONValue::~JSONValue()
  * Convert an internal JsonNode to a api JSONValue object.
  *
  * @param[in] node the internal node to convert.
+ * @param[in] tree the lazy tree node belongs to, if the elements of 
+ *            objects and arrays are to be converted on first access, 
+ *            see JSONValue::Materialize(), or NULL.
  * 
  * @return on success, pointer to a JSONValue object (caller must delete)
  *         on failure, NULL.
  */
 
 JSONValue *
-JSONAPI::ToJsonValue(JsonNode *node)
+JSONAPI::ToJsonValue(JsonNode *node, JsonLazyTree *tree)
 {
     JsonType type = node->GetType();
     JSONValue *val = (JSONValue *) NULL;
@@ -846,34 +3448,40 @@ JSONAPI::ToJsonValue(JsonNode *node)
     switch(type) {
     case JsonType_Object:
         {
-        JSONObject *jsonobj = new JSONObject();
-        std::list<JsonNode *> children = node->GetChildren();
-        std::list<JsonNode *>::iterator iter;
+        std::unique_ptr<JSONObject> jsonobj(new JSONObject());
 
-        for (iter = children.begin(); iter != children.end(); ++iter) {
-            jsonobj->Append(ToJsonValue(*iter));
+        if (tree && node->GetNumChildren() > 0) {
+            jsonobj->m_lazy.store(new JsonLazyNode(tree, node), 
+                std::memory_order_relaxed);
+        } else {
+            for (JsonNode *child : *node) {
+                jsonobj->Append(ToJsonValue(child));
+            }
         }
-        val = static_cast<JSONValue *>(jsonobj);
+        val = static_cast<JSONValue *>(jsonobj.release());
         }
         break;
     case JsonType_Array:
         {
-        JSONArray *jsonarray = new JSONArray();
-        std::list<JsonNode *> children = node->GetChildren();
-        std::list<JsonNode *>::iterator iter;
+        std::unique_ptr<JSONArray> jsonarray(new JSONArray());
 
-        for (iter = children.begin(); iter != children.end(); ++iter) {
-            jsonarray->Append(ToJsonValue(*iter));
+        if (tree && node->GetNumChildren() > 0) {
+            jsonarray->m_lazy.store(new JsonLazyNode(tree, node), 
+                std::memory_order_relaxed);
+        } else {
+            for (JsonNode *child : *node) {
+                jsonarray->Append(ToJsonValue(child));
+            }
         }
-        val = static_cast<JSONValue *>(jsonarray);
+        val = static_cast<JSONValue *>(jsonarray.release());
         }
         break;
     case JsonType_String:
         {
-        std::string str;
+        JsonStr str;
         JSONString *jsonstr = new JSONString();
         static_cast<JsonValue *>(node)->GetValue(str);
-        jsonstr->Set(str);
+        jsonstr->Set(std::move(str));
         val = static_cast<JSONValue *>(jsonstr);
         }
         break;
@@ -907,13 +3515,13 @@ JSONAPI::ToJsonValue(JsonNode *node)
     case JsonType_Tuple:
         {
         JsonTuple *tval = static_cast<JsonTuple *>(node);
-        JSONTuple *jsontuple = new JSONTuple();
-        std::string key;
+        std::unique_ptr<JSONTuple> jsontuple(new JSONTuple());
+        JsonStr key;
 
-        key = tval->GetKey();
-        jsontuple->SetKey(key);
-        jsontuple->SetValue(ToJsonValue(tval->GetKeyValue()));
-        val = static_cast<JSONValue *>(jsontuple);
+        tval->GetKey(key);
+        jsontuple->SetKey(std::move(key));
+        jsontuple->SetValue(ToJsonValue(tval->GetKeyValue(), tree));
+        val = static_cast<JSONValue *>(jsontuple.release());
         }
         break;
     case JsonType_Null:
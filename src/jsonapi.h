@@ -52,6 +52,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "jsonobj.h"
 #include "jsonparse.h"
+#include "jsonshape.h"
+#include <atomic>
+#include <iterator>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 /**
  * public classes for accessing values of JSON objects and arrays.
@@ -59,6 +69,128 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 
 class JSONValue;
+class JsonLazyNode;
+class JsonLazyTree;
+
+typedef std::list<JSONValue *, JsonCountingAllocator<JSONValue *> > 
+    JsonElementList;
+
+/**
+ * Bidirectional iterator over the children of a JSONValue: the elements
+ * of an array, the tuples of an object, the values of a record. See 
+ * JSONValue::begin(). V is JSONValue for an iterator, const JSONValue for
+ * a const_iterator.
+ */
+
+template<typename V, typename I>
+class JSONValueIterator
+{
+public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef V *value_type;
+    typedef ptrdiff_t difference_type;
+    typedef V **pointer;
+    typedef V *reference;
+
+    JSONValueIterator() {}
+    explicit JSONValueIterator(I iter) : m_iter(iter) {}
+    template<typename W, typename J>
+    JSONValueIterator(const JSONValueIterator<W, J> &other) : m_iter(other.GetBase()) {}
+    V *operator*() const {return *m_iter;}
+    JSONValueIterator &operator++() {++m_iter; return *this;}
+    JSONValueIterator operator++(int) {JSONValueIterator ret(*this); ++m_iter; return ret;}
+    JSONValueIterator &operator--() {--m_iter; return *this;}
+    JSONValueIterator operator--(int) {JSONValueIterator ret(*this); --m_iter; return ret;}
+    bool operator==(const JSONValueIterator &other) const {return m_iter == other.m_iter;}
+    bool operator!=(const JSONValueIterator &other) const {return m_iter != other.m_iter;}
+    I GetBase() const {return m_iter;}
+private:
+    I m_iter;
+};
+
+/**
+ * A key and its value, as visited by JSONValue::Members(). The key is as 
+ * stored, see JSONTuple::GetKeyView(), and is valid as long as the 
+ * object it came from. The value is NULL for a tuple without a value.
+ */
+
+template<typename V>
+struct JSONMember
+{
+    std::string_view key;
+    V *value;
+};
+
+/**
+ * Bidirectional iterator over the members of an object or a record. See
+ * JSONValue::Members().
+ */
+
+template<typename V, typename I>
+class JSONMemberIterator
+{
+public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef JSONMember<V> value_type;
+    typedef ptrdiff_t difference_type;
+    typedef JSONMember<V> *pointer;
+    typedef JSONMember<V> reference;
+
+    JSONMemberIterator() : m_shape(NULL), m_index(0) {}
+    JSONMemberIterator(I iter, const JSONShape *shape, size_t index) : 
+        m_iter(iter), m_shape(shape), m_index(index) {}
+    JSONMember<V> operator*() const;
+    JSONMemberIterator &operator++() {++m_iter; m_index++; return *this;}
+    JSONMemberIterator operator++(int) {JSONMemberIterator ret(*this); ++*this; return ret;}
+    JSONMemberIterator &operator--() {--m_iter; m_index--; return *this;}
+    JSONMemberIterator operator--(int) {JSONMemberIterator ret(*this); --*this; return ret;}
+    bool operator==(const JSONMemberIterator &other) const {return m_iter == other.m_iter;}
+    bool operator!=(const JSONMemberIterator &other) const {return m_iter != other.m_iter;}
+private:
+    I m_iter;
+    const JSONShape *m_shape;   // of a record, NULL for an object
+    size_t m_index;             // of the key in m_shape
+};
+
+/**
+ * A pair of member iterators, for use with range-based for.
+ */
+
+template<typename V, typename I>
+class JSONMemberRange
+{
+public:
+    JSONMemberRange(JSONMemberIterator<V, I> begin, JSONMemberIterator<V, I> end) :
+        m_begin(begin), m_end(end) {}
+    JSONMemberIterator<V, I> begin() const {return m_begin;}
+    JSONMemberIterator<V, I> end() const {return m_end;}
+private:
+    JSONMemberIterator<V, I> m_begin;
+    JSONMemberIterator<V, I> m_end;
+};
+
+/**
+ * A run of values stored contiguously, such as the numbers of a 
+ * JSONPackedArray. Like std::string_view, it refers to storage it does 
+ * not own.
+ */
+
+template<typename T>
+class JSONSpan
+{
+public:
+    JSONSpan() : m_data(NULL), m_size(0) {}
+    JSONSpan(T *data, size_t size) : m_data(data), m_size(size) {}
+    T *data() const {return m_data;}
+    size_t size() const {return m_size;}
+    bool empty() const {return m_size == 0;}
+    T &operator[](size_t index) const {return m_data[index];}
+    T *begin() const {return m_data;}
+    T *end() const {return m_data + m_size;}
+private:
+    T *m_data;
+    size_t m_size;
+};
 
 /**
  * Singleton class that allows an application to get a JSONValue after 
@@ -74,32 +206,135 @@ public:
 private:
     JSONAPI(JSONAPI const&) {};
     JSONAPI& operator=(JSONAPI const&); 
-    JSONValue *ToJsonValue(JsonNode *);
+    friend class JSONValue;
+    JSONValue *ToJsonValue(JsonNode *, JsonLazyTree *tree = NULL);
     JSONAPI() {};
 };
 
 
 /**
  * Base class for all JSON objects exposed by the API.
+ *
+ * Values are reference counted so that subtrees can be shared between
+ * documents (see JSONDocument::Clone()). A value that is not shared 
+ * behaves exactly as if it were exclusively owned by its parent. A shared
+ * value must not be modified in place; use GetMutable() (or 
+ * JSONTuple::GetMutableValue()) to get a private copy of it first.
+ *
+ * Equals() and Hash() compare and hash trees structurally, the order of
+ * the tuples in an object does not matter, the order of the elements of
+ * an array does. The hash of a shared value is cached, since a shared 
+ * value cannot change, so comparing documents cloned from a common 
+ * ancestor costs little more than comparing the parts that differ.
+ *
+ * The const getters, and the std::string_view accessors 
+ * (JSONTuple::GetKeyView(), JSONString::GetView()), read the tree without
+ * allocating or copying anything. A view refers to the storage of the 
+ * value it came from, and is valid until that value is modified or 
+ * destroyed, which for a value in a JSONDocument means for as long as 
+ * the document (or a clone of it) holds the tree.
+ *
+ * Arrays are best built in bulk: Append() a range of values, or of 
+ * numbers, strings and booleans that are made into values (see 
+ * MakeValue()), or Emplace() each element, which makes it in the array 
+ * and returns it; JSONObject::EmplaceMember() does the same for the 
+ * members of an object. For a large array of numbers, a JSONPackedArray
+ * can be sized up front with Reserve(), and filled from a span.
+ *
+ * Children are best visited with iterators, which work with range-based
+ * for: begin() and end() visit the elements of an array, the tuples of 
+ * an object or the values of a record, and Members() the keys and values
+ * of an object or a record. Get() walks the children from the first one,
+ * so a loop calling Get() for each index is quadratic. Like Get(), 
+ * iterators do not unshare (see GetMutable()), and an iterator is 
+ * invalidated when the child it is at is removed.
+ *
+ * An object or array returned by a lazy parse (see JsonParse::SetLazy())
+ * converts its elements from the internal tree of the parse when it is 
+ * first looked into, by any getter, iterator or modifier, or by Equals(),
+ * Hash() or a copy. Its elements that are objects or arrays are again 
+ * converted only when they are looked into. This is safe to do from many
+ * threads at once, as reading any other value is.
  */
 
 class JSONValue
 {
 public:
+    typedef JSONValueIterator<JSONValue, JsonElementList::iterator> iterator;
+    typedef JSONValueIterator<const JSONValue, JsonElementList::const_iterator> 
+        const_iterator;
+    typedef JSONMemberRange<JSONValue, JsonElementList::iterator> MemberRange;
+    typedef JSONMemberRange<const JSONValue, JsonElementList::const_iterator> 
+        ConstMemberRange;
+
+    JSONValue() : m_refs(1), m_hash(0), m_lazy(NULL) {}
+    JSONValue(const JSONValue &) = delete;
+    JSONValue &operator=(const JSONValue &) = delete;
+    JSONValue(JSONValue &&other);
+    JSONValue &operator=(JSONValue &&other);
     virtual ~JSONValue();
-    JsonType GetType() {return m_type;}
-    int GetSize() {return m_elements.size();}
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+    JsonType GetType() const {return m_type;}
+    int GetSize() const {Materialize(); return m_elements.size();}
     JSONValue *Get(int index);
+    const JSONValue *Get(int index) const;
+    iterator begin() {Materialize(); return iterator(m_elements.begin());}
+    iterator end() {Materialize(); return iterator(m_elements.end());}
+    const_iterator begin() const {Materialize(); return const_iterator(m_elements.begin());}
+    const_iterator end() const {Materialize(); return const_iterator(m_elements.end());}
+    MemberRange Members();
+    ConstMemberRange Members() const;
     bool Set(int index, JSONValue *val);
-    void Append(JSONValue *val);
-    void Prepend(JSONValue *val);
+    bool Set(int index, std::unique_ptr<JSONValue> val);
+    int Append(JSONValue *val);
+    int Append(std::unique_ptr<JSONValue> val);
+    template<typename I> bool Append(I first, I last);
+    template<typename T, typename... Args> T *Emplace(Args &&... args);
+    bool Prepend(JSONValue *val);
+    bool Prepend(std::unique_ptr<JSONValue> val);
     bool Delete(int offset);
     bool Insert(int offset, JSONValue *val);
+    bool Insert(int offset, std::unique_ptr<JSONValue> val);
+    std::unique_ptr<JSONValue> Detach(int offset);
+    JSONValue *GetMutable(int offset);
+    int FindKey(std::string_view key) const;
+    JSONValue *Copy();
+    bool IsShared() const {return m_refs.load(std::memory_order_acquire) > 1;}
+    JSONValue *Ref();
+    static void Unref(JSONValue *val);
+    bool Equals(const JSONValue &other) const;
+    uint64_t Hash() const;
+    JSONMemoryUsage MemoryUsage() const;
     virtual std::string &ToJSON(std::string &str);
+    template<typename T> static JSONValue *MakeValue(const T &val);
 protected:
+    friend class JSONDocument;
+    friend class JSONShapeTable;
+    friend class JSONPackedArray;
+    friend class JSONAPI;
+    friend class JSONObject;
+    virtual JSONValue *CopyNode();
+    virtual bool EqualsNode(const JSONValue &other) const;
+    virtual uint64_t HashNode() const;
+    virtual void AddMemoryUsage(JSONMemoryUsage &usage) const;
+    static JSONValue *Unshare(JSONValue *val);
+    void ShareElements(JSONValue *from);
+    void Materialize() const 
+    {
+        if (m_lazy.load(std::memory_order_acquire)) {
+            MaterializeElements();
+        }
+    }
     JsonType m_type;
 private:
-    std::list<JSONValue *> m_elements; // tuples in the case of JSONObject
+    void DeleteElements();
+    void UnshareTree();
+    void MaterializeElements() const;
+    JsonElementList m_elements; // tuples in the case of JSONObject
+    std::atomic<int> m_refs;
+    mutable std::atomic<uint64_t> m_hash; // 0 if not cached
+    mutable std::atomic<JsonLazyNode *> m_lazy; // NULL once converted
 }; 
 
 
@@ -111,27 +346,108 @@ class JSONTuple : public JSONValue
 {
 public:
     JSONTuple();
-    ~JSONTuple() {delete m_value;}
-    void SetKey(std::string &key) {m_key = key;}
+    JSONTuple(JSONTuple &&other);
+    JSONTuple &operator=(JSONTuple &&other);
+    ~JSONTuple() {Unref(m_value);}
+    void SetKey(const std::string &key) {m_key = key;}
+    void SetKey(const JsonStr &key) {m_key = key;}
+    void SetKey(JsonStr &&key) {m_key = std::move(key);}
     void SetKey(const char *key) {m_key = key;}
-    std::string GetKey() {return m_key;}
+    const JsonStr &GetKey() const {return m_key;}
+    std::string_view GetKeyView() const {return m_key.View();}
     void SetValue(JSONValue *value) {m_value = value;}
+    void SetValue(std::unique_ptr<JSONValue> value);
     JSONValue *GetValue() {return m_value;}
+    const JSONValue *GetValue() const {return m_value;}
+    JSONValue *GetMutableValue();
+    std::unique_ptr<JSONValue> ReleaseValue();
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
+    void AddMemoryUsage(JSONMemoryUsage &usage) const;
 private:
-    std::string m_key;
+    JsonStr m_key;
     JSONValue *m_value;
 };
 
 /**
  * Class to represent a JSON object.
+ *
+ * After SortKeys(), an object keeps its tuples sorted by key (the text
+ * of the key, without its quotes and with its escapes decoded), so that
+ * ToJSON() emits its keys in a canonical order, and FindKey() and Get() look them up by binary search
+ * over an array of the tuples instead of walking them. Tuples added to a 
+ * sorted object go where their key belongs, whatever the offset they are
+ * inserted at; tuples with the same key keep the order they were added 
+ * in. The key of a tuple of a sorted object must not be changed. To 
+ * build a large sorted object, add the tuples first and sort once.
+ * SortAllKeys() sorts every object of a tree, so that equal trees give
+ * the same JSON. Keys are written as they are stored, though, so that 
+ * holds for keys spelled the same way: "\u0063" sorts as "c" does, but 
+ * is not written as "c".
  */
 
 class JSONObject : public JSONValue
 {
 public:
     JSONObject();
+    JSONObject(JSONObject &&other) = default;
+    JSONObject &operator=(JSONObject &&other) = default;
     std::string &ToJSON(std::string &str);
+    void SortKeys();
+    bool IsSorted() const {return m_sorted;}
+    static void SortAllKeys(JSONValue *val);
+    void Reserve(size_t count);
+    template<typename T, typename... Args> 
+    T *EmplaceMember(std::string_view key, Args &&... args);
+protected:
+    JSONValue *CopyNode();
+    void AddMemoryUsage(JSONMemoryUsage &usage) const;
+private:
+    friend class JSONValue;
+    void IndexKeys();
+    int FindSorted(std::string_view key) const;
+    int InsertSorted(JSONValue *tuple);
+    bool m_sorted;
+    bool m_escapedKeys;         // a key of the index may have escapes
+    std::vector<JSONValue *, JsonCountingAllocator<JSONValue *> > m_index; // the tuples, if sorted
+};
+
+
+/**
+ * Class to represent a JSON object whose keys are those of a shape (see 
+ * JSONShape). A record stores only its values, in the order of the keys
+ * of the shape, instead of a tuple for each key, so that the many objects
+ * of an array of records take a fraction of the memory. Records are made
+ * by JSONShapeTable::Compact(), and by the parser, see 
+ * JsonParse::SetShapes().
+ *
+ * Get() returns the value for a key, not a tuple; GetKey() the key. The
+ * keys of a record do not change: Append() its values when making it, 
+ * one for each key of its shape, then change them with Set() and 
+ * GetMutable() only. ToObject() makes an object that can be changed 
+ * freely. A record equals the object with the same keys and values.
+ */
+
+class JSONRecord : public JSONValue
+{
+public:
+    explicit JSONRecord(JSONShape *shape);
+    ~JSONRecord() {JSONShape::Unref(m_shape);}
+    const JSONShape *GetShape() const {return m_shape;}
+    const JsonStr &GetKey(int index) const {return m_shape->GetKey(index);}
+    std::string_view GetKeyView(int index) const {return m_shape->GetKey(index).View();}
+    JSONObject *ToObject();
+    bool EqualsObject(const JSONValue &obj) const;
+    std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
+private:
+    JSONShape *m_shape;
 };
 
 
@@ -143,7 +459,60 @@ class JSONArray : public JSONValue
 {
 public:
     JSONArray();
+    JSONArray(JSONArray &&other) = default;
+    JSONArray &operator=(JSONArray &&other) = default;
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+};
+
+
+/**
+ * Class to represent a JSON array whose elements are all integers, or 
+ * all doubles, stored packed in a single buffer: 8 bytes an element 
+ * instead of a JSONNumber or JSONDouble and the list element linking it
+ * to the array. Packed arrays are made by Pack(), and by the parser, see
+ * JsonParse::SetPackArrays().
+ *
+ * The elements are not JSONValue objects, so GetSize(), Get() and the 
+ * iterators see none; GetCount() and GetIntegers() or GetDoubles() give
+ * them, the spans refer to the storage of the array. AppendInteger() and
+ * AppendDouble() add an element of the type of the array, 
+ * AppendIntegers() and AppendDoubles() many at once; for anything
+ * else, make a generic array with ToArray() (JSONPatch does so for the 
+ * arrays it modifies). The modifiers of JSONValue, which take a value, 
+ * fail on a packed array rather than add it. A packed array equals, and
+ * hashes as, the array with the same elements.
+ */
+
+class JSONPackedArray : public JSONValue
+{
+public:
+    explicit JSONPackedArray(JsonType elementType = JsonType_Number);
+    JsonType GetElementType() const {return m_elementType;}
+    size_t GetCount() const;
+    JSONSpan<const int64_t> GetIntegers() const;
+    JSONSpan<const double> GetDoubles() const;
+    bool AppendInteger(int64_t val);
+    bool AppendDouble(double val);
+    bool AppendIntegers(JSONSpan<const int64_t> vals);
+    bool AppendDoubles(JSONSpan<const double> vals);
+    void Reserve(size_t count);
+    JSONValue *MakeElement(size_t index) const;
+    JSONArray *ToArray() const;
+    bool EqualsArray(const JSONValue &array) const;
+    std::string &ToJSON(std::string &str);
+    static JSONValue *Pack(JSONValue *val);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
+    void AddMemoryUsage(JSONMemoryUsage &usage) const;
+private:
+    static JSONValue *PackNode(JSONValue *val);
+    JsonType m_elementType;     // JsonType_Number or JsonType_Double
+    std::vector<int64_t, JsonCountingAllocator<int64_t> > m_integers;
+    std::vector<double, JsonCountingAllocator<double> > m_doubles;
 };
 
 /**
@@ -155,33 +524,64 @@ class JSONNumber : public JSONValue
 public:
     JSONNumber();
     JSONNumber(long val);
-    void Set(long val) {m_value = val;}
-    long Get() {return m_value;}
+    JSONNumber(JSONNumber &&other) = default;
+    JSONNumber &operator=(JSONNumber &&other) = default;
+    void Set(long val) {m_value = val; m_unsigned = false;}
+    long Get() const {return m_value;}
+    void SetUnsigned(unsigned long val);
+    unsigned long GetUnsigned() const {return (unsigned long) m_value;}
+    bool IsUnsigned() const {return m_unsigned;}
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
 private:
     long m_value;
+    bool m_unsigned;    // m_value holds an unsigned value > LONG_MAX
 };
 
 /**
  * Class to represent a JSON string.
+ *
+ * A string that needs escaping or UTF-8 conversion when serialized keeps
+ * its serialized form after the first ToJSON(), so serializing it again
+ * is a copy. Set() and SetAsUTF8() discard it.
  */
 
 class JSONString : public JSONValue
 {
 public:
-    JSONString() {m_type = JsonType_String;}
-    JSONString(std::string &str);
+    JSONString() : m_wire(NULL) {m_type = JsonType_String;}
+    JSONString(const std::string &str);
+    JSONString(JsonStr &&str);
     JSONString(const char *str);
-    void Set(std::string &str) {m_value = str;}
-    void Set(const char *str) {m_value = str;}
-    std::string Get() {return ProcessEscapes(m_value);}
+    JSONString(JSONString &&other);
+    JSONString &operator=(JSONString &&other);
+    ~JSONString() {ClearWire();}
+    void Set(const std::string &str) {ClearWire(); m_value = str;}
+    void Set(const JsonStr &str) {ClearWire(); m_value = str;}
+    void Set(JsonStr &&str) {ClearWire(); m_value = std::move(str);}
+    void Set(const char *str) {ClearWire(); m_value = str;}
+    std::string Get() const {return ProcessEscapes(m_value);}
+    const JsonStr &GetStr() const {return m_value;}
+    std::string_view GetView() const {return m_value.View();}
     bool SetAsUTF8(const char *str);
     char *GetAsUTF8();
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
+    void AddMemoryUsage(JSONMemoryUsage &usage) const;
 private:
     char *ConvertUTF8Multibyte();
-    std::string ProcessEscapes(std::string &s);
-    std::string m_value;
+    static std::string ProcessEscapes(const JsonStr &s);
+    const char *GetWire(size_t &len);
+    void ClearWire();
+    JsonStr m_value;
+    std::atomic<char *> m_wire;     // the serialized form, if it has been
+                                    // made, see GetWire()
 };
 
 
@@ -194,9 +594,15 @@ class JSONDouble : public JSONValue
 public:
     JSONDouble();
     JSONDouble(double val);
+    JSONDouble(JSONDouble &&other) = default;
+    JSONDouble &operator=(JSONDouble &&other) = default;
     void Set(double val) {m_value = val;}
-    double Get() {return m_value;}
+    double Get() const {return m_value;}
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
 private:
     double m_value;
 };
@@ -210,9 +616,15 @@ class JSONBoolean : public JSONValue
 public:
     JSONBoolean();
     JSONBoolean(bool val);
+    JSONBoolean(JSONBoolean &&other) = default;
+    JSONBoolean &operator=(JSONBoolean &&other) = default;
     void Set(bool val) {m_value = val;}
-    bool Get() {return m_value;}
+    bool Get() const {return m_value;}
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
 private:
     bool m_value;
 };
@@ -225,9 +637,151 @@ class JSONNull : public JSONValue
 {
 public:
     JSONNull();
-    long Get() {return 0L;}
+    JSONNull(JSONNull &&other) = default;
+    JSONNull &operator=(JSONNull &&other) = default;
+    long Get() const {return 0L;}
     std::string &ToJSON(std::string &str);
+protected:
+    JSONValue *CopyNode();
+    bool EqualsNode(const JSONValue &other) const;
+    uint64_t HashNode() const;
 private:
 };
 
+
+/**
+ * Get the member the iterator is at.
+ *
+ * @return the key and the value.
+ */
+
+template<typename V, typename I>
+JSONMember<V>
+JSONMemberIterator<V, I>::operator*() const
+{
+    JSONMember<V> ret;
+
+    if (m_shape) {
+        ret.key = m_shape->GetKey(m_index).View();
+        ret.value = *m_iter;
+    } else {
+        ret.key = static_cast<JSONTuple *>(*m_iter)->GetKeyView();
+        ret.value = static_cast<JSONTuple *>(*m_iter)->GetValue();
+    }
+    return ret;
+}
+
+
+/**
+ * Make a value of a number, string or boolean: a JSONNumber of an 
+ * integer, a JSONDouble of a floating point number, a JSONBoolean of a
+ * bool, a JSONString of anything convertible to std::string_view, and a
+ * JSONNull of nullptr. A JSONValue pointer is returned as is.
+ *
+ * @param[in] val the number, string or boolean.
+ *
+ * @return the value (caller must delete).
+ */
+
+template<typename T>
+JSONValue *
+JSONValue::MakeValue(const T &val)
+{
+    if constexpr (std::is_convertible<T, JSONValue *>::value) {
+        return val;
+    } else if constexpr (std::is_same<T, bool>::value) {
+        return new JSONBoolean(val);
+    } else if constexpr (std::is_integral<T>::value && 
+        std::is_unsigned<T>::value) {
+        JSONNumber *num = new JSONNumber();
+
+        num->SetUnsigned(val);
+        return num;
+    } else if constexpr (std::is_integral<T>::value) {
+        return new JSONNumber((long) val);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        return new JSONDouble(val);
+    } else if constexpr (std::is_same<T, std::nullptr_t>::value) {
+        return new JSONNull();
+    } else {
+        std::string_view str(val);
+
+        return new JSONString(JsonStr(str.data(), str.size()));
+    }
+}
+
+
+/**
+ * Add a value for each element of a range to the end of an array (see 
+ * MakeValue()), or the tuples of a range to an object.
+ *
+ * @param[in] first the first element.
+ * @param[in] last the end of the range.
+ *
+ * @return true on success, false if the values were refused (by a 
+ *         JSONPackedArray), and destroyed.
+ */
+
+template<typename I>
+bool
+JSONValue::Append(I first, I last)
+{
+    typedef typename std::iterator_traits<I>::value_type T;
+    bool ret = true;
+
+    for (; first != last; ++first) {
+        if (Append(std::unique_ptr<JSONValue>(MakeValue<T>(*first))) < 0) {
+            ret = false;
+        }
+    }
+    return ret;
+}
+
+
+/**
+ * Make an element at the end of an array.
+ *
+ * @param[in] args the arguments of the constructor of the element.
+ *
+ * @return the element, owned by the array, or NULL if the array is a 
+ *         JSONPackedArray, which takes no JSONValue elements.
+ */
+
+template<typename T, typename... Args>
+T *
+JSONValue::Emplace(Args &&... args)
+{
+    T *val;
+
+    if (m_type == JsonType_PackedArray) {
+        return NULL;
+    }
+    val = new T(std::forward<Args>(args)...);
+    Append(val);
+    return val;
+}
+
+
+/**
+ * Make a member of an object: a tuple with the key and a new value.
+ *
+ * @param[in] key the key.
+ * @param[in] args the arguments of the constructor of the value.
+ *
+ * @return the value, owned by the object.
+ */
+
+template<typename T, typename... Args>
+T *
+JSONObject::EmplaceMember(std::string_view key, Args &&... args)
+{
+    JSONTuple *tuple = new JSONTuple();
+    T *val = new T(std::forward<Args>(args)...);
+
+    tuple->SetKey(JsonStr(key.data(), key.size()));
+    tuple->SetValue(val);
+    Append(tuple);
+    return val;
+}
+
 #endif
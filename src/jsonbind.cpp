@@ -0,0 +1,657 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonbind.h"
+#include <ctype.h>
+
+/**
+ * Skip white space.
+ */
+
+void
+JSONReader::SkipSpace()
+{
+    while (m_p < m_end && (*m_p == ' ' || *m_p == '\n' || *m_p == '\r' || 
+        *m_p == '\t')) {
+        m_p++;
+    }
+}
+
+
+/**
+ * Consume a character, after any white space.
+ *
+ * @param[in] c the character.
+ *
+ * @return true if it was next, false otherwise (nothing is consumed).
+ */
+
+bool
+JSONReader::Expect(char c)
+{
+    SkipSpace();
+    if (m_p < m_end && *m_p == c) {
+        m_p++;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Start reading an object. Its members are then read with NextKey().
+ *
+ * @return true if an object is next.
+ */
+
+bool
+JSONReader::BeginObject()
+{
+    m_first = true;
+    return Expect('{');
+}
+
+
+/**
+ * Read the key of the next member of an object, after which its value 
+ * must be read (or skipped).
+ *
+ * @param[out] key the key, without its quotes, and with its escapes 
+ *             decoded.
+ * @param[out] done true if the object ended instead.
+ *
+ * @return true on success, false if the input is not valid.
+ */
+
+bool
+JSONReader::NextKey(std::string_view &key, bool &done)
+{
+    bool first = m_first;
+    const char *start;
+
+    m_first = false;
+    done = Expect('}');
+    if (done) {
+        return true;
+    }
+    if (!first && !Expect(',')) {
+        return false;
+    }
+    SkipSpace();
+    start = m_p + 1;
+    if (!ScanString(NULL)) {
+        return false;
+    }
+
+    // a key without escapes is returned in place, others are decoded
+
+    key = std::string_view(start, m_p - start - 1);
+    if (key.find('\\') != std::string_view::npos) {
+        m_p = start - 1;
+        m_key.clear();
+        ScanString(&m_key);
+        key = m_key;
+    }
+    return Expect(':');
+}
+
+
+/**
+ * Start reading an array. Its elements are then read with NextElement().
+ *
+ * @return true if an array is next.
+ */
+
+bool
+JSONReader::BeginArray()
+{
+    m_first = true;
+    return Expect('[');
+}
+
+
+/**
+ * Move to the next element of an array, which must then be read (or 
+ * skipped).
+ *
+ * @param[out] done true if the array ended instead.
+ *
+ * @return true on success, false if the input is not valid.
+ */
+
+bool
+JSONReader::NextElement(bool &done)
+{
+    bool first = m_first;
+
+    m_first = false;
+    done = Expect(']');
+    return done || first || Expect(',');
+}
+
+
+/**
+ * Scan a string, decoding it if asked to.
+ *
+ * @param[out] out if not NULL, the decoded string is appended to it.
+ *
+ * @return true on success, false if a valid string is not next.
+ */
+
+bool
+JSONReader::ScanString(std::string *out)
+{
+    const char *run;
+    uint32_t code, low;
+    char buf[4];
+    int i;
+
+    if (m_p >= m_end || *m_p != '"') {
+        return false;
+    }
+    run = ++m_p;
+    for (;;) {
+        while (m_p < m_end && *m_p != '"' && *m_p != '\\' && 
+            (unsigned char) *m_p >= 0x20) {
+            m_p++;
+        }
+        if (out) {
+            out->append(run, m_p - run);
+        }
+        if (m_p >= m_end || (unsigned char) *m_p < 0x20) {
+            return false;
+        }
+        if (*m_p++ == '"') {
+            return true;
+        }
+        if (m_p >= m_end) {
+            return false;
+        }
+        switch (*m_p++) {
+        case '"': buf[0] = '"'; break;
+        case '\\': buf[0] = '\\'; break;
+        case '/': buf[0] = '/'; break;
+        case 'b': buf[0] = '\b'; break;
+        case 'f': buf[0] = '\f'; break;
+        case 'n': buf[0] = '\n'; break;
+        case 'r': buf[0] = '\r'; break;
+        case 't': buf[0] = '\t'; break;
+        case 'u':
+            code = 0;
+            for (i = 0; i < 4; i++) {
+                if (m_p >= m_end || !isxdigit((unsigned char) *m_p)) {
+                    return false;
+                }
+                code = code * 16 + (isdigit((unsigned char) *m_p) ? 
+                    *m_p - '0' : (tolower((unsigned char) *m_p) - 'a' + 10));
+                m_p++;
+            }
+
+            // a high surrogate must be followed by a low one
+
+            if (code >= 0xd800 && code <= 0xdbff) {
+                if (m_end - m_p < 6 || m_p[0] != '\\' || m_p[1] != 'u') {
+                    return false;
+                }
+                low = 0;
+                for (i = 2; i < 6; i++) {
+                    if (!isxdigit((unsigned char) m_p[i])) {
+                        return false;
+                    }
+                    low = low * 16 + (isdigit((unsigned char) m_p[i]) ? 
+                        m_p[i] - '0' : (tolower((unsigned char) m_p[i]) - 'a' + 10));
+                }
+                if (low < 0xdc00 || low > 0xdfff) {
+                    return false;
+                }
+                m_p += 6;
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            } else if (code >= 0xdc00 && code <= 0xdfff) {
+                return false;
+            }
+            if (out) {
+                if (code < 0x80) {
+                    *out += (char) code;
+                } else if (code < 0x800) {
+                    *out += (char) (0xc0 | (code >> 6));
+                    *out += (char) (0x80 | (code & 0x3f));
+                } else if (code < 0x10000) {
+                    *out += (char) (0xe0 | (code >> 12));
+                    *out += (char) (0x80 | ((code >> 6) & 0x3f));
+                    *out += (char) (0x80 | (code & 0x3f));
+                } else {
+                    *out += (char) (0xf0 | (code >> 18));
+                    *out += (char) (0x80 | ((code >> 12) & 0x3f));
+                    *out += (char) (0x80 | ((code >> 6) & 0x3f));
+                    *out += (char) (0x80 | (code & 0x3f));
+                }
+            }
+            run = m_p;
+            continue;
+        default:
+            return false;
+        }
+        if (out) {
+            *out += buf[0];
+        }
+        run = m_p;
+    }
+}
+
+
+/**
+ * Read a string.
+ *
+ * @param[out] out the string, with its escapes decoded.
+ *
+ * @return true if a string is next.
+ */
+
+bool
+JSONReader::ReadString(std::string &out)
+{
+    out.clear();
+    SkipSpace();
+    return ScanString(&out);
+}
+
+
+/**
+ * Scan a number, checking that it follows the JSON grammar.
+ *
+ * @param[out] start where the number starts.
+ * @param[out] integer true if it has no fraction and no exponent.
+ *
+ * @return true if a number is next.
+ */
+
+bool
+JSONReader::ScanNumber(const char *&start, bool &integer)
+{
+    const char *p;
+
+    SkipSpace();
+    start = p = m_p;
+    integer = true;
+    if (p < m_end && *p == '-') {
+        p++;
+    }
+    if (p < m_end && *p == '0') {
+        p++;
+    } else if (p < m_end && *p >= '1' && *p <= '9') {
+        while (p < m_end && isdigit((unsigned char) *p)) {
+            p++;
+        }
+    } else {
+        return false;
+    }
+    if (p < m_end && *p == '.') {
+        integer = false;
+        if (++p >= m_end || !isdigit((unsigned char) *p)) {
+            return false;
+        }
+        while (p < m_end && isdigit((unsigned char) *p)) {
+            p++;
+        }
+    }
+    if (p < m_end && (*p == 'e' || *p == 'E')) {
+        integer = false;
+        p++;
+        if (p < m_end && (*p == '+' || *p == '-')) {
+            p++;
+        }
+        if (p >= m_end || !isdigit((unsigned char) *p)) {
+            return false;
+        }
+        while (p < m_end && isdigit((unsigned char) *p)) {
+            p++;
+        }
+    }
+    m_p = p;
+    return true;
+}
+
+
+/**
+ * Read an integer.
+ *
+ * @param[out] val the integer.
+ *
+ * @return true if an integer that fits val is next.
+ */
+
+bool
+JSONReader::ReadInteger(int64_t &val)
+{
+    const char *start = m_p;
+    bool integer;
+
+    if (!ScanNumber(start, integer) || !integer) {
+        return false;
+    }
+    return std::from_chars(start, m_p, val).ec == std::errc();
+}
+
+
+/**
+ * Read an unsigned integer.
+ *
+ * @param[out] val the integer.
+ *
+ * @return true if a non-negative integer that fits val is next.
+ */
+
+bool
+JSONReader::ReadUnsigned(uint64_t &val)
+{
+    const char *start = m_p;
+    bool integer;
+
+    if (!ScanNumber(start, integer) || !integer || *start == '-') {
+        return false;
+    }
+    return std::from_chars(start, m_p, val).ec == std::errc();
+}
+
+
+/**
+ * Read a number, with or without a fraction.
+ *
+ * @param[out] val the number.
+ *
+ * @return true if a number is next.
+ */
+
+bool
+JSONReader::ReadDouble(double &val)
+{
+    const char *start = m_p;
+    bool integer;
+
+    if (!ScanNumber(start, integer)) {
+        return false;
+    }
+    return std::from_chars(start, m_p, val).ec == std::errc();
+}
+
+
+/**
+ * Read a number, as an integer if it is one that fits.
+ *
+ * @param[out] val the number.
+ * @param[out] integer the number, if isInteger.
+ * @param[out] isInteger true if the number is an integer in the range of
+ *             int64_t.
+ *
+ * @return true if a number is next.
+ */
+
+bool
+JSONReader::ReadNumber(double &val, int64_t &integer, bool &isInteger)
+{
+    const char *start = m_p;
+
+    if (!ScanNumber(start, isInteger)) {
+        return false;
+    }
+    if (isInteger && std::from_chars(start, m_p, integer).ec == std::errc()) {
+        val = (double) integer;
+        return true;
+    }
+    isInteger = false;
+    return std::from_chars(start, m_p, val).ec == std::errc();
+}
+
+
+/**
+ * Read true or false.
+ *
+ * @param[out] val the value.
+ *
+ * @return true if a boolean is next.
+ */
+
+bool
+JSONReader::ReadBoolean(bool &val)
+{
+    SkipSpace();
+    if (m_end - m_p >= 4 && memcmp(m_p, "true", 4) == 0) {
+        m_p += 4;
+        val = true;
+        return true;
+    }
+    if (m_end - m_p >= 5 && memcmp(m_p, "false", 5) == 0) {
+        m_p += 5;
+        val = false;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Read null, if it is next.
+ *
+ * @return true if it was, false otherwise (nothing is consumed).
+ */
+
+bool
+JSONReader::ReadNull()
+{
+    SkipSpace();
+    if (m_end - m_p >= 4 && memcmp(m_p, "null", 4) == 0) {
+        m_p += 4;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * Skip the next value, whatever it is, checking that it is valid.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONReader::Skip()
+{
+    std::string_view key;
+    const char *start;
+    bool integer, done, val;
+    bool ret = false;
+
+    SkipSpace();
+    if (m_p >= m_end || ++m_depth > MaxDepth) {
+        goto out;
+    }
+    switch (*m_p) {
+    case '{':
+        BeginObject();
+        for (;;) {
+            if (!NextKey(key, done)) {
+                goto out;
+            }
+            if (done) {
+                break;
+            }
+            if (!Skip()) {
+                goto out;
+            }
+        }
+        ret = true;
+        break;
+    case '[':
+        BeginArray();
+        for (;;) {
+            if (!NextElement(done)) {
+                goto out;
+            }
+            if (done) {
+                break;
+            }
+            if (!Skip()) {
+                goto out;
+            }
+        }
+        ret = true;
+        break;
+    case '"':
+        ret = ScanString(NULL);
+        break;
+    case 't':
+    case 'f':
+        ret = ReadBoolean(val);
+        break;
+    case 'n':
+        ret = ReadNull();
+        break;
+    default:
+        ret = ScanNumber(start, integer);
+        break;
+    }
+out:
+    m_depth--;
+    return ret;
+}
+
+
+/**
+ * Check that nothing but white space is left.
+ *
+ * @return true if so.
+ */
+
+bool
+JSONReader::AtEnd()
+{
+    SkipSpace();
+    return m_p == m_end;
+}
+
+
+/**
+ * Get the next character that is not white space, without consuming it.
+ *
+ * @return the character, or 0 at the end of the input.
+ */
+
+char
+JSONReader::Peek()
+{
+    SkipSpace();
+    return m_p < m_end ? *m_p : 0;
+}
+
+
+/**
+ * Append a string as JSON: quoted, with quotes, backslashes and control 
+ * characters escaped. Other characters, including UTF-8 sequences, are 
+ * copied as they are.
+ *
+ * @param[in] str the string.
+ * @param[in] out the string the text is appended to.
+ */
+
+void
+JSONBind::EncodeString(std::string_view str, std::string &out)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+    size_t i;
+
+    out += '"';
+    for (i = 0; i < str.size(); i++) {
+        unsigned char c = str[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(str.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        default:
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xf];
+            break;
+        }
+    }
+    out.append(str.data() + run, i - run);
+    out += '"';
+}
+
+
+/**
+ * Append a floating point number as JSON, in the shortest form that 
+ * reads back as the same number. JSON has no infinity or NaN, those are
+ * written as null.
+ *
+ * @param[in] val the number.
+ * @param[in] out the string the text is appended to.
+ */
+
+void
+JSONBind::EncodeDouble(double val, std::string &out)
+{
+    char buf[32];
+
+    if (val != val || val - val != 0) {
+        out += "null";
+        return;
+    }
+    out.append(buf, std::to_chars(buf, buf + sizeof(buf), val).ptr - buf);
+}
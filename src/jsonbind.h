@@ -0,0 +1,476 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONBIND_H__)
+#define __JSONBIND_H__
+
+#include <charconv>
+#include <limits>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+/**
+ * The fields of a struct, for JSONBind. A struct is bound by declaring 
+ * its fields once, at namespace scope:
+ *
+ *     struct Telemetry {
+ *         std::string device;
+ *         long seq;
+ *         std::vector<int> samples;
+ *     };
+ *
+ *     JSON_BIND_BEGIN(Telemetry)
+ *         JSON_BIND_FIELD(device)
+ *         JSON_BIND_FIELD(seq)
+ *         JSON_BIND_FIELD(samples)
+ *     JSON_BIND_END()
+ *
+ * which specializes JSONBinding for the struct. Visit() calls the 
+ * visitor with the name of each field, its length and the field, in 
+ * order, until the visitor returns false.
+ */
+
+template<typename T>
+struct JSONBinding
+{
+    static const bool Bound = false;
+};
+
+#define JSON_BIND_BEGIN(type) \
+    template<> \
+    struct JSONBinding<type> \
+    { \
+        static const bool Bound = true; \
+        template<typename O, typename V> \
+        static bool Visit(O &obj, V &visitor) \
+        { \
+            return true
+
+#define JSON_BIND_FIELD(name) \
+            && visitor(#name, sizeof(#name) - 1, obj.name)
+
+#define JSON_BIND_END() \
+            ; \
+        } \
+    };
+
+/**
+ * A pull parser reading JSON text a token at a time, straight from the 
+ * caller's buffer. It builds nothing: strings are decoded into the 
+ * caller's std::string, keys are returned as views of the buffer (or, 
+ * if they have escapes, of a scratch string valid until the next key).
+ * Used by JSONBind and JSONSchema; each method returns false if the 
+ * input is not what was asked for, or is not valid JSON.
+ */
+
+class JSONReader
+{
+public:
+    JSONReader(const char *buf, size_t len) : 
+        m_p(buf), m_end(buf + len), m_first(false), m_depth(0) {}
+    bool BeginObject();
+    bool NextKey(std::string_view &key, bool &done);
+    bool BeginArray();
+    bool NextElement(bool &done);
+    bool ReadString(std::string &out);
+    bool ReadInteger(int64_t &val);
+    bool ReadUnsigned(uint64_t &val);
+    bool ReadDouble(double &val);
+    bool ReadNumber(double &val, int64_t &integer, bool &isInteger);
+    bool ReadBoolean(bool &val);
+    bool ReadNull();
+    bool Skip();
+    bool AtEnd();
+    char Peek();
+private:
+    static const int MaxDepth = 512;
+    void SkipSpace();
+    bool Expect(char c);
+    bool ScanNumber(const char *&start, bool &integer);
+    bool ScanString(std::string *out);
+    const char *m_p;
+    const char *m_end;
+    bool m_first;           // no member or element read yet
+    int m_depth;            // of nested values being skipped
+    std::string m_key;      // scratch for keys with escapes
+};
+
+/**
+ * Conversion between JSON text and C++ types, without a JSONValue tree. 
+ * Decode() parses straight into a struct bound with JSON_BIND_BEGIN(), 
+ * Encode() writes one as JSON text.
+ *
+ * Fields may be bool, integers, floating point numbers, std::string, 
+ * bound structs, and std::vector or std::optional of these. Decode() 
+ * skips unknown members, leaves fields without a member as they were, 
+ * and fails on a value that does not fit its field (a string for a 
+ * number, a number out of the range of an integer field, and so on); 
+ * null is only accepted for a std::optional, which it resets. Encode()
+ * omits an empty std::optional. Strings are UTF-8, and are escaped only
+ * where JSON requires it.
+ */
+
+class JSONBind
+{
+public:
+    template<typename T>
+    static bool Decode(const char *buf, size_t len, T &obj);
+    template<typename T>
+    static bool Decode(const std::string &str, T &obj) 
+        {return Decode(str.data(), str.size(), obj);}
+    template<typename T>
+    static std::string &Encode(const T &obj, std::string &out);
+    static void EncodeString(std::string_view str, std::string &out);
+    static void EncodeDouble(double val, std::string &out);
+private:
+    template<typename T> struct IsVector : std::false_type {};
+    template<typename T, typename A> 
+    struct IsVector<std::vector<T, A>> : std::true_type {};
+    template<typename T> struct IsOptional : std::false_type {};
+    template<typename T> struct IsOptional<std::optional<T>> : std::true_type {};
+
+    /**
+     * Visitor decoding the value of a member into the field of the same 
+     * name. With a hint, only the field at that index is tried.
+     */
+
+    class FieldReader
+    {
+    public:
+        FieldReader(JSONReader &reader, std::string_view key, size_t hint) :
+            m_reader(reader), m_key(key), m_hint(hint), m_count(0), 
+            m_found(false), m_ok(false) {}
+        template<typename F>
+        bool operator()(const char *name, size_t len, F &field)
+        {
+            size_t index = m_count++;
+
+            if ((m_hint == NoHint || index == m_hint) && len == m_key.size() &&
+                memcmp(name, m_key.data(), len) == 0) {
+                m_ok = ReadValue(m_reader, field);
+                m_found = true;
+                m_hint = index;
+                return false;
+            }
+            return true;
+        }
+        static const size_t NoHint = (size_t) -1;
+        JSONReader &m_reader;
+        std::string_view m_key;
+        size_t m_hint;      // index of the field, once found
+        size_t m_count;
+        bool m_found;
+        bool m_ok;
+    };
+
+    /**
+     * Visitor writing each field as a member.
+     */
+
+    class FieldWriter
+    {
+    public:
+        FieldWriter(std::string &out) : m_out(out), m_first(true) {}
+        template<typename F>
+        bool operator()(const char *name, size_t len, const F &field)
+        {
+            if constexpr (IsOptional<F>::value) {
+                if (!field) {
+                    return true;
+                }
+            }
+            if (!m_first) {
+                m_out += ",";
+            }
+            m_first = false;
+            m_out += "\"";
+            m_out.append(name, len);
+            m_out += "\": ";
+            WriteValue(m_out, field);
+            return true;
+        }
+        std::string &m_out;
+        bool m_first;
+    };
+
+    template<typename T>
+    static bool ReadValue(JSONReader &reader, T &val);
+    template<typename T>
+    static bool ReadObject(JSONReader &reader, T &obj);
+    template<typename T>
+    static void WriteValue(std::string &out, const T &val);
+};
+
+
+/**
+ * Decode JSON text into a bound struct. The text must hold one object, 
+ * and nothing else but white space.
+ *
+ * @param[in] buf the text, need not be NUL terminated.
+ * @param[in] len its length.
+ * @param[out] obj the struct. On failure, some of its fields may have 
+ *             been set.
+ *
+ * @return true on success, false if the text is not valid JSON or does 
+ *         not fit the struct.
+ */
+
+template<typename T>
+bool
+JSONBind::Decode(const char *buf, size_t len, T &obj)
+{
+    JSONReader reader(buf, len);
+
+    return ReadValue(reader, obj) && reader.AtEnd();
+}
+
+
+/**
+ * Encode a bound struct as JSON text.
+ *
+ * @param[in] obj the struct.
+ * @param[in] out the string the text is appended to.
+ *
+ * @return out.
+ */
+
+template<typename T>
+std::string &
+JSONBind::Encode(const T &obj, std::string &out)
+{
+    WriteValue(out, obj);
+    return out;
+}
+
+
+/**
+ * Decode the next value into a variable of any supported type.
+ *
+ * @param[in] reader the reader.
+ * @param[out] val the variable.
+ *
+ * @return true on success.
+ */
+
+template<typename T>
+bool
+JSONBind::ReadValue(JSONReader &reader, T &val)
+{
+    if constexpr (std::is_same<T, bool>::value) {
+        return reader.ReadBoolean(val);
+    } else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) {
+        int64_t num;
+
+        if (!reader.ReadInteger(num) || num < std::numeric_limits<T>::min() ||
+            num > std::numeric_limits<T>::max()) {
+            return false;
+        }
+        val = (T) num;
+        return true;
+    } else if constexpr (std::is_integral<T>::value) {
+        uint64_t num;
+
+        if (!reader.ReadUnsigned(num) || num > std::numeric_limits<T>::max()) {
+            return false;
+        }
+        val = (T) num;
+        return true;
+    } else if constexpr (std::is_floating_point<T>::value) {
+        double num;
+
+        if (!reader.ReadDouble(num)) {
+            return false;
+        }
+        val = (T) num;
+        return true;
+    } else if constexpr (std::is_same<T, std::string>::value) {
+        return reader.ReadString(val);
+    } else if constexpr (IsOptional<T>::value) {
+        if (reader.ReadNull()) {
+            val.reset();
+            return true;
+        }
+        if (!val) {
+            val.emplace();
+        }
+        return ReadValue(reader, *val);
+    } else if constexpr (IsVector<T>::value) {
+        bool done;
+
+        val.clear();
+        if (!reader.BeginArray()) {
+            return false;
+        }
+        for (;;) {
+            if (!reader.NextElement(done)) {
+                return false;
+            }
+            if (done) {
+                return true;
+            }
+            typename T::value_type elem{};
+
+            if (!ReadValue(reader, elem)) {
+                return false;
+            }
+            val.push_back(std::move(elem));
+        }
+    } else {
+        return ReadObject(reader, val);
+    }
+}
+
+
+/**
+ * Decode an object into a bound struct. Members usually come in the 
+ * order of the fields, so the field after the last one found is tried 
+ * first.
+ *
+ * @param[in] reader the reader.
+ * @param[out] obj the struct.
+ *
+ * @return true on success.
+ */
+
+template<typename T>
+bool
+JSONBind::ReadObject(JSONReader &reader, T &obj)
+{
+    static_assert(JSONBinding<T>::Bound, 
+        "type has no JSON binding, see JSON_BIND_BEGIN()");
+    std::string_view key;
+    size_t next = 0;
+    bool done;
+
+    if (!reader.BeginObject()) {
+        return false;
+    }
+    for (;;) {
+        if (!reader.NextKey(key, done)) {
+            return false;
+        }
+        if (done) {
+            return true;
+        }
+
+        FieldReader field(reader, key, next);
+
+        JSONBinding<T>::Visit(obj, field);
+        if (!field.m_found) {
+            field.m_hint = FieldReader::NoHint;
+            field.m_count = 0;
+            JSONBinding<T>::Visit(obj, field);
+        }
+        if (!field.m_found) {
+            if (!reader.Skip()) {
+                return false;
+            }
+        } else if (!field.m_ok) {
+            return false;
+        } else {
+            next = field.m_hint + 1;
+        }
+    }
+}
+
+
+/**
+ * Encode a variable of any supported type.
+ *
+ * @param[in] out the string the text is appended to.
+ * @param[in] val the variable.
+ */
+
+template<typename T>
+void
+JSONBind::WriteValue(std::string &out, const T &val)
+{
+    if constexpr (std::is_same<T, bool>::value) {
+        out += val ? "true" : "false";
+    } else if constexpr (std::is_integral<T>::value) {
+        char buf[24];
+
+        out.append(buf, std::to_chars(buf, buf + sizeof(buf), val).ptr - buf);
+    } else if constexpr (std::is_floating_point<T>::value) {
+        EncodeDouble(val, out);
+    } else if constexpr (std::is_same<T, std::string>::value) {
+        EncodeString(val, out);
+    } else if constexpr (IsOptional<T>::value) {
+        if (val) {
+            WriteValue(out, *val);
+        } else {
+            out += "null";
+        }
+    } else if constexpr (IsVector<T>::value) {
+        out += "[";
+        for (size_t i = 0; i < val.size(); i++) {
+            if (i) {
+                out += ",";
+            }
+            WriteValue(out, val[i]);
+        }
+        out += "]";
+    } else {
+        static_assert(JSONBinding<T>::Bound, 
+            "type has no JSON binding, see JSON_BIND_BEGIN()");
+        FieldWriter writer(out);
+
+        out += "{";
+        JSONBinding<T>::Visit(val, writer);
+        out += "}";
+    }
+}
+
+#endif
@@ -0,0 +1,318 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsoncache.h"
+#include "jsonparse.h"
+#include <string.h>
+
+/**
+ * Constructor.
+ *
+ * @param[in] budget the number of bytes that the cached documents may 
+ *            use, divided evenly between the shards.
+ * @param[in] shards the number of shards (and locks).
+ */
+
+JSONParseCache::JSONParseCache(size_t budget, int shards) :
+    m_hits(0), m_misses(0), m_evictions(0)
+{
+    if (shards < 1) {
+        shards = 1;
+    }
+    for (int i = 0; i < shards; i++) {
+        m_shards.push_back(std::unique_ptr<JsonCacheShard>(new JsonCacheShard()));
+        m_shards.back()->budget = budget / shards;
+    }
+}
+
+
+/**
+ * Hash the bytes of an input. The input is read a word at a time, into
+ * four independent lanes, so that hashing a large body costs little next 
+ * to parsing it.
+ *
+ * @param[in] input the input.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONParseCache::HashInput(const std::string &input)
+{
+    static const uint64_t k1 = 0xbf58476d1ce4e5b9ULL;
+    static const uint64_t k2 = 0x94d049bb133111ebULL;
+    uint64_t lanes[4] = {k1, k2, ~k1, ~k2};
+    const char *p = input.data();
+    size_t len = input.size();
+    uint64_t h = len;
+    uint64_t word;
+
+    for (; len >= sizeof(lanes); p += sizeof(lanes), len -= sizeof(lanes)) {
+        for (int i = 0; i < 4; i++) {
+            memcpy(&word, p + i * sizeof(word), sizeof(word));
+            lanes[i] ^= word * k1;
+            lanes[i] = ((lanes[i] << 31) | (lanes[i] >> 33)) * k2;
+        }
+    }
+    for (int i = 0; i < 4; i++) {
+        h = (h ^ lanes[i]) * k1;
+    }
+    while (len > 0) {
+        size_t n = len < sizeof(word) ? len : sizeof(word);
+
+        word = 0;
+        memcpy(&word, p, n);
+        h = (h ^ (word * k1)) * k2;
+        h ^= h >> 29;
+        p += n;
+        len -= n;
+    }
+    h ^= h >> 32;
+    h *= k1;
+    h ^= h >> 29;
+    return h;
+}
+
+
+/**
+ * Look up an input in a shard, whose lock must be held, and make it the 
+ * most recently used entry if it is found.
+ *
+ * @param[in] shard the shard.
+ * @param[in] hash the hash of the input.
+ * @param[in] input the input.
+ * @param[out] doc a clone of the cached document, if it is found.
+ *
+ * @return true if the input was found.
+ */
+
+bool
+JSONParseCache::Find(JsonCacheShard &shard, uint64_t hash, 
+    const std::string &input, JSONDocument &doc)
+{
+    auto range = shard.index.equal_range(hash);
+    bool ret = false;
+
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (iter->second->input == input) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+            doc = iter->second->doc;
+            ret = true;
+            break;
+        }
+    }
+    return ret;
+}
+
+
+/**
+ * Get the document parsed from an input, from the cache if it is there,
+ * or by parsing it and adding it to the cache otherwise.
+ *
+ * @param[in] input the input, in JSON format.
+ * @param[out] doc the document, which shares its tree with the cache.
+ *
+ * @return true on success, false if the input could not be parsed (such
+ *         inputs are not cached).
+ */
+
+bool
+JSONParseCache::Get(const std::string &input, JSONDocument &doc)
+{
+    uint64_t hash = HashInput(input);
+    JsonCacheShard &shard = *m_shards[(hash >> 32) % m_shards.size()];
+    bool ret;
+
+    shard.lock.lock();
+    ret = Find(shard, hash, input, doc);
+    shard.lock.unlock();
+    if (ret) {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        ret = Add(shard, hash, input, doc);
+    }
+    return ret;
+}
+
+
+/**
+ * Parse an input that was not found in the cache, and add it to the 
+ * cache, evicting the least recently used entries of the shard to make
+ * room for it.
+ *
+ * @param[in] shard the shard that the input belongs to.
+ * @param[in] hash the hash of the input.
+ * @param[in] input the input, in JSON format.
+ * @param[out] doc the document, which shares its tree with the cache.
+ *
+ * @return true on success, false if the input could not be parsed.
+ */
+
+bool
+JSONParseCache::Add(JsonCacheShard &shard, uint64_t hash, 
+    const std::string &input, JSONDocument &doc)
+{
+    std::list<JsonCacheEntry> evicted;
+    std::string copy(input);
+    JsonCacheEntry entry;
+    JsonParse parser;
+    JSONValue *root;
+    bool ret = false;
+
+    parser.SetDirect(true);
+    parser.SetInput(copy);
+    if (parser.Parse() == false || 
+        (root = JSONAPI::GetValue(&parser)) == NULL) {
+        goto out;
+    }
+    entry.hash = hash;
+    entry.input.swap(copy);
+    entry.doc.SetRoot(root);
+    entry.size = sizeof(JsonCacheEntry) + 
+        JSONMemory::StringSize(entry.input) + 
+        root->MemoryUsage().GetTotal() + 
+        4 * sizeof(void *);  // list and index nodes
+    doc = entry.doc;
+    ret = true;
+    if (entry.size > shard.budget) {
+        goto out;
+    }
+
+    shard.lock.lock();
+
+    // another thread may have added the input while it was being parsed
+
+    if (Find(shard, hash, entry.input, doc) == false) {
+        shard.lru.push_front(std::move(entry));
+        shard.index.insert(std::make_pair(hash, shard.lru.begin()));
+        shard.bytes += shard.lru.front().size;
+        while (shard.bytes > shard.budget) {
+            auto victim = --shard.lru.end();
+            auto range = shard.index.equal_range(victim->hash);
+
+            for (auto iter = range.first; iter != range.second; ++iter) {
+                if (iter->second == victim) {
+                    shard.index.erase(iter);
+                    break;
+                }
+            }
+            shard.bytes -= victim->size;
+            evicted.splice(evicted.end(), shard.lru, victim);
+            m_evictions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    shard.lock.unlock();
+
+    // the evicted entries are freed on return, outside of the lock
+
+out:
+    return ret;
+}
+
+
+/**
+ * Remove every entry from the cache. Documents handed out by Get() are 
+ * not affected.
+ */
+
+void
+JSONParseCache::Clear()
+{
+    for (size_t i = 0; i < m_shards.size(); i++) {
+        std::list<JsonCacheEntry> entries;
+        JsonCacheShard &shard = *m_shards[i];
+
+        shard.lock.lock();
+        entries.swap(shard.lru);
+        shard.index.clear();
+        shard.bytes = 0;
+        shard.lock.unlock();
+    }
+}
+
+
+/**
+ * Get the number of bytes charged to the cached documents.
+ *
+ * @return the number of bytes.
+ */
+
+size_t
+JSONParseCache::GetBytes()
+{
+    size_t bytes = 0;
+
+    for (size_t i = 0; i < m_shards.size(); i++) {
+        std::lock_guard<std::mutex> guard(m_shards[i]->lock);
+
+        bytes += m_shards[i]->bytes;
+    }
+    return bytes;
+}
+
+
+/**
+ * Get the number of cached documents.
+ *
+ * @return the number of documents.
+ */
+
+size_t
+JSONParseCache::GetCount()
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < m_shards.size(); i++) {
+        std::lock_guard<std::mutex> guard(m_shards[i]->lock);
+
+        count += m_shards[i]->lru.size();
+    }
+    return count;
+}
@@ -0,0 +1,136 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONCACHE_H__)
+#define __JSONCACHE_H__
+
+#include "jsondocument.h"
+#include <stdint.h>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A parsed document held by JSONParseCache, along with the input it was 
+ * parsed from, which is compared on lookup, so that inputs with the same 
+ * hash are never confused.
+ */
+
+struct JsonCacheEntry
+{
+    uint64_t hash;
+    std::string input;
+    JSONDocument doc;
+    size_t size;        // bytes charged against the budget
+};
+
+/**
+ * A shard of the cache: entries in least recently used order, and an 
+ * index of them by hash, under a lock of their own.
+ */
+
+struct JsonCacheShard
+{
+    JsonCacheShard() : bytes(0), budget(0) {}
+    std::mutex lock;
+    std::list<JsonCacheEntry> lru;  // most recently used first
+    std::unordered_multimap<uint64_t, std::list<JsonCacheEntry>::iterator>
+        index;
+    size_t bytes;
+    size_t budget;
+};
+
+/**
+ * A cache of parsed documents, keyed by the bytes of their input, for
+ * services that parse the same JSON over and over.
+ *
+ * Get() returns a clone of the cached document (see JSONDocument::Clone()),
+ * which shares the cached tree: it costs a reference count, and a caller
+ * that modifies its clone (through JSONDocument::GetMutableRoot()) copies 
+ * only the nodes it changes, leaving the cached tree as it was.
+ *
+ * Entries are charged the memory of their tree (see 
+ * JSONValue::MemoryUsage()), their input, and their bookkeeping, and the
+ * least recently used entries are evicted to keep the total within the 
+ * budget. The cache is split into shards, chosen by hash, each with its own lock
+ * and its own share of the budget, so that threads looking up different
+ * inputs rarely contend. Parsing is done outside of the lock.
+ */
+
+class JSONParseCache
+{
+public:
+    JSONParseCache(size_t budget, int shards = 16);
+    JSONParseCache(const JSONParseCache &) = delete;
+    JSONParseCache &operator=(const JSONParseCache &) = delete;
+    bool Get(const std::string &input, JSONDocument &doc);
+    void Clear();
+    size_t GetBytes();
+    size_t GetCount();
+    uint64_t GetHits() {return m_hits.load(std::memory_order_relaxed);}
+    uint64_t GetMisses() {return m_misses.load(std::memory_order_relaxed);}
+    uint64_t GetEvictions() 
+        {return m_evictions.load(std::memory_order_relaxed);}
+private:
+    static uint64_t HashInput(const std::string &input);
+    bool Find(JsonCacheShard &shard, uint64_t hash, const std::string &input,
+        JSONDocument &doc);
+    bool Add(JsonCacheShard &shard, uint64_t hash, const std::string &input,
+        JSONDocument &doc);
+    std::vector<std::unique_ptr<JsonCacheShard>> m_shards;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+    std::atomic<uint64_t> m_evictions;
+};
+
+#endif
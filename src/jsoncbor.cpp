@@ -0,0 +1,783 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsoncbor.h"
+#include <float.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Append a big endian integer to a string.
+ *
+ * @param[in] out the string.
+ * @param[in] val the integer.
+ * @param[in] len the number of bytes to append, from 1 to 8.
+ */
+
+static void
+PutBigEndian(std::string &out, uint64_t val, int len)
+{
+    char buf[8];
+
+    for (int i = len - 1; i >= 0; i--) {
+        buf[i] = (char) (val & 0xff);
+        val >>= 8;
+    }
+    out.append(buf, len);
+}
+
+
+/**
+ * Read a big endian integer.
+ *
+ * @param[in] p the bytes.
+ * @param[in] len the number of bytes, from 1 to 8.
+ *
+ * @return the integer.
+ */
+
+static uint64_t
+GetBigEndian(const unsigned char *p, int len)
+{
+    uint64_t val = 0;
+
+    for (int i = 0; i < len; i++) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+
+/**
+ * Append the head of a data item: its major type, and its argument in 
+ * the shortest form that holds it.
+ *
+ * @param[in] out the string.
+ * @param[in] major the major type.
+ * @param[in] val the argument (the value, length or size of the item).
+ */
+
+static void
+PutHead(std::string &out, int major, uint64_t val)
+{
+    major <<= 5;
+    if (val < 24) {
+        out += (char) (major | val);
+    } else if (val <= 0xff) {
+        out += (char) (major | 24);
+        PutBigEndian(out, val, 1);
+    } else if (val <= 0xffff) {
+        out += (char) (major | 25);
+        PutBigEndian(out, val, 2);
+    } else if (val <= 0xffffffffUL) {
+        out += (char) (major | 26);
+        PutBigEndian(out, val, 4);
+    } else {
+        out += (char) (major | 27);
+        PutBigEndian(out, val, 8);
+    }
+}
+
+
+/**
+ * Append a text string, as its text, without the quotes and escapes that
+ * the strings of a parsed document keep.
+ *
+ * @param[in] out the string.
+ * @param[in] str the string to encode.
+ */
+
+static void
+PutText(std::string &out, const JsonStr &str)
+{
+    std::string scratch;
+    std::string_view text = JsonStr::Text(str.View(), scratch);
+
+    PutHead(out, 3, text.size());
+    out.append(text.data(), text.size());
+}
+
+
+/**
+ * Convert a double to half precision, if that can be done exactly.
+ *
+ * @param[in] val the double.
+ * @param[out] half the half precision bits.
+ *
+ * @return true if val is held by a half exactly (or is NaN), false 
+ *         otherwise.
+ */
+
+static bool
+ToHalf(double val, uint16_t *half)
+{
+    uint16_t sign = signbit(val) ? 0x8000 : 0;
+    bool ret = true;
+    double frac;
+    int exp;
+
+    if (isnan(val)) {
+        *half = 0x7e00;
+    } else if (isinf(val)) {
+        *half = sign | 0x7c00;
+    } else if (val == 0) {
+        *half = sign;
+    } else {
+        frac = frexp(fabs(val), &exp);  // fabs(val) = frac * 2^exp
+        exp--;
+        if (exp > 15) {
+            ret = false;
+        } else if (exp >= -14) {
+
+            // normal: 1.mantissa * 2^exp, with a 10 bit mantissa
+
+            frac = (frac * 2 - 1) * 1024;
+            ret = frac == floor(frac);
+            *half = sign | (uint16_t) ((exp + 15) << 10) | (uint16_t) frac;
+        } else {
+
+            // subnormal: mantissa * 2^-24
+
+            frac = fabs(val) * 16777216.0;
+            ret = frac == floor(frac);
+            *half = sign | (uint16_t) frac;
+        }
+    }
+    return ret;
+}
+
+
+/**
+ * Convert half precision bits to a double.
+ *
+ * @param[in] half the bits.
+ *
+ * @return the double.
+ */
+
+static double
+FromHalf(uint16_t half)
+{
+    int exp = (half >> 10) & 0x1f;
+    int mant = half & 0x3ff;
+    double val;
+
+    if (exp == 0) {
+        val = ldexp(mant, -24);
+    } else if (exp != 31) {
+        val = ldexp(mant + 1024, exp - 25);
+    } else {
+        val = mant == 0 ? INFINITY : NAN;
+    }
+    return (half & 0x8000) ? -val : val;
+}
+
+
+/**
+ * Append a double, in the shortest of half, single and double precision
+ * that holds it exactly.
+ *
+ * @param[in] out the string.
+ * @param[in] val the double.
+ */
+
+static void
+PutDouble(std::string &out, double val)
+{
+    uint64_t bits;
+    uint32_t bits32;
+    uint16_t half;
+    float fval;
+
+    if (ToHalf(val, &half)) {
+        out += (char) 0xf9;
+        PutBigEndian(out, half, 2);
+    } else if (fabs(val) <= FLT_MAX && (double) (fval = (float) val) == val) {
+        memcpy(&bits32, &fval, sizeof(bits32));
+        out += (char) 0xfa;
+        PutBigEndian(out, bits32, 4);
+    } else {
+        memcpy(&bits, &val, sizeof(bits));
+        out += (char) 0xfb;
+        PutBigEndian(out, bits, 8);
+    }
+}
+
+
+/**
+ * Append the base64url encoding (RFC 4648, without padding) of some 
+ * bytes to a string.
+ *
+ * @param[in] out the string.
+ * @param[in] p the bytes.
+ * @param[in] len the number of bytes.
+ */
+
+static void
+PutBase64Url(std::string &out, const unsigned char *p, size_t len)
+{
+    static const char alphabet[] = 
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    uint32_t bits;
+
+    for (; len >= 3; p += 3, len -= 3) {
+        bits = (p[0] << 16) | (p[1] << 8) | p[2];
+        out += alphabet[(bits >> 18) & 0x3f];
+        out += alphabet[(bits >> 12) & 0x3f];
+        out += alphabet[(bits >> 6) & 0x3f];
+        out += alphabet[bits & 0x3f];
+    }
+    if (len > 0) {
+        bits = (p[0] << 16) | (len > 1 ? p[1] << 8 : 0);
+        out += alphabet[(bits >> 18) & 0x3f];
+        out += alphabet[(bits >> 12) & 0x3f];
+        if (len > 1) {
+            out += alphabet[(bits >> 6) & 0x3f];
+        }
+    }
+}
+
+
+/**
+ * Encode a value, and everything below it, as CBOR.
+ *
+ * @param[in] val the value.
+ * @param[in] out the string the encoding is appended to.
+ *
+ * @return out.
+ */
+
+std::string &
+JSONCbor::Encode(JSONValue *val, std::string &out)
+{
+    JSONValue::iterator iter;
+    JSONTuple *tuple;
+    JSONNumber *number;
+
+    switch (val->GetType()) {
+    case JsonType_Object:
+    case JsonType_Array:
+        PutHead(out, val->GetType() == JsonType_Object ? 5 : 4, 
+            val->GetSize());
+        for (iter = val->begin(); iter != val->end(); ++iter) {
+            Encode(*iter, out);
+        }
+        break;
+    case JsonType_Record:
+        {
+        JSONRecord *record = static_cast<JSONRecord *>(val);
+        int i = 0;
+
+        PutHead(out, 5, record->GetSize());
+        for (iter = val->begin(); iter != val->end(); ++iter, i++) {
+            PutText(out, record->GetKey(i));
+            Encode(*iter, out);
+        }
+        }
+        break;
+    case JsonType_PackedArray:
+        {
+        JSONPackedArray *array = static_cast<JSONPackedArray *>(val);
+
+        PutHead(out, 4, array->GetCount());
+        for (int64_t number : array->GetIntegers()) {
+            if (number >= 0) {
+                PutHead(out, 0, number);
+            } else {
+                PutHead(out, 1, (uint64_t) (-1 - number));
+            }
+        }
+        for (double number : array->GetDoubles()) {
+            PutDouble(out, number);
+        }
+        }
+        break;
+    case JsonType_Tuple:
+        tuple = static_cast<JSONTuple *>(val);
+        PutText(out, tuple->GetKey());
+        if (tuple->GetValue()) {
+            Encode(tuple->GetValue(), out);
+        } else {
+            out += (char) 0xf6;
+        }
+        break;
+    case JsonType_String:
+        PutText(out, static_cast<JSONString *>(val)->GetStr());
+        break;
+    case JsonType_Number:
+        number = static_cast<JSONNumber *>(val);
+        if (number->IsUnsigned()) {
+            PutHead(out, 0, number->GetUnsigned());
+        } else if (number->Get() >= 0) {
+            PutHead(out, 0, number->Get());
+        } else {
+            PutHead(out, 1, (uint64_t) (-1 - number->Get()));
+        }
+        break;
+    case JsonType_Double:
+        PutDouble(out, static_cast<JSONDouble *>(val)->Get());
+        break;
+    case JsonType_Bool:
+        out += (char) (static_cast<JSONBoolean *>(val)->Get() ? 0xf5 : 0xf4);
+        break;
+    default:
+        out += (char) 0xf6;
+        break;
+    }
+    return out;
+}
+
+
+/**
+ * Decode a CBOR value into a new JSONValue tree.
+ *
+ * @param[in] buf the encoded data.
+ * @param[in] len the number of bytes in buf.
+ * @param[out] val the decoded value (caller must delete), NULL if buf 
+ *             does not hold a complete value.
+ * @param[out] used the number of bytes of buf that were decoded, 0 if buf
+ *             does not hold a complete value.
+ *
+ * @return false if the data is not well-formed CBOR (or cannot be 
+ *         represented by a JSONValue), true otherwise.
+ */
+
+bool
+JSONCbor::Decode(const char *buf, size_t len, JSONValue **val, size_t *used)
+{
+    JSONEventBuilder builder;
+    JSONCborDecoder decoder(&builder);
+    long ret;
+
+    *val = NULL;
+    *used = 0;
+    ret = decoder.Feed(buf, len);
+    if (ret > 0 && decoder.IsComplete()) {
+        *val = builder.ReleaseValue();
+        *used = ret;
+    }
+    return ret >= 0;
+}
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] handler the handler that the decoded values are delivered 
+ *            to.
+ */
+
+JSONCborDecoder::JSONCborDecoder(JSONEventHandler *handler) :
+    m_handler(handler), m_tag(0), m_tagged(false), m_complete(false), 
+    m_error(false)
+{
+}
+
+
+/**
+ * Discard the state of a partially decoded value (or of an error), so 
+ * that decoding can start again with a new value.
+ */
+
+void
+JSONCborDecoder::Reset()
+{
+    m_stack.clear();
+    m_buffer.clear();
+    m_tagged = false;
+    m_complete = false;
+    m_error = false;
+}
+
+
+/**
+ * Decode data, up to the end of the next top-level value.
+ *
+ * @param[in] buf the data.
+ * @param[in] len the number of bytes in buf.
+ *
+ * @return the number of bytes consumed (see the class description), or
+ *         -1 if the data is not well-formed, or a handler returned false.
+ *         Once an error has been returned, it is returned by every call
+ *         until Reset() is called.
+ */
+
+long
+JSONCborDecoder::Feed(const char *buf, size_t len)
+{
+    const unsigned char *start = reinterpret_cast<const unsigned char *>(buf);
+    const unsigned char *p = start;
+    long ret = -1;
+    long n;
+
+    if (m_error) {
+        goto out;
+    }
+    m_complete = false;
+    while (p < start + len && m_complete == false) {
+        n = DecodeItem(p, start + len);
+        if (n < 0) {
+            m_error = true;
+            goto out;
+        }
+        if (n == 0) {
+            break;
+        }
+        p += n;
+    }
+    ret = p - start;
+out:
+    return ret;
+}
+
+
+/**
+ * Is the next item the key of a map?
+ *
+ * @return true if so.
+ */
+
+bool
+JSONCborDecoder::IsKey()
+{
+    return m_stack.empty() == false && m_stack.back().major == 5 && 
+        m_stack.back().count % 2 == 0;
+}
+
+
+/**
+ * Deliver a string, as a key or a value.
+ *
+ * @param[in] major 3 for a text string, 2 for a byte string.
+ * @param[in] negative the byte string is a negative bignum.
+ * @param[in] str the string.
+ * @param[in] len the length of the string.
+ *
+ * @return true on success, false if the string is a byte string used as
+ *         a key, or the handler returned false.
+ */
+
+bool
+JSONCborDecoder::EmitString(int major, bool negative, const char *str, 
+    size_t len)
+{
+    bool ret = false;
+
+    if (major == 2) {
+        if (IsKey()) {
+            goto out;
+        }
+        m_encoded.clear();
+        if (negative) {
+            m_encoded += '~';
+        }
+        PutBase64Url(m_encoded, reinterpret_cast<const unsigned char *>(str),
+            len);
+        ret = m_handler->String(m_encoded.data(), m_encoded.size());
+    } else if (IsKey()) {
+        ret = m_handler->Key(str, len);
+    } else {
+        ret = m_handler->String(str, len);
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Deliver an integer, as a key or a value.
+ *
+ * @param[in] major 0 for an unsigned integer, 1 for a negative one.
+ * @param[in] val the argument of the integer (for a negative integer, 
+ *            the integer is -1 - val).
+ *
+ * @return true on success, false if the handler returned false.
+ */
+
+bool
+JSONCborDecoder::EmitInteger(int major, uint64_t val)
+{
+    char buf[32];
+    bool ret;
+
+    if (IsKey()) {
+        if (major == 0) {
+            snprintf(buf, sizeof(buf), "%lu", (unsigned long) val);
+        } else if (val == UINT64_MAX) {
+            snprintf(buf, sizeof(buf), "-18446744073709551616");
+        } else {
+            snprintf(buf, sizeof(buf), "-%lu", (unsigned long) val + 1);
+        }
+        ret = m_handler->Key(buf, strlen(buf));
+    } else if (major == 0) {
+        if (val <= LONG_MAX) {
+            ret = m_handler->Number((long) val);
+        } else {
+            ret = m_handler->Unsigned((unsigned long) val);
+        }
+    } else if (val <= LONG_MAX) {
+        ret = m_handler->Number(-1 - (long) val);
+    } else {
+        ret = m_handler->Double(-1.0 - (double) val);
+    }
+    return ret;
+}
+
+
+/**
+ * Account for a data item that has been delivered, ending the arrays 
+ * and maps that it completes.
+ *
+ * @return true on success, false if a handler returned false.
+ */
+
+bool
+JSONCborDecoder::EndItem()
+{
+    bool ret = true;
+    int major;
+
+    while (ret) {
+        if (m_stack.empty()) {
+            m_complete = true;
+            break;
+        }
+        JsonCborFrame &frame = m_stack.back();
+        frame.count++;
+        if (frame.indefinite || frame.count < frame.size) {
+            break;
+        }
+        major = frame.major;
+        m_stack.pop_back();
+        ret = (major == 4) ? m_handler->EndArray() : m_handler->EndObject();
+    }
+    return ret;
+}
+
+
+/**
+ * Decode the next data item: a head, and the content of a definite 
+ * length string.
+ *
+ * @param[in] p the data.
+ * @param[in] end the end of the data.
+ *
+ * @return the number of bytes consumed, 0 if the data ends before the 
+ *         item does, -1 if the item is not well-formed or out of place,
+ *         or a handler returned false.
+ */
+
+long
+JSONCborDecoder::DecodeItem(const unsigned char *p, const unsigned char *end)
+{
+    const unsigned char *start = p;
+    JsonCborFrame frame;
+    uint64_t val = 0;
+    uint32_t bits32;
+    double dval;
+    float fval;
+    long ret = 0;
+    bool ok = false;
+    int major;
+    int info;
+    int n;
+
+    if (p >= end) {
+        goto out;
+    }
+    major = *p >> 5;
+    info = *p & 0x1f;
+    p++;
+    if (info < 24) {
+        val = info;
+    } else if (info <= 27) {
+        n = 1 << (info - 24);
+        if (end - p < n) {
+            goto out;
+        }
+        val = GetBigEndian(p, n);
+        p += n;
+    } else if (info != 31 || major == 0 || major == 1 || major == 6) {
+
+        // reserved, or indefinite length for a type that has no length
+
+        goto error;
+    }
+    if ((major == 2 || major == 3) && info != 31 && 
+        (uint64_t) (end - p) < val) {
+        goto out;
+    }
+
+    // the chunks of an indefinite length string are definite length 
+    // strings of the same type, and are gathered until the break
+
+    if (m_stack.empty() == false && m_stack.back().major <= 3 &&
+        (major != 7 || info != 31)) {
+        if (major != m_stack.back().major || info == 31) {
+            goto error;
+        }
+        m_buffer.append(reinterpret_cast<const char *>(p), val);
+        p += val;
+        ret = p - start;
+        goto out;
+    }
+
+    switch (major) {
+    case 0:
+    case 1:
+        ok = EmitInteger(major, val);
+        break;
+    case 2:
+    case 3:
+        frame.negative = major == 2 && m_tagged && m_tag == 3;
+        m_tagged = false;
+        if (info == 31) {
+            if (m_stack.size() >= MaxDepth || (major == 2 && IsKey())) {
+                goto error;
+            }
+            frame.major = major;
+            frame.indefinite = true;
+            frame.size = frame.count = 0;
+            m_stack.push_back(frame);
+            m_buffer.clear();
+            ret = p - start;
+            goto out;
+        }
+        ok = EmitString(major, frame.negative, 
+            reinterpret_cast<const char *>(p), val);
+        p += val;
+        break;
+    case 4:
+    case 5:
+        if (IsKey() || m_stack.size() >= MaxDepth || 
+            (major == 5 && info != 31 && val > UINT64_MAX / 2)) {
+            goto error;
+        }
+        m_tagged = false;
+        if (!(major == 4 ? m_handler->StartArray() : m_handler->StartObject())) {
+            goto error;
+        }
+        if (info != 31 && val == 0) {
+            ok = major == 4 ? m_handler->EndArray() : m_handler->EndObject();
+            break;
+        }
+        frame.major = major;
+        frame.indefinite = info == 31;
+        frame.negative = false;
+        frame.size = major == 5 ? val * 2 : val;
+        frame.count = 0;
+        m_stack.push_back(frame);
+        ret = p - start;
+        goto out;
+    case 6:
+
+        // tags are ignored, except for telling negative bignums apart
+
+        m_tag = val;
+        m_tagged = true;
+        ret = p - start;
+        goto out;
+    default:
+        if (info == 31) {
+
+            // break
+
+            if (m_tagged || m_stack.empty() || 
+                m_stack.back().indefinite == false ||
+                (m_stack.back().major == 5 && m_stack.back().count % 2)) {
+                goto error;
+            }
+            frame = m_stack.back();
+            m_stack.pop_back();
+            if (frame.major <= 3) {
+                ok = EmitString(frame.major, frame.negative, m_buffer.data(),
+                    m_buffer.size());
+            } else if (frame.major == 4) {
+                ok = m_handler->EndArray();
+            } else {
+                ok = m_handler->EndObject();
+            }
+            break;
+        }
+        if (IsKey() || (info == 24 && val < 32)) {
+            goto error;
+        }
+        m_tagged = false;
+        if (info == 20 || info == 21) {
+            ok = m_handler->Boolean(info == 21);
+            break;
+        } else if (info == 25) {
+            dval = FromHalf((uint16_t) val);
+        } else if (info == 26) {
+            bits32 = (uint32_t) val;
+            memcpy(&fval, &bits32, sizeof(fval));
+            dval = fval;
+        } else if (info == 27) {
+            memcpy(&dval, &val, sizeof(dval));
+        } else {
+
+            // null, undefined, and the other simple values
+
+            ok = m_handler->Null();
+            break;
+        }
+        ok = isfinite(dval) ? m_handler->Double(dval) : m_handler->Null();
+        break;
+    }
+    if (ok && EndItem()) {
+        ret = p - start;
+        goto out;
+    }
+error:
+    ret = -1;
+out:
+    return ret;
+}
@@ -0,0 +1,148 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONCBOR_H__)
+#define __JSONCBOR_H__
+
+#include "jsonapi.h"
+#include "jsonevents.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * An array, map or indefinite length string that JSONCborDecoder has 
+ * started, but not yet finished, decoding.
+ */
+
+struct JsonCborFrame
+{
+    int major;          // CBOR major type (2 to 5)
+    bool indefinite;    // ends with a break, rather than after size items
+    bool negative;      // byte string is a negative bignum (tag 3)
+    uint64_t size;      // number of items (keys and values, for a map)
+    uint64_t count;     // number of items decoded so far
+};
+
+/**
+ * A streaming CBOR (RFC 8949) decoder, which delivers the values it 
+ * decodes as events to a JSONEventHandler. 
+ *
+ * Feed() decodes as much of the data given to it as it can, up to the 
+ * end of the next top-level value, and returns the number of bytes it
+ * consumed. An item that is not complete in the data (a head, or a 
+ * definite length string) is not consumed, and must be passed again, 
+ * along with what follows, in the next call. Everything else is, so
+ * the events of a large or indefinite length array or map are delivered
+ * as its items arrive, and the chunks of an indefinite length string are
+ * consumed (and gathered) as they arrive, the string being delivered 
+ * when its break is. Strings are otherwise passed to the handler 
+ * straight from the caller's data, and the decoder allocates nothing 
+ * once its stack and string buffer have grown to fit the data.
+ *
+ * CBOR is mapped to JSON as described in RFC 8949 section 6.1: byte 
+ * strings become base64url encoded strings (with a leading '~' for a 
+ * negative bignum), tags are ignored, and undefined, other simple values,
+ * NaN and the infinities become null. Integer map keys become their 
+ * decimal string, and other keys that are not text strings are an error.
+ * Integers above LONG_MAX are delivered as Unsigned(), and those below 
+ * LONG_MIN as Double().
+ */
+
+class JSONCborDecoder
+{
+public:
+    JSONCborDecoder(JSONEventHandler *handler);
+    long Feed(const char *buf, size_t len);
+    bool IsComplete() {return m_complete;}
+    int GetDepth() {return m_stack.size();}
+    void Reset();
+private:
+    static const int MaxDepth = 512;
+    long DecodeItem(const unsigned char *p, const unsigned char *end);
+    bool IsKey();
+    bool EmitString(int major, bool negative, const char *str, size_t len);
+    bool EmitInteger(int major, uint64_t val);
+    bool EndItem();
+    JSONEventHandler *m_handler;
+    std::vector<JsonCborFrame> m_stack;
+    std::string m_buffer;
+    std::string m_encoded;
+    uint64_t m_tag;
+    bool m_tagged;
+    bool m_complete;
+    bool m_error;
+};
+
+/**
+ * CBOR encoding and decoding of JSONValue trees.
+ *
+ * Encode() uses the preferred serialization of RFC 8949: the shortest 
+ * head for every integer, length and size, and the shortest of half, 
+ * single and double precision that holds each double exactly. Arrays, 
+ * objects and strings are encoded with definite lengths. Strings and 
+ * keys are encoded as their text, without the quotes and escapes that 
+ * those of a parsed document keep (see JsonStr::Unquote()).
+ *
+ * Decode() builds a tree from the next value in a buffer, using 
+ * JSONCborDecoder and JSONEventBuilder. Like JSONMsgPack::Decode(), it 
+ * consumes nothing if the buffer does not hold a complete value. Its 
+ * strings and keys are stored as the parser stores them, quotes and 
+ * escapes included.
+ */
+
+class JSONCbor
+{
+public:
+    static std::string &Encode(JSONValue *val, std::string &out);
+    static bool Decode(const char *buf, size_t len, JSONValue **val, 
+        size_t *used);
+};
+
+#endif
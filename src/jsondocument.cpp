@@ -0,0 +1,333 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsondocument.h"
+
+/**
+ * Copy constructor. The tree is shared with other, not copied. The copy
+ * uses the same allocator as other.
+ *
+ * @param[in] other the document to copy.
+ */
+
+JSONDocument::JSONDocument(const JSONDocument &other) :
+    m_root(other.m_root ? other.m_root->Ref() : NULL),
+    m_allocator(other.m_allocator)
+{
+}
+
+
+/**
+ * Move constructor. The tree is taken from other, which is left empty.
+ *
+ * @param[in] other the document to move from.
+ */
+
+JSONDocument::JSONDocument(JSONDocument &&other) :
+    m_root(other.m_root),
+    m_allocator(other.m_allocator)
+{
+    other.m_root = NULL;
+}
+
+
+/**
+ * Copy assignment. The tree is shared with other, not copied.
+ *
+ * @param[in] other the document to copy.
+ *
+ * @return this document.
+ */
+
+JSONDocument &
+JSONDocument::operator=(const JSONDocument &other)
+{
+    if (this != &other) {
+        JSONValue *root = other.m_root ? other.m_root->Ref() : NULL;
+        JSONValue::Unref(m_root);
+        m_root = root;
+        m_allocator = other.m_allocator;
+    }
+    return *this;
+}
+
+
+/**
+ * Move assignment. 
+ *
+ * @param[in] other the document to move from. It is left empty.
+ *
+ * @return this document.
+ */
+
+JSONDocument &
+JSONDocument::operator=(JSONDocument &&other)
+{
+    if (this != &other) {
+        JSONValue::Unref(m_root);
+        m_root = other.m_root;
+        m_allocator = other.m_allocator;
+        other.m_root = NULL;
+    }
+    return *this;
+}
+
+
+/**
+ * Replace the tree held by the document. 
+ *
+ * @param[in] root the new tree, owned by the document from now on.
+ */
+
+void
+JSONDocument::SetRoot(JSONValue *root)
+{
+    JSONValue::Unref(m_root);
+    m_root = root;
+}
+
+
+/**
+ * Get the root of the tree for modification. If the root is shared with
+ * another document, this document gets its own (shallow) copy of it.
+ *
+ * @return the root value, or NULL if the document is empty.
+ */
+
+JSONValue *
+JSONDocument::GetMutableRoot()
+{
+    JSONAllocatorScope scope(m_allocator);
+
+    m_root = JSONValue::Unshare(m_root);
+    return m_root;
+}
+
+
+/**
+ * Get a value inside the tree for modification, copying the shared
+ * nodes on the path to it. 
+ *
+ * Each element of path is an offset into the current object or array, 
+ * as passed to JSONValue::Get(). When the offset selects a tuple, the 
+ * walk continues with the tuple's value.
+ *
+ * @param[in] path offsets leading from the root to the value.
+ *
+ * @return the value, or NULL if the path does not exist.
+ */
+
+JSONValue *
+JSONDocument::GetMutable(const std::vector<int> &path)
+{
+    JSONAllocatorScope scope(m_allocator);
+    JSONValue *val = GetMutableRoot();
+
+    for (size_t i = 0; val && i < path.size(); i++) {
+        val = val->GetMutable(path[i]);
+        if (val && val->GetType() == JsonType_Tuple) {
+            val = static_cast<JSONTuple *>(val)->GetMutableValue();
+        }
+    }
+    return val;
+}
+
+
+/**
+ * Convert the document to JSON, concatenating to the passed in string.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the document as a string, concatenated to str.
+ */
+
+std::string &
+JSONDocument::ToJSON(std::string &str)
+{
+    if (m_root) {
+        m_root->ToJSON(str);
+    }
+    return str;
+}
+
+
+/**
+ * Write the document to a tape. Whatever the tape held before is 
+ * discarded.
+ *
+ * @param[in] tape the tape.
+ *
+ * @return true on success, false if the document is empty.
+ */
+
+bool
+JSONDocument::ToTape(JSONTape &tape)
+{
+    tape.Clear();
+    if (m_root == NULL) {
+        return false;
+    }
+    AddToTape(tape, m_root);
+    return true;
+}
+
+
+/**
+ * Save the document to a snapshot file. See JSONTape::SaveSnapshot().
+ *
+ * @param[in] path the path of the file, replaced if it exists.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+JSONDocument::SaveSnapshot(const char *path)
+{
+    JSONTape tape;
+
+    return ToTape(tape) && tape.SaveSnapshot(path);
+}
+
+
+/**
+ * Save the document to a shared memory object. See JSONTape::SaveShared().
+ *
+ * @param[in] name the name of the object, which must not exist.
+ *
+ * @return true on success, false otherwise.
+ */
+
+bool
+JSONDocument::SaveShared(const char *name)
+{
+    JSONTape tape;
+
+    return ToTape(tape) && tape.SaveShared(name);
+}
+
+
+/**
+ * Add a value, and everything below it, to a tape.
+ *
+ * @param[in] tape the tape.
+ * @param[in] val the value.
+ */
+
+void
+JSONDocument::AddToTape(JSONTape &tape, JSONValue *val)
+{
+    JSONValue::iterator iter;
+    std::string str;
+
+    switch (val->GetType()) {
+    case JsonType_Object:
+    case JsonType_Array:
+        tape.BeginContainer(val->GetType());
+        for (iter = val->begin(); iter != val->end(); ++iter) {
+            AddToTape(tape, *iter);
+        }
+        tape.EndContainer();
+        break;
+    case JsonType_Record:
+        {
+        JSONRecord *record = static_cast<JSONRecord *>(val);
+        int i = 0;
+
+        tape.BeginContainer(JsonType_Object);
+        for (iter = val->begin(); iter != val->end(); ++iter, i++) {
+            tape.AddKey(record->GetKey(i).data(), record->GetKey(i).size());
+            AddToTape(tape, *iter);
+        }
+        tape.EndContainer();
+        }
+        break;
+    case JsonType_PackedArray:
+        {
+        JSONPackedArray *array = static_cast<JSONPackedArray *>(val);
+
+        tape.BeginContainer(JsonType_Array);
+        for (int64_t number : array->GetIntegers()) {
+            tape.AddNumber(number);
+        }
+        for (double number : array->GetDoubles()) {
+            tape.AddDouble(number);
+        }
+        tape.EndContainer();
+        }
+        break;
+    case JsonType_Tuple:
+        {
+        JSONTuple *tuple = static_cast<JSONTuple *>(val);
+
+        tape.AddKey(tuple->GetKey().data(), tuple->GetKey().size());
+        if (tuple->GetValue()) {
+            AddToTape(tape, tuple->GetValue());
+        } else {
+            tape.AddNull();
+        }
+        }
+        break;
+    case JsonType_String:
+        str = static_cast<JSONString *>(val)->Get();
+        tape.AddString(str.data(), str.size());
+        break;
+    case JsonType_Number:
+        tape.AddNumber(static_cast<JSONNumber *>(val)->Get());
+        break;
+    case JsonType_Double:
+        tape.AddDouble(static_cast<JSONDouble *>(val)->Get());
+        break;
+    case JsonType_Bool:
+        tape.AddBoolean(static_cast<JSONBoolean *>(val)->Get());
+        break;
+    default:
+        tape.AddNull();
+        break;
+    }
+}
@@ -0,0 +1,106 @@
+#if !defined(__JSONDOCUMENT_H__)
+#define __JSONDOCUMENT_H__
+
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonapi.h"
+#include "jsontape.h"
+#include <vector>
+
+/**
+ * A handle to a tree of JSONValue objects that can be cloned cheaply.
+ *
+ * Copying or cloning a document is O(1), the copy shares the tree with 
+ * the original. Modifications go through GetMutableRoot() and 
+ * JSONValue::GetMutable(), which copy a shared node before handing it 
+ * out, so a patch to a clone copies only the nodes on the path from the
+ * root to what is being changed, and the original is not affected. 
+ *
+ * Values obtained through GetRoot() and JSONValue::Get() are for reading
+ * only, since they may be shared with other documents.
+ *
+ * SaveSnapshot() writes the document to a file that JSONTape::LoadSnapshot()
+ * can map and use without parsing it, SaveShared() to a shared memory 
+ * object that JSONTape::AttachShared() can.
+ *
+ * The copies made for modification are allocated from the allocator set
+ * with SetAllocator(), if any, see JSONAllocator.
+ */
+
+class JSONDocument
+{
+public:
+    JSONDocument() : m_root(NULL), m_allocator(NULL) {}
+    explicit JSONDocument(JSONValue *root) : m_root(root), m_allocator(NULL) {}
+    explicit JSONDocument(std::unique_ptr<JSONValue> root) : m_root(root.release()), m_allocator(NULL) {}
+    JSONDocument(const JSONDocument &other);
+    JSONDocument(JSONDocument &&other);
+    JSONDocument &operator=(const JSONDocument &other);
+    JSONDocument &operator=(JSONDocument &&other);
+    ~JSONDocument() {JSONValue::Unref(m_root);}
+    JSONDocument Clone() const {return JSONDocument(*this);}
+    JSONValue *GetRoot() {return m_root;}
+    const JSONValue *GetRoot() const {return m_root;}
+    void SetRoot(JSONValue *root);
+    JSONValue *GetMutableRoot();
+    JSONValue *GetMutable(const std::vector<int> &path);
+    std::string &ToJSON(std::string &str);
+    bool ToTape(JSONTape &tape);
+    bool SaveSnapshot(const char *path);
+    bool SaveShared(const char *name);
+    void SetAllocator(JSONAllocator *allocator) {m_allocator = allocator;}
+    JSONAllocator *GetAllocator() {return m_allocator;}
+private:
+    static void AddToTape(JSONTape &tape, JSONValue *val);
+    JSONValue *m_root;
+    JSONAllocator *m_allocator;
+};
+
+#endif
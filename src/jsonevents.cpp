@@ -0,0 +1,333 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonevents.h"
+
+/**
+ * Add a value to the tree: it becomes the root if there is none yet, 
+ * the value of the pending key if the current container is an object,
+ * or the next element of the current array.
+ *
+ * @param[in] val the value, owned by the tree from now on.
+ *
+ * @return true on success, false if the value is out of place (a second
+ *         root, or a member of an object without a key).
+ */
+
+bool
+JSONEventBuilder::Add(JSONValue *val)
+{
+    bool ret = false;
+
+    if (m_stack.empty()) {
+        if (m_root != NULL) {
+            goto out;
+        }
+        m_root = val;
+    } else if (m_stack.back()->GetType() == JsonType_Object) {
+        if (m_tuple == NULL) {
+            goto out;
+        }
+        m_tuple->SetValue(val);
+        m_tuple = NULL;
+    } else {
+        m_stack.back()->Append(val);
+    }
+    val = NULL;
+    ret = true;
+out:
+    delete val;
+    return ret;
+}
+
+
+/**
+ * End the current container.
+ *
+ * @param[in] type the type of container being ended.
+ *
+ * @return true on success, false if the current container is not of 
+ *         the given type, or an object ends with a key that has no value.
+ */
+
+bool
+JSONEventBuilder::End(JsonType type)
+{
+    bool ret = false;
+
+    if (m_stack.empty() || m_stack.back()->GetType() != type || m_tuple) {
+        goto out;
+    }
+    m_stack.pop_back();
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Start an object, which becomes the current container.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::StartObject()
+{
+    JSONValue *val = new JSONObject();
+    bool ret;
+
+    if ((ret = Add(val))) {
+        m_stack.push_back(val);
+    }
+    return ret;
+}
+
+
+/**
+ * End the current object.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::EndObject()
+{
+    return End(JsonType_Object);
+}
+
+
+/**
+ * Start an array, which becomes the current container.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::StartArray()
+{
+    JSONValue *val = new JSONArray();
+    bool ret;
+
+    if ((ret = Add(val))) {
+        m_stack.push_back(val);
+    }
+    return ret;
+}
+
+
+/**
+ * End the current array.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::EndArray()
+{
+    return End(JsonType_Array);
+}
+
+
+/**
+ * Add a member with the given key to the current object. Its value is 
+ * the next value added.
+ *
+ * @param[in] str the key.
+ * @param[in] len the length of the key.
+ *
+ * @return true on success, false if the current container is not an 
+ *         object, or the previous key has no value yet.
+ */
+
+bool
+JSONEventBuilder::Key(const char *str, size_t len)
+{
+    bool ret = false;
+
+    if (m_stack.empty() || m_stack.back()->GetType() != JsonType_Object ||
+        m_tuple) {
+        goto out;
+    }
+    JsonStr::Quote(std::string_view(str, len), m_scratch);
+    m_tuple = new JSONTuple();
+    m_tuple->SetKey(m_scratch);
+    m_stack.back()->Append(m_tuple);
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Add a string.
+ *
+ * @param[in] str the string.
+ * @param[in] len the length of the string.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::String(const char *str, size_t len)
+{
+    JsonStr::Quote(std::string_view(str, len), m_scratch);
+    return Add(new JSONString(JsonStr(m_scratch)));
+}
+
+
+/**
+ * Add a number.
+ *
+ * @param[in] val the number.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::Number(long val)
+{
+    return Add(new JSONNumber(val));
+}
+
+
+/**
+ * Add an unsigned number.
+ *
+ * @param[in] val the number.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::Unsigned(unsigned long val)
+{
+    JSONNumber *number = new JSONNumber();
+
+    number->SetUnsigned(val);
+    return Add(number);
+}
+
+
+/**
+ * Add a double.
+ *
+ * @param[in] val the double.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::Double(double val)
+{
+    return Add(new JSONDouble(val));
+}
+
+
+/**
+ * Add a boolean.
+ *
+ * @param[in] val the boolean.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::Boolean(bool val)
+{
+    return Add(new JSONBoolean(val));
+}
+
+
+/**
+ * Add a null.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONEventBuilder::Null()
+{
+    return Add(new JSONNull());
+}
+
+
+/**
+ * Hand the tree that was built to the caller.
+ *
+ * @return the tree (caller must delete), or NULL if a complete value has 
+ *         not been built yet.
+ */
+
+JSONValue *
+JSONEventBuilder::ReleaseValue()
+{
+    JSONValue *val = NULL;
+
+    if (IsComplete()) {
+        val = m_root;
+        m_root = NULL;
+    }
+    return val;
+}
+
+
+/**
+ * Discard whatever has been built so far, so that the builder can be
+ * used for another value.
+ */
+
+void
+JSONEventBuilder::Clear()
+{
+    delete m_root;
+    m_root = NULL;
+    m_tuple = NULL;
+    m_stack.clear();
+}
@@ -0,0 +1,125 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONEVENTS_H__)
+#define __JSONEVENTS_H__
+
+#include "jsonapi.h"
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * SAX-style events, delivered by the streaming decoders (see 
+ * JSONCborDecoder) as values are decoded, so that a caller can process
+ * a value without a JSONValue tree being built for it. Strings and keys
+ * are passed as a pointer and a length, and are only valid for the 
+ * duration of the call. Each handler returns false to stop decoding, 
+ * and the default implementations do nothing but return true, so that
+ * a handler need only override the events it is interested in.
+ *
+ * The members of an object are delivered as a Key() followed by the 
+ * events of its value.
+ */
+
+class JSONEventHandler
+{
+public:
+    virtual ~JSONEventHandler() {}
+    virtual bool StartObject() {return true;}
+    virtual bool EndObject() {return true;}
+    virtual bool StartArray() {return true;}
+    virtual bool EndArray() {return true;}
+    virtual bool Key(const char *str, size_t len) {return true;}
+    virtual bool String(const char *str, size_t len) {return true;}
+    virtual bool Number(long val) {return true;}
+    virtual bool Unsigned(unsigned long val) {return true;}
+    virtual bool Double(double val) {return true;}
+    virtual bool Boolean(bool val) {return true;}
+    virtual bool Null() {return true;}
+};
+
+/**
+ * An event handler that builds a JSONValue tree from the events it is 
+ * given. Once a complete value has been delivered, ReleaseValue() hands
+ * it to the caller. Keys and strings are stored as the parser stores 
+ * them, in quotes and with escapes, see JsonStr::Quote().
+ */
+
+class JSONEventBuilder : public JSONEventHandler
+{
+public:
+    JSONEventBuilder() : m_root(NULL), m_tuple(NULL) {}
+    ~JSONEventBuilder() {Clear();}
+    JSONEventBuilder(const JSONEventBuilder &) = delete;
+    JSONEventBuilder &operator=(const JSONEventBuilder &) = delete;
+    bool StartObject();
+    bool EndObject();
+    bool StartArray();
+    bool EndArray();
+    bool Key(const char *str, size_t len);
+    bool String(const char *str, size_t len);
+    bool Number(long val);
+    bool Unsigned(unsigned long val);
+    bool Double(double val);
+    bool Boolean(bool val);
+    bool Null();
+    bool IsComplete() {return m_root != NULL && m_stack.empty();}
+    JSONValue *ReleaseValue();
+    void Clear();
+private:
+    bool Add(JSONValue *val);
+    bool End(JsonType type);
+    JSONValue *m_root;
+    JSONTuple *m_tuple;
+    std::vector<JSONValue *> m_stack;
+    std::string m_scratch;      // a key or string, as the parser stores it
+};
+
+#endif
@@ -0,0 +1,235 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonholder.h"
+#include "jsonpatch.h"
+#include <thread>
+
+/**
+ * Constructor.
+ *
+ * @param[in] doc the first version. The holder shares its tree.
+ */
+
+JSONDocumentHolder::JSONDocumentHolder(const JSONDocument &doc) :
+    m_root(NULL),
+    m_epoch(0)
+{
+    JSONDocument copy(doc);
+
+    m_root = copy.GetRoot() ? copy.GetRoot()->Ref() : NULL;
+}
+
+
+/**
+ * Destructor. There must be no read sections left.
+ */
+
+JSONDocumentHolder::~JSONDocumentHolder()
+{
+    JSONValue::Unref(m_root.load());
+}
+
+
+/**
+ * Enter a read section, and get the current version.
+ *
+ * @param[in] holder the holder.
+ */
+
+JSONDocumentHolder::ReadGuard::ReadGuard(const JSONDocumentHolder &holder)
+{
+    unsigned long epoch = holder.m_epoch.load();
+
+    // counted before the root is loaded, so that a writer replacing it
+    // waits for this section (see Synchronize())
+
+    m_readers = &holder.GetSlot().readers[epoch & 1];
+    m_readers->fetch_add(1);
+    m_root = holder.m_root.load();
+}
+
+
+/**
+ * Leave the read section.
+ */
+
+JSONDocumentHolder::ReadGuard::~ReadGuard()
+{
+    m_readers->fetch_sub(1, std::memory_order_release);
+}
+
+
+/**
+ * Get the slot of the calling thread. Threads are given slots in turn,
+ * the first time they read.
+ *
+ * @return the slot.
+ */
+
+JsonReaderSlot &
+JSONDocumentHolder::GetSlot() const
+{
+    static std::atomic<unsigned> next(0);
+    static thread_local unsigned index = 
+        next.fetch_add(1, std::memory_order_relaxed) % Slots;
+
+    return m_slots[index];
+}
+
+
+/**
+ * Get the current version, as a document that keeps it alive after 
+ * later versions are published. Modifying the document copies the nodes
+ * it changes (see JSONDocument::GetMutableRoot()), the version itself is
+ * not modified.
+ *
+ * @return the document, empty if nothing was published.
+ */
+
+JSONDocument
+JSONDocumentHolder::Get() const
+{
+    ReadGuard guard(*this);
+
+    // the reference is taken inside the section, so the version cannot 
+    // be destroyed before it is
+
+    return JSONDocument(guard.GetRoot() ? 
+        const_cast<JSONValue *>(guard.GetRoot())->Ref() : NULL);
+}
+
+
+/**
+ * Make a document the current version. The holder shares its tree, so 
+ * the writer may go on modifying the document, or make the next version
+ * from it, without affecting the published one.
+ *
+ * @param[in] doc the document.
+ */
+
+void
+JSONDocumentHolder::Publish(const JSONDocument &doc)
+{
+    std::lock_guard<std::mutex> lock(m_writer);
+    JSONDocument copy(doc);
+
+    Exchange(copy.GetRoot() ? copy.GetRoot()->Ref() : NULL);
+}
+
+
+/**
+ * Apply a patch to a clone of the current version, and publish the 
+ * result.
+ *
+ * @param[in] patch the patch.
+ *
+ * @return true, or false if the patch failed, in which case nothing is 
+ *         published.
+ */
+
+bool
+JSONDocumentHolder::Update(JSONPatch &patch)
+{
+    std::lock_guard<std::mutex> lock(m_writer);
+    JSONValue *root = m_root.load();
+
+    // only writers replace the root, so it needs no read section here
+
+    JSONDocument next(root ? root->Ref() : NULL);
+
+    if (patch.Apply(next) == false) {
+        return false;
+    }
+    Exchange(next.GetRoot() ? next.GetRoot()->Ref() : NULL);
+    return true;
+}
+
+
+/**
+ * Replace the current version, and drop the reference of the holder to 
+ * the previous one once no read section can still be using it. Called 
+ * with m_writer held.
+ *
+ * @param[in] root the root of the new version, whose reference the 
+ *            holder takes over.
+ */
+
+void
+JSONDocumentHolder::Exchange(JSONValue *root)
+{
+    JSONValue *old = m_root.exchange(root);
+
+    Synchronize();
+    JSONValue::Unref(old);
+}
+
+
+/**
+ * Wait for the read sections that began before the call to end. The 
+ * epoch is advanced, so that new sections count themselves under the 
+ * other parity, and those under the old parity are waited for; twice, 
+ * since a section may have read the epoch just before the previous 
+ * writer advanced it, and so counted itself under the parity that is now
+ * current.
+ */
+
+void
+JSONDocumentHolder::Synchronize()
+{
+    for (int phase = 0; phase < 2; phase++) {
+        unsigned long epoch = m_epoch.fetch_add(1);
+
+        for (int i = 0; i < Slots; i++) {
+            while (m_slots[i].readers[epoch & 1].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+}
@@ -0,0 +1,132 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONHOLDER_H__)
+#define __JSONHOLDER_H__
+
+#include "jsondocument.h"
+#include <atomic>
+#include <mutex>
+
+class JSONPatch;
+
+/**
+ * The number of readers in a read section of a JSONDocumentHolder, by 
+ * the parity of the epoch they entered in. A reader uses the slot of its
+ * thread, so that readers on different threads do not write to the same
+ * cache line.
+ */
+
+struct alignas(64) JsonReaderSlot
+{
+    JsonReaderSlot() {readers[0] = 0; readers[1] = 0;}
+    std::atomic<long> readers[2];
+};
+
+/**
+ * Holds the current version of a document that many threads read while 
+ * a writer now and then replaces it, in the manner of RCU (read-copy-
+ * update). Readers take no lock: a ReadGuard marks a read section in the
+ * slot of its thread, and gets the root of the current version with a 
+ * single atomic load. Get() returns the current version as a JSONDocument,
+ * for keeping beyond a read section. A version is never modified once 
+ * published.
+ *
+ * A writer makes the next version from a clone of the current one (see 
+ * JSONDocument::Clone()), so it copies only the nodes it changes and 
+ * shares the rest, then publishes it with Publish(). Update() does both 
+ * with a JSONPatch. Writers are serialized. Publishing waits for the 
+ * read sections that may have seen the previous version to end, then 
+ * drops the reference of the holder to it; the version is destroyed once
+ * the last JSONDocument that Get() returned for it is destroyed too. 
+ * Read sections should therefore be short, and must not publish.
+ */
+
+class JSONDocumentHolder
+{
+public:
+    /**
+     * A read section: while it exists, GetRoot() is the version that was
+     * current when it was made.
+     */
+
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(const JSONDocumentHolder &holder);
+        ~ReadGuard();
+        ReadGuard(const ReadGuard &) = delete;
+        ReadGuard &operator=(const ReadGuard &) = delete;
+        const JSONValue *GetRoot() const {return m_root;}
+    private:
+        std::atomic<long> *m_readers;  // the counter of the section
+        const JSONValue *m_root;
+    };
+
+    JSONDocumentHolder() : m_root(NULL), m_epoch(0) {}
+    explicit JSONDocumentHolder(const JSONDocument &doc);
+    ~JSONDocumentHolder();
+    JSONDocumentHolder(const JSONDocumentHolder &) = delete;
+    JSONDocumentHolder &operator=(const JSONDocumentHolder &) = delete;
+    JSONDocument Get() const;
+    void Publish(const JSONDocument &doc);
+    bool Update(JSONPatch &patch);
+private:
+    static const int Slots = 64;
+    JsonReaderSlot &GetSlot() const;
+    void Exchange(JSONValue *root);
+    void Synchronize();
+    mutable JsonReaderSlot m_slots[Slots];
+    std::atomic<JSONValue *> m_root;
+    std::atomic<unsigned long> m_epoch;     // its parity selects the 
+                                            // counters of new readers
+    std::mutex m_writer;
+};
+
+#endif
@@ -0,0 +1,346 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonmemory.h"
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+/**
+ * The allocator used when no other is set, which uses the heap.
+ */
+
+class JsonHeapAllocator : public JSONAllocator
+{
+public:
+    void *Allocate(size_t size) {return malloc(size);}
+    void Free(void *p, size_t) {free(p);}
+};
+
+// each allocation is preceded by a pointer to the allocator it came 
+// from, padded so that the memory after it stays 8 byte aligned
+
+static const size_t HeaderSize = 8;
+static_assert(sizeof(JSONAllocator *) <= HeaderSize && 
+    sizeof(size_t) <= HeaderSize, "allocation header too small");
+
+static thread_local JSONAllocator *currentAllocator = NULL;
+
+/**
+ * A set of counters. Each thread uses one set, chosen when it first 
+ * allocates, and the sets are a cache line apart so that threads using
+ * different sets do not slow each other down.
+ */
+
+struct alignas(64) JsonMemoryCounters
+{
+    std::atomic<long> bytes[JsonMemoryCategory_Count];
+};
+
+static const int NumCounters = 16;
+static JsonMemoryCounters counters[NumCounters];
+static std::atomic<unsigned> nextCounters;
+static thread_local int threadCounters = -1;
+
+/**
+ * Get the set of counters of the calling thread.
+ *
+ * @return the counters.
+ */
+
+static JsonMemoryCounters &
+GetCounters()
+{
+    if (threadCounters < 0) {
+        threadCounters = nextCounters.fetch_add(1, std::memory_order_relaxed) 
+            % NumCounters;
+    }
+    return counters[threadCounters];
+}
+
+
+/**
+ * Count memory that has been allocated.
+ *
+ * @param[in] category what the memory is used for.
+ * @param[in] bytes the number of bytes.
+ */
+
+void
+JSONMemory::Allocated(JsonMemoryCategory category, size_t bytes)
+{
+    GetCounters().bytes[category].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+
+/**
+ * Count memory that has been freed. It need not be freed by the thread
+ * that allocated it.
+ *
+ * @param[in] category what the memory was used for.
+ * @param[in] bytes the number of bytes.
+ */
+
+void
+JSONMemory::Freed(JsonMemoryCategory category, size_t bytes)
+{
+    GetCounters().bytes[category].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+
+/**
+ * Get the memory held by the trees of the library, in all threads.
+ *
+ * @return the number of bytes, by category.
+ */
+
+JSONMemoryUsage
+JSONMemory::GetLiveUsage()
+{
+    long bytes[JsonMemoryCategory_Count] = {0};
+    JSONMemoryUsage usage;
+
+    for (int i = 0; i < NumCounters; i++) {
+        for (int j = 0; j < JsonMemoryCategory_Count; j++) {
+            bytes[j] += counters[i].bytes[j].load(std::memory_order_relaxed);
+        }
+    }
+    usage.nodes = bytes[JsonMemoryCategory_Nodes];
+    usage.strings = bytes[JsonMemoryCategory_Strings];
+    usage.containers = bytes[JsonMemoryCategory_Containers];
+    usage.buffers = bytes[JsonMemoryCategory_Buffers];
+    return usage;
+}
+
+
+/**
+ * Get the allocator that uses the heap.
+ *
+ * @return the allocator. It is never destroyed.
+ */
+
+JSONAllocator *
+JSONAllocator::GetDefault()
+{
+    static JSONAllocator *allocator = new JsonHeapAllocator();
+
+    return allocator;
+}
+
+
+/**
+ * Get the allocator that the calling thread allocates from.
+ *
+ * @return the allocator, the default one if none has been set.
+ */
+
+JSONAllocator *
+JSONAllocator::GetCurrent()
+{
+    return currentAllocator ? currentAllocator : GetDefault();
+}
+
+
+/**
+ * Set the allocator that the calling thread allocates from.
+ *
+ * @param[in] allocator the allocator, or NULL for the default one.
+ */
+
+void
+JSONAllocator::SetCurrent(JSONAllocator *allocator)
+{
+    currentAllocator = allocator;
+}
+
+
+/**
+ * Allocate memory from the current allocator, and count it.
+ *
+ * @param[in] size the number of bytes.
+ * @param[in] category what the memory is used for.
+ *
+ * @return the memory, 8 byte aligned. Throws std::bad_alloc if the 
+ *         allocator has none to give.
+ */
+
+void *
+JSONMemory::Allocate(size_t size, JsonMemoryCategory category)
+{
+    JSONAllocator *allocator = JSONAllocator::GetCurrent();
+    char *p = static_cast<char *>(allocator->Allocate(size + HeaderSize));
+
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<JSONAllocator **>(p) = allocator;
+    Allocated(category, size);
+    return p + HeaderSize;
+}
+
+
+/**
+ * Give memory back to the allocator it came from, and count it.
+ *
+ * @param[in] p the memory, from Allocate(), or NULL.
+ * @param[in] size the number of bytes, as passed to Allocate().
+ * @param[in] category what the memory was used for.
+ */
+
+void
+JSONMemory::Free(void *p, size_t size, JsonMemoryCategory category)
+{
+    char *q;
+
+    if (!p) {
+        return;
+    }
+    q = static_cast<char *>(p) - HeaderSize;
+    Freed(category, size);
+    (*reinterpret_cast<JSONAllocator **>(q))->Free(q, size + HeaderSize);
+}
+
+
+/**
+ * Allocate a buffer, which remembers its size so that it can be freed
+ * without it. Counted as buffer memory.
+ *
+ * @param[in] size the number of bytes.
+ *
+ * @return the buffer, 8 byte aligned. Throws std::bad_alloc if the 
+ *         allocator has none to give.
+ */
+
+void *
+JSONMemory::AllocateBuffer(size_t size)
+{
+    char *p = static_cast<char *>(Allocate(size + HeaderSize, 
+        JsonMemoryCategory_Buffers));
+
+    *reinterpret_cast<size_t *>(p) = size;
+    return p + HeaderSize;
+}
+
+
+/**
+ * Resize a buffer, keeping its contents, as realloc() does.
+ *
+ * @param[in] p the buffer, from AllocateBuffer(), or NULL.
+ * @param[in] size the new number of bytes.
+ *
+ * @return the resized buffer. Throws std::bad_alloc if the allocator has
+ *         none to give, in which case p is left as it was.
+ */
+
+void *
+JSONMemory::ReallocateBuffer(void *p, size_t size)
+{
+    void *ret = AllocateBuffer(size);
+
+    if (p) {
+        size_t old = *reinterpret_cast<size_t *>(
+            static_cast<char *>(p) - HeaderSize);
+
+        memcpy(ret, p, old < size ? old : size);
+        FreeBuffer(p);
+    }
+    return ret;
+}
+
+
+/**
+ * Free a buffer.
+ *
+ * @param[in] p the buffer, from AllocateBuffer(), or NULL.
+ */
+
+void
+JSONMemory::FreeBuffer(void *p)
+{
+    char *q;
+
+    if (!p) {
+        return;
+    }
+    q = static_cast<char *>(p) - HeaderSize;
+    Free(q, *reinterpret_cast<size_t *>(q) + HeaderSize, 
+        JsonMemoryCategory_Buffers);
+}
+
+
+/**
+ * AllocateBuffer() for C code, see utf8.c.
+ *
+ * @param[in] size the number of bytes.
+ *
+ * @return the buffer, or NULL if the allocator has none to give.
+ */
+
+extern "C" void *
+JsonAllocateBuffer(size_t size)
+{
+    try {
+        return JSONMemory::AllocateBuffer(size);
+    } catch (std::bad_alloc &) {
+        return NULL;
+    }
+}
+
+
+/**
+ * FreeBuffer() for C code, see utf8.c.
+ *
+ * @param[in] p the buffer, or NULL.
+ */
+
+extern "C" void
+JsonFreeBuffer(void *p)
+{
+    JSONMemory::FreeBuffer(p);
+}
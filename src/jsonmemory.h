@@ -0,0 +1,250 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONMEMORY_H__)
+#define __JSONMEMORY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <string>
+
+/**
+ * The kinds of memory that the trees of the library are made of.
+ */
+
+typedef enum {
+    JsonMemoryCategory_Nodes,       // the value objects themselves
+    JsonMemoryCategory_Strings,     // heap buffers of strings and keys
+    JsonMemoryCategory_Containers,  // list elements linking children to
+                                    // their containers
+    JsonMemoryCategory_Buffers,     // scratch memory of the parser and of
+                                    // string conversions
+    JsonMemoryCategory_Count
+} JsonMemoryCategory;
+
+/**
+ * Bytes of memory, by category. See JSONValue::MemoryUsage(), 
+ * JsonParse::MemoryUsage() and JSONMemory::GetLiveUsage().
+ */
+
+struct JSONMemoryUsage
+{
+    JSONMemoryUsage() : nodes(0), strings(0), containers(0), buffers(0) {}
+    size_t GetTotal() const {return nodes + strings + containers + buffers;}
+    JSONMemoryUsage &operator+=(const JSONMemoryUsage &other)
+    {
+        nodes += other.nodes;
+        strings += other.strings;
+        containers += other.containers;
+        buffers += other.buffers;
+        return *this;
+    }
+    size_t nodes;
+    size_t strings;
+    size_t containers;
+    size_t buffers;
+};
+
+/**
+ * The source of all the memory of the library. Implement Allocate() and
+ * Free() to take that memory from somewhere other than the heap, e.g., 
+ * from a pool, or to put a limit on it. Allocate() returns memory aligned
+ * to at least 8 bytes, or NULL if it cannot, in which case the operation 
+ * that needed the memory fails: Parse() returns false, and anything else 
+ * throws std::bad_alloc.
+ *
+ * The allocator used is the current allocator of the calling thread, see
+ * SetCurrent(), or the one set on the JsonParse or JSONDocument at work, 
+ * see JSONAllocatorScope. Memory is always given back to the allocator 
+ * it came from, by whichever thread frees it, so an allocator must 
+ * outlive everything allocated from it, and must be thread safe if the
+ * values allocated from it are freed in other threads.
+ */
+
+class JSONAllocator
+{
+public:
+    virtual ~JSONAllocator() {}
+    virtual void *Allocate(size_t size) = 0;
+    virtual void Free(void *p, size_t size) = 0;
+    static JSONAllocator *GetDefault();
+    static JSONAllocator *GetCurrent();
+    static void SetCurrent(JSONAllocator *allocator);
+};
+
+/**
+ * Makes an allocator the current allocator of the calling thread for as 
+ * long as it is in scope. A NULL allocator leaves the current one as is.
+ */
+
+class JSONAllocatorScope
+{
+public:
+    explicit JSONAllocatorScope(JSONAllocator *allocator) : 
+        m_saved(JSONAllocator::GetCurrent())
+    {
+        if (allocator) {
+            JSONAllocator::SetCurrent(allocator);
+        }
+    }
+    ~JSONAllocatorScope() {JSONAllocator::SetCurrent(m_saved);}
+private:
+    JSONAllocatorScope(const JSONAllocatorScope &);
+    JSONAllocatorScope &operator=(const JSONAllocatorScope &);
+    JSONAllocator *m_saved;
+};
+
+/**
+ * Process-wide counters of the memory held by the trees of the library 
+ * (JSONValue trees, and the trees built internally by the parser), by 
+ * category, updated as it is allocated and freed. The counters are 
+ * split between threads, so that threads allocating at the same time do
+ * not contend for them; GetLiveUsage() adds them up.
+ *
+ * Memory is counted as requested by the library, without the overhead 
+ * of the heap, or of the allocator, itself.
+ *
+ * Allocate() and Free() take memory from, and give it back to, the 
+ * current JSONAllocator, and count it. AllocateBuffer(), 
+ * ReallocateBuffer() and FreeBuffer() do the same for buffers whose size
+ * is not known when they are freed, as those of the scanner.
+ */
+
+class JSONMemory
+{
+public:
+    static JSONMemoryUsage GetLiveUsage();
+    static size_t GetLiveBytes() {return GetLiveUsage().GetTotal();}
+    static void Allocated(JsonMemoryCategory category, size_t bytes);
+    static void Freed(JsonMemoryCategory category, size_t bytes);
+    template <typename S> static size_t StringSize(const S &str);
+    static void *Allocate(size_t size, JsonMemoryCategory category);
+    static void Free(void *p, size_t size, JsonMemoryCategory category);
+    static void *AllocateBuffer(size_t size);
+    static void *ReallocateBuffer(void *p, size_t size);
+    static void FreeBuffer(void *p);
+
+    // the size of an element of a JsonCountingAllocator list: two links
+    // and the pointer to the child
+
+    static const size_t ListNodeSize = 3 * sizeof(void *);
+};
+
+/**
+ * An allocator for standard containers that takes their memory from 
+ * JSONMemory, counted in the given category.
+ */
+
+template <typename T, JsonMemoryCategory Category>
+class JsonAllocatorAdapter
+{
+public:
+    typedef T value_type;
+    template <typename U> struct rebind 
+    {
+        typedef JsonAllocatorAdapter<U, Category> other;
+    };
+
+    JsonAllocatorAdapter() {}
+    template <typename U> 
+    JsonAllocatorAdapter(const JsonAllocatorAdapter<U, Category> &) {}
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(JSONMemory::Allocate(n * sizeof(T), 
+            Category));
+    }
+    void deallocate(T *p, size_t n)
+    {
+        JSONMemory::Free(p, n * sizeof(T), Category);
+    }
+};
+
+template <typename T, typename U, JsonMemoryCategory Category>
+inline bool operator==(const JsonAllocatorAdapter<T, Category> &, 
+    const JsonAllocatorAdapter<U, Category> &) {return true;}
+template <typename T, typename U, JsonMemoryCategory Category>
+inline bool operator!=(const JsonAllocatorAdapter<T, Category> &, 
+    const JsonAllocatorAdapter<U, Category> &) {return false;}
+
+/**
+ * The allocator of the lists that link children to their containers.
+ */
+
+template <typename T>
+using JsonCountingAllocator = 
+    JsonAllocatorAdapter<T, JsonMemoryCategory_Containers>;
+
+/**
+ * A string whose memory is taken from JSONMemory, counted as strings.
+ */
+
+typedef std::basic_string<char, std::char_traits<char>, 
+    JsonAllocatorAdapter<char, JsonMemoryCategory_Strings> > JsonString;
+
+/**
+ * Get the size of the heap buffer of a string, which it does not have
+ * if the string is short enough to be stored in the object itself.
+ *
+ * @param[in] str the string, a std::string or a JsonString.
+ *
+ * @return the number of bytes.
+ */
+
+template <typename S>
+size_t
+JSONMemory::StringSize(const S &str)
+{
+    uintptr_t p = reinterpret_cast<uintptr_t>(str.data());
+    uintptr_t obj = reinterpret_cast<uintptr_t>(&str);
+
+    return (p >= obj && p < obj + sizeof(str)) ? 0 : str.capacity() + 1;
+}
+
+#endif
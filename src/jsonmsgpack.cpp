@@ -0,0 +1,511 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonmsgpack.h"
+#include <limits.h>
+#include <string.h>
+
+/**
+ * Append a big endian integer to a string.
+ *
+ * @param[in] out the string.
+ * @param[in] val the integer.
+ * @param[in] len the number of bytes to append, from 1 to 8.
+ */
+
+static void
+PutBigEndian(std::string &out, uint64_t val, int len)
+{
+    char buf[8];
+
+    for (int i = len - 1; i >= 0; i--) {
+        buf[i] = (char) (val & 0xff);
+        val >>= 8;
+    }
+    out.append(buf, len);
+}
+
+
+/**
+ * Read a big endian integer.
+ *
+ * @param[in] p the bytes.
+ * @param[in] len the number of bytes, from 1 to 8.
+ *
+ * @return the integer.
+ */
+
+static uint64_t
+GetBigEndian(const unsigned char *p, int len)
+{
+    uint64_t val = 0;
+
+    for (int i = 0; i < len; i++) {
+        val = (val << 8) | p[i];
+    }
+    return val;
+}
+
+
+/**
+ * Read the header of a string.
+ *
+ * @param[in] p the encoded data.
+ * @param[in] end the end of the data.
+ * @param[out] len the length of the string.
+ *
+ * @return the size of the header on success, 0 if the data ends before
+ *         the header does, -1 if the data is not a string.
+ */
+
+static long
+GetStringHeader(const unsigned char *p, const unsigned char *end, size_t *len)
+{
+    long ret = 0;
+    int n;
+
+    if (p >= end) {
+        goto out;
+    }
+    if ((*p & 0xe0) == 0xa0) {
+        *len = *p & 0x1f;
+        ret = 1;
+    } else if (*p == 0xd9 || *p == 0xda || *p == 0xdb) {
+        n = 1 << (*p - 0xd9);
+        if (end - p > n) {
+            *len = GetBigEndian(p + 1, n);
+            ret = n + 1;
+        }
+    } else {
+        ret = -1;
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Append a type byte followed by a length, using the smallest of the 
+ * three formats (8, 16 or 32 bit length) that holds it, or the fix 
+ * format if fix is non-zero and the length fits in its low bits.
+ *
+ * @param[in] out the string.
+ * @param[in] len the length.
+ * @param[in] fix the fix format type byte (0 if there is none).
+ * @param[in] fixmax the largest length the fix format holds.
+ * @param[in] type8 the type byte of the 8 bit format (0 if there is none),
+ *            the 16 and 32 bit formats follow it.
+ */
+
+static void
+PutLength(std::string &out, size_t len, int fix, size_t fixmax, int type8)
+{
+    if (fix && len <= fixmax) {
+        out += (char) (fix | len);
+    } else if (type8 && len <= 0xff) {
+        out += (char) type8;
+        PutBigEndian(out, len, 1);
+    } else if (len <= 0xffff) {
+        out += (char) (type8 ? type8 + 1 : fix == 0x90 ? 0xdc : 0xde);
+        PutBigEndian(out, len, 2);
+    } else {
+        out += (char) (type8 ? type8 + 2 : fix == 0x90 ? 0xdd : 0xdf);
+        PutBigEndian(out, len, 4);
+    }
+}
+
+
+/**
+ * Append a string, as its text, without the quotes and escapes that the
+ * strings of a parsed document keep.
+ *
+ * @param[in] out the string to append to.
+ * @param[in] str the string to encode.
+ */
+
+static void
+PutString(std::string &out, const JsonStr &str)
+{
+    std::string scratch;
+    std::string_view text = JsonStr::Text(str.View(), scratch);
+
+    PutLength(out, text.size(), 0xa0, 31, 0xd9);
+    out.append(text.data(), text.size());
+}
+
+
+/**
+ * Append a signed integer, in the smallest format that holds it.
+ *
+ * @param[in] out the string.
+ * @param[in] val the integer.
+ */
+
+static void
+PutInteger(std::string &out, long val)
+{
+    if (val >= 0) {
+        if (val <= 0x7f) {
+            out += (char) val;
+        } else if (val <= 0xff) {
+            out += (char) 0xcc;
+            PutBigEndian(out, val, 1);
+        } else if (val <= 0xffff) {
+            out += (char) 0xcd;
+            PutBigEndian(out, val, 2);
+        } else if (val <= 0xffffffffL) {
+            out += (char) 0xce;
+            PutBigEndian(out, val, 4);
+        } else {
+            out += (char) 0xcf;
+            PutBigEndian(out, val, 8);
+        }
+    } else if (val >= -32) {
+        out += (char) val;
+    } else if (val >= -128) {
+        out += (char) 0xd0;
+        PutBigEndian(out, (uint64_t) val, 1);
+    } else if (val >= -32768) {
+        out += (char) 0xd1;
+        PutBigEndian(out, (uint64_t) val, 2);
+    } else if (val >= -2147483648L) {
+        out += (char) 0xd2;
+        PutBigEndian(out, (uint64_t) val, 4);
+    } else {
+        out += (char) 0xd3;
+        PutBigEndian(out, (uint64_t) val, 8);
+    }
+}
+
+
+/**
+ * Encode a value, and everything below it, as MessagePack.
+ *
+ * @param[in] val the value.
+ * @param[in] out the string the encoding is appended to.
+ *
+ * @return out.
+ */
+
+std::string &
+JSONMsgPack::Encode(JSONValue *val, std::string &out)
+{
+    JSONValue::iterator iter;
+    JSONTuple *tuple;
+    uint64_t bits;
+    double dval;
+
+    switch (val->GetType()) {
+    case JsonType_Object:
+    case JsonType_Array:
+        if (val->GetType() == JsonType_Object) {
+            PutLength(out, val->GetSize(), 0x80, 15, 0);
+        } else {
+            PutLength(out, val->GetSize(), 0x90, 15, 0);
+        }
+        for (iter = val->begin(); iter != val->end(); ++iter) {
+            Encode(*iter, out);
+        }
+        break;
+    case JsonType_Record:
+        {
+        JSONRecord *record = static_cast<JSONRecord *>(val);
+        int i = 0;
+
+        PutLength(out, record->GetSize(), 0x80, 15, 0);
+        for (iter = val->begin(); iter != val->end(); ++iter, i++) {
+            PutString(out, record->GetKey(i));
+            Encode(*iter, out);
+        }
+        }
+        break;
+    case JsonType_PackedArray:
+        {
+        JSONPackedArray *array = static_cast<JSONPackedArray *>(val);
+
+        PutLength(out, array->GetCount(), 0x90, 15, 0);
+        for (int64_t number : array->GetIntegers()) {
+            PutInteger(out, number);
+        }
+        for (double number : array->GetDoubles()) {
+            memcpy(&bits, &number, sizeof(bits));
+            out += (char) 0xcb;
+            PutBigEndian(out, bits, 8);
+        }
+        }
+        break;
+    case JsonType_Tuple:
+        tuple = static_cast<JSONTuple *>(val);
+        PutString(out, tuple->GetKey());
+        if (tuple->GetValue()) {
+            Encode(tuple->GetValue(), out);
+        } else {
+            out += (char) 0xc0;
+        }
+        break;
+    case JsonType_String:
+        PutString(out, static_cast<JSONString *>(val)->GetStr());
+        break;
+    case JsonType_Number:
+        if (static_cast<JSONNumber *>(val)->IsUnsigned()) {
+            out += (char) 0xcf;
+            PutBigEndian(out, static_cast<JSONNumber *>(val)->GetUnsigned(), 8);
+        } else {
+            PutInteger(out, static_cast<JSONNumber *>(val)->Get());
+        }
+        break;
+    case JsonType_Double:
+        dval = static_cast<JSONDouble *>(val)->Get();
+        memcpy(&bits, &dval, sizeof(bits));
+        out += (char) 0xcb;
+        PutBigEndian(out, bits, 8);
+        break;
+    case JsonType_Bool:
+        out += (char) (static_cast<JSONBoolean *>(val)->Get() ? 0xc3 : 0xc2);
+        break;
+    default:
+        out += (char) 0xc0;
+        break;
+    }
+    return out;
+}
+
+
+/**
+ * Decode a MessagePack value into a new JSONValue tree.
+ *
+ * @param[in] buf the encoded data.
+ * @param[in] len the number of bytes in buf.
+ * @param[out] val the decoded value (caller must delete), NULL if buf 
+ *             does not hold a complete value.
+ * @param[out] used the number of bytes of buf that were decoded, 0 if buf
+ *             does not hold a complete value.
+ *
+ * @return false if the data is not valid MessagePack (or cannot be 
+ *         represented by a JSONValue), true otherwise.
+ */
+
+bool
+JSONMsgPack::Decode(const char *buf, size_t len, JSONValue **val, size_t *used)
+{
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(buf);
+    long ret;
+
+    *val = NULL;
+    *used = 0;
+    ret = DecodeValue(p, p + len, val, 0);
+    if (ret > 0) {
+        *used = ret;
+    }
+    return ret >= 0;
+}
+
+
+/**
+ * Decode one value, recursively.
+ *
+ * @param[in] p the encoded data.
+ * @param[in] end the end of the data.
+ * @param[out] val the decoded value, on success.
+ * @param[in] depth the nesting depth of the value.
+ *
+ * @return the number of bytes decoded on success, 0 if the data ends 
+ *         before the value does, -1 if the data is not valid.
+ */
+
+long
+JSONMsgPack::DecodeValue(const unsigned char *p, const unsigned char *end,
+    JSONValue **val, int depth)
+{
+    const unsigned char *start = p;
+    JSONValue *container = NULL;
+    JSONTuple *tuple;
+    JSONNumber *number;
+    JSONValue *child;
+    std::string stored;
+    uint64_t bits;
+    size_t count = 0;
+    size_t len = 0;
+    double dval;
+    float fval;
+    long ret = 0;
+    int type;
+    int n;
+
+    if (p >= end) {
+        goto out;
+    }
+    if (depth > MaxDepth) {
+        ret = -1;
+        goto out;
+    }
+    type = *p++;
+
+    // lengths of strings, arrays and maps
+
+    if ((type & 0xe0) == 0xa0 || type == 0xd9 || type == 0xda || type == 0xdb) {
+        ret = GetStringHeader(p - 1, end, &len);
+        if (ret <= 0) {
+            goto out;
+        }
+        p += ret - 1;
+        ret = 0;
+        type = 0xa0;
+    } else if ((type & 0xf0) == 0x90 || (type & 0xf0) == 0x80) {
+        count = type & 0x0f;
+        type &= 0xf0;
+    } else if (type == 0xdc || type == 0xdd || type == 0xde || type == 0xdf) {
+        n = (type == 0xdc || type == 0xde) ? 2 : 4;
+        if (end - p < n) {
+            goto out;
+        }
+        count = GetBigEndian(p, n);
+        p += n;
+        type = (type <= 0xdd) ? 0x90 : 0x80;
+    }
+
+    if (type < 0x80 || type >= 0xe0) {
+        *val = new JSONNumber((long) (signed char) type);
+    } else if (type == 0xc0) {
+        *val = new JSONNull();
+    } else if (type == 0xc2 || type == 0xc3) {
+        *val = new JSONBoolean(type == 0xc3);
+    } else if (type >= 0xcc && type <= 0xd3) {
+        n = 1 << ((type - 0xcc) & 3);
+        if (end - p < n) {
+            goto out;
+        }
+        bits = GetBigEndian(p, n);
+        p += n;
+        if (type <= 0xcf) {
+            number = new JSONNumber();
+            number->SetUnsigned(bits);
+        } else {
+            // sign extend
+
+            if (n < 8 && (bits & (1ULL << (n * 8 - 1)))) {
+                bits |= ~0ULL << (n * 8);
+            }
+            number = new JSONNumber((long) bits);
+        }
+        *val = number;
+    } else if (type == 0xca || type == 0xcb) {
+        n = (type == 0xca) ? 4 : 8;
+        if (end - p < n) {
+            goto out;
+        }
+        bits = GetBigEndian(p, n);
+        p += n;
+        if (n == 4) {
+            uint32_t bits32 = (uint32_t) bits;
+
+            memcpy(&fval, &bits32, sizeof(fval));
+            dval = fval;
+        } else {
+            memcpy(&dval, &bits, sizeof(dval));
+        }
+        *val = new JSONDouble(dval);
+    } else if (type == 0xa0) {
+        if ((size_t) (end - p) < len) {
+            goto out;
+        }
+        JsonStr::Quote(std::string_view(reinterpret_cast<const char *>(p), 
+            len), stored);
+        *val = new JSONString(JsonStr(stored));
+        p += len;
+    } else if (type == 0x90 || type == 0x80) {
+        container = (type == 0x90) ? 
+            static_cast<JSONValue *>(new JSONArray()) : 
+            static_cast<JSONValue *>(new JSONObject());
+        for (size_t i = 0; i < count; i++) {
+            tuple = NULL;
+            if (type == 0x80) {
+
+                // keys must be strings
+
+                ret = GetStringHeader(p, end, &len);
+                if (ret <= 0) {
+                    goto out;
+                }
+                p += ret;
+                ret = 0;
+                if ((size_t) (end - p) < len) {
+                    goto out;
+                }
+                tuple = new JSONTuple();
+                JsonStr::Quote(std::string_view(
+                    reinterpret_cast<const char *>(p), len), stored);
+                tuple->SetKey(stored);
+                p += len;
+                container->Append(tuple);
+            }
+            ret = DecodeValue(p, end, &child, depth + 1);
+            if (ret <= 0) {
+                goto out;
+            }
+            p += ret;
+            if (tuple) {
+                tuple->SetValue(child);
+            } else {
+                container->Append(child);
+            }
+        }
+        *val = container;
+        container = NULL;
+    } else {
+        // binary, extension, and the unused type 0xc1
+
+        ret = -1;
+        goto out;
+    }
+    ret = p - start;
+out:
+    delete container;
+    return ret;
+}
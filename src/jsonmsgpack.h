@@ -0,0 +1,90 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONMSGPACK_H__)
+#define __JSONMSGPACK_H__
+
+#include "jsonapi.h"
+#include <string>
+
+/**
+ * MessagePack encoding and decoding of JSONValue trees.
+ *
+ * Every JsonType has a MessagePack counterpart: objects are maps (keyed
+ * by strings), arrays are arrays, numbers are encoded in the smallest
+ * integer format that holds them (unsigned values above LONG_MAX are 
+ * kept, see JSONNumber::SetUnsigned()), and doubles as float64, so
+ * nothing is lost in either direction. Strings and keys are encoded as 
+ * their text, without the quotes and escapes that those of a parsed 
+ * document keep (see JsonStr::Unquote()), and are decoded to the form 
+ * the parser stores, quotes and escapes included.
+ *
+ * Encode() appends to the caller's string as it walks the tree. Decode()
+ * reads straight from the caller's buffer, and decodes one value at a
+ * time, so a stream of values can be decoded as data arrives: when the
+ * buffer holds an incomplete value, nothing is consumed, and Decode() 
+ * can be called again once more data has been appended.
+ *
+ * The binary and extension types have no JSON counterpart, and are 
+ * rejected by Decode(), as are maps with keys that are not strings.
+ */
+
+class JSONMsgPack
+{
+public:
+    static std::string &Encode(JSONValue *val, std::string &out);
+    static bool Decode(const char *buf, size_t len, JSONValue **val, 
+        size_t *used);
+private:
+    static const int MaxDepth = 512;
+    static long DecodeValue(const unsigned char *p, const unsigned char *end,
+        JSONValue **val, int depth);
+};
+
+#endif
@@ -88,6 +88,92 @@ JsonNode::DeleteChildren()
 }
 
 
+/**
+ * Allocate a node from the current allocator, counting it in the live
+ * memory of the library (see JSONMemory).
+ *
+ * @param[in] size the size of the node.
+ *
+ * @return the memory.
+ */
+
+void *
+JsonNode::operator new(size_t size)
+{
+    return JSONMemory::Allocate(size, JsonMemoryCategory_Nodes);
+}
+
+
+/**
+ * Free a node, giving it back to the allocator it came from.
+ *
+ * @param[in] p the memory.
+ * @param[in] size the size of the node.
+ */
+
+void
+JsonNode::operator delete(void *p, size_t size)
+{
+    JSONMemory::Free(p, size, JsonMemoryCategory_Nodes);
+}
+
+
+/**
+ * Add the memory used by the node, and its children, to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JsonNode::AddMemoryUsage(JSONMemoryUsage &usage)
+{
+    JsonNodeList::iterator iter;
+
+    usage.nodes += sizeof(JsonNode);
+    for (iter = m_children.begin(); iter != m_children.end(); ++iter) {
+        usage.containers += JSONMemory::ListNodeSize;
+        (*iter)->AddMemoryUsage(usage);
+    }
+}
+
+
+/**
+ * Add the memory used by the value, and its children, to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JsonValue::AddMemoryUsage(JSONMemoryUsage &usage)
+{
+    JsonNode::AddMemoryUsage(usage);
+    usage.nodes += sizeof(JsonValue) - sizeof(JsonNode);
+    if (m_strVal.IsInline() == false) {
+        usage.strings += m_strVal.size() + 1;
+    }
+}
+
+
+/**
+ * Add the memory used by the tuple, its key and its value, to a total.
+ *
+ * @param[in,out] usage the total.
+ */
+
+void
+JsonTuple::AddMemoryUsage(JSONMemoryUsage &usage)
+{
+    JsonValue::AddMemoryUsage(usage);
+    usage.nodes += sizeof(JsonTuple) - sizeof(JsonValue);
+    if (m_key) {
+        m_key->AddMemoryUsage(usage);
+    }
+    if (m_val) {
+        m_val->AddMemoryUsage(usage);
+    }
+}
+
+
 /**
  * Convert all children of a node to a string, concatenating to passed in 
  * string, and returning the result.
@@ -102,11 +188,10 @@ JsonNode::DeleteChildren()
 std::string 
 JsonValue::DumpChildren(std::string &str)
 {
-    std::list<JsonNode *>::iterator iter;
     int count = 0;
 
-    for (iter = GetChildren().begin(); iter != GetChildren().end(); ++iter) {
-        JsonValue *val = static_cast<JsonValue *>(*iter);
+    for (JsonNode *child : *this) {
+        JsonValue *val = static_cast<JsonValue *>(child);
         if (count) {
             str += ", ";
         }
@@ -170,13 +255,15 @@ JsonValue::ToJson(std::string &str)
         break;
     case JsonType_Tuple:
         tup = static_cast<JsonTuple *>(this);
-        str += tup->GetKey();
+        str += tup->GetKeyView();
         str += " : ";
         str = tup->GetKeyValue()->ToJson(str);
         break;
     case JsonType_Root:
         str = DumpChildren(str);
         break;
+    default:
+        break;
     } 
     return str;
 }
@@ -322,6 +409,26 @@ JsonValue::GetValue(double &val)
 
 bool 
 JsonValue::GetValue(std::string &val)
+{
+    bool ret = false;
+    if (GetType() == JsonType_String) {
+        ret = true;
+        val = m_strVal.str();
+    }
+    return ret;
+}
+
+
+/**
+ * Get value object's value as a string.
+ *
+ * @param[out] val value as a string
+ *
+ * @return true on success, false on failure.
+ */
+
+bool 
+JsonValue::GetValue(JsonStr &val)
 {
     bool ret = false;
     if (GetType() == JsonType_String) {
@@ -331,3 +438,37 @@ JsonValue::GetValue(std::string &val)
     return ret;
 }
 
+
+/**
+ * Get value object's value as a string, without copying it. The view is
+ * valid as long as the value object is, and is not modified.
+ *
+ * @return the string, empty if the value is not a string.
+ */
+
+std::string_view
+JsonValue::GetStringView() const
+{
+    return GetType() == JsonType_String ? m_strVal.View() : std::string_view();
+}
+
+
+/**
+ * Exchange the value object's string value with the passed in string,
+ * avoiding a copy. Used to hand the string over to another object.
+ *
+ * @param[in,out] val string to exchange with
+ *
+ * @return true on success, false on failure (value is not a string).
+ */
+
+bool 
+JsonValue::SwapValue(JsonStr &val)
+{
+    bool ret = false;
+    if (GetType() == JsonType_String) {
+        ret = true;
+        m_strVal.swap(val);
+    }
+    return ret;
+}
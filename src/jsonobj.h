@@ -52,6 +52,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <string>
 #include <list>
+#include "jsonstr.h"
 
 /**
  * Enums for the various JSON types, plus a couple of types for
@@ -71,9 +72,15 @@ typedef enum {
     JsonType_Bool,
     JsonType_Root,
     JsonType_Tuple,
-    JsonType_Null
+    JsonType_Null,
+    JsonType_Record,    // an object that shares its keys, see JSONRecord
+    JsonType_PackedArray // an array of numbers, see JSONPackedArray
 } JsonType;
 
+class JsonNode;
+
+typedef std::list<JsonNode *, JsonCountingAllocator<JsonNode *> > JsonNodeList;
+
 /**
  * Base class for all Json values. Basically manages the type of the
  * value, and its list of children. Arrays and Objects both have 
@@ -87,18 +94,25 @@ class JsonNode
 public:
     JsonNode();
     virtual ~JsonNode();
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
     void AddChild(JsonNode *node) {node->SetParent(this); m_children.push_back(node);}
     void SetParent(JsonNode *node) {m_parent = node;}
-    JsonNode *GetParent() {return m_parent;}
-    int GetNumChildren() {return m_children.size();}
-    std::list<JsonNode *>& GetChildren() {return m_children;};
+    JsonNode *GetParent() const {return m_parent;}
+    int GetNumChildren() const {return m_children.size();}
+    JsonNodeList& GetChildren() {return m_children;};
+    JsonNodeList::iterator begin() {return m_children.begin();}
+    JsonNodeList::iterator end() {return m_children.end();}
+    JsonNodeList::const_iterator begin() const {return m_children.begin();}
+    JsonNodeList::const_iterator end() const {return m_children.end();}
     void SetType(JsonType type) {m_type = type;}
-    JsonType GetType() {return m_type;}
+    JsonType GetType() const {return m_type;}
     void DeleteChildren();
+    virtual void AddMemoryUsage(JSONMemoryUsage &usage);
 private:
     JsonType m_type;
     JsonNode *m_parent;
-    std::list<JsonNode *> m_children;
+    JsonNodeList m_children;
 };
 
 
@@ -129,13 +143,17 @@ public:
     bool GetValue(long &val);
     bool GetValue(double &val);
     bool GetValue(std::string &val);
+    bool GetValue(JsonStr &val);
+    std::string_view GetStringView() const;
+    bool SwapValue(JsonStr &val);
     std::string ToJson(std::string &str);
+    void AddMemoryUsage(JSONMemoryUsage &usage);
 private:
     std::string DumpChildren(std::string &str);
     bool m_boolVal;
     double m_dblVal;
     long m_longVal;
-    std::string m_strVal;
+    JsonStr m_strVal;
 };
 
 
@@ -156,8 +174,11 @@ public:
     }
     ~JsonTuple() {delete m_key; delete m_val;}
     std::string GetKey() {std::string ret; m_key->GetValue(ret); return ret;}
+    bool GetKey(JsonStr &key) {return m_key->GetValue(key);}
+    std::string_view GetKeyView() const {return m_key->GetStringView();}
     JsonValue *GetKeyValue() {return m_val;}
     void SetKeyValue(JsonValue *val) {m_val = val;}
+    void AddMemoryUsage(JSONMemoryUsage &usage);
 private:
     JsonValue *m_key;
     JsonValue *m_val;
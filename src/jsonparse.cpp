@@ -50,6 +50,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "jsonparse.h"
 #include "context.h"
 #include "jsonobj.h"
+#include "jsonapi.h"
+#include "jsontape.h"
 #include <memory.h>
 
 /**
@@ -58,7 +60,15 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 JsonParse::JsonParse() :
     m_offset(0),
-    m_root(NULL)
+    m_direct(false),
+    m_root(NULL),
+    m_value(NULL),
+    m_tape(NULL),
+    m_allocator(NULL),
+    m_shapes(NULL),
+    m_packArrays(false),
+    m_lazy(false),
+    m_schema(NULL)
 {
 }
 
@@ -70,6 +80,7 @@ JsonParse::JsonParse() :
 JsonParse::~JsonParse()
 {
     delete m_root;
+    delete m_value;
 }
 
 
@@ -84,8 +95,16 @@ JsonParse::GetType()
 {
     JsonType type = JsonType_Root;
 
-    if (m_root->GetNumChildren() == 1) {
-        std::list<JsonNode *>::iterator iter;
+    if (m_tape) {
+        if (!m_tape->IsEmpty()) {
+            type = m_tape->GetRoot().GetType();
+        }
+    } else if (m_direct) {
+        if (m_value) {
+            type = m_value->GetType();
+        }
+    } else if (m_root && m_root->GetNumChildren() == 1) {
+        JsonNodeList::iterator iter;
 
         iter = m_root->GetChildren().begin();
         type = (*iter)->GetType();
@@ -97,15 +116,17 @@ JsonParse::GetType()
 /** 
  * Get the root element from the parse.
  *
- * @return the root element of the parse.
+ * @return the root element of the parse. Always NULL if the parse was
+ *         done in direct mode, see SetDirect(), or into a tape, see
+ *         SetTape().
  */
 
 JsonNode *
 JsonParse::GetRoot()
 {
     JsonNode *ret = (JsonNode *)NULL;
-    if (m_root->GetNumChildren() == 1) {
-        std::list<JsonNode *>::iterator iter;
+    if (m_root && m_root->GetNumChildren() == 1) {
+        JsonNodeList::iterator iter;
 
         ret = *(m_root->GetChildren().begin());
     }
@@ -113,6 +134,30 @@ JsonParse::GetRoot()
 }
 
 
+/**
+ * Get the memory held by the parser: the tree it built (the internal 
+ * tree, or in direct mode the JSONValue tree not yet released), and its 
+ * copy of the input, which is counted as a string.
+ *
+ * @return the number of bytes, by category.
+ */
+
+JSONMemoryUsage
+JsonParse::MemoryUsage()
+{
+    JSONMemoryUsage usage;
+
+    if (m_root) {
+        m_root->AddMemoryUsage(usage);
+    }
+    if (m_value) {
+        usage += m_value->MemoryUsage();
+    }
+    usage.strings += JSONMemory::StringSize(m_input);
+    return usage;
+}
+
+
 /**
  * Set the input path for a parse.
  *
@@ -122,7 +167,9 @@ JsonParse::GetRoot()
 void
 JsonParse::SetInput(std::string &input)
 {
-    m_input = input;
+    JSONAllocatorScope scope(m_allocator);
+
+    m_input.assign(input.data(), input.size());
     m_offset = 0;
 }
 
@@ -206,23 +253,271 @@ JsonParse::PushRoot()
     m_root = new JsonNode();
     m_root->SetType(JsonType_Root);
     m_ctx.Push(m_root);
+    if (m_value) {
+        delete m_value;
+        m_value = NULL;
+    }
+}
+
+
+/**
+ * Take ownership of the JSONValue tree built by a parse in direct mode.
+ * Subsequent calls return NULL until the next parse.
+ *
+ * @return the root of the tree (caller must delete), or NULL.
+ */
+
+JSONValue *
+JsonParse::ReleaseValue()
+{
+    JSONValue *ret = m_value;
+
+    m_value = NULL;
+    return ret;
+}
+
+
+/**
+ * Take ownership of the internal tree built by a parse, including its 
+ * root node (see PushRoot()). Subsequent calls return NULL until the 
+ * next parse.
+ *
+ * @return the root node of the tree (caller must delete), or NULL.
+ */
+
+JsonNode *
+JsonParse::ReleaseRoot()
+{
+    JsonNode *ret = m_root;
+
+    // the root is left on the context stack by a parse.
+
+    while (m_ctx.Pop() != (JsonNode *) NULL) {
+    }
+    m_root = NULL;
+    return ret;
+}
+
+
+/**
+ * Convert a scalar value created by the lexer to its JSONValue 
+ * counterpart. String values are handed over rather than copied. The 
+ * lexer's object is destroyed.
+ *
+ * @param[in] obj the scalar value to convert.
+ *
+ * @return the new JSONValue, or NULL if obj is not a scalar.
+ */
+
+JSONValue *
+JsonParse::MakeValue(JsonValue *obj)
+{
+    JSONValue *val = (JSONValue *) NULL;
+
+    switch(obj->GetType()) {
+    case JsonType_String:
+        {
+        JsonStr str;
+        obj->SwapValue(str);
+        val = new JSONString(std::move(str));
+        }
+        break;
+    case JsonType_Number:
+        {
+        long lval;
+        obj->GetValue(lval);
+        val = new JSONNumber(lval);
+        }
+        break;
+    case JsonType_Double:
+        {
+        double dval;
+        obj->GetValue(dval);
+        val = new JSONDouble(dval);
+        }
+        break;
+    case JsonType_Bool:
+        {
+        bool bval;
+        obj->GetValue(bval);
+        val = new JSONBoolean(bval);
+        }
+        break;
+    case JsonType_Null:
+        val = new JSONNull();
+        break;
+    default:
+        break;
+    }
+    delete obj;
+    return val;
+}
+
+
+/**
+ * Attach a newly created JSONValue to the array on top of the value
+ * stack, or make it the result of the parse if the stack is empty. If
+ * the top of the stack is an object, nothing is done, the value is
+ * waiting to become the value of a tuple.
+ *
+ * @param[in] val the value to attach.
+ * @param[in] current the top of the value stack, or NULL.
+ * @param[in] value where the result of the parse is kept.
+ */
+
+static void
+AttachValue(JSONValue *val, JSONValue *current, JSONValue **value)
+{
+    if (!current) {
+        if (!*value) {
+            *value = val;
+        }
+    } else if (current->GetType() == JsonType_Array) {
+        current->Append(val);
+    }
+}
+
+
+/**
+ * Discard the partial JSONValue tree left behind when a parse in direct
+ * mode fails. Containers on the value stack that were not yet attached
+ * to a parent (i.e., values of tuples not yet reduced) are deleted, 
+ * as is the tree rooted at m_value, and the value stack is emptied.
+ */
+
+void
+JsonParse::DiscardValue()
+{
+    JSONValue *below;
+    JSONValue *p;
+
+    // anything attached to a parent is deleted along with m_value.
+
+    for (int i = 0; i < m_ctx.GetValueDepth() - 1; i++) {
+        below = m_ctx.GetValueAt(i + 1);
+        if (below->GetType() == JsonType_Object) {
+            delete m_ctx.GetValueAt(i);
+        }
+    }
+    while ((p = m_ctx.PopValue()) != (JSONValue *) NULL) {
+        ;
+    }
+    delete m_value;
+    m_value = NULL;
+}
+
+
+/**
+ * Add a scalar value created by the lexer to the tape. The lexer's 
+ * object is destroyed.
+ *
+ * @param[in] tape the tape.
+ * @param[in] obj the scalar value to add.
+ */
+
+static void
+AddTapeValue(JSONTape *tape, JsonValue *obj)
+{
+    switch(obj->GetType()) {
+    case JsonType_String:
+        {
+        JsonStr str;
+        obj->SwapValue(str);
+        tape->AddString(str.data(), str.size());
+        }
+        break;
+    case JsonType_Number:
+        {
+        long lval;
+        obj->GetValue(lval);
+        tape->AddNumber(lval);
+        }
+        break;
+    case JsonType_Double:
+        {
+        double dval;
+        obj->GetValue(dval);
+        tape->AddDouble(dval);
+        }
+        break;
+    case JsonType_Bool:
+        {
+        bool bval;
+        obj->GetValue(bval);
+        tape->AddBoolean(bval);
+        }
+        break;
+    case JsonType_Null:
+        tape->AddNull();
+        break;
+    default:
+        break;
+    }
+    delete obj;
+}
+
+
+/**
+ * Called when the key of a tuple has been seen, before its value is 
+ * parsed. Only the tape needs the key at this point, since values are
+ * written to it in document order. 
+ *
+ * @param[in] name key for the tuple.
+ */
+
+void
+JsonParse::AddKey(void *name)
+{
+    if (m_tape) {
+        JsonValue *key = static_cast<JsonValue *>(name);
+        JsonStr str;
+
+        key->GetValue(str);
+        m_tape->AddKey(str.data(), str.size());
+    }
 }
 
 
 /**
  * Create a JsonTuple and add it as a child to the node on top of the
- * context stack.
+ * context stack. In direct mode, create a JSONTuple and append it to
+ * the JSONObject on top of the value stack. When filling a tape, the 
+ * tuple was already added by AddKey(), and its value since.
  *
  * @param[in] name key for the tuple.
  * @param[in] value value for the tuple/
  *
- * @return true on success, false otherwise.
+ * @return the tuple on success, NULL otherwise.
  */
 
-bool
+void *
 JsonParse::AddTuple(void *name, void *val)
 {
-    bool ret = false;
+    void *ret = NULL;
+
+    if (m_tape) {
+        delete static_cast<JsonValue *>(name);
+        return ret;
+    }
+    if (m_direct) {
+        JSONValue *current = m_ctx.CurrentValue();
+        JsonValue *key = static_cast<JsonValue *>(name);
+
+        if (current && current->GetType() == JsonType_Object) {
+            JsonStr str;
+            JSONTuple *tuple = new JSONTuple();
+
+            key->SwapValue(str);
+            tuple->SetKey(std::move(str));
+            tuple->SetValue(static_cast<JSONValue *>(val));
+            current->Append(tuple);
+            ret = tuple;
+        } else {
+            delete static_cast<JSONValue *>(val);
+        }
+        delete key;
+        return ret;
+    }
 
     JsonNode *current;
     JsonTuple *tuple;
@@ -233,7 +528,7 @@ JsonParse::AddTuple(void *name, void *val)
             static_cast<JsonValue *>(name),
             static_cast<JsonValue *>(val));
         current->AddChild(tuple);
-        ret = true;
+        ret = tuple;
     } else {
         delete static_cast<JsonValue *>(name);
         delete static_cast<JsonValue *>(val);
@@ -243,59 +538,121 @@ JsonParse::AddTuple(void *name, void *val)
 
 
 /**
- * Push JSON object onto context stack.
+ * Push JSON object onto context stack. In direct mode, a JSONObject is
+ * created in its place and pushed onto the value stack. When filling a
+ * tape, the object is started on the tape.
  *
  * @param[in] obj the object to push.
  *
- * @return true on success, false on failure.
+ * @return the object pushed.
  */
 
-bool 
+void *
 JsonParse::AddObject(JsonValue *obj)
 {
+    if (m_tape) {
+        delete obj;
+        m_tape->BeginContainer(JsonType_Object);
+        return NULL;
+    }
+    if (m_direct) {
+        JSONObject *jsonobj = new JSONObject();
+
+        delete obj;
+        AttachValue(jsonobj, m_ctx.CurrentValue(), &m_value);
+        m_ctx.PushValue(jsonobj);
+        return jsonobj;
+    }
+
     obj->SetType(JsonType_Object); 
     if (m_ctx.Current()->GetType() == JsonType_Root ||
         m_ctx.Current()->GetType() == JsonType_Array) {
         m_ctx.Current()->AddChild(obj); 
     }
     m_ctx.Push(obj);
-    return true;
+    return obj;
 }
 
 
 /**
- * Push JSON array onto context stack.
+ * Push JSON array onto context stack. In direct mode, a JSONArray is
+ * created in its place and pushed onto the value stack. When filling a
+ * tape, the array is started on the tape.
  *
  * @param[in] obj the object to push.
  *
- * @return true on success, false on failure.
+ * @return the array pushed.
  */
 
-bool 
+void *
 JsonParse::AddArray(JsonValue *obj)
 {
+    if (m_tape) {
+        delete obj;
+        m_tape->BeginContainer(JsonType_Array);
+        return NULL;
+    }
+    if (m_direct) {
+        JSONArray *jsonarray = new JSONArray();
+
+        delete obj;
+        AttachValue(jsonarray, m_ctx.CurrentValue(), &m_value);
+        m_ctx.PushValue(jsonarray);
+        return jsonarray;
+    }
+
     obj->SetType(JsonType_Array); 
     if (m_ctx.Current()->GetType() == JsonType_Root ||
         m_ctx.Current()->GetType() == JsonType_Array) {
         m_ctx.Current()->AddChild(obj); 
     }
     m_ctx.Push(obj);
-    return true;
+    return obj;
 }
 
 
 /**
- * Push JSON value onto context stack.
+ * Pop the object or array on top of the context stack (or the value 
+ * stack, in direct mode, or end it on the tape) when its closing brace
+ * or bracket is seen.
+ */
+
+void
+JsonParse::PopContext()
+{
+    if (m_tape) {
+        m_tape->EndContainer();
+    } else if (m_direct) {
+        m_ctx.PopValue();
+    } else {
+        m_ctx.Pop();
+    }
+}
+
+
+/**
+ * Push JSON value onto context stack. In direct mode, the value is 
+ * converted to a JSONValue and added to the array on top of the value
+ * stack. When filling a tape, the value is added to the tape.
  *
  * @param[in] obj the value to push.
  *
- * @return true on success, false on failure.
+ * @return the value (in direct mode, the JSONValue that replaced it).
  */
 
-bool 
+void *
 JsonParse::AddValue(JsonValue *obj)
 {
-    bool ret = false;
+    if (m_tape) {
+        AddTapeValue(m_tape, obj);
+        return NULL;
+    }
+    if (m_direct) {
+        JSONValue *val = MakeValue(obj);
+
+        AttachValue(val, m_ctx.CurrentValue(), &m_value);
+        return val;
+    }
 
     JsonNode *current;
     JsonType type;
@@ -306,7 +663,6 @@ JsonParse::AddValue(JsonValue *obj)
     }
     if (current && type != JsonType_Object && type != JsonType_Tuple) {
         current->AddChild(obj);
-        ret = true;
     } 
-    return ret;
+    return obj;
 }
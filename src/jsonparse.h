@@ -54,10 +54,35 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "context.h"
 #include <string>
 
+class JSONValue;
+class JSONTape;
+class JSONShapeTable;
+class JSONSchema;
+
 /**
  * Helper class providing interfaces useful to parser, primarily called
  * when parser reduces some production that requires adding something to
  * the DOM.
+ *
+ * SetInput(), Parse() and JSONAPI::GetRootObject() allocate from the 
+ * allocator set with SetAllocator(), if any, see JSONAllocator. Parse() 
+ * returns false if the allocator runs out; SetInput() throws 
+ * std::bad_alloc.
+ *
+ * If a shape table is set with SetShapes(), JSONAPI::GetRootObject() 
+ * returns the objects of the tree as records sharing the shapes of the 
+ * table, see JSONRecord. If SetPackArrays() is set, it returns the 
+ * arrays of numbers of the tree as packed arrays, see JSONPackedArray.
+ *
+ * If SetLazy() is set, JSONAPI::GetRootObject() takes the internal tree
+ * of the parse, and converts the elements of each object or array to
+ * JSONValues only when the object or array is first looked into (see
+ * JSONValue), so that the parts of a document never accessed are never 
+ * converted. GetRoot() then returns NULL until the next parse.
+ *
+ * If a schema is set with SetSchema(), Parse() first validates the input 
+ * against it and returns false, without building anything, if it is not 
+ * valid; GetSchemaError() then tells why.
  */
 
 class JsonParse 
@@ -66,10 +91,12 @@ public:
     JsonParse();
     ~JsonParse();
     void PushRoot();
-    bool AddTuple(void *name, void *val);
-    bool AddArray(JsonValue *obj);
-    bool AddObject(JsonValue *obj);
-    bool AddValue(JsonValue *obj);
+    void AddKey(void *name);
+    void *AddTuple(void *name, void *val);
+    void *AddArray(JsonValue *obj);
+    void *AddObject(JsonValue *obj);
+    void *AddValue(JsonValue *obj);
+    void PopContext();
     std::string ToJson();
     std::string ToJson(JsonValue *val);
     JsonType GetType();
@@ -79,11 +106,40 @@ public:
     Context *GetContext() {return &m_ctx;}
     bool Parse();
     void HandleError(void *scanner, const char *msg);
+    void SetDirect(bool direct) {m_direct = direct;}
+    bool GetDirect() {return m_direct;}
+    JSONValue *ReleaseValue();
+    JsonNode *ReleaseRoot();
+    void SetTape(JSONTape *tape) {m_tape = tape;}
+    JSONTape *GetTape() {return m_tape;}
+    JSONMemoryUsage MemoryUsage();
+    void SetAllocator(JSONAllocator *allocator) {m_allocator = allocator;}
+    JSONAllocator *GetAllocator() {return m_allocator;}
+    void SetShapes(JSONShapeTable *shapes) {m_shapes = shapes;}
+    JSONShapeTable *GetShapes() {return m_shapes;}
+    void SetPackArrays(bool pack) {m_packArrays = pack;}
+    bool GetPackArrays() {return m_packArrays;}
+    void SetLazy(bool lazy) {m_lazy = lazy;}
+    bool GetLazy() {return m_lazy;}
+    void SetSchema(const JSONSchema *schema) {m_schema = schema;}
+    const JSONSchema *GetSchema() {return m_schema;}
+    const std::string &GetSchemaError() {return m_schemaError;}
 private:
+    JSONValue *MakeValue(JsonValue *obj);
+    void DiscardValue();
     int m_offset;
-    std::string m_input;
+    bool m_direct;
+    JsonString m_input;
     Context m_ctx;
     JsonNode *m_root;
+    JSONValue *m_value;
+    JSONTape *m_tape;
+    JSONAllocator *m_allocator;
+    JSONShapeTable *m_shapes;
+    bool m_packArrays;
+    bool m_lazy;
+    const JSONSchema *m_schema;
+    std::string m_schemaError;
 };
 
 #endif
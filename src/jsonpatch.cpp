@@ -0,0 +1,917 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonpatch.h"
+#include <algorithm>
+#include <map>
+#include <stdlib.h>
+
+/**
+ * Get the text of a string in a patch document. Strings of a parsed 
+ * document keep their quotes and escapes, these are removed, see 
+ * JsonStr::Unquote().
+ *
+ * @param[in] val the value, should be a JSONString.
+ * @param[out] out the text of the string.
+ *
+ * @return true on success, false if val is not a string.
+ */
+
+static bool
+GetPatchString(JSONValue *val, std::string &out)
+{
+    bool ret = false;
+
+    if (val == NULL || val->GetType() != JsonType_String) {
+        goto out;
+    }
+    ret = JsonStr::Unquote(static_cast<JSONString *>(val)->GetView(), out);
+out:
+    return ret;
+}
+
+
+/**
+ * Compare two values as the "test" operation does (RFC 6902, section 
+ * 4.6): numbers are equal if their values are, whether they are 
+ * integers or doubles, strings and keys if their text is, whatever the 
+ * escapes used to write it. 
+ *
+ * @param[in] a a value.
+ * @param[in] b the value to compare it with.
+ *
+ * @return true if the values are equal.
+ */
+
+static bool
+PatchEquals(const JSONValue *a, const JSONValue *b)
+{
+    JsonType ta = a->GetType(), tb = b->GetType();
+    bool ret = false;
+
+    if (ta == JsonType_PackedArray || tb == JsonType_PackedArray) {
+        JSONArray *ca = NULL, *cb = NULL;
+
+        if (ta == tb && static_cast<const JSONPackedArray *>(a)->
+            GetElementType() == static_cast<const JSONPackedArray *>(b)->
+            GetElementType()) {
+            ret = a->Equals(*b);
+            goto out;
+        }
+        if (ta == JsonType_PackedArray) {
+            ca = static_cast<const JSONPackedArray *>(a)->ToArray();
+        }
+        if (tb == JsonType_PackedArray) {
+            cb = static_cast<const JSONPackedArray *>(b)->ToArray();
+        }
+        ret = PatchEquals(ca ? ca : a, cb ? cb : b);
+        JSONValue::Unref(ca);
+        JSONValue::Unref(cb);
+    } else if ((ta == JsonType_Number || ta == JsonType_Double) && 
+        (tb == JsonType_Number || tb == JsonType_Double) && ta != tb) {
+        const JSONNumber *n;
+        double d;
+
+        if (ta == JsonType_Number) {
+            n = static_cast<const JSONNumber *>(a);
+            d = static_cast<const JSONDouble *>(b)->Get();
+        } else {
+            n = static_cast<const JSONNumber *>(b);
+            d = static_cast<const JSONDouble *>(a)->Get();
+        }
+
+        // a long double holds any 64 bit integer exactly
+
+        if (n->IsUnsigned()) {
+            ret = (long double) n->GetUnsigned() == (long double) d;
+        } else {
+            ret = (long double) n->Get() == (long double) d;
+        }
+    } else if (ta == JsonType_String && tb == JsonType_String) {
+        std::string sa, sb;
+
+        ret = JsonStr::Unquote(static_cast<const JSONString *>(a)->GetView(), 
+                sa) && 
+            JsonStr::Unquote(static_cast<const JSONString *>(b)->GetView(), 
+                sb) && 
+            sa == sb;
+    } else if (ta == JsonType_Array && tb == JsonType_Array) {
+        JSONValue::const_iterator ia, ib;
+
+        if (a->GetSize() != b->GetSize()) {
+            goto out;
+        }
+        for (ia = a->begin(), ib = b->begin(); ia != a->end(); ++ia, ++ib) {
+            if (!PatchEquals(*ia, *ib)) {
+                goto out;
+            }
+        }
+        ret = true;
+    } else if ((ta == JsonType_Object || ta == JsonType_Record) && 
+        (tb == JsonType_Object || tb == JsonType_Record)) {
+        std::map<std::string, const JSONValue *> members;
+        std::map<std::string, const JSONValue *>::iterator iter;
+        std::string key;
+
+        if (a->GetSize() != b->GetSize()) {
+            goto out;
+        }
+        for (const auto &member : b->Members()) {
+            if (!JsonStr::Unquote(member.key, key)) {
+                goto out;
+            }
+            members[key] = member.value;
+        }
+        for (const auto &member : a->Members()) {
+            if (!JsonStr::Unquote(member.key, key) || 
+                (iter = members.find(key)) == members.end() || 
+                !PatchEquals(member.value, iter->second)) {
+                goto out;
+            }
+        }
+        ret = true;
+    } else {
+        ret = a->Equals(*b);
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Find the member of an object or record with the specified key. Keys
+ * written with escapes are compared by their text, see 
+ * JsonStr::Unquote().
+ *
+ * @param[in] obj the object or record.
+ * @param[in] key the text of the key.
+ *
+ * @return the offset of the member, see JSONValue::FindKey(), or -1 if 
+ *         there is no such key.
+ */
+
+static int
+FindMember(const JSONValue *obj, const std::string &key)
+{
+    bool plain = key.find_first_of("\\\"") == std::string::npos;
+    std::string text;
+    int ret = -1;
+    int i = 0;
+
+    if (plain && (ret = obj->FindKey(key)) >= 0) {
+        goto out;
+    }
+    for (const auto &member : obj->Members()) {
+        if ((!plain || member.key.find('\\') != std::string_view::npos) && 
+            JsonStr::Unquote(member.key, text) && text == key) {
+            ret = i;
+            break;
+        }
+        i++;
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Split a JSON Pointer (RFC 6901) into its reference tokens, decoding
+ * "~1" to "/" and "~0" to "~".
+ *
+ * @param[in] ptr the pointer, "" for the whole document.
+ * @param[out] tokens the reference tokens.
+ *
+ * @return true on success, false if the pointer is malformed.
+ */
+
+static bool
+ParsePointer(const std::string &ptr, std::vector<std::string> &tokens)
+{
+    bool ret = false;
+    std::string token;
+    size_t i;
+
+    tokens.clear();
+    if (ptr.size() && ptr[0] != '/') {
+        goto out;
+    }
+    for (i = 1; i <= ptr.size(); i++) {
+        if (i == ptr.size() || ptr[i] == '/') {
+            tokens.push_back(token);
+            token.clear();
+        } else if (ptr[i] == '~') {
+            if (i + 1 < ptr.size() && ptr[i + 1] == '0') {
+                token += '~';
+            } else if (i + 1 < ptr.size() && ptr[i + 1] == '1') {
+                token += '/';
+            } else {
+                goto out;
+            }
+            i++;
+        } else {
+            token += ptr[i];
+        }
+    }
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Convert a reference token to an array index.
+ *
+ * @param[in] token the token, digits without leading zeros, or "-".
+ * @param[in] size the size of the array.
+ * @param[in] append if true, the index may be size, which is also what
+ *            "-" refers to. Otherwise, it must refer to an element.
+ *
+ * @return the index, or -1 if the token is not a valid index.
+ */
+
+static int
+ParseIndex(const std::string &token, int size, bool append)
+{
+    int ret = -1;
+    long val;
+    char *end;
+
+    if (append == false) {
+        size--;
+    }
+    if (token == "-") {
+        ret = append ? size : -1;
+        goto out;
+    }
+    if (token.empty() || token[0] < '0' || token[0] > '9' ||
+        (token[0] == '0' && token.size() > 1)) {
+        goto out;
+    }
+    val = strtol(token.c_str(), &end, 10);
+    if (*end == '\0' && val <= size) {
+        ret = (int) val;
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Find the value of a member of a patch operation.
+ *
+ * @param[in] op the operation object.
+ * @param[in] name the member name.
+ *
+ * @return the value, or NULL if there is no such member.
+ */
+
+static JSONValue *
+GetMember(JSONValue *op, const char *name)
+{
+    int i = op->FindKey(name);
+
+    if (i < 0) {
+        return NULL;
+    }
+    return static_cast<JSONTuple *>(op->Get(i))->GetValue();
+}
+
+
+/**
+ * Compile a patch document. Any previously compiled operations are 
+ * discarded. The values in the patch are copied, so the patch document
+ * may be deleted once compiled.
+ *
+ * @param[in] patch the patch document, an array of operation objects.
+ *
+ * @return true on success, false if the patch is malformed, in which 
+ *         case the patch is left empty.
+ */
+
+bool
+JSONPatch::Compile(JSONValue *patch)
+{
+    JSONValue::iterator iter;
+    bool ret = false;
+
+    Clear();
+    if (patch == NULL || patch->GetType() != JsonType_Array) {
+        goto out;
+    }
+    m_ops.reserve(patch->GetSize());
+    for (iter = patch->begin(); iter != patch->end(); ++iter) {
+        if (CompileOp(*iter) == false) {
+            Clear();
+            goto out;
+        }
+    }
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Parse and compile a patch document.
+ *
+ * @param[in] patch the patch document, in JSON format.
+ *
+ * @return true on success, false if the patch could not be parsed or is
+ *         malformed.
+ */
+
+bool
+JSONPatch::Compile(const std::string &patch)
+{
+    JsonParse parser;
+    std::string input(patch);
+    JSONValue *val = NULL;
+    bool ret = false;
+
+    parser.SetDirect(true);
+    parser.SetInput(input);
+    if (parser.Parse() == false) {
+        Clear();
+        goto out;
+    }
+    val = JSONAPI::GetValue(&parser);
+    ret = Compile(val);
+    delete val;
+out:
+    return ret;
+}
+
+
+/**
+ * Compile one operation of a patch, and add it to the list.
+ *
+ * @param[in] op the operation object.
+ *
+ * @return true on success, false if the operation is malformed.
+ */
+
+bool
+JSONPatch::CompileOp(JSONValue *op)
+{
+    static const struct {
+        const char *name;
+        JsonPatchOpType type;
+    } names[] = {
+        {"add", JsonPatchOpType_Add},
+        {"remove", JsonPatchOpType_Remove},
+        {"replace", JsonPatchOpType_Replace},
+        {"move", JsonPatchOpType_Move},
+        {"copy", JsonPatchOpType_Copy},
+        {"test", JsonPatchOpType_Test},
+    };
+    JsonPatchOp compiled;
+    std::string str;
+    JSONValue *value;
+    bool ret = false;
+    size_t i;
+
+    compiled.value = NULL;
+    if (op == NULL || op->GetType() != JsonType_Object) {
+        goto out;
+    }
+    if (GetPatchString(GetMember(op, "op"), str) == false) {
+        goto out;
+    }
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (str == names[i].name) {
+            break;
+        }
+    }
+    if (i == sizeof(names) / sizeof(names[0])) {
+        goto out;
+    }
+    compiled.type = names[i].type;
+    if (GetPatchString(GetMember(op, "path"), str) == false ||
+        ParsePointer(str, compiled.path) == false) {
+        goto out;
+    }
+    if (compiled.type == JsonPatchOpType_Move || 
+        compiled.type == JsonPatchOpType_Copy) {
+        if (GetPatchString(GetMember(op, "from"), str) == false ||
+            ParsePointer(str, compiled.from) == false) {
+            goto out;
+        }
+    }
+    if (compiled.type == JsonPatchOpType_Add || 
+        compiled.type == JsonPatchOpType_Replace ||
+        compiled.type == JsonPatchOpType_Test) {
+        value = GetMember(op, "value");
+        if (value == NULL) {
+            goto out;
+        }
+        compiled.value = value->Copy();
+    }
+    m_ops.push_back(std::move(compiled));
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Discard the compiled operations.
+ */
+
+void
+JSONPatch::Clear()
+{
+    std::vector<JsonPatchOp>::iterator iter;
+
+    for (iter = m_ops.begin(); iter != m_ops.end(); ++iter) {
+        delete iter->value;
+    }
+    m_ops.clear();
+    m_failed = -1;
+}
+
+
+/**
+ * Apply the patch to a document. The operations are applied in order,
+ * in place. If one fails, the ones already applied are undone. Memory 
+ * is allocated from the document's allocator, see 
+ * JSONDocument::SetAllocator().
+ *
+ * @param[in] doc the document.
+ *
+ * @return true if all operations succeeded, false otherwise, in which 
+ *         case GetFailedOp() returns the index of the failed operation.
+ */
+
+bool
+JSONPatch::Apply(JSONDocument &doc)
+{
+    JSONAllocatorScope scope(doc.GetAllocator());
+    bool ret = true;
+    size_t i;
+
+    m_failed = -1;
+    for (i = 0; i < m_ops.size(); i++) {
+        if (ApplyOp(doc, m_ops[i]) == false) {
+            m_failed = i;
+            ret = false;
+            break;
+        }
+    }
+    if (ret) {
+        Commit();
+    } else {
+        Undo(doc);
+    }
+    return ret;
+}
+
+
+/**
+ * Get the value to replace a record or a packed array with, before 
+ * modifying it (the keys of a record cannot change, a packed array holds
+ * only numbers of one type).
+ *
+ * @param[in] val the value.
+ *
+ * @return a new object with the keys and values of the record, or a new
+ *         array with the elements of the packed array, or NULL if val is
+ *         neither.
+ */
+
+static JSONValue *
+Expand(JSONValue *val)
+{
+    JSONValue *ret = NULL;
+
+    if (val && val->GetType() == JsonType_Record) {
+        ret = static_cast<JSONRecord *>(val)->ToObject();
+    } else if (val && val->GetType() == JsonType_PackedArray) {
+        ret = static_cast<JSONPackedArray *>(val)->ToArray();
+    }
+    return ret;
+}
+
+
+/**
+ * Resolve the first len reference tokens of a path.
+ *
+ * @param[in] doc the document.
+ * @param[in] path the reference tokens.
+ * @param[in] len the number of tokens to resolve.
+ * @param[in] mutate if true, the value is going to be modified, and 
+ *            shared nodes on the path are replaced by private copies.
+ *            Records and packed arrays on the path are replaced by the 
+ *            equivalent objects and arrays.
+ *
+ * @return the value, or NULL if the path does not exist. An element of
+ *         a packed array that is only read is made for the purpose, and
+ *         is valid until the next call.
+ */
+
+JSONValue *
+JSONPatch::Resolve(JSONDocument &doc, const std::vector<std::string> &path,
+    size_t len, bool mutate)
+{
+    JSONValue *val = mutate ? doc.GetMutableRoot() : doc.GetRoot();
+    JSONValue *obj;
+    JSONTuple *tuple;
+    size_t i;
+    int offset;
+
+    if (mutate && (obj = Expand(val)) != NULL) {
+        doc.SetRoot(obj);
+        val = obj;
+    }
+    for (i = 0; val && i < len; i++) {
+        if (val->GetType() == JsonType_Object) {
+            offset = FindMember(val, path[i]);
+            if (offset < 0) {
+                val = NULL;
+            } else if (mutate) {
+                tuple = static_cast<JSONTuple *>(val->GetMutable(offset));
+                val = tuple->GetMutableValue();
+                if ((obj = Expand(val)) != NULL) {
+                    tuple->SetValue(std::unique_ptr<JSONValue>(obj));
+                    val = obj;
+                }
+            } else {
+                val = static_cast<JSONTuple *>(val->Get(offset))->GetValue();
+            }
+        } else if (val->GetType() == JsonType_Record) {
+
+            // only read, records on a mutate path were expanded above
+
+            offset = FindMember(val, path[i]);
+            val = offset < 0 ? NULL : val->Get(offset);
+        } else if (val->GetType() == JsonType_PackedArray) {
+            JSONPackedArray *array = static_cast<JSONPackedArray *>(val);
+
+            offset = ParseIndex(path[i], array->GetCount(), false);
+            m_element.reset(offset < 0 ? NULL : array->MakeElement(offset));
+            val = m_element.get();
+        } else if (val->GetType() == JsonType_Array) {
+            offset = ParseIndex(path[i], val->GetSize(), false);
+            if (offset < 0) {
+                val = NULL;
+            } else if (mutate) {
+                JSONValue *parent = val;
+
+                val = parent->GetMutable(offset);
+                if ((obj = Expand(val)) != NULL) {
+                    parent->Set(offset, obj);
+                    val = obj;
+                }
+            } else {
+                val = val->Get(offset);
+            }
+        } else {
+            val = NULL;
+        }
+    }
+    return val;
+}
+
+
+/**
+ * Add a value at the specified location: insert it into an array, add
+ * it to an object, or replace the value of an existing member or the 
+ * whole document.
+ *
+ * @param[in] doc the document.
+ * @param[in] path the location.
+ * @param[in] val the value, owned by the document on success.
+ *
+ * @return true on success, false if the location is not valid.
+ */
+
+bool
+JSONPatch::Add(JSONDocument &doc, const std::vector<std::string> &path,
+    JSONValue *val)
+{
+    JsonPatchUndo undo = {JsonPatchUndoType_Inserted, NULL, 0, NULL};
+    JSONValue *parent;
+    JSONTuple *tuple;
+    bool ret = false;
+    int offset;
+
+    if (path.empty()) {
+        return Replace(doc, path, val);
+    }
+    parent = Resolve(doc, path, path.size() - 1, true);
+    if (parent == NULL) {
+        goto out;
+    }
+    if (parent->GetType() == JsonType_Object) {
+        offset = FindMember(parent, path.back());
+        if (offset >= 0) {
+            return Replace(doc, path, val);
+        }
+        tuple = new JSONTuple();
+
+        // follow the convention of the object's other keys (keys of a 
+        // parsed object keep their quotes and escapes)
+
+        if (parent->GetSize() && 
+            static_cast<JSONTuple *>(parent->Get(0))->GetKey().c_str()[0] == '"') {
+            std::string key;
+
+            JsonStr::Quote(path.back(), key);
+            tuple->SetKey(key);
+        } else {
+            tuple->SetKey(path.back());
+        }
+        tuple->SetValue(val);
+
+        // a sorted object puts the tuple where its key belongs
+
+        undo.index = parent->Append(tuple);
+    } else if (parent->GetType() == JsonType_Array) {
+        offset = ParseIndex(path.back(), parent->GetSize(), true);
+        if (offset < 0 || parent->Insert(offset, val) == false) {
+            goto out;
+        }
+        undo.index = offset;
+    } else {
+        goto out;
+    }
+    undo.container = parent;
+    m_log.push_back(undo);
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Remove the value at the specified location.
+ *
+ * @param[in] doc the document.
+ * @param[in] path the location.
+ * @param[out] removed if not NULL, a new reference to the removed value.
+ *
+ * @return true on success, false if there is no value at the location.
+ */
+
+bool
+JSONPatch::Remove(JSONDocument &doc, const std::vector<std::string> &path,
+    JSONValue **removed)
+{
+    JsonPatchUndo undo = {JsonPatchUndoType_Removed, NULL, 0, NULL};
+    JSONValue *parent = NULL;
+    JSONValue *val = NULL;
+    bool ret = false;
+    int offset = -1;
+
+    if (path.empty()) {
+        goto out;
+    }
+    parent = Resolve(doc, path, path.size() - 1, true);
+    if (parent == NULL) {
+        goto out;
+    }
+    if (parent->GetType() == JsonType_Object) {
+        offset = FindMember(parent, path.back());
+    } else if (parent->GetType() == JsonType_Array) {
+        offset = ParseIndex(path.back(), parent->GetSize(), false);
+    }
+    if (offset < 0) {
+        goto out;
+    }
+    undo.value = parent->Get(offset)->Ref();
+    val = undo.value;
+    if (parent->GetType() == JsonType_Object) {
+        val = static_cast<JSONTuple *>(val)->GetValue();
+    }
+    parent->Delete(offset);
+    undo.container = parent;
+    undo.index = offset;
+    m_log.push_back(undo);
+    if (removed) {
+        *removed = val->Ref();
+    }
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Replace the value at the specified location.
+ *
+ * @param[in] doc the document.
+ * @param[in] path the location.
+ * @param[in] val the new value, owned by the document on success.
+ *
+ * @return true on success, false if there is no value at the location.
+ */
+
+bool
+JSONPatch::Replace(JSONDocument &doc, const std::vector<std::string> &path,
+    JSONValue *val)
+{
+    JsonPatchUndo undo = {JsonPatchUndoType_Replaced, NULL, 0, NULL};
+    JSONValue *parent = NULL;
+    JSONTuple *tuple;
+    bool ret = false;
+    int offset = -1;
+
+    if (path.empty()) {
+        undo.type = JsonPatchUndoType_Root;
+        undo.value = doc.GetRoot() ? doc.GetRoot()->Ref() : NULL;
+        doc.SetRoot(val);
+        m_log.push_back(undo);
+        ret = true;
+        goto out;
+    }
+    parent = Resolve(doc, path, path.size() - 1, true);
+    if (parent == NULL) {
+        goto out;
+    }
+    if (parent->GetType() == JsonType_Object) {
+        offset = FindMember(parent, path.back());
+        if (offset < 0) {
+            goto out;
+        }
+        tuple = static_cast<JSONTuple *>(parent->GetMutable(offset));
+        undo.value = tuple->GetValue() ? tuple->GetValue()->Ref() : NULL;
+        tuple->SetValue(std::unique_ptr<JSONValue>(val));
+        undo.container = tuple;
+    } else if (parent->GetType() == JsonType_Array) {
+        offset = ParseIndex(path.back(), parent->GetSize(), false);
+        if (offset < 0) {
+            goto out;
+        }
+        undo.value = parent->Get(offset)->Ref();
+        parent->Set(offset, val);
+        undo.container = parent;
+        undo.index = offset;
+    } else {
+        goto out;
+    }
+    m_log.push_back(undo);
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Apply one operation.
+ *
+ * @param[in] doc the document.
+ * @param[in] op the operation.
+ *
+ * @return true on success, false if the operation failed.
+ */
+
+bool
+JSONPatch::ApplyOp(JSONDocument &doc, JsonPatchOp &op)
+{
+    JSONValue *val = NULL;
+    bool ret = false;
+
+    switch (op.type) {
+    case JsonPatchOpType_Add:
+        val = op.value->Copy();
+        ret = Add(doc, op.path, val);
+        break;
+    case JsonPatchOpType_Remove:
+        ret = Remove(doc, op.path, NULL);
+        break;
+    case JsonPatchOpType_Replace:
+        val = op.value->Copy();
+        ret = Replace(doc, op.path, val);
+        break;
+    case JsonPatchOpType_Move:
+        if (op.from == op.path) {
+            ret = Resolve(doc, op.from, op.from.size(), false) != NULL;
+            break;
+        }
+
+        // a value cannot be moved into one of its own children
+
+        if (op.from.size() < op.path.size() && 
+            std::equal(op.from.begin(), op.from.end(), op.path.begin())) {
+            break;
+        }
+        if (Remove(doc, op.from, &val)) {
+            ret = Add(doc, op.path, val);
+        }
+        break;
+    case JsonPatchOpType_Copy:
+        val = Resolve(doc, op.from, op.from.size(), false);
+        if (val) {
+            val = val->Copy();
+            ret = Add(doc, op.path, val);
+        }
+        break;
+    case JsonPatchOpType_Test:
+        val = Resolve(doc, op.path, op.path.size(), false);
+        ret = val && PatchEquals(val, op.value);
+        val = NULL;
+        break;
+    }
+    if (ret == false) {
+        JSONValue::Unref(val);
+    }
+    return ret;
+}
+
+
+/**
+ * Undo the operations applied so far, most recent first.
+ *
+ * @param[in] doc the document.
+ */
+
+void
+JSONPatch::Undo(JSONDocument &doc)
+{
+    std::vector<JsonPatchUndo>::reverse_iterator iter;
+
+    for (iter = m_log.rbegin(); iter != m_log.rend(); ++iter) {
+        switch (iter->type) {
+        case JsonPatchUndoType_Inserted:
+            iter->container->Delete(iter->index);
+            break;
+        case JsonPatchUndoType_Removed:
+            iter->container->Insert(iter->index, iter->value);
+            break;
+        case JsonPatchUndoType_Replaced:
+            if (iter->container->GetType() == JsonType_Tuple) {
+                static_cast<JSONTuple *>(iter->container)->SetValue(
+                    std::unique_ptr<JSONValue>(iter->value));
+            } else {
+                iter->container->Set(iter->index, iter->value);
+            }
+            break;
+        case JsonPatchUndoType_Root:
+            doc.SetRoot(iter->value);
+            break;
+        }
+    }
+    m_log.clear();
+}
+
+
+/**
+ * Make the changes permanent, dropping the references the undo log 
+ * holds to removed and replaced values.
+ */
+
+void
+JSONPatch::Commit()
+{
+    std::vector<JsonPatchUndo>::iterator iter;
+
+    for (iter = m_log.begin(); iter != m_log.end(); ++iter) {
+        JSONValue::Unref(iter->value);
+    }
+    m_log.clear();
+}
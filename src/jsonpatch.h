@@ -0,0 +1,145 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONPATCH_H__)
+#define __JSONPATCH_H__
+
+#include "jsondocument.h"
+#include <string>
+#include <vector>
+
+typedef enum {
+    JsonPatchOpType_Add,
+    JsonPatchOpType_Remove,
+    JsonPatchOpType_Replace,
+    JsonPatchOpType_Move,
+    JsonPatchOpType_Copy,
+    JsonPatchOpType_Test
+} JsonPatchOpType;
+
+/**
+ * A compiled patch operation. Paths are stored as their decoded JSON 
+ * Pointer reference tokens.
+ */
+
+struct JsonPatchOp
+{
+    JsonPatchOpType type;
+    std::vector<std::string> path;
+    std::vector<std::string> from;
+    JSONValue *value;
+};
+
+/**
+ * An entry in the log used to undo a partially applied patch. Values
+ * held by an entry (removed or replaced values) are referenced by it.
+ */
+
+typedef enum {
+    JsonPatchUndoType_Inserted, // element added to container at index
+    JsonPatchUndoType_Removed,  // value removed from container at index
+    JsonPatchUndoType_Replaced, // element of container at index (or the
+                                // value, if container is a tuple) replaced
+    JsonPatchUndoType_Root      // root of the document replaced
+} JsonPatchUndoType;
+
+struct JsonPatchUndo
+{
+    JsonPatchUndoType type;
+    JSONValue *container;
+    int index;
+    JSONValue *value;
+};
+
+/**
+ * A JSON Patch (RFC 6902). The patch document is compiled once into a 
+ * list of operations, which can then be applied to any number of 
+ * documents. Apply() modifies the document in place: only the nodes on 
+ * the paths that are changed are touched (and copied, if shared with 
+ * another document). If any operation fails, including a "test", the 
+ * changes already made are undone, and the document is left as it was.
+ * Keys in paths, and strings in values, are compared by their text, 
+ * whatever escapes they are written with; a "test" compares numbers by 
+ * value, so 1 equals 1.0.
+ */
+
+class JSONPatch
+{
+public:
+    JSONPatch() : m_failed(-1) {}
+    ~JSONPatch() {Clear();}
+    JSONPatch(const JSONPatch &) = delete;
+    JSONPatch &operator=(const JSONPatch &) = delete;
+    bool Compile(JSONValue *patch);
+    bool Compile(const std::string &patch);
+    bool Apply(JSONDocument &doc);
+    int GetSize() {return m_ops.size();}
+    int GetFailedOp() {return m_failed;}
+    void Clear();
+private:
+    bool CompileOp(JSONValue *op);
+    JSONValue *Resolve(JSONDocument &doc, const std::vector<std::string> &path,
+        size_t len, bool mutate);
+    bool Add(JSONDocument &doc, const std::vector<std::string> &path,
+        JSONValue *val);
+    bool Remove(JSONDocument &doc, const std::vector<std::string> &path,
+        JSONValue **removed);
+    bool Replace(JSONDocument &doc, const std::vector<std::string> &path,
+        JSONValue *val);
+    bool ApplyOp(JSONDocument &doc, JsonPatchOp &op);
+    void Undo(JSONDocument &doc);
+    void Commit();
+    std::vector<JsonPatchOp> m_ops;
+    std::vector<JsonPatchUndo> m_log;
+    int m_failed;
+    std::unique_ptr<JSONValue> m_element;   // read from a packed array, 
+                                            // see Resolve()
+};
+
+#endif
@@ -0,0 +1,1408 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonschema.h"
+#include "jsonbind.h"
+#include "jsonparse.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * Get a member of a schema object.
+ *
+ * @param[in] obj the object.
+ * @param[in] name the name of the member.
+ *
+ * @return the value, or NULL if there is no such member.
+ */
+
+static const JSONValue *
+GetMember(const JSONValue *obj, std::string_view name)
+{
+    std::string scratch;
+
+    for (const auto &member : obj->Members()) {
+        if (JsonStr::Text(member.key, scratch) == name) {
+            return member.value;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Get the number a value holds.
+ *
+ * @param[in] val the value.
+ * @param[out] out the number.
+ *
+ * @return true if val is a number.
+ */
+
+static bool
+GetNumber(const JSONValue *val, double &out)
+{
+    bool ret = true;
+
+    if (val == NULL) {
+        ret = false;
+    } else if (val->GetType() == JsonType_Number) {
+        const JSONNumber *num = static_cast<const JSONNumber *>(val);
+
+        out = num->IsUnsigned() ? (double) num->GetUnsigned() : (double) num->Get();
+    } else if (val->GetType() == JsonType_Double) {
+        out = static_cast<const JSONDouble *>(val)->Get();
+    } else {
+        ret = false;
+    }
+    return ret;
+}
+
+
+/**
+ * Get a count (minLength, maxItems and the like) from a schema.
+ *
+ * @param[in] val the value.
+ * @param[out] out the count.
+ *
+ * @return true if val is a non-negative integer.
+ */
+
+static bool
+GetCount(const JSONValue *val, uint32_t &out)
+{
+    double num;
+
+    if (!GetNumber(val, num) || num < 0 || num != floor(num)) {
+        return false;
+    }
+    out = num >= UINT32_MAX ? UINT32_MAX : (uint32_t) num;
+    return true;
+}
+
+
+/**
+ * Get the text of a string value.
+ *
+ * @param[in] val the value.
+ * @param[out] out the text, without quotes or escapes.
+ *
+ * @return true if val is a string.
+ */
+
+static bool
+GetString(const JSONValue *val, std::string &out)
+{
+    std::string scratch;
+
+    if (val == NULL || val->GetType() != JsonType_String) {
+        return false;
+    }
+    out = JsonStr::Text(static_cast<const JSONString *>(val)->GetView(), scratch);
+    return true;
+}
+
+
+/**
+ * Record why compiling failed.
+ *
+ * @param[in] msg the reason.
+ *
+ * @return false.
+ */
+
+bool
+JSONSchema::Fail(const std::string &msg)
+{
+    if (m_error.empty()) {
+        m_error = msg;
+    }
+    return false;
+}
+
+
+/**
+ * Compile a schema. Any previous program is discarded.
+ *
+ * @param[in] schema the schema, as parsed.
+ *
+ * @return true on success, false if the schema is not valid or uses a 
+ *         keyword that is not supported (see GetError()).
+ */
+
+bool
+JSONSchema::Compile(const JSONValue *schema)
+{
+    m_nodes.clear();
+    m_properties.clear();
+    m_enums.clear();
+    m_error.clear();
+    m_refs.clear();
+    m_start = -1;
+    m_root = schema;
+    if (schema == NULL) {
+        Fail("no schema");
+    } else {
+        m_start = CompileNode(schema, 0);
+    }
+    if (!m_error.empty()) {
+        m_start = -1;
+    }
+    m_root = NULL;
+    m_refs.clear();
+    return m_start >= 0;
+}
+
+
+/**
+ * Parse and compile a schema.
+ *
+ * @param[in] text the schema, as JSON text.
+ *
+ * @return true on success, false if the text or the schema are not 
+ *         valid.
+ */
+
+bool
+JSONSchema::Compile(const std::string &text)
+{
+    JsonParse parser;
+    std::string input(text);
+    bool ret;
+
+    parser.SetDirect(true);
+    parser.SetInput(input);
+    if (!parser.Parse()) {
+        m_start = -1;
+        m_error = "schema is not valid JSON";
+        return false;
+    }
+    std::unique_ptr<JSONValue> schema(JSONAPI::GetRootObject(&parser));
+
+    ret = Compile(schema.get());
+    return ret;
+}
+
+
+/**
+ * Compile a schema into a node of the program.
+ *
+ * @param[in] schema the schema.
+ * @param[in] depth how deep it is in the schema document.
+ *
+ * @return the index of the node, or -1 on failure.
+ */
+
+int
+JSONSchema::CompileNode(const JSONValue *schema, int depth)
+{
+    static const char *unsupported[] = {
+        "pattern", "patternProperties", "anyOf", "oneOf", "allOf", "not",
+        "if", "then", "else", "uniqueItems", "dependencies", 
+        "dependentRequired", "dependentSchemas", "propertyNames", "contains",
+        "prefixItems", "unevaluatedProperties", "unevaluatedItems"
+    };
+    const JSONValue *properties = NULL;
+    const JSONValue *required = NULL;
+    bool exclusiveMin = false, exclusiveMax = false;
+    JsonSchemaNode node;
+    std::string scratch, str;
+    const JSONValue *ref;
+    int index;
+    double num;
+
+    if (depth > MaxDepth) {
+        Fail("schema is nested too deep");
+        return -1;
+    }
+    memset(&node, 0, sizeof(node));
+    node.types = JsonSchemaType_Any;
+    node.maxLength = node.maxItems = node.maxProperties = UINT32_MAX;
+    node.items = node.additional = -1;
+    if (schema->GetType() == JsonType_Bool) {
+        if (!static_cast<const JSONBoolean *>(schema)->Get()) {
+            node.flags |= JsonSchemaFlag_Nothing;
+        }
+        m_nodes.push_back(node);
+        return m_nodes.size() - 1;
+    }
+    if (schema->GetType() != JsonType_Object && 
+        schema->GetType() != JsonType_Record) {
+        Fail("a schema must be an object or a boolean");
+        return -1;
+    }
+
+    // other keywords next to $ref are ignored
+
+    if ((ref = GetMember(schema, "$ref")) != NULL) {
+        if (!GetString(ref, str)) {
+            Fail("$ref must be a string");
+            return -1;
+        }
+        return CompileRef(str, depth + 1);
+    }
+    index = m_nodes.size();
+    m_nodes.push_back(node);
+    for (const auto &member : schema->Members()) {
+        std::string_view key = JsonStr::Text(member.key, scratch);
+        const JSONValue *val = member.value;
+
+        for (size_t i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]); i++) {
+            if (key == unsupported[i]) {
+                Fail("unsupported keyword " + std::string(key));
+                return -1;
+            }
+        }
+        if (val == NULL) {
+            continue;
+        }
+        if (key == "type") {
+            node.types = 0;
+            for (size_t i = 0; val->GetType() == JsonType_Array ? 
+                i < (size_t) val->GetSize() : i < 1; i++) {
+                const JSONValue *type = val->GetType() == JsonType_Array ? 
+                    val->Get(i) : val;
+
+                if (!GetString(type, str)) {
+                    Fail("type must be a string or an array of strings");
+                    return -1;
+                }
+                if (str == "null") {
+                    node.types |= JsonSchemaType_Null;
+                } else if (str == "boolean") {
+                    node.types |= JsonSchemaType_Boolean;
+                } else if (str == "object") {
+                    node.types |= JsonSchemaType_Object;
+                } else if (str == "array") {
+                    node.types |= JsonSchemaType_Array;
+                } else if (str == "number") {
+                    node.types |= JsonSchemaType_Number | JsonSchemaType_Integer;
+                } else if (str == "integer") {
+                    node.types |= JsonSchemaType_Integer;
+                } else if (str == "string") {
+                    node.types |= JsonSchemaType_String;
+                } else {
+                    Fail("unknown type " + str);
+                    return -1;
+                }
+            }
+        } else if (key == "enum" || key == "const") {
+            if (!CompileEnum(node, val, key == "const")) {
+                return -1;
+            }
+        } else if (key == "minimum" || key == "maximum") {
+            if (!GetNumber(val, num)) {
+                Fail(std::string(key) + " must be a number");
+                return -1;
+            }
+            if (key == "minimum") {
+                node.minimum = num;
+                node.flags |= JsonSchemaFlag_Minimum;
+            } else {
+                node.maximum = num;
+                node.flags |= JsonSchemaFlag_Maximum;
+            }
+        } else if (key == "exclusiveMinimum" || key == "exclusiveMaximum") {
+            bool min = key == "exclusiveMinimum";
+
+            if (val->GetType() == JsonType_Bool) {
+
+                // draft 4: a modifier of minimum or maximum
+
+                (min ? exclusiveMin : exclusiveMax) = 
+                    static_cast<const JSONBoolean *>(val)->Get();
+            } else if (GetNumber(val, num)) {
+
+                // a limit of its own, checked as well as minimum or 
+                // maximum
+
+                if (min) {
+                    node.exclusiveMinimum = num;
+                    node.flags |= JsonSchemaFlag_ExclusiveMinimum;
+                } else {
+                    node.exclusiveMaximum = num;
+                    node.flags |= JsonSchemaFlag_ExclusiveMaximum;
+                }
+            } else {
+                Fail(std::string(key) + " must be a number");
+                return -1;
+            }
+        } else if (key == "multipleOf") {
+            if (!GetNumber(val, num) || num <= 0) {
+                Fail("multipleOf must be a positive number");
+                return -1;
+            }
+            node.multipleOf = num;
+            node.flags |= JsonSchemaFlag_MultipleOf;
+        } else if (key == "minLength" || key == "maxLength" || 
+            key == "minItems" || key == "maxItems" || 
+            key == "minProperties" || key == "maxProperties") {
+            uint32_t *count = key == "minLength" ? &node.minLength :
+                key == "maxLength" ? &node.maxLength :
+                key == "minItems" ? &node.minItems :
+                key == "maxItems" ? &node.maxItems :
+                key == "minProperties" ? &node.minProperties : 
+                &node.maxProperties;
+
+            if (!GetCount(val, *count)) {
+                Fail(std::string(key) + " must be a non-negative integer");
+                return -1;
+            }
+        } else if (key == "properties") {
+            properties = val;
+        } else if (key == "required") {
+            required = val;
+        } else if (key == "additionalProperties") {
+            if (val->GetType() == JsonType_Bool) {
+                if (!static_cast<const JSONBoolean *>(val)->Get()) {
+                    node.flags |= JsonSchemaFlag_NoAdditional;
+                }
+            } else if ((node.additional = CompileNode(val, depth + 1)) < 0) {
+                return -1;
+            }
+        } else if (key == "items") {
+            if (val->GetType() == JsonType_Array) {
+                Fail("unsupported keyword items with an array of schemas");
+                return -1;
+            }
+            if ((node.items = CompileNode(val, depth + 1)) < 0) {
+                return -1;
+            }
+        }
+    }
+    if (exclusiveMin && (node.flags & JsonSchemaFlag_Minimum)) {
+        node.exclusiveMinimum = node.minimum;
+        node.flags &= ~JsonSchemaFlag_Minimum;
+        node.flags |= JsonSchemaFlag_ExclusiveMinimum;
+    }
+    if (exclusiveMax && (node.flags & JsonSchemaFlag_Maximum)) {
+        node.exclusiveMaximum = node.maximum;
+        node.flags &= ~JsonSchemaFlag_Maximum;
+        node.flags |= JsonSchemaFlag_ExclusiveMaximum;
+    }
+    if ((properties || required) && 
+        !CompileProperties(node, properties, required, depth)) {
+        return -1;
+    }
+    m_nodes[index] = node;
+    return index;
+}
+
+
+/**
+ * Compile the schema a $ref points to. Each target is compiled once, so
+ * recursive schemas refer to themselves.
+ *
+ * @param[in] ref the reference, a JSON Pointer into the schema document.
+ * @param[in] depth how deep the reference is in the schema document.
+ *
+ * @return the index of the node, or -1 on failure.
+ */
+
+int
+JSONSchema::CompileRef(std::string_view ref, int depth)
+{
+    std::map<std::string, int>::iterator iter;
+    const JSONValue *target = m_root;
+    std::string name(ref);
+    std::string token;
+    size_t pos;
+    int index, node;
+
+    iter = m_refs.find(name);
+    if (iter != m_refs.end()) {
+        return iter->second;
+    }
+    if (ref.empty() || ref[0] != '#') {
+        Fail("unsupported $ref " + std::string(ref) + ", only local ones are");
+        return -1;
+    }
+
+    // walk the pointer, unescaping ~1 and ~0 in each token
+
+    ref.remove_prefix(1);
+    while (target && !ref.empty()) {
+        if (ref[0] != '/') {
+            target = NULL;
+            break;
+        }
+        ref.remove_prefix(1);
+        pos = ref.find('/');
+        token = ref.substr(0, pos);
+        ref.remove_prefix(pos == std::string_view::npos ? ref.size() : pos);
+        for (pos = 0; (pos = token.find('~', pos)) != std::string::npos; pos++) {
+            token.replace(pos, 2, pos + 1 < token.size() && token[pos + 1] == '1' ? "/" : "~");
+        }
+        if (target->GetType() == JsonType_Array) {
+            char *end;
+            long i = strtol(token.c_str(), &end, 10);
+
+            target = *end == '\0' && i >= 0 && i < target->GetSize() ? 
+                target->Get(i) : NULL;
+        } else {
+            target = target->GetType() == JsonType_Object || 
+                target->GetType() == JsonType_Record ? 
+                GetMember(target, token) : NULL;
+        }
+    }
+    if (target == NULL) {
+        Fail("$ref to a schema that does not exist");
+        return -1;
+    }
+
+    // reserve the node first, so that references to it from within the
+    // target find it
+
+    index = m_nodes.size();
+    m_nodes.push_back(JsonSchemaNode());
+    m_refs[name] = index;
+    node = CompileNode(target, depth);
+    if (node < 0) {
+        return -1;
+    }
+    m_nodes[index] = m_nodes[node];
+    return index;
+}
+
+
+/**
+ * Compile properties and required into the members of a node.
+ *
+ * @param[in,out] node the node.
+ * @param[in] props the value of properties, may be NULL.
+ * @param[in] required the value of required, may be NULL.
+ * @param[in] depth how deep the node is in the schema document.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONSchema::CompileProperties(JsonSchemaNode &node, const JSONValue *props,
+    const JSONValue *required, int depth)
+{
+    std::vector<JsonSchemaProperty> list;
+    JsonSchemaProperty prop;
+    std::string scratch;
+    size_t i;
+
+    if (props) {
+        if (props->GetType() != JsonType_Object && 
+            props->GetType() != JsonType_Record) {
+            return Fail("properties must be an object");
+        }
+        for (const auto &member : props->Members()) {
+            prop.key = JsonStr::Text(member.key, scratch);
+            prop.declared = true;
+            prop.required = -1;
+            if (member.value == NULL || 
+                (prop.node = CompileNode(member.value, depth + 1)) < 0) {
+                return Fail("properties must hold schemas");
+            }
+            list.push_back(prop);
+        }
+    }
+    if (required) {
+        if (required->GetType() != JsonType_Array) {
+            return Fail("required must be an array of strings");
+        }
+        for (const JSONValue *val : *required) {
+            if (!GetString(val, prop.key)) {
+                return Fail("required must be an array of strings");
+            }
+            for (i = 0; i < list.size() && list[i].key != prop.key; i++) {
+            }
+            if (i == list.size()) {
+                prop.declared = false;
+                prop.node = -1;
+                prop.required = -1;
+                list.push_back(prop);
+            }
+            if (list[i].required < 0) {
+                list[i].required = node.requiredCount++;
+            }
+        }
+    }
+
+    // nested schemas have added their own members by now, so this 
+    // node's are contiguous
+
+    node.properties = m_properties.size();
+    node.propertyCount = list.size();
+    m_properties.insert(m_properties.end(), list.begin(), list.end());
+    return true;
+}
+
+
+/**
+ * Compile enum or const.
+ *
+ * @param[in,out] node the node.
+ * @param[in] val the value of enum, or of const.
+ * @param[in] single true for const.
+ *
+ * @return true on success.
+ */
+
+bool
+JSONSchema::CompileEnum(JsonSchemaNode &node, const JSONValue *val, 
+    bool single)
+{
+    JsonSchemaEnum value;
+    size_t count = single ? 1 : val->GetSize();
+
+    if (node.enumCount) {
+        return Fail("enum and const together are not supported");
+    }
+    if (!single && val->GetType() != JsonType_Array) {
+        return Fail("enum must be an array");
+    }
+    node.enums = m_enums.size();
+    for (size_t i = 0; i < count; i++) {
+        const JSONValue *item = single ? val : val->Get(i);
+
+        value.number = 0;
+        value.str.clear();
+        switch (item->GetType()) {
+        case JsonType_Null:
+            value.type = JsonSchemaType_Null;
+            break;
+        case JsonType_Bool:
+            value.type = JsonSchemaType_Boolean;
+            value.number = static_cast<const JSONBoolean *>(item)->Get();
+            break;
+        case JsonType_Number:
+        case JsonType_Double:
+            value.type = JsonSchemaType_Number;
+            GetNumber(item, value.number);
+            break;
+        case JsonType_String:
+            value.type = JsonSchemaType_String;
+            GetString(item, value.str);
+            break;
+        default:
+            return Fail("unsupported enum or const value, only scalars are");
+        }
+        m_enums.push_back(value);
+    }
+    node.enumCount = count;
+    return true;
+}
+
+
+/**
+ * Find a member of an object schema. Members usually come in the order 
+ * of the schema, so the one after the last one found is tried first.
+ *
+ * @param[in] node the schema.
+ * @param[in] key the key.
+ * @param[in,out] hint the index of the member to try first, updated to 
+ *                that of the next one.
+ *
+ * @return the member, or NULL if the schema does not name it.
+ */
+
+const JsonSchemaProperty *
+JSONSchema::FindProperty(const JsonSchemaNode &node, std::string_view key,
+    uint32_t &hint) const
+{
+    const JsonSchemaProperty *props = m_properties.data() + node.properties;
+    uint32_t i;
+
+    if (hint < node.propertyCount && props[hint].key == key) {
+        return &props[hint++];
+    }
+    for (i = 0; i < node.propertyCount; i++) {
+        if (props[i].key == key) {
+            hint = i + 1;
+            return &props[i];
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Deliver the events of a tree.
+ *
+ * @param[in] val the tree.
+ * @param[in] handler the handler.
+ * @param[in] scratch for decoding keys and strings.
+ *
+ * @return false if the handler stopped.
+ */
+
+static bool
+WalkTree(const JSONValue *val, JSONEventHandler &handler, std::string &scratch)
+{
+    std::string_view str;
+
+    if (val == NULL) {
+        return handler.Null();
+    }
+    switch (val->GetType()) {
+    case JsonType_Object:
+    case JsonType_Record:
+        if (!handler.StartObject()) {
+            return false;
+        }
+        for (const auto &member : val->Members()) {
+            str = JsonStr::Text(member.key, scratch);
+            if (!handler.Key(str.data(), str.size()) || 
+                !WalkTree(member.value, handler, scratch)) {
+                return false;
+            }
+        }
+        return handler.EndObject();
+    case JsonType_Array:
+        if (!handler.StartArray()) {
+            return false;
+        }
+        for (const JSONValue *child : *val) {
+            if (!WalkTree(child, handler, scratch)) {
+                return false;
+            }
+        }
+        return handler.EndArray();
+    case JsonType_PackedArray:
+        {
+        const JSONPackedArray *array = static_cast<const JSONPackedArray *>(val);
+
+        if (!handler.StartArray()) {
+            return false;
+        }
+        for (int64_t number : array->GetIntegers()) {
+            if (!handler.Number(number)) {
+                return false;
+            }
+        }
+        for (double number : array->GetDoubles()) {
+            if (!handler.Double(number)) {
+                return false;
+            }
+        }
+        return handler.EndArray();
+        }
+    case JsonType_String:
+        str = JsonStr::Text(static_cast<const JSONString *>(val)->GetView(), scratch);
+        return handler.String(str.data(), str.size());
+    case JsonType_Number:
+        if (static_cast<const JSONNumber *>(val)->IsUnsigned()) {
+            return handler.Unsigned(static_cast<const JSONNumber *>(val)->GetUnsigned());
+        }
+        return handler.Number(static_cast<const JSONNumber *>(val)->Get());
+    case JsonType_Double:
+        return handler.Double(static_cast<const JSONDouble *>(val)->Get());
+    case JsonType_Bool:
+        return handler.Boolean(static_cast<const JSONBoolean *>(val)->Get());
+    default:
+        return handler.Null();
+    }
+}
+
+
+/**
+ * Deliver the events of the next value of JSON text.
+ *
+ * @param[in] reader the reader.
+ * @param[in] handler the handler.
+ * @param[in] scratch for decoding strings.
+ * @param[in] depth how deep the value is.
+ *
+ * @return false if the text is not valid, or the handler stopped.
+ */
+
+static bool
+ReadText(JSONReader &reader, JSONEventHandler &handler, std::string &scratch,
+    int depth)
+{
+    std::string_view key;
+    int64_t integer;
+    double num;
+    bool done, flag;
+
+    if (depth > 512) {
+        return false;
+    }
+    switch (reader.Peek()) {
+    case '{':
+        if (!reader.BeginObject() || !handler.StartObject()) {
+            return false;
+        }
+        for (;;) {
+            if (!reader.NextKey(key, done)) {
+                return false;
+            }
+            if (done) {
+                return handler.EndObject();
+            }
+            if (!handler.Key(key.data(), key.size()) ||
+                !ReadText(reader, handler, scratch, depth + 1)) {
+                return false;
+            }
+        }
+    case '[':
+        if (!reader.BeginArray() || !handler.StartArray()) {
+            return false;
+        }
+        for (;;) {
+            if (!reader.NextElement(done)) {
+                return false;
+            }
+            if (done) {
+                return handler.EndArray();
+            }
+            if (!ReadText(reader, handler, scratch, depth + 1)) {
+                return false;
+            }
+        }
+    case '"':
+        return reader.ReadString(scratch) && 
+            handler.String(scratch.data(), scratch.size());
+    case 't':
+    case 'f':
+        return reader.ReadBoolean(flag) && handler.Boolean(flag);
+    case 'n':
+        return reader.ReadNull() && handler.Null();
+    default:
+        if (!reader.ReadNumber(num, integer, flag)) {
+            return false;
+        }
+        return flag ? handler.Number(integer) : handler.Double(num);
+    }
+}
+
+
+/**
+ * Validate a tree.
+ *
+ * @param[in] val the tree.
+ * @param[out] error if not NULL, why the tree is not valid.
+ *
+ * @return true if the tree is valid.
+ */
+
+bool
+JSONSchema::Validate(const JSONValue *val, std::string *error) const
+{
+    JSONSchemaValidator validator(*this);
+    std::string scratch;
+    bool ret;
+
+    if (!IsCompiled()) {
+        if (error) {
+            *error = "no schema compiled";
+        }
+        return false;
+    }
+    ret = WalkTree(val, validator, scratch) && validator.IsComplete();
+    if (!ret && error) {
+        *error = validator.GetError();
+    }
+    return ret;
+}
+
+
+/**
+ * Validate JSON text as it is read, without building anything. Reading 
+ * stops at the first error.
+ *
+ * @param[in] buf the text, need not be NUL terminated.
+ * @param[in] len its length.
+ * @param[out] error if not NULL, why the text is not valid.
+ *
+ * @return true if the text is valid JSON, and valid for the schema.
+ */
+
+bool
+JSONSchema::Validate(const char *buf, size_t len, std::string *error) const
+{
+    JSONSchemaValidator validator(*this);
+    JSONReader reader(buf, len);
+    std::string scratch;
+    bool ret;
+
+    if (!IsCompiled()) {
+        if (error) {
+            *error = "no schema compiled";
+        }
+        return false;
+    }
+    ret = ReadText(reader, validator, scratch, 0) && reader.AtEnd() && 
+        validator.IsComplete();
+    if (!ret && error) {
+        *error = validator.GetError().empty() ? std::string("not valid JSON") :
+            validator.GetError();
+    }
+    return ret;
+}
+
+
+/**
+ * Constructor.
+ *
+ * @param[in] schema the compiled schema, which must outlive the 
+ *            validator. If it is not compiled, any document is valid.
+ */
+
+JSONSchemaValidator::JSONSchemaValidator(const JSONSchema &schema) :
+    m_schema(schema),
+    m_done(false)
+{
+}
+
+
+/**
+ * Get ready to validate another document.
+ */
+
+void
+JSONSchemaValidator::Reset()
+{
+    m_stack.clear();
+    m_seen.clear();
+    m_done = false;
+    m_error.clear();
+}
+
+
+/**
+ * Record that the document is not valid, and where.
+ *
+ * @param[in] msg why.
+ * @param[in] depth the number of containers whose current member or 
+ *            element is part of the location.
+ *
+ * @return false.
+ */
+
+bool
+JSONSchemaValidator::Invalid(const std::string &msg, size_t depth)
+{
+    std::string path;
+
+    for (size_t i = 0; i < depth; i++) {
+        path += '/';
+        if (m_stack[i].object) {
+            for (char c : m_stack[i].key) {
+                if (c == '~') {
+                    path += "~0";
+                } else if (c == '/') {
+                    path += "~1";
+                } else {
+                    path += c;
+                }
+            }
+        } else {
+            path += std::to_string(m_stack[i].count - 1);
+        }
+    }
+    m_error = msg + " at " + (path.empty() ? std::string("the root") : path);
+    return false;
+}
+
+
+/**
+ * Find the schema of the value an event is for.
+ *
+ * @param[out] node the schema, -1 for any.
+ *
+ * @return true, or false if the document was already known to be 
+ *         invalid, or is a second value.
+ */
+
+bool
+JSONSchemaValidator::BeginValue(int &node)
+{
+    if (!m_error.empty()) {
+        return false;
+    }
+    if (m_stack.empty()) {
+        if (m_done) {
+            return Invalid("more than one value", 0);
+        }
+        node = m_schema.m_start;
+        return true;
+    }
+
+    Frame &frame = m_stack.back();
+
+    if (frame.object) {
+        node = frame.value;
+        return true;
+    }
+    frame.count++;
+    node = -1;
+    if (frame.node >= 0) {
+        const JsonSchemaNode &array = m_schema.m_nodes[frame.node];
+
+        if (frame.count > array.maxItems) {
+            return Invalid("more than " + std::to_string(array.maxItems) + 
+                " items", m_stack.size());
+        }
+        node = array.items;
+    }
+    return true;
+}
+
+
+/**
+ * Note that a value is complete.
+ *
+ * @return true.
+ */
+
+bool
+JSONSchemaValidator::EndValue()
+{
+    if (m_stack.empty()) {
+        m_done = true;
+    }
+    return true;
+}
+
+
+/**
+ * Check the type of a value.
+ *
+ * @param[in] node the schema.
+ * @param[in] type the type, a JsonSchemaType.
+ *
+ * @return true if the schema allows it.
+ */
+
+bool
+JSONSchemaValidator::CheckType(const JsonSchemaNode &node, uint8_t type)
+{
+    static const char *names[] = {"null", "boolean", "object", "array", 
+        "number", "integer", "string"};
+    std::string msg;
+
+    if (node.flags & JsonSchemaFlag_Nothing) {
+        return Invalid("no value allowed", m_stack.size());
+    }
+    if (node.types & type) {
+        return true;
+    }
+    for (int i = 0; i < 7; i++) {
+        if ((node.types & (1 << i)) && !((1 << i) == JsonSchemaType_Integer &&
+            (node.types & JsonSchemaType_Number))) {
+            msg += msg.empty() ? "expected " : " or ";
+            msg += names[i];
+        }
+    }
+    return Invalid(msg, m_stack.size());
+}
+
+
+/**
+ * Check a scalar against enum or const.
+ *
+ * @param[in] node the schema.
+ * @param[in] type the type of the value, a JsonSchemaType (integers are 
+ *            JsonSchemaType_Number).
+ * @param[in] number the number, or the boolean as 0 or 1.
+ * @param[in] str the string.
+ *
+ * @return true if the value is allowed.
+ */
+
+bool
+JSONSchemaValidator::CheckEnum(const JsonSchemaNode &node, uint8_t type, 
+    double number, std::string_view str)
+{
+    const JsonSchemaEnum *values = m_schema.m_enums.data() + node.enums;
+
+    if (node.enumCount == 0) {
+        return true;
+    }
+    for (uint32_t i = 0; i < node.enumCount; i++) {
+        if (values[i].type == type && values[i].number == number && 
+            values[i].str == str) {
+            return true;
+        }
+    }
+    return Invalid("not one of the allowed values", m_stack.size());
+}
+
+
+/**
+ * Check a number.
+ *
+ * @param[in] val the number.
+ * @param[in] integer true if it has no fraction.
+ *
+ * @return true if the schema allows it.
+ */
+
+bool
+JSONSchemaValidator::CheckNumber(double val, bool integer)
+{
+    int index;
+
+    if (!BeginValue(index)) {
+        return false;
+    }
+    if (index >= 0) {
+        const JsonSchemaNode &node = m_schema.m_nodes[index];
+
+        if (!CheckType(node, integer ? JsonSchemaType_Integer : 
+            JsonSchemaType_Number)) {
+            return false;
+        }
+        if (((node.flags & JsonSchemaFlag_Minimum) && 
+             val < node.minimum) || 
+            ((node.flags & JsonSchemaFlag_ExclusiveMinimum) && 
+             val <= node.exclusiveMinimum)) {
+            return Invalid("below the minimum", m_stack.size());
+        }
+        if (((node.flags & JsonSchemaFlag_Maximum) && 
+             val > node.maximum) || 
+            ((node.flags & JsonSchemaFlag_ExclusiveMaximum) && 
+             val >= node.exclusiveMaximum)) {
+            return Invalid("above the maximum", m_stack.size());
+        }
+        if (node.flags & JsonSchemaFlag_MultipleOf) {
+            double q = val / node.multipleOf;
+
+            if (fabs(q - nearbyint(q)) > 1e-9 * fmax(1.0, fabs(q))) {
+                return Invalid("not a multiple of " + 
+                    std::to_string(node.multipleOf), m_stack.size());
+            }
+        }
+        if (!CheckEnum(node, JsonSchemaType_Number, val, std::string_view())) {
+            return false;
+        }
+    }
+    return EndValue();
+}
+
+
+/**
+ * Start an object or array.
+ *
+ * @param[in] node its schema.
+ * @param[in] object true for an object.
+ *
+ * @return true.
+ */
+
+bool
+JSONSchemaValidator::Push(int node, bool object)
+{
+    Frame frame;
+
+    frame.node = node;
+    frame.object = object;
+    frame.count = 0;
+    frame.seen = m_seen.size();
+    frame.hint = 0;
+    frame.value = -1;
+    m_stack.push_back(std::move(frame));
+    if (object && node >= 0) {
+        m_seen.resize(m_seen.size() + m_schema.m_nodes[node].requiredCount, 
+            false);
+    }
+    return true;
+}
+
+
+/**
+ * End an object or array, checking what could only be checked once all
+ * its members or elements were seen.
+ *
+ * @param[in] object true for an object.
+ *
+ * @return true if it is valid.
+ */
+
+bool
+JSONSchemaValidator::Pop(bool object)
+{
+    if (!m_error.empty() || m_stack.empty() || 
+        m_stack.back().object != object) {
+        return false;
+    }
+
+    Frame &frame = m_stack.back();
+
+    if (frame.node >= 0) {
+        const JsonSchemaNode &node = m_schema.m_nodes[frame.node];
+
+        if (object) {
+            const JsonSchemaProperty *props = m_schema.m_properties.data() + 
+                node.properties;
+
+            if (frame.count < node.minProperties) {
+                return Invalid("fewer than " + 
+                    std::to_string(node.minProperties) + " members", 
+                    m_stack.size() - 1);
+            }
+            for (uint32_t i = 0; i < node.propertyCount; i++) {
+                if (props[i].required >= 0 && 
+                    !m_seen[frame.seen + props[i].required]) {
+                    return Invalid("missing member " + props[i].key, 
+                        m_stack.size() - 1);
+                }
+            }
+            m_seen.resize(frame.seen);
+        } else if (frame.count < node.minItems) {
+            return Invalid("fewer than " + std::to_string(node.minItems) + 
+                " items", m_stack.size() - 1);
+        }
+    }
+    m_stack.pop_back();
+    return EndValue();
+}
+
+
+bool
+JSONSchemaValidator::StartObject()
+{
+    int node;
+
+    if (!BeginValue(node)) {
+        return false;
+    }
+    if (node >= 0) {
+        const JsonSchemaNode &schema = m_schema.m_nodes[node];
+
+        if (!CheckType(schema, JsonSchemaType_Object)) {
+            return false;
+        }
+        if (schema.enumCount) {
+            return Invalid("not one of the allowed values", m_stack.size());
+        }
+    }
+    return Push(node, true);
+}
+
+
+bool
+JSONSchemaValidator::EndObject()
+{
+    return Pop(true);
+}
+
+
+bool
+JSONSchemaValidator::StartArray()
+{
+    int node;
+
+    if (!BeginValue(node)) {
+        return false;
+    }
+    if (node >= 0) {
+        const JsonSchemaNode &schema = m_schema.m_nodes[node];
+
+        if (!CheckType(schema, JsonSchemaType_Array)) {
+            return false;
+        }
+        if (schema.enumCount) {
+            return Invalid("not one of the allowed values", m_stack.size());
+        }
+    }
+    return Push(node, false);
+}
+
+
+bool
+JSONSchemaValidator::EndArray()
+{
+    return Pop(false);
+}
+
+
+/**
+ * Start a member of an object: find the schema of its value.
+ *
+ * @param[in] str the key.
+ * @param[in] len its length.
+ *
+ * @return true if the object may have the member.
+ */
+
+bool
+JSONSchemaValidator::Key(const char *str, size_t len)
+{
+    const JsonSchemaProperty *prop;
+
+    if (!m_error.empty() || m_stack.empty() || !m_stack.back().object) {
+        return false;
+    }
+
+    Frame &frame = m_stack.back();
+
+    frame.count++;
+    frame.key.assign(str, len);
+    frame.value = -1;
+    if (frame.node < 0) {
+        return true;
+    }
+
+    const JsonSchemaNode &node = m_schema.m_nodes[frame.node];
+
+    if (frame.count > node.maxProperties) {
+        return Invalid("more than " + std::to_string(node.maxProperties) + 
+            " members", m_stack.size() - 1);
+    }
+    prop = m_schema.FindProperty(node, frame.key, frame.hint);
+    if (prop && prop->required >= 0) {
+        m_seen[frame.seen + prop->required] = true;
+    }
+    if (prop && prop->declared) {
+        frame.value = prop->node;
+    } else if (node.flags & JsonSchemaFlag_NoAdditional) {
+        return Invalid("unexpected member", m_stack.size());
+    } else {
+        frame.value = node.additional;
+    }
+    return true;
+}
+
+
+bool
+JSONSchemaValidator::String(const char *str, size_t len)
+{
+    int index;
+
+    if (!BeginValue(index)) {
+        return false;
+    }
+    if (index >= 0) {
+        const JsonSchemaNode &node = m_schema.m_nodes[index];
+
+        if (!CheckType(node, JsonSchemaType_String)) {
+            return false;
+        }
+        if (node.minLength > 0 || node.maxLength < UINT32_MAX) {
+            size_t count = 0;
+
+            // count code points, not bytes
+
+            for (size_t i = 0; i < len; i++) {
+                count += ((unsigned char) str[i] & 0xc0) != 0x80;
+            }
+            if (count < node.minLength) {
+                return Invalid("shorter than " + 
+                    std::to_string(node.minLength), m_stack.size());
+            }
+            if (count > node.maxLength) {
+                return Invalid("longer than " + 
+                    std::to_string(node.maxLength), m_stack.size());
+            }
+        }
+        if (!CheckEnum(node, JsonSchemaType_String, 0, 
+            std::string_view(str, len))) {
+            return false;
+        }
+    }
+    return EndValue();
+}
+
+
+bool
+JSONSchemaValidator::Number(long val)
+{
+    return CheckNumber((double) val, true);
+}
+
+
+bool
+JSONSchemaValidator::Unsigned(unsigned long val)
+{
+    return CheckNumber((double) val, true);
+}
+
+
+bool
+JSONSchemaValidator::Double(double val)
+{
+    return CheckNumber(val, isfinite(val) && val == floor(val));
+}
+
+
+bool
+JSONSchemaValidator::Boolean(bool val)
+{
+    int index;
+
+    if (!BeginValue(index)) {
+        return false;
+    }
+    if (index >= 0) {
+        const JsonSchemaNode &node = m_schema.m_nodes[index];
+
+        if (!CheckType(node, JsonSchemaType_Boolean) || 
+            !CheckEnum(node, JsonSchemaType_Boolean, val, std::string_view())) {
+            return false;
+        }
+    }
+    return EndValue();
+}
+
+
+bool
+JSONSchemaValidator::Null()
+{
+    int index;
+
+    if (!BeginValue(index)) {
+        return false;
+    }
+    if (index >= 0) {
+        const JsonSchemaNode &node = m_schema.m_nodes[index];
+
+        if (!CheckType(node, JsonSchemaType_Null) || 
+            !CheckEnum(node, JsonSchemaType_Null, 0, std::string_view())) {
+            return false;
+        }
+    }
+    return EndValue();
+}
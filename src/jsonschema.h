@@ -0,0 +1,253 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONSCHEMA_H__)
+#define __JSONSCHEMA_H__
+
+#include "jsonapi.h"
+#include "jsonevents.h"
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Bits of JsonSchemaNode::types.
+ */
+
+typedef enum {
+    JsonSchemaType_Null = 0x01,
+    JsonSchemaType_Boolean = 0x02,
+    JsonSchemaType_Object = 0x04,
+    JsonSchemaType_Array = 0x08,
+    JsonSchemaType_Number = 0x10,
+    JsonSchemaType_Integer = 0x20,  // a number with no fraction
+    JsonSchemaType_String = 0x40,
+    JsonSchemaType_Any = 0x7f
+} JsonSchemaType;
+
+/**
+ * Bits of JsonSchemaNode::flags.
+ */
+
+typedef enum {
+    JsonSchemaFlag_Minimum = 0x01,
+    JsonSchemaFlag_Maximum = 0x02,
+    JsonSchemaFlag_ExclusiveMinimum = 0x04,
+    JsonSchemaFlag_ExclusiveMaximum = 0x08,
+    JsonSchemaFlag_MultipleOf = 0x10,
+    JsonSchemaFlag_NoAdditional = 0x20,     // additionalProperties: false
+    JsonSchemaFlag_Nothing = 0x40           // the schema false
+} JsonSchemaFlag;
+
+/**
+ * One schema of a compiled JSONSchema. Subschemas are referred to by 
+ * their index in the program, -1 standing for a schema that accepts 
+ * anything. The limits that are not set are 0 (minimums) and UINT32_MAX
+ * (maximums).
+ */
+
+struct JsonSchemaNode
+{
+    uint8_t types;
+    uint8_t flags;
+    double minimum;
+    double maximum;
+    double exclusiveMinimum;
+    double exclusiveMaximum;
+    double multipleOf;
+    uint32_t minLength, maxLength;          // in code points
+    uint32_t minItems, maxItems;
+    uint32_t minProperties, maxProperties;
+    int items;                              // schema of the elements
+    int additional;                         // schema of undeclared members
+    uint32_t properties, propertyCount;     // in JSONSchema::m_properties
+    uint32_t requiredCount;
+    uint32_t enums, enumCount;              // in JSONSchema::m_enums
+};
+
+/**
+ * A member named by properties or required, in the order of the schema.
+ */
+
+struct JsonSchemaProperty
+{
+    std::string key;
+    int node;           // schema of the value
+    bool declared;      // in properties, otherwise only required
+    int required;       // index of the flag recording it was seen, or -1
+};
+
+/**
+ * A value allowed by enum or const.
+ */
+
+struct JsonSchemaEnum
+{
+    uint8_t type;       // JsonSchemaType_Null, _Boolean, _Number or _String
+    double number;      // or the boolean, as 0 or 1
+    std::string str;
+};
+
+/**
+ * A JSON Schema compiled into a program: a flat array of JsonSchemaNode,
+ * with the properties and enumerations of all the nodes in arrays of 
+ * their own. The program is run by JSONSchemaValidator over the events 
+ * of a document, so validating needs no tree: Validate() runs it over 
+ * JSON text as it is read, stopping at the first error, or over a 
+ * JSONValue tree. A JsonParse with a schema (see JsonParse::SetSchema())
+ * validates its input before building anything.
+ *
+ * The keywords supported are type, enum, const, minimum, maximum, 
+ * exclusiveMinimum, exclusiveMaximum (as numbers, or as booleans in the 
+ * style of draft 4), multipleOf, minLength, maxLength, properties, 
+ * required, additionalProperties, minProperties, maxProperties, items 
+ * (a single schema), minItems, maxItems, and $ref to the whole schema or
+ * to a schema under definitions or $defs. enum and const take scalars.
+ * Annotations, and keywords this class does not know of, are ignored; 
+ * Compile() fails on the keywords it knows it does not support (such as
+ * pattern, anyOf or oneOf), rather than accept documents the schema 
+ * rejects.
+ *
+ * A compiled schema is not modified by validation, so one can be shared
+ * by any number of threads.
+ */
+
+class JSONSchema
+{
+public:
+    JSONSchema() : m_start(-1), m_root(NULL) {}
+    bool Compile(const JSONValue *schema);
+    bool Compile(const std::string &text);
+    bool IsCompiled() const {return m_start >= 0;}
+    const std::string &GetError() const {return m_error;}
+    bool Validate(const JSONValue *val, std::string *error = NULL) const;
+    bool Validate(const char *buf, size_t len, std::string *error = NULL) const;
+    size_t GetSize() const {return m_nodes.size();}
+private:
+    friend class JSONSchemaValidator;
+    static const int MaxDepth = 512;
+    int CompileNode(const JSONValue *schema, int depth);
+    int CompileRef(std::string_view ref, int depth);
+    bool CompileProperties(JsonSchemaNode &node, const JSONValue *props, 
+        const JSONValue *required, int depth);
+    bool CompileEnum(JsonSchemaNode &node, const JSONValue *val, bool single);
+    bool Fail(const std::string &msg);
+    const JsonSchemaProperty *FindProperty(const JsonSchemaNode &node, 
+        std::string_view key, uint32_t &hint) const;
+    std::vector<JsonSchemaNode> m_nodes;
+    std::vector<JsonSchemaProperty> m_properties;
+    std::vector<JsonSchemaEnum> m_enums;
+    std::string m_error;
+    int m_start;                            // the node of the schema
+    const JSONValue *m_root;                // while compiling
+    std::map<std::string, int> m_refs;      // while compiling
+};
+
+/**
+ * Runs a compiled JSONSchema over the events of a document. The events 
+ * may come from a decoder (see JSONCborDecoder) as well as from 
+ * JSONSchema::Validate(). Each event returns false once the document is 
+ * known to be invalid, which stops a decoder early; GetError() then 
+ * tells why, and where, as a JSON Pointer. A validator can be reused 
+ * with Reset().
+ */
+
+class JSONSchemaValidator : public JSONEventHandler
+{
+public:
+    explicit JSONSchemaValidator(const JSONSchema &schema);
+    void Reset();
+    bool IsComplete() const {return m_done && m_error.empty();}
+    const std::string &GetError() const {return m_error;}
+    bool StartObject();
+    bool EndObject();
+    bool StartArray();
+    bool EndArray();
+    bool Key(const char *str, size_t len);
+    bool String(const char *str, size_t len);
+    bool Number(long val);
+    bool Unsigned(unsigned long val);
+    bool Double(double val);
+    bool Boolean(bool val);
+    bool Null();
+private:
+    /**
+     * An object or array being validated.
+     */
+
+    struct Frame
+    {
+        int node;           // schema of the container, -1 for any
+        bool object;
+        uint32_t count;     // members or elements so far
+        uint32_t seen;      // offset of the required flags in m_seen
+        uint32_t hint;      // property expected next
+        int value;          // schema of the value of the current member
+        std::string key;    // of the current member
+    };
+
+    bool BeginValue(int &node);
+    bool EndValue();
+    bool CheckType(const JsonSchemaNode &node, uint8_t type);
+    bool CheckNumber(double val, bool integer);
+    bool CheckEnum(const JsonSchemaNode &node, uint8_t type, double number,
+        std::string_view str);
+    bool Push(int node, bool object);
+    bool Pop(bool object);
+    bool Invalid(const std::string &msg, size_t depth);
+    const JSONSchema &m_schema;
+    std::vector<Frame> m_stack;
+    std::vector<bool> m_seen;
+    bool m_done;            // the root value is complete
+    std::string m_error;
+};
+
+#endif
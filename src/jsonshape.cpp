@@ -0,0 +1,373 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonshape.h"
+#include "jsonapi.h"
+#include <string.h>
+
+/**
+ * Constructor. Copies the keys, and builds the table used to look them
+ * up. If a key appears more than once, Find() returns the first.
+ *
+ * @param[in] keys the keys, in order.
+ * @param[in] count the number of keys.
+ */
+
+JSONShape::JSONShape(const JsonStr *keys, size_t count) :
+    m_keys(keys, keys + count),
+    m_hash(HashKeys(keys, count)),
+    m_refs(1)
+{
+    size_t size = 4;
+
+    while (size < count * 2) {
+        size *= 2;
+    }
+    m_table.assign(size, -1);
+    for (size_t i = 0; i < count; i++) {
+        size_t slot = HashKey(Unquote(m_keys[i].View())) & (size - 1);
+
+        while (m_table[slot] >= 0) {
+            if (Unquote(m_keys[m_table[slot]].View()) == 
+                Unquote(m_keys[i].View())) {
+                break;
+            }
+            slot = (slot + 1) & (size - 1);
+        }
+        if (m_table[slot] < 0) {
+            m_table[slot] = (int) i;
+        }
+    }
+}
+
+
+/**
+ * Add a reference to the shape.
+ *
+ * @return the shape.
+ */
+
+JSONShape *
+JSONShape::Ref()
+{
+    m_refs.fetch_add(1, std::memory_order_relaxed);
+    return this;
+}
+
+
+/**
+ * Drop a reference to the shape, destroying it when the last one goes.
+ *
+ * @param[in] shape the shape, may be NULL.
+ */
+
+void
+JSONShape::Unref(JSONShape *shape)
+{
+    if (shape && shape->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete shape;
+    }
+}
+
+
+/**
+ * Find a key. 
+ *
+ * @param[in] key the key, with or without quotes.
+ *
+ * @return the index of the key, or -1 if the shape does not have it.
+ */
+
+int
+JSONShape::Find(std::string_view key) const
+{
+    size_t mask = m_table.size() - 1;
+    size_t slot;
+    int ret = -1;
+
+    key = Unquote(key);
+    slot = HashKey(key) & mask;
+    while (m_table[slot] >= 0) {
+        if (Unquote(m_keys[m_table[slot]].View()) == key) {
+            ret = m_table[slot];
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return ret;
+}
+
+
+/**
+ * Check if the shape has the given keys, in order.
+ *
+ * @param[in] keys the keys.
+ * @param[in] count the number of keys.
+ *
+ * @return true if it does.
+ */
+
+bool
+JSONShape::Equals(const JsonStr *keys, size_t count) const
+{
+    bool ret = false;
+
+    if (count != m_keys.size()) {
+        goto out;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (m_keys[i] != keys[i]) {
+            goto out;
+        }
+    }
+    ret = true;
+out:
+    return ret;
+}
+
+
+/**
+ * Hash a sequence of keys. Shapes with the same keys have the same hash.
+ *
+ * @param[in] keys the keys.
+ * @param[in] count the number of keys.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONShape::HashKeys(const JsonStr *keys, size_t count)
+{
+    uint64_t h = count;
+
+    for (size_t i = 0; i < count; i++) {
+        h = (h ^ HashKey(keys[i].View())) * 0x100000001b3ULL;
+        h ^= keys[i].size();
+    }
+    return h;
+}
+
+
+/**
+ * Hash a key (FNV-1a).
+ *
+ * @param[in] key the key.
+ *
+ * @return the hash.
+ */
+
+uint64_t
+JSONShape::HashKey(std::string_view key)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (size_t i = 0; i < key.size(); i++) {
+        h = (h ^ (unsigned char) key[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+
+/**
+ * Remove the quotes that a parsed key keeps, if any.
+ *
+ * @param[in] key the key.
+ *
+ * @return the key without its quotes.
+ */
+
+std::string_view
+JSONShape::Unquote(std::string_view key)
+{
+    if (key.size() >= 2 && key.front() == '"' && key.back() == '"') {
+        key = key.substr(1, key.size() - 2);
+    }
+    return key;
+}
+
+
+/**
+ * Get the shape for a sequence of keys, making it if the table does not 
+ * have it yet.
+ *
+ * @param[in] keys the keys, in order.
+ * @param[in] count the number of keys.
+ *
+ * @return the shape, with a reference for the caller (see 
+ *         JSONShape::Unref()).
+ */
+
+JSONShape *
+JSONShapeTable::Intern(const JsonStr *keys, size_t count)
+{
+    uint64_t hash = JSONShape::HashKeys(keys, count);
+    auto range = m_shapes.equal_range(hash);
+    JSONShape *ret = NULL;
+
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (iter->second->Equals(keys, count)) {
+            ret = iter->second;
+            break;
+        }
+    }
+    if (ret == NULL) {
+        ret = new JSONShape(keys, count);
+        m_shapes.emplace(hash, ret);
+    }
+    return ret->Ref();
+}
+
+
+/**
+ * Replace the objects of a tree by records, bottom up. Values shared with
+ * another document are left alone, since they must not be modified. 
+ *
+ * @param[in] val the root of the tree. If it is replaced, it is destroyed.
+ *
+ * @return the new root, which is val unless val itself was an object.
+ */
+
+JSONValue *
+JSONShapeTable::Compact(JSONValue *val)
+{
+    JSONValue *ret = val;
+
+    if (val) {
+        ret = CompactNode(val);
+        if (ret) {
+            JSONValue::Unref(val);
+        } else {
+            ret = val;
+        }
+    }
+    return ret;
+}
+
+
+/**
+ * Compact the children of a value, and the value itself if it is an 
+ * object.
+ *
+ * @param[in] val the value.
+ *
+ * @return the record replacing val, or NULL if val stays (the caller 
+ *         then still owns val, otherwise it must drop its reference).
+ */
+
+JSONValue *
+JSONShapeTable::CompactNode(JSONValue *val)
+{
+    JsonElementList::iterator iter;
+    JSONRecord *ret = NULL;
+    JSONShape *shape;
+
+    if (val->IsShared()) {
+        goto out;
+    }
+    if (val->GetType() == JsonType_Array) {
+
+        // replaced in place, Set() would walk the array for each element
+
+        val->Materialize();
+        for (iter = val->m_elements.begin(); 
+             iter != val->m_elements.end(); ++iter) {
+            JSONValue *rec = CompactNode(*iter);
+
+            if (rec) {
+                JSONValue::Unref(*iter);
+                *iter = rec;
+            }
+        }
+        goto out;
+    }
+    if (val->GetType() != JsonType_Object) {
+        goto out;
+    }
+    for (JSONValue *child : *val) {
+        JSONTuple *tuple = static_cast<JSONTuple *>(child);
+
+        if (tuple->GetValue()) {
+            JSONValue *rec = CompactNode(tuple->GetValue());
+
+            if (rec) {
+                tuple->SetValue(std::unique_ptr<JSONValue>(rec));
+            }
+        }
+    }
+
+    // The scratch is reused by the recursive calls above, so fill it 
+    // only now
+
+    m_keys.clear();
+    for (JSONValue *child : *val) {
+        m_keys.push_back(static_cast<JSONTuple *>(child)->GetKey());
+    }
+    shape = Intern(m_keys.data(), m_keys.size());
+    ret = new JSONRecord(shape);
+    for (const auto &member : val->Members()) {
+        ret->Append(member.value ? member.value->Ref() : new JSONNull());
+    }
+out:
+    return ret;
+}
+
+
+/**
+ * Drop the references of the table to its shapes. Shapes still used by
+ * records stay alive until the records are destroyed.
+ */
+
+void
+JSONShapeTable::Clear()
+{
+    for (auto &entry : m_shapes) {
+        JSONShape::Unref(entry.second);
+    }
+    m_shapes.clear();
+}
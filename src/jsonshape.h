@@ -0,0 +1,120 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONSHAPE_H__)
+#define __JSONSHAPE_H__
+
+#include "jsonstr.h"
+#include <stdint.h>
+#include <atomic>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class JSONValue;
+
+/**
+ * The keys of an object, in order, with a table to look them up. Objects
+ * with the same keys in the same order can share a shape, and store only
+ * their values, see JSONRecord. A shape does not change once made, so it
+ * can be shared between threads. It is reference counted.
+ *
+ * Keys are looked up as FindKey() does: a key of a parsed object, which
+ * keeps its quotes, matches with or without them.
+ */
+
+class JSONShape
+{
+public:
+    JSONShape(const JsonStr *keys, size_t count);
+    JSONShape(const JSONShape &) = delete;
+    JSONShape &operator=(const JSONShape &) = delete;
+    JSONShape *Ref();
+    static void Unref(JSONShape *shape);
+    size_t GetSize() const {return m_keys.size();}
+    const JsonStr &GetKey(size_t index) const {return m_keys[index];}
+    int Find(std::string_view key) const;
+    uint64_t GetHash() const {return m_hash;}
+    bool Equals(const JsonStr *keys, size_t count) const;
+    static uint64_t HashKeys(const JsonStr *keys, size_t count);
+private:
+    ~JSONShape() {}
+    static uint64_t HashKey(std::string_view key);
+    static std::string_view Unquote(std::string_view key);
+    std::vector<JsonStr> m_keys;
+    std::vector<int> m_table;   // open addressing, index of a key or -1
+    uint64_t m_hash;            // see HashKeys()
+    std::atomic<int> m_refs;
+};
+
+/**
+ * Makes objects share shapes. Each distinct sequence of keys gets one 
+ * shape, which the table keeps until it is destroyed; the records made 
+ * with it keep their own references, so they may outlive the table. A 
+ * table is not thread safe, use one per parse or per thread.
+ */
+
+class JSONShapeTable
+{
+public:
+    JSONShapeTable() {}
+    JSONShapeTable(const JSONShapeTable &) = delete;
+    JSONShapeTable &operator=(const JSONShapeTable &) = delete;
+    ~JSONShapeTable() {Clear();}
+    JSONShape *Intern(const JsonStr *keys, size_t count);
+    JSONValue *Compact(JSONValue *val);
+    size_t GetCount() const {return m_shapes.size();}
+    void Clear();
+private:
+    JSONValue *CompactNode(JSONValue *val);
+    std::unordered_multimap<uint64_t, JSONShape *> m_shapes;
+    std::vector<JsonStr> m_keys;    // scratch, reused by Compact()
+};
+
+#endif
@@ -0,0 +1,407 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonstr.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <utility>
+
+/**
+ * Move constructor. Long strings have their buffer taken over, and other
+ * is left empty.
+ *
+ * @param[in] other the string to move from.
+ */
+
+JsonStr::JsonStr(JsonStr &&other) :
+    m_info(other.m_info)
+{
+    if (IsInline()) {
+        memcpy(m_inline, other.m_inline, sizeof m_inline);
+    } else {
+        m_ptr = other.m_ptr;
+    }
+    other.m_info = 0;
+    other.m_inline[0] = '\0';
+}
+
+
+/**
+ * Copy assignment.
+ *
+ * @param[in] other the string to copy.
+ *
+ * @return this string.
+ */
+
+JsonStr &
+JsonStr::operator=(const JsonStr &other)
+{
+    if (this != &other) {
+        Assign(other.c_str(), other.size());
+    }
+    return *this;
+}
+
+
+/**
+ * Move assignment. 
+ *
+ * @param[in] other the string to move from. It is left empty.
+ *
+ * @return this string.
+ */
+
+JsonStr &
+JsonStr::operator=(JsonStr &&other)
+{
+    if (this != &other) {
+        JsonStr tmp(std::move(other));
+        swap(tmp);
+    }
+    return *this;
+}
+
+
+/**
+ * Exchange the contents of two strings without copying long strings.
+ *
+ * @param[in,out] other the string to exchange with.
+ */
+
+void
+JsonStr::swap(JsonStr &other)
+{
+    char tmp[sizeof m_inline];
+
+    memcpy(tmp, m_inline, sizeof m_inline);
+    memcpy(m_inline, other.m_inline, sizeof m_inline);
+    memcpy(other.m_inline, tmp, sizeof m_inline);
+    std::swap(m_info, other.m_info);
+}
+
+
+/**
+ * Set the string's value, classifying it as plain or not along the way.
+ *
+ * @param[in] str the bytes to copy. Need not be NULL terminated.
+ * @param[in] len the number of bytes to copy.
+ */
+
+void
+JsonStr::Assign(const char *str, size_t len)
+{
+    size_t flags = 0;
+    char *p;
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char) str[i];
+        if (c < 0x20 || c >= 0x80) {
+            flags |= Escape;
+            break;
+        }
+    }
+
+    // str may point into this string, so copy it before freeing anything.
+
+    if (len <= InlineMax) {
+        char tmp[InlineMax + 1];
+
+        memcpy(tmp, str, len);
+        Free();
+        p = m_inline;
+        memcpy(p, tmp, len);
+    } else {
+        p = (char *) JSONMemory::Allocate(len + 1, 
+            JsonMemoryCategory_Strings);
+        memcpy(p, str, len);
+        Free();
+        m_ptr = p;
+        flags |= Long;
+    }
+    p[len] = '\0';
+    m_info = (len << 2) | flags;
+}
+
+
+/**
+ * Compare to a byte sequence.
+ *
+ * @param[in] str the bytes to compare to.
+ * @param[in] len the number of bytes.
+ *
+ * @return true if the string consists of exactly those bytes.
+ */
+
+bool
+JsonStr::Equals(const char *str, size_t len) const
+{
+    return size() == len && memcmp(c_str(), str, len) == 0;
+}
+
+
+/**
+ * Compare to another string. The packed length and flags are compared 
+ * first, which rejects most mismatches without touching the bytes.
+ *
+ * @param[in] other the string to compare to.
+ *
+ * @return true if the strings are equal.
+ */
+
+bool
+JsonStr::Equals(const JsonStr &other) const
+{
+    return m_info == other.m_info && 
+        memcmp(c_str(), other.c_str(), size()) == 0;
+}
+
+
+/**
+ * Read the 4 hex digits of a \\u escape.
+ *
+ * @param[in] p the digits.
+ * @param[out] code the code unit.
+ *
+ * @return true on success, false if p is not 4 hex digits.
+ */
+
+static bool
+ReadHex4(const char *p, uint32_t &code)
+{
+    code = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+
+        code <<= 4;
+        if (c >= '0' && c <= '9') {
+            code += c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            code += c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            code += c - 'A' + 10;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Get the text of a string as stored by the parser, by removing its 
+ * quotes and decoding its escapes, \\u escapes to UTF-8. A string 
+ * without quotes was not made by the parser, and is its own text.
+ *
+ * @param[in] stored the string.
+ * @param[out] out the text.
+ *
+ * @return true on success, false if an escape is malformed.
+ */
+
+bool
+JsonStr::Unquote(std::string_view stored, std::string &out)
+{
+    size_t i = 0, end = stored.size();
+    uint32_t code, low;
+
+    out.clear();
+    if (end < 2 || stored[0] != '"' || stored[end - 1] != '"') {
+        out.assign(stored.data(), end);
+        return true;
+    }
+    i++;
+    end--;
+    while (i < end) {
+        size_t run = i;
+
+        while (i < end && stored[i] != '\\') {
+            i++;
+        }
+        out.append(stored.data() + run, i - run);
+        if (i == end) {
+            break;
+        }
+        if (++i == end) {
+            return false;
+        }
+        switch (stored[i++]) {
+        case '"': out += '"'; continue;
+        case '\\': out += '\\'; continue;
+        case '/': out += '/'; continue;
+        case 'b': out += '\b'; continue;
+        case 'f': out += '\f'; continue;
+        case 'n': out += '\n'; continue;
+        case 'r': out += '\r'; continue;
+        case 't': out += '\t'; continue;
+        case 'u': break;
+        default: return false;
+        }
+        if (end - i < 4 || !ReadHex4(stored.data() + i, code)) {
+            return false;
+        }
+        i += 4;
+
+        // a high surrogate must be followed by a low one
+
+        if (code >= 0xd800 && code <= 0xdbff) {
+            if (end - i < 6 || stored[i] != '\\' || stored[i + 1] != 'u' ||
+                !ReadHex4(stored.data() + i + 2, low) || 
+                low < 0xdc00 || low > 0xdfff) {
+                return false;
+            }
+            i += 6;
+            code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+        } else if (code >= 0xdc00 && code <= 0xdfff) {
+            return false;
+        }
+        if (code < 0x80) {
+            out += (char) code;
+        } else if (code < 0x800) {
+            out += (char) (0xc0 | (code >> 6));
+            out += (char) (0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += (char) (0xe0 | (code >> 12));
+            out += (char) (0x80 | ((code >> 6) & 0x3f));
+            out += (char) (0x80 | (code & 0x3f));
+        } else {
+            out += (char) (0xf0 | (code >> 18));
+            out += (char) (0x80 | ((code >> 12) & 0x3f));
+            out += (char) (0x80 | ((code >> 6) & 0x3f));
+            out += (char) (0x80 | (code & 0x3f));
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Get the text of a string as stored by the parser, see Unquote(). The 
+ * text of a string without escapes is part of the string itself, and is
+ * not copied.
+ *
+ * @param[in] stored the string.
+ * @param[out] scratch holds the text of a string with escapes.
+ *
+ * @return the text, which refers to stored or scratch. If an escape is 
+ *         malformed, stored itself.
+ */
+
+std::string_view
+JsonStr::Text(std::string_view stored, std::string &scratch)
+{
+    size_t len = stored.size();
+
+    if (len < 2 || stored[0] != '"' || stored[len - 1] != '"') {
+        return stored;
+    }
+    if (stored.find('\\') == std::string_view::npos) {
+        return stored.substr(1, len - 2);
+    }
+    if (!Unquote(stored, scratch)) {
+        return stored;
+    }
+    return scratch;
+}
+
+
+/**
+ * Make the string the parser stores for a text: the text in quotes, 
+ * with quotes, backslashes and control characters escaped. Multibyte 
+ * UTF-8 is kept as is.
+ *
+ * @param[in] text the text.
+ * @param[out] out the string.
+ */
+
+void
+JsonStr::Quote(std::string_view text, std::string &out)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out.clear();
+    out.reserve(text.size() + 2);
+    out += '"';
+    for (char c : text) {
+        switch (c) {
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char) c < 0x20) {
+                out += "\\u00";
+                out += hex[(unsigned char) c >> 4];
+                out += hex[c & 0xf];
+            } else {
+                out += c;
+            }
+            break;
+        }
+    }
+    out += '"';
+}
+
+
+/**
+ * Free the heap buffer of a long string, leaving an empty string.
+ */
+
+void
+JsonStr::Free()
+{
+    if (!IsInline()) {
+        JSONMemory::Free(m_ptr, size() + 1, JsonMemoryCategory_Strings);
+    }
+    m_info = 0;
+    m_inline[0] = '\0';
+}
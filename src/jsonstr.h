@@ -0,0 +1,136 @@
+#if !defined(__JSONSTR_H__)
+#define __JSONSTR_H__
+
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsonmemory.h"
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+
+/**
+ * Compact string used for string values and keys, both by the parser and
+ * by the public API. 
+ *
+ * Strings of up to JsonStr::InlineMax bytes are stored inline, avoiding a 
+ * heap allocation and a pointer chase when comparing keys. Longer strings
+ * are stored in a heap buffer. The length and flags are packed into a 
+ * single word, so two strings can usually be told apart by comparing 
+ * that word alone. The strings are always NULL terminated.
+ *
+ * A string is "plain" if it contains only ASCII characters that do not 
+ * need to be escaped when converted to JSON (i.e., no control characters
+ * and no multibyte UTF-8), which lets serialization skip escape and UTF-8 
+ * processing.
+ *
+ * The parser stores strings as they appear in the input, quotes and
+ * escapes included. Unquote() gives the text of such a string, for
+ * comparing it by value or writing it in a format other than JSON (or
+ * Text(), which copies nothing for a string without escapes), and 
+ * Quote() makes the string the parser would have stored for a text.
+ */
+
+class JsonStr
+{
+public:
+    static const size_t InlineMax = 15;
+
+    JsonStr() : m_info(0) {m_inline[0] = '\0';}
+    JsonStr(const char *str) : m_info(0) {Assign(str, strlen(str));}
+    JsonStr(const char *str, size_t len) : m_info(0) {Assign(str, len);}
+    JsonStr(const std::string &str) : m_info(0) {Assign(str.c_str(), str.size());}
+    JsonStr(const JsonStr &other) : m_info(0) {Assign(other.c_str(), other.size());}
+    JsonStr(JsonStr &&other);
+    ~JsonStr() {Free();}
+    JsonStr &operator=(const JsonStr &other);
+    JsonStr &operator=(JsonStr &&other);
+    JsonStr &operator=(const char *str) {Assign(str, strlen(str)); return *this;}
+    JsonStr &operator=(const std::string &str) {Assign(str.c_str(), str.size()); return *this;}
+    const char *c_str() const {return IsInline() ? m_inline : m_ptr;}
+    const char *data() const {return c_str();}
+    size_t size() const {return m_info >> 2;}
+    size_t length() const {return size();}
+    bool empty() const {return size() == 0;}
+    bool IsInline() const {return (m_info & Long) == 0;}
+    bool IsPlain() const {return (m_info & Escape) == 0;}
+    std::string str() const {return std::string(c_str(), size());}
+    std::string_view View() const {return std::string_view(c_str(), size());}
+    operator std::string() const {return str();}
+    void swap(JsonStr &other);
+    bool Equals(const char *str, size_t len) const;
+    bool Equals(const JsonStr &other) const;
+    void Assign(const char *str, size_t len);
+    static bool Unquote(std::string_view stored, std::string &out);
+    static void Quote(std::string_view text, std::string &out);
+    static std::string_view Text(std::string_view stored, std::string &scratch);
+private:
+    enum {
+        Long = 1,       // stored in m_ptr rather than m_inline
+        Escape = 2      // not plain, see IsPlain()
+    };
+    void Free();
+    size_t m_info;      // length << 2 | flags
+    union {
+        char m_inline[InlineMax + 1];
+        char *m_ptr;
+    };
+};
+
+inline bool operator==(const JsonStr &a, const JsonStr &b) {return a.Equals(b);}
+inline bool operator==(const JsonStr &a, const char *b) {return a.Equals(b, strlen(b));}
+inline bool operator==(const char *a, const JsonStr &b) {return b.Equals(a, strlen(a));}
+inline bool operator==(const JsonStr &a, const std::string &b) {return a.Equals(b.c_str(), b.size());}
+inline bool operator==(const std::string &a, const JsonStr &b) {return b.Equals(a.c_str(), a.size());}
+inline bool operator!=(const JsonStr &a, const JsonStr &b) {return !a.Equals(b);}
+inline bool operator!=(const JsonStr &a, const char *b) {return !(a == b);}
+inline bool operator!=(const JsonStr &a, const std::string &b) {return !(a == b);}
+
+#endif
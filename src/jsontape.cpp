@@ -0,0 +1,940 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "jsontape.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define JSON_SNAPSHOT_MAGIC "JSONSNAP"
+#define JSON_SNAPSHOT_VERSION 1
+#define JSON_SNAPSHOT_BYTE_ORDER 0x01020304
+
+/**
+ * Header of a snapshot file. It is followed by the words of the tape, 
+ * then by the string buffer. The size of the header is a multiple of 8, 
+ * so the words are aligned in a mapping of the file.
+ */
+
+struct JsonSnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;     // as written by the host that saved the file
+    uint64_t numWords;
+    uint64_t numStrings;    // size of the string buffer in bytes
+    uint64_t checksum;      // of the words and the string buffer
+};
+
+/**
+ * Compute the checksum of the contents of a snapshot.
+ *
+ * @param[in] words the words of the tape.
+ * @param[in] numWords the number of words.
+ * @param[in] strings the string buffer.
+ * @param[in] numStrings the size of the string buffer.
+ *
+ * @return the checksum.
+ */
+
+static uint64_t
+SnapshotChecksum(const uint64_t *words, size_t numWords, 
+    const char *strings, size_t numStrings)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    uint64_t w;
+    size_t i;
+
+    for (i = 0; i < numWords; i++) {
+        h = (h ^ words[i]) * 0x100000001b3ULL;
+    }
+    for (i = 0; i + sizeof(w) <= numStrings; i += sizeof(w)) {
+        memcpy(&w, strings + i, sizeof(w));
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    for (; i < numStrings; i++) {
+        h = (h ^ (unsigned char) strings[i]) * 0x100000001b3ULL;
+    }
+    return h ^ (h >> 32);
+}
+
+
+/**
+ * Constructor.
+ */
+
+JSONTape::JSONTape() :
+    m_map(NULL),
+    m_mapSize(0),
+    m_mapWords(NULL),
+    m_mapNumWords(0),
+    m_mapStrings(NULL),
+    m_mapNumStrings(0)
+{
+}
+
+
+/**
+ * Empty the tape, so it can be reused by another parse. The memory 
+ * allocated for the tape is kept, a loaded snapshot is unmapped.
+ */
+
+void
+JSONTape::Clear()
+{
+    m_tape.clear();
+    m_strings.clear();
+    m_stack.clear();
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+        m_map = NULL;
+        m_mapSize = 0;
+        m_mapWords = NULL;
+        m_mapNumWords = 0;
+        m_mapStrings = NULL;
+        m_mapNumStrings = 0;
+    }
+}
+
+
+/**
+ * Save the tape to a snapshot file, which can later be loaded with 
+ * LoadSnapshot(). The file can only be loaded on a host with the same
+ * byte order. The snapshot is written to a temporary file in the same 
+ * directory, which is then renamed over path, so processes that have 
+ * the old file loaded keep reading it intact, and a crash never leaves 
+ * a partly written file at path.
+ *
+ * @param[in] path the path of the file, replaced if it exists.
+ *
+ * @return true on success, false if the tape is empty or the file 
+ *         could not be written.
+ */
+
+bool
+JSONTape::SaveSnapshot(const char *path) const
+{
+    std::string tmp(path);
+    bool ret = false;
+    FILE *fp = NULL;
+    int fd = -1;
+
+    if (IsEmpty()) {
+        goto out;
+    }
+    tmp += ".XXXXXX";
+    fd = mkstemp(&tmp[0]);
+    if (fd < 0) {
+        goto out;
+    }
+    fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        close(fd);
+        goto out;
+    }
+    ret = fchmod(fd, 0644) == 0 && WriteSnapshot(fp) && fflush(fp) == 0 && 
+        fsync(fd) == 0;
+out:
+    if (fp && fclose(fp) != 0) {
+        ret = false;
+    }
+    if (ret && rename(tmp.c_str(), path) != 0) {
+        ret = false;
+    }
+    if (ret == false && fd >= 0) {
+        unlink(tmp.c_str());
+    }
+    return ret;
+}
+
+
+/**
+ * Save the tape to a POSIX shared memory object, as a snapshot that 
+ * AttachShared() maps, so that the processes of a host share a single 
+ * copy of a document. The object is created, never replaced: a process
+ * that attached it keeps using its pages, so to publish a new version of
+ * the document, save it under a new name, or remove the old object with
+ * RemoveShared() first (processes that attached it keep it until they 
+ * detach). Until the object is completely written, attaching it fails.
+ *
+ * @param[in] name the name of the object, a slash followed by up to 
+ *            NAME_MAX characters that are not slashes, see shm_open(3).
+ *
+ * @return true on success, false if the tape is empty, the object 
+ *         exists or could not be written.
+ */
+
+bool
+JSONTape::SaveShared(const char *name) const
+{
+    bool ret = false;
+    FILE *fp = NULL;
+    int fd;
+
+    if (IsEmpty()) {
+        goto out;
+    }
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        goto out;
+    }
+    fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        close(fd);
+        shm_unlink(name);
+        goto out;
+    }
+    ret = WriteSnapshot(fp);
+out:
+    if (fp && fclose(fp) != 0) {
+        ret = false;
+    }
+    if (fp && ret == false) {
+        shm_unlink(name);
+    }
+    return ret;
+}
+
+
+/**
+ * Remove a shared memory object saved by SaveShared(). Processes that
+ * attached it keep their mapping.
+ *
+ * @param[in] name the name of the object.
+ *
+ * @return true on success, false if there is no such object.
+ */
+
+bool
+JSONTape::RemoveShared(const char *name)
+{
+    return shm_unlink(name) == 0;
+}
+
+
+/**
+ * Write the tape as a snapshot: a header, the words of the tape, then 
+ * the string buffer.
+ *
+ * @param[in] fp the file.
+ *
+ * @return true on success, false if the file could not be written.
+ */
+
+bool
+JSONTape::WriteSnapshot(FILE *fp) const
+{
+    JsonSnapshotHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JSON_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = JSON_SNAPSHOT_VERSION;
+    header.byteOrder = JSON_SNAPSHOT_BYTE_ORDER;
+    header.numWords = GetTapeSize();
+    header.numStrings = GetStringsSize();
+    header.checksum = SnapshotChecksum(Words(), GetTapeSize(), 
+        Strings(), GetStringsSize());
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(Words(), sizeof(uint64_t), GetTapeSize(), fp) != GetTapeSize() ||
+        (GetStringsSize() && 
+         fwrite(Strings(), 1, GetStringsSize(), fp) != GetStringsSize())) {
+        return false;
+    }
+    return true;
+}
+
+
+/**
+ * Load a snapshot file saved by SaveSnapshot(). The file is mapped read 
+ * only, and used in place: no copy of it is made, and nothing is 
+ * decoded. Whatever the tape held before is discarded.
+ *
+ * The header is always checked. The checksum is checked only if verify
+ * is true, since doing so reads the whole file. It protects against 
+ * truncated or corrupted files, but not against files crafted to be 
+ * malicious, so only load snapshots from a trusted source.
+ *
+ * @param[in] path the path of the file.
+ * @param[in] verify if true, check the checksum of the contents.
+ *
+ * @return true on success, false if the file could not be mapped or 
+ *         is not a valid snapshot, in which case the tape is empty.
+ */
+
+bool
+JSONTape::LoadSnapshot(const char *path, bool verify)
+{
+    bool ret = false;
+    int fd;
+
+    Clear();
+    fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        ret = MapSnapshot(fd, verify);
+        close(fd);
+    }
+    return ret;
+}
+
+
+/**
+ * Attach a shared memory object saved by SaveShared(), read only. The 
+ * snapshot it holds is used in place, as by LoadSnapshot(), so the 
+ * pages of the document are those of the object, shared by all the 
+ * processes that attach it. Whatever the tape held before is discarded.
+ *
+ * @param[in] name the name of the object.
+ * @param[in] verify if true, check the checksum of the contents.
+ *
+ * @return true on success, false if there is no such object, or it is 
+ *         not a valid snapshot (yet), in which case the tape is empty.
+ */
+
+bool
+JSONTape::AttachShared(const char *name, bool verify)
+{
+    bool ret = false;
+    int fd;
+
+    Clear();
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd >= 0) {
+        ret = MapSnapshot(fd, verify);
+        close(fd);
+    }
+    return ret;
+}
+
+
+/**
+ * Map a snapshot read only, and use it as the tape if it is valid.
+ *
+ * @param[in] fd the file or shared memory object holding the snapshot.
+ * @param[in] verify if true, check the checksum of the contents.
+ *
+ * @return true on success, false if the snapshot could not be mapped, 
+ *         or is not valid.
+ */
+
+bool
+JSONTape::MapSnapshot(int fd, bool verify)
+{
+    const JsonSnapshotHeader *header;
+    const char *base;
+    struct stat st;
+    bool ret = false;
+    void *map = NULL;
+    size_t size = 0;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(*header)) {
+        goto out;
+    }
+    size = st.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        map = NULL;
+        goto out;
+    }
+    base = static_cast<const char *>(map);
+    header = reinterpret_cast<const JsonSnapshotHeader *>(base);
+    if (memcmp(header->magic, JSON_SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+        header->version != JSON_SNAPSHOT_VERSION ||
+        header->byteOrder != JSON_SNAPSHOT_BYTE_ORDER ||
+        header->numWords == 0 ||
+        header->numWords > (size - sizeof(*header)) / sizeof(uint64_t) ||
+        header->numStrings != 
+            size - sizeof(*header) - header->numWords * sizeof(uint64_t)) {
+        goto out;
+    }
+    if (verify && header->checksum != 
+        SnapshotChecksum(reinterpret_cast<const uint64_t *>(header + 1), 
+            header->numWords, 
+            base + sizeof(*header) + header->numWords * sizeof(uint64_t), 
+            header->numStrings)) {
+        goto out;
+    }
+    m_map = map;
+    m_mapSize = size;
+    m_mapWords = reinterpret_cast<const uint64_t *>(header + 1);
+    m_mapNumWords = header->numWords;
+    m_mapStrings = base + sizeof(*header) + header->numWords * sizeof(uint64_t);
+    m_mapNumStrings = header->numStrings;
+    ret = true;
+out:
+    if (ret == false && map) {
+        munmap(map, size);
+    }
+    return ret;
+}
+
+
+/**
+ * Get the root value of the document.
+ *
+ * @return the root value, or an invalid value if the tape is empty.
+ */
+
+JSONTapeValue
+JSONTape::GetRoot() const
+{
+    if (IsEmpty()) {
+        return JSONTapeValue();
+    }
+    return JSONTapeValue(this, 0);
+}
+
+
+/**
+ * Get the index of the value following the one at index, skipping any
+ * elements of a container in O(1).
+ *
+ * @param[in] index the index of a value.
+ *
+ * @return the index just past the value.
+ */
+
+size_t
+JSONTape::Skip(size_t index) const
+{
+    size_t ret = index + 1;
+
+    switch (GetTag(index)) {
+    case JsonType_Object:
+    case JsonType_Array:
+        ret = GetPayload(index);
+        break;
+    case JsonType_Number:
+    case JsonType_Double:
+        ret = index + 2;
+        break;
+    case JsonType_Tuple:
+        ret = Skip(index + 1);
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
+
+/**
+ * Append the first word of a value to the tape, counting it as an 
+ * element of the enclosing array (or, for a tuple, object).
+ *
+ * @param[in] type the type of the value.
+ * @param[in] payload the payload.
+ */
+
+void
+JSONTape::AddElement(JsonType type, uint64_t payload)
+{
+    if (m_stack.size()) {
+        size_t top = m_stack.back();
+
+        if (type == JsonType_Tuple || GetTag(top) == JsonType_Array) {
+            m_tape[top + 1]++;
+        }
+    }
+    m_tape.push_back(((uint64_t) type << TagShift) | (payload & PayloadMask));
+}
+
+
+/**
+ * Copy a string to the string buffer.
+ *
+ * @param[in] str the string.
+ * @param[in] len the length of the string.
+ *
+ * @return the offset of the string in the buffer.
+ */
+
+uint64_t
+JSONTape::AddStr(const char *str, size_t len)
+{
+    uint64_t ret = m_strings.size();
+    uint32_t len32 = (uint32_t) len;
+
+    m_strings.append((const char *) &len32, sizeof(len32));
+    m_strings.append(str, len);
+    m_strings += '\0';
+    return ret;
+}
+
+
+/**
+ * Get a string from the string buffer.
+ *
+ * @param[in] offset the offset of the string.
+ * @param[out] len if not NULL, the length of the string.
+ *
+ * @return the string, NUL terminated.
+ */
+
+const char *
+JSONTape::GetStr(uint64_t offset, size_t *len) const
+{
+    uint32_t len32;
+
+    if (len) {
+        memcpy(&len32, Strings() + offset, sizeof(len32));
+        *len = len32;
+    }
+    return Strings() + offset + sizeof(len32);
+}
+
+
+/**
+ * Start an object or array. Its elements are added until the matching
+ * call to EndContainer().
+ *
+ * @param[in] type JsonType_Object or JsonType_Array.
+ */
+
+void
+JSONTape::BeginContainer(JsonType type)
+{
+    size_t index = m_tape.size();
+
+    AddElement(type, 0);
+    m_tape.push_back(0);
+    m_stack.push_back(index);
+}
+
+
+/**
+ * End the object or array started last, recording where it ends.
+ */
+
+void
+JSONTape::EndContainer()
+{
+    size_t index;
+
+    if (m_stack.empty()) {
+        return;
+    }
+    index = m_stack.back();
+    m_stack.pop_back();
+    m_tape[index] |= m_tape.size() & PayloadMask;
+}
+
+
+/**
+ * Start a tuple of the object being filled in. Its value is added next.
+ *
+ * @param[in] str the key.
+ * @param[in] len the length of the key.
+ */
+
+void
+JSONTape::AddKey(const char *str, size_t len)
+{
+    AddElement(JsonType_Tuple, AddStr(str, len));
+}
+
+
+/**
+ * Add a string.
+ *
+ * @param[in] str the string.
+ * @param[in] len the length of the string.
+ */
+
+void
+JSONTape::AddString(const char *str, size_t len)
+{
+    AddElement(JsonType_String, AddStr(str, len));
+}
+
+
+/**
+ * Add a number.
+ *
+ * @param[in] val the number.
+ */
+
+void
+JSONTape::AddNumber(long val)
+{
+    AddElement(JsonType_Number, 0);
+    m_tape.push_back((uint64_t) val);
+}
+
+
+/**
+ * Add a double.
+ *
+ * @param[in] val the double.
+ */
+
+void
+JSONTape::AddDouble(double val)
+{
+    uint64_t bits;
+
+    memcpy(&bits, &val, sizeof(bits));
+    AddElement(JsonType_Double, 0);
+    m_tape.push_back(bits);
+}
+
+
+/**
+ * Add a boolean.
+ *
+ * @param[in] val the boolean.
+ */
+
+void
+JSONTape::AddBoolean(bool val)
+{
+    AddElement(JsonType_Bool, val ? 1 : 0);
+}
+
+
+/**
+ * Add a null.
+ */
+
+void
+JSONTape::AddNull()
+{
+    AddElement(JsonType_Null, 0);
+}
+
+
+/**
+ * Get the type of the value.
+ *
+ * @return the type.
+ */
+
+JsonType
+JSONTapeValue::GetType() const
+{
+    return m_tape->GetTag(m_index);
+}
+
+
+/**
+ * Get the number of elements of an object or array.
+ *
+ * @return the number of elements, 0 if the value is not a container.
+ */
+
+int
+JSONTapeValue::GetSize() const
+{
+    JsonType type = GetType();
+
+    if (type != JsonType_Object && type != JsonType_Array) {
+        return 0;
+    }
+    return (int) m_tape->Words()[m_index + 1];
+}
+
+
+/**
+ * Get the element of an object or array at specified offset. Elements
+ * before it are skipped without being visited.
+ *
+ * @param[in] offset the offset in range [0, size - 1]
+ *
+ * @return the element (a tuple in the case of an object), or an invalid
+ *         value if offset is out of range.
+ */
+
+JSONTapeValue
+JSONTapeValue::Get(int offset) const
+{
+    size_t index;
+
+    if (offset < 0 || offset >= GetSize()) {
+        return JSONTapeValue();
+    }
+    index = m_index + 2;
+    while (offset--) {
+        index = m_tape->Skip(index);
+    }
+    return JSONTapeValue(m_tape, index);
+}
+
+
+/**
+ * Find the tuple with the specified key in an object. As with 
+ * JSONValue::FindKey(), a key matches either as is or enclosed in quotes.
+ *
+ * @param[in] key the key, without quotes.
+ *
+ * @return the offset of the tuple, or -1 if there is no such key.
+ */
+
+int
+JSONTapeValue::FindKey(const std::string &key) const
+{
+    size_t index = m_index + 2;
+    size_t len = key.size();
+    const char *k;
+    size_t klen;
+    int i;
+
+    if (GetType() != JsonType_Object) {
+        return -1;
+    }
+    for (i = 0; i < GetSize(); i++) {
+        k = m_tape->GetStr(m_tape->GetPayload(index), &klen);
+        if ((klen == len && memcmp(k, key.c_str(), len) == 0) ||
+            (klen == len + 2 && k[0] == '"' && k[len + 1] == '"' && 
+             memcmp(k + 1, key.c_str(), len) == 0)) {
+            return i;
+        }
+        index = m_tape->Skip(index);
+    }
+    return -1;
+}
+
+
+/**
+ * Get the key of a tuple.
+ *
+ * @return the key, NUL terminated, or NULL if the value is not a tuple.
+ */
+
+const char *
+JSONTapeValue::GetKey() const
+{
+    if (GetType() != JsonType_Tuple) {
+        return NULL;
+    }
+    return m_tape->GetStr(m_tape->GetPayload(m_index), NULL);
+}
+
+
+/**
+ * Get the length of the key of a tuple.
+ *
+ * @return the length, 0 if the value is not a tuple.
+ */
+
+size_t
+JSONTapeValue::GetKeyLength() const
+{
+    size_t len = 0;
+
+    if (GetType() == JsonType_Tuple) {
+        m_tape->GetStr(m_tape->GetPayload(m_index), &len);
+    }
+    return len;
+}
+
+
+/**
+ * Get the value of a tuple.
+ *
+ * @return the value, or an invalid value if this is not a tuple.
+ */
+
+JSONTapeValue
+JSONTapeValue::GetValue() const
+{
+    if (GetType() != JsonType_Tuple) {
+        return JSONTapeValue();
+    }
+    return JSONTapeValue(m_tape, m_index + 1);
+}
+
+
+/**
+ * Get the value of a string.
+ *
+ * @return the string, NUL terminated, or NULL if this is not a string.
+ */
+
+const char *
+JSONTapeValue::GetString() const
+{
+    if (GetType() != JsonType_String) {
+        return NULL;
+    }
+    return m_tape->GetStr(m_tape->GetPayload(m_index), NULL);
+}
+
+
+/**
+ * Get the length of a string.
+ *
+ * @return the length, 0 if this is not a string.
+ */
+
+size_t
+JSONTapeValue::GetStringLength() const
+{
+    size_t len = 0;
+
+    if (GetType() == JsonType_String) {
+        m_tape->GetStr(m_tape->GetPayload(m_index), &len);
+    }
+    return len;
+}
+
+
+/**
+ * Get the value of a number.
+ *
+ * @return the number, 0 if this is not a number.
+ */
+
+long
+JSONTapeValue::GetNumber() const
+{
+    if (GetType() != JsonType_Number) {
+        return 0L;
+    }
+    return (long) m_tape->Words()[m_index + 1];
+}
+
+
+/**
+ * Get the value of a double.
+ *
+ * @return the double, 0.0 if this is not a double.
+ */
+
+double
+JSONTapeValue::GetDouble() const
+{
+    double ret = 0.0;
+
+    if (GetType() == JsonType_Double) {
+        memcpy(&ret, &m_tape->Words()[m_index + 1], sizeof(ret));
+    }
+    return ret;
+}
+
+
+/**
+ * Get the value of a boolean.
+ *
+ * @return the boolean, false if this is not a boolean.
+ */
+
+bool
+JSONTapeValue::GetBoolean() const
+{
+    return GetType() == JsonType_Bool && m_tape->GetPayload(m_index) != 0;
+}
+
+
+/**
+ * Convert the value to JSON, concatenating to the passed in string. The
+ * output is the same as that of the corresponding JSONValue.
+ *
+ * @param[in] str the currently formed JSON string
+ *
+ * @return the value as a string, concatenated to str.
+ */
+
+std::string &
+JSONTapeValue::ToJSON(std::string &str) const
+{
+    JSONTapeValue val;
+    char buf[128];
+    size_t len;
+    int i, size;
+
+    switch (GetType()) {
+    case JsonType_Object:
+    case JsonType_Array:
+        str += (GetType() == JsonType_Object ? '{' : '[');
+        size = GetSize();
+        val = JSONTapeValue(m_tape, m_index + 2);
+        for (i = 0; i < size; i++) {
+            if (i) {
+                str += ',';
+            }
+            val.ToJSON(str);
+            val.m_index = m_tape->Skip(val.m_index);
+        }
+        str += (GetType() == JsonType_Object ? '}' : ']');
+        break;
+    case JsonType_Tuple:
+        str += '"';
+        str.append(GetKey(), GetKeyLength());
+        str += "\": ";
+        GetValue().ToJSON(str);
+        break;
+    case JsonType_String:
+        str += '"';
+        len = GetStringLength();
+        str.append(GetString(), len);
+        str += '"';
+        break;
+    case JsonType_Number:
+        snprintf(buf, sizeof buf - 1, "%ld", GetNumber());
+        str += buf;
+        break;
+    case JsonType_Double:
+        snprintf(buf, sizeof buf - 1, "%f", GetDouble());
+        str += buf;
+        break;
+    case JsonType_Bool:
+        str += (GetBoolean() ? "true" : "false");
+        break;
+    case JsonType_Null:
+        str += "null";
+        break;
+    default:
+        break;
+    }
+    return str;
+}
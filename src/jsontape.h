@@ -0,0 +1,182 @@
+/*
+jsonapi - c++ JSON parser
+
+Copyright (C) 2012  Syd Logan
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301,
+USA.
+
+Copyright (c) 2012, Syd Logan
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+3. Neither the name of the copyright holder nor the names of its contributors
+may be used to endorse or promote products derived from this software without
+specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#if !defined(__JSONTAPE_H__)
+#define __JSONTAPE_H__
+
+#include "jsonobj.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class JSONTape;
+
+/**
+ * Read only view of a value stored in a JSONTape. The accessors mirror 
+ * those of JSONValue and its subclasses. A view is just a reference to
+ * the tape plus an index, so it is cheap to copy, and is valid for as 
+ * long as the tape is not modified or destroyed.
+ */
+
+class JSONTapeValue
+{
+public:
+    JSONTapeValue() : m_tape(NULL), m_index(0) {}
+    JSONTapeValue(const JSONTape *tape, size_t index) : m_tape(tape), m_index(index) {}
+    bool IsValid() const {return m_tape != NULL;}
+    JsonType GetType() const;
+    int GetSize() const;
+    JSONTapeValue Get(int offset) const;
+    int FindKey(const std::string &key) const;
+    const char *GetKey() const;
+    size_t GetKeyLength() const;
+    JSONTapeValue GetValue() const;
+    const char *GetString() const;
+    size_t GetStringLength() const;
+    long GetNumber() const;
+    double GetDouble() const;
+    bool GetBoolean() const;
+    std::string &ToJSON(std::string &str) const;
+private:
+    const JSONTape *m_tape;
+    size_t m_index;
+};
+
+/**
+ * A flat, immutable representation of a parsed document. Every value is
+ * encoded in a single array of 64-bit words, in document order. The top
+ * 8 bits of the first word of a value hold its JsonType, the rest a 
+ * payload:
+ *
+ *   object, array: the index just past the end of the container, so it 
+ *                  can be skipped in O(1). The next word holds the 
+ *                  number of elements.
+ *   tuple:         the offset of the key in the string buffer. The value
+ *                  of the tuple follows.
+ *   string:        the offset of the string in the string buffer.
+ *   number:        nothing, the next word holds the value.
+ *   double:        nothing, the next word holds the bits of the value.
+ *   bool:          0 or 1.
+ *   null:          nothing.
+ *
+ * Strings are kept in one side buffer, each preceded by its length (32 
+ * bits) and followed by a NUL, as they appear in the input (so parsed
+ * strings keep their quotes, like JSONString).
+ *
+ * A tape is filled in by JsonParse (see JsonParse::SetTape()), and then
+ * read through JSONTapeValue. Since it is never modified after the 
+ * parse, it can be read from any number of threads.
+ *
+ * Since the tape only contains indices and offsets, never pointers, it 
+ * can be saved to a snapshot file as is (see SaveSnapshot()), and a 
+ * snapshot can be used straight from a read-only memory mapping of the 
+ * file (see LoadSnapshot()), with no decoding. The pages of the mapping 
+ * are shared by all processes that load the same snapshot. A snapshot 
+ * can also be kept in a POSIX shared memory object instead of a file 
+ * (see SaveShared() and AttachShared()): one process parses a document 
+ * into a tape and saves it, and the others attach it without parsing it
+ * or holding a copy of it.
+ */
+
+class JSONTape
+{
+public:
+    JSONTape();
+    ~JSONTape() {Clear();}
+    JSONTape(const JSONTape &) = delete;
+    JSONTape &operator=(const JSONTape &) = delete;
+    void Clear();
+    bool IsEmpty() const {return GetTapeSize() == 0;}
+    bool IsMapped() const {return m_map != NULL;}
+    JSONTapeValue GetRoot() const;
+    size_t GetTapeSize() const {return m_map ? m_mapNumWords : m_tape.size();}
+    size_t GetStringsSize() const {return m_map ? m_mapNumStrings : m_strings.size();}
+    bool SaveSnapshot(const char *path) const;
+    bool LoadSnapshot(const char *path, bool verify);
+    bool SaveShared(const char *name) const;
+    bool AttachShared(const char *name, bool verify);
+    static bool RemoveShared(const char *name);
+
+    // for use by the parser
+
+    void BeginContainer(JsonType type);
+    void EndContainer();
+    void AddKey(const char *str, size_t len);
+    void AddString(const char *str, size_t len);
+    void AddNumber(long val);
+    void AddDouble(double val);
+    void AddBoolean(bool val);
+    void AddNull();
+private:
+    friend class JSONTapeValue;
+    static const int TagShift = 56;
+    static const uint64_t PayloadMask = (1ULL << TagShift) - 1;
+    const uint64_t *Words() const {return m_map ? m_mapWords : m_tape.data();}
+    const char *Strings() const {return m_map ? m_mapStrings : m_strings.data();}
+    JsonType GetTag(size_t index) const {return (JsonType) (Words()[index] >> TagShift);}
+    uint64_t GetPayload(size_t index) const {return Words()[index] & PayloadMask;}
+    size_t Skip(size_t index) const;
+    bool WriteSnapshot(FILE *fp) const;
+    bool MapSnapshot(int fd, bool verify);
+    void AddElement(JsonType type, uint64_t payload);
+    uint64_t AddStr(const char *str, size_t len);
+    const char *GetStr(uint64_t offset, size_t *len) const;
+    std::vector<uint64_t> m_tape;
+    std::string m_strings;
+    std::vector<size_t> m_stack;    // containers being filled in
+    void *m_map;                    // snapshot mapping, if loaded
+    size_t m_mapSize;
+    const uint64_t *m_mapWords;
+    size_t m_mapNumWords;
+    const char *m_mapStrings;
+    size_t m_mapNumStrings;
+};
+
+#endif
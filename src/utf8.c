@@ -51,6 +51,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>
 #include <stdlib.h>
 
+/* the buffers returned come from the current allocator of the library, 
+   see JSONAllocator, and are freed with JsonFreeBuffer() */
+
+void *JsonAllocateBuffer(size_t size);
+void JsonFreeBuffer(void *p);
+
 /**
  * Check to see if we are dealing with multibyte UTF-8.
  *
@@ -85,7 +91,8 @@ IsMultibyteUTF8(char *p, int *lenout)
  * @return UTF-8 byte string or NULL if failure.
  * 
  * @note routine expects "\\u" to be removed by caller.
- * @note caller must free memory returned by this function.
+ * @note caller must free memory returned by this function with
+ *       JsonFreeBuffer().
  */
 
 char *
@@ -141,7 +148,7 @@ FromStrToUTF8(char *p, int *lenout)
 
     *lenout = len;
 
-    ret = q = malloc(len);
+    ret = q = JsonAllocateBuffer(len);
     if (ret == (char *) NULL) {
         goto out;
     }
@@ -189,7 +196,7 @@ FromUTF8ToStr(char *u, int *len)
     unsigned char c; 
 
     *len = 7;
-    ret = malloc(*len);
+    ret = JsonAllocateBuffer(*len);
     if (ret == (char *) NULL) {
         goto out;
     }
@@ -222,7 +229,7 @@ FromUTF8ToStr(char *u, int *len)
         ret[5] = c & 0x0f;
     } else {
         // unsupported, len > 3 
-        free(ret);
+        JsonFreeBuffer(ret);
         ret = NULL;
         goto out;
     }
@@ -269,11 +276,11 @@ main(int argc, char *argv[])
         q = FromUTF8ToStr(p, &len);
         if (q != (char *) NULL) {
             printf("q is %s\n", q);
-            free(q);
+            JsonFreeBuffer(q);
         } else {
             printf("%s: unable to malloc unicode str\n", __FUNCTION__);
         }
-        free(p);
+        JsonFreeBuffer(p);
     } else {
         printf("%s: unable to malloc unicode bytestream\n", __FUNCTION__);
     }
@@ -1,5 +1,8 @@
 #include "jsonapitest.h"
+#include <atomic>
 #include <cstdio>
+#include <new>
+#include <stdlib.h>
 
 /*
 jsonapi - c++ JSON parser
@@ -50,6 +53,65 @@ OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
 OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+/**
+ * Every allocation the test program makes with operator new, in any of
+ * its forms, is counted, see newCount. The replacements are defined
+ * here, and not in jsonapitest.h, since a program can only have one.
+ */
+
+std::atomic<long> newCount;
+
+/**
+ * Allocate memory for operator new.
+ *
+ * @param[in] size the size.
+ * @param[in] align the alignment, 0 for that of malloc().
+ *
+ * @return the memory. Throws std::bad_alloc on failure.
+ */
+
+static void *
+CountedNew(size_t size, size_t align)
+{
+    void *p;
+
+    if (size == 0) {
+        size = 1;
+    }
+    if (align) {
+        p = aligned_alloc(align, (size + align - 1) / align * align);
+    } else {
+        p = malloc(size);
+    }
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    newCount++;
+    return p;
+}
+
+void *operator new(size_t size) {return CountedNew(size, 0);}
+void *operator new[](size_t size) {return CountedNew(size, 0);}
+void *operator new(size_t size, std::align_val_t align)
+    {return CountedNew(size, (size_t) align);}
+void *operator new[](size_t size, std::align_val_t align)
+    {return CountedNew(size, (size_t) align);}
+
+// the compiler takes these for the mismatched use of free() on memory
+// from operator new
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept {free(p);}
+void operator delete(void *p, size_t) noexcept {free(p);}
+void operator delete[](void *p) noexcept {free(p);}
+void operator delete[](void *p, size_t) noexcept {free(p);}
+void operator delete(void *p, std::align_val_t) noexcept {free(p);}
+void operator delete(void *p, size_t, std::align_val_t) noexcept {free(p);}
+void operator delete[](void *p, std::align_val_t) noexcept {free(p);}
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {free(p);}
+#pragma GCC diagnostic pop
+
 int
 main(int argc, char *argv[])
 {
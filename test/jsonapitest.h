@@ -62,8 +62,128 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "jsonparse.h"
 #include "jsonapi.h"
+#include "jsondocument.h"
+#include "jsonpatch.h"
+#include "jsontape.h"
+#include "jsonmsgpack.h"
+#include "jsoncbor.h"
+#include "jsoncache.h"
+#include "jsonbind.h"
+#include "jsonschema.h"
+#include "jsonholder.h"
 
 #include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <atomic>
+#include <new>
+
+/**
+ * An event handler that records the events it is given as text, one
+ * token per event, for comparison with what is expected.
+ */
+
+class EventRecorder : public JSONEventHandler
+{
+public:
+    bool StartObject() {m_out += "{ "; return true;}
+    bool EndObject() {m_out += "} "; return true;}
+    bool StartArray() {m_out += "[ "; return true;}
+    bool EndArray() {m_out += "] "; return true;}
+    bool Key(const char *str, size_t len)
+        {m_out.append(str, len); m_out += ": "; return true;}
+    bool String(const char *str, size_t len)
+        {m_out += '"'; m_out.append(str, len); m_out += "\" "; return true;}
+    bool Number(long val) {return Print("%ld ", val);}
+    bool Unsigned(unsigned long val) {return Print("%lu ", val);}
+    bool Double(double val) {return Print("%.16g ", val);}
+    bool Boolean(bool val) {m_out += val ? "true " : "false "; return true;}
+    bool Null() {m_out += "null "; return true;}
+    std::string m_out;
+private:
+    template <typename T> bool Print(const char *fmt, T val)
+    {
+        char buf[64];
+
+        snprintf(buf, sizeof(buf), fmt, val);
+        m_out += buf;
+        return true;
+    }
+};
+
+/**
+ * Structs bound to JSON, for testBind.
+ */
+
+struct BindPoint
+{
+    int x;
+    int y;
+};
+
+JSON_BIND_BEGIN(BindPoint)
+    JSON_BIND_FIELD(x)
+    JSON_BIND_FIELD(y)
+JSON_BIND_END()
+
+struct BindMessage
+{
+    std::string device;
+    long seq;
+    unsigned char level;
+    bool ok;
+    double temp;
+    std::vector<int> samples;
+    std::vector<BindPoint> path;
+    std::optional<std::string> note;
+};
+
+JSON_BIND_BEGIN(BindMessage)
+    JSON_BIND_FIELD(device)
+    JSON_BIND_FIELD(seq)
+    JSON_BIND_FIELD(level)
+    JSON_BIND_FIELD(ok)
+    JSON_BIND_FIELD(temp)
+    JSON_BIND_FIELD(samples)
+    JSON_BIND_FIELD(path)
+    JSON_BIND_FIELD(note)
+JSON_BIND_END()
+
+/**
+ * The number of allocations the test program has made with operator new,
+ * so that a test can check that something allocates nothing. The
+ * replacement operators that count them are in jsonapitest.cpp.
+ */
+
+extern std::atomic<long> newCount;
+
+/**
+ * An allocator that takes its memory from the heap, keeping track of how
+ * much it has given out, and giving out no more than a limit.
+ */
+
+class LimitedAllocator : public JSONAllocator
+{
+public:
+    explicit LimitedAllocator(size_t limit) : m_limit(limit), m_bytes(0) {}
+    void *Allocate(size_t size)
+    {
+        if (m_bytes + size > m_limit) {
+            return NULL;
+        }
+        m_bytes += size;
+        return malloc(size);
+    }
+    void Free(void *p, size_t size) {m_bytes -= size; free(p);}
+    size_t m_limit;
+    size_t m_bytes;
+};
 
 class ParseTest : public CppUnit::TestFixture {
 public:
@@ -109,6 +229,33 @@ public:
     CPPUNIT_TEST( testCreateTwoElementNestedObject );
     CPPUNIT_TEST( testCreateThreeElementNestedObject );
     CPPUNIT_TEST( testCreateUTF8 );
+    CPPUNIT_TEST( testDirectParse );
+    CPPUNIT_TEST( testDirectBadInput );
+    CPPUNIT_TEST( testMoveAndOwnership );
+    CPPUNIT_TEST( testSetInsertDelete );
+    CPPUNIT_TEST( testShortString );
+    CPPUNIT_TEST( testCloneCopyOnWrite );
+    CPPUNIT_TEST( testEqualsAndHash );
+    CPPUNIT_TEST( testJsonPatch );
+    CPPUNIT_TEST( testTapeParse );
+    CPPUNIT_TEST( testSnapshot );
+    CPPUNIT_TEST( testMsgPack );
+    CPPUNIT_TEST( testCbor );
+    CPPUNIT_TEST( testParseCache );
+    CPPUNIT_TEST( testMemoryUsage );
+    CPPUNIT_TEST( testAllocator );
+    CPPUNIT_TEST( testReadWithoutAllocating );
+    CPPUNIT_TEST( testStringWireCache );
+    CPPUNIT_TEST( testShapes );
+    CPPUNIT_TEST( testIterators );
+    CPPUNIT_TEST( testBind );
+    CPPUNIT_TEST( testSchema );
+    CPPUNIT_TEST( testPackedArrays );
+    CPPUNIT_TEST( testDocumentHolder );
+    CPPUNIT_TEST( testLazy );
+    CPPUNIT_TEST( testSortedKeys );
+    CPPUNIT_TEST( testBulk );
+    CPPUNIT_TEST( testSharedSnapshot );
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -1572,7 +1719,2366 @@ public:
         CPPUNIT_ASSERT(str == "\"\\u20ACp\\u20AC\"");
         delete jstr;
     }
+
+    void testDirectParse()
+    {
+        std::string str("{\"Name\": {\"First\": 1, \"Last\": [2, 3.5, true, null]}, \"Age\": \"Old\"}");
+        JsonParse *parser = new JsonParse();
+
+        parser->SetInput(str);
+        CPPUNIT_ASSERT(parser->Parse() == true);
+        JSONValue *val = JSONAPI::GetValue(parser);
+        CPPUNIT_ASSERT(val);
+        std::string expected;
+        expected = val->ToJSON(expected);
+        delete val;
+
+        // same input, building the JSONValue tree directly
+
+        parser->SetDirect(true);
+        CPPUNIT_ASSERT(parser->Parse() == true);
+        CPPUNIT_ASSERT(parser->GetRoot() == NULL);
+        CPPUNIT_ASSERT(parser->GetType() == JsonType_Object);
+        JSONObject *obj = static_cast<JSONObject *>(JSONAPI::GetValue(parser));
+        CPPUNIT_ASSERT(obj);
+        CPPUNIT_ASSERT(JSONAPI::GetValue(parser) == NULL);
+        CPPUNIT_ASSERT(obj->GetType() == JsonType_Object);
+        CPPUNIT_ASSERT(obj->GetSize() == 2);
+        JSONTuple *tuple = static_cast<JSONTuple *>(obj->Get(0));
+        CPPUNIT_ASSERT(tuple->GetType() == JsonType_Tuple);
+        CPPUNIT_ASSERT(tuple->GetKey() == "\"Name\"");
+        JSONObject *obj2 = static_cast<JSONObject *>(tuple->GetValue());
+        CPPUNIT_ASSERT(obj2->GetType() == JsonType_Object);
+        tuple = static_cast<JSONTuple *>(obj2->Get(1));
+        JSONArray *array = static_cast<JSONArray *>(tuple->GetValue());
+        CPPUNIT_ASSERT(array->GetType() == JsonType_Array);
+        CPPUNIT_ASSERT(array->GetSize() == 4);
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(array->Get(0))->Get() == 2);
+        CPPUNIT_ASSERT(static_cast<JSONDouble *>(array->Get(1))->Get() == 3.5);
+        CPPUNIT_ASSERT(static_cast<JSONBoolean *>(array->Get(2))->Get() == true);
+        CPPUNIT_ASSERT(array->Get(3)->GetType() == JsonType_Null);
+        tuple = static_cast<JSONTuple *>(obj->Get(1));
+        CPPUNIT_ASSERT(static_cast<JSONString *>(tuple->GetValue())->Get() == "\"Old\"");
+
+        str = "";
+        str = obj->ToJSON(str);
+        CPPUNIT_ASSERT(str == expected);
+        delete obj;
+
+        str = "17";
+        parser->SetInput(str);
+        CPPUNIT_ASSERT(parser->Parse() == true);
+        JSONNumber *num = static_cast<JSONNumber *>(JSONAPI::GetValue(parser));
+        CPPUNIT_ASSERT(num);
+        CPPUNIT_ASSERT(num->Get() == 17);
+        delete num;
+        delete parser;
+    }
+
+    void testDirectBadInput()
+    {
+        const char *inputs[] = {
+            "{17",
+            "[1, 2",
+            "{\"Name\": {\"First\": 1, \"Last\": }, \"Age\": 3}",
+            "{\"Name\": {\"First\": [1, {\"Last\": 2}, \"Age\": 3}",
+            "[[1, 2], [3, ",
+        };
+        JsonParse *parser = new JsonParse();
+
+        parser->SetDirect(true);
+        for (unsigned int i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            std::string str(inputs[i]);
+            parser->SetInput(str);
+            CPPUNIT_ASSERT(parser->Parse() == false);
+            CPPUNIT_ASSERT(JSONAPI::GetValue(parser) == NULL);
+        }
+        delete parser;
+    }
+
+    void testMoveAndOwnership()
+    {
+        std::string name("Fred");
+        std::unique_ptr<JSONTuple> tuple(new JSONTuple());
+        std::unique_ptr<JSONObject> object(new JSONObject());
+        std::string str;
+
+        tuple->SetKey(std::string("Name"));
+        tuple->SetValue(std::unique_ptr<JSONValue>(new JSONString(std::move(name))));
+        CPPUNIT_ASSERT(tuple->GetKey() == "Name");
+        object->Append(std::move(tuple));
+        CPPUNIT_ASSERT(!tuple);
+        CPPUNIT_ASSERT(object->GetSize() == 1);
+
+        std::unique_ptr<JSONArray> array(new JSONArray());
+        array->Append(std::unique_ptr<JSONValue>(new JSONNumber(17)));
+        array->Append(std::unique_ptr<JSONValue>(new JSONNumber(18)));
+        JSONValue *num = array->Get(1);
+
+        // move a subtree from one document to another without a copy
+
+        std::unique_ptr<JSONValue> detached = array->Detach(1);
+        CPPUNIT_ASSERT(detached.get() == num);
+        CPPUNIT_ASSERT(array->GetSize() == 1);
+        CPPUNIT_ASSERT(array->Detach(5).get() == NULL);
+
+        std::unique_ptr<JSONTuple> tuple2(new JSONTuple());
+        tuple2->SetKey("Age");
+        tuple2->SetValue(std::move(detached));
+        object->Append(std::move(tuple2));
+
+        str = object->ToJSON(str);
+        CPPUNIT_ASSERT(str == "{\"Name\": \"Fred\",\"Age\": 18}");
+
+        std::unique_ptr<JSONValue> value =
+            static_cast<JSONTuple *>(object->Get(1))->ReleaseValue();
+        CPPUNIT_ASSERT(value.get() == num);
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(object->Get(1))->GetValue() == NULL);
+        static_cast<JSONTuple *>(object->Get(1))->SetValue(std::move(value));
+
+        // move constructors take over children without copying
+
+        JSONObject moved(std::move(*object));
+        CPPUNIT_ASSERT(object->GetSize() == 0);
+        CPPUNIT_ASSERT(moved.GetSize() == 2);
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(moved.Get(1))->GetValue() == num);
+
+        JSONString jstr("Hello");
+        JSONString jstr2(std::move(jstr));
+        CPPUNIT_ASSERT(jstr2.Get() == "Hello");
+
+        JSONTuple tuple3;
+        tuple3.SetKey("Key");
+        tuple3.SetValue(new JSONNumber(1));
+        JSONTuple tuple4(std::move(tuple3));
+        CPPUNIT_ASSERT(tuple3.GetValue() == NULL);
+        CPPUNIT_ASSERT(tuple4.GetKey() == "Key");
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(tuple4.GetValue())->Get() == 1);
+    }
+
+    void testSetInsertDelete()
+    {
+        JSONArray *array = new JSONArray();
+        std::string str;
+
+        array->Append(new JSONNumber(1));
+        array->Append(new JSONNumber(2));
+        array->Append(new JSONNumber(3));
+
+        CPPUNIT_ASSERT(array->Set(2, new JSONNumber(30)) == true);
+        CPPUNIT_ASSERT(array->Set(0, std::unique_ptr<JSONValue>(new JSONNumber(10))) == true);
+        CPPUNIT_ASSERT(array->Set(3, std::unique_ptr<JSONValue>(new JSONNumber(40))) == false);
+        str = array->ToJSON(str);
+        CPPUNIT_ASSERT(str == "[10,2,30]");
+
+        CPPUNIT_ASSERT(array->Insert(1, new JSONNumber(5)) == true);
+        CPPUNIT_ASSERT(array->Insert(4, std::unique_ptr<JSONValue>(new JSONNumber(50))) == true);
+        CPPUNIT_ASSERT(array->Insert(0, new JSONNumber(0)) == true);
+        str = "";
+        str = array->ToJSON(str);
+        CPPUNIT_ASSERT(str == "[0,10,5,2,30,50]");
+
+        CPPUNIT_ASSERT(array->Delete(2) == true);
+        CPPUNIT_ASSERT(array->Delete(6) == false);
+        str = "";
+        str = array->ToJSON(str);
+        CPPUNIT_ASSERT(str == "[0,10,2,30,50]");
+        delete array;
+    }
+
+    void testShortString()
+    {
+        JsonStr empty;
+        JsonStr shortstr("Name");
+        JsonStr longstr("A key that does not fit inline");
+        JsonStr escaped("Hello\nWorld");
+
+        CPPUNIT_ASSERT(sizeof(JsonStr) < sizeof(std::string));
+        CPPUNIT_ASSERT(empty.empty() && empty.IsInline() && empty.IsPlain());
+        CPPUNIT_ASSERT(shortstr.IsInline() && shortstr.IsPlain());
+        CPPUNIT_ASSERT(shortstr.size() == 4);
+        CPPUNIT_ASSERT(strcmp(shortstr.c_str(), "Name") == 0);
+        CPPUNIT_ASSERT(!longstr.IsInline() && longstr.IsPlain());
+        CPPUNIT_ASSERT(longstr == "A key that does not fit inline");
+        CPPUNIT_ASSERT(!escaped.IsPlain());
+        CPPUNIT_ASSERT(!JsonStr("\u20AC").IsPlain());
+
+        CPPUNIT_ASSERT(shortstr == JsonStr("Name"));
+        CPPUNIT_ASSERT(shortstr != JsonStr("Nome"));
+        CPPUNIT_ASSERT(shortstr != longstr);
+        CPPUNIT_ASSERT(shortstr == std::string("Name"));
+        std::string str = longstr;
+        CPPUNIT_ASSERT(str == "A key that does not fit inline");
+
+        JsonStr moved(std::move(longstr));
+        CPPUNIT_ASSERT(longstr.empty());
+        CPPUNIT_ASSERT(moved == "A key that does not fit inline");
+        moved.swap(shortstr);
+        CPPUNIT_ASSERT(moved == "Name");
+        CPPUNIT_ASSERT(shortstr == "A key that does not fit inline");
+        shortstr.Assign(shortstr.c_str() + 2, 3);
+        CPPUNIT_ASSERT(shortstr == "key" && shortstr.IsInline());
+        moved = moved;
+        CPPUNIT_ASSERT(moved == "Name");
+
+        JSONTuple tuple;
+        tuple.SetKey("Name");
+        CPPUNIT_ASSERT(tuple.GetKey() == "Name");
+        CPPUNIT_ASSERT(tuple.GetKey() == JsonStr("Name"));
+
+        JSONString jstr(JsonStr("Hello\tWorld"));
+        str = "";
+        str = jstr.ToJSON(str);
+        CPPUNIT_ASSERT(str == "\"Hello\\tWorld\"");
+        CPPUNIT_ASSERT(jstr.Get() == "Hello\\tWorld");
+    }
+
+    void testCloneCopyOnWrite()
+    {
+        JSONObject *object = new JSONObject();
+        JSONArray *array = new JSONArray();
+        JSONTuple *tuple;
+        std::string str;
+
+        array->Append(new JSONNumber(1));
+        array->Append(new JSONNumber(2));
+        tuple = new JSONTuple();
+        tuple->SetKey("List");
+        tuple->SetValue(array);
+        object->Append(tuple);
+        tuple = new JSONTuple();
+        tuple->SetKey("Name");
+        tuple->SetValue(new JSONString("Fred"));
+        object->Append(tuple);
+
+        JSONDocument doc(object);
+        JSONDocument clone = doc.Clone();
+
+        // a clone shares the tree until it is modified
+
+        CPPUNIT_ASSERT(clone.GetRoot() == doc.GetRoot());
+        CPPUNIT_ASSERT(doc.GetRoot()->IsShared());
+
+        JSONValue *val = clone.GetMutable(std::vector<int>{0, 1});
+        CPPUNIT_ASSERT(val != NULL && val->GetType() == JsonType_Number);
+        static_cast<JSONNumber *>(val)->Set(20);
+        CPPUNIT_ASSERT(clone.GetMutable(std::vector<int>{0, 5}) == NULL);
+
+        // only the path to the modified value was copied
+
+        CPPUNIT_ASSERT(clone.GetRoot() != doc.GetRoot());
+        CPPUNIT_ASSERT(clone.GetRoot()->Get(1) == doc.GetRoot()->Get(1));
+        CPPUNIT_ASSERT(clone.GetRoot()->Get(0) != doc.GetRoot()->Get(0));
+        CPPUNIT_ASSERT(!doc.GetRoot()->IsShared());
+
+        clone.ToJSON(str);
+        CPPUNIT_ASSERT(str == "{\"List\": [1,20],\"Name\": \"Fred\"}");
+        str = "";
+        doc.ToJSON(str);
+        CPPUNIT_ASSERT(str == "{\"List\": [1,2],\"Name\": \"Fred\"}");
+
+        // detaching a shared value yields a private copy
+
+        std::unique_ptr<JSONValue> detached = clone.GetMutableRoot()->Detach(1);
+        CPPUNIT_ASSERT(detached.get() != doc.GetRoot()->Get(1));
+        CPPUNIT_ASSERT(!doc.GetRoot()->Get(1)->IsShared());
+        CPPUNIT_ASSERT(clone.GetRoot()->GetSize() == 1);
+        CPPUNIT_ASSERT(doc.GetRoot()->GetSize() == 2);
+
+        JSONDocument moved(std::move(clone));
+        CPPUNIT_ASSERT(clone.GetRoot() == NULL);
+        str = "";
+        moved.ToJSON(str);
+        CPPUNIT_ASSERT(str == "{\"List\": [1,20]}");
+    }
+
+    JSONValue *ParseDirect(const char *str)
+    {
+        JsonParse parser;
+        std::string input(str);
+
+        parser.SetDirect(true);
+        parser.SetInput(input);
+        if (parser.Parse() == false) {
+            return NULL;
+        }
+        return JSONAPI::GetValue(&parser);
+    }
+
+    void testEqualsAndHash()
+    {
+        std::unique_ptr<JSONValue> a(ParseDirect("{\"a\": 1, \"b\": [1, 2.5, \"x\"], \"c\": {\"d\": null, \"e\": true}}"));
+        std::unique_ptr<JSONValue> b(ParseDirect("{\"c\": {\"e\": true, \"d\": null}, \"a\": 1, \"b\": [1, 2.5, \"x\"]}"));
+        std::unique_ptr<JSONValue> c(ParseDirect("{\"a\": 1, \"b\": [2.5, 1, \"x\"], \"c\": {\"d\": null, \"e\": true}}"));
+        std::unique_ptr<JSONValue> d(ParseDirect("{\"a\": 1, \"b\": [1, 2.5, \"x\"], \"c\": {\"d\": null, \"f\": true}}"));
+
+        CPPUNIT_ASSERT(a && b && c && d);
+
+        // key order does not matter, array order does
+
+        CPPUNIT_ASSERT(a->Equals(*a));
+        CPPUNIT_ASSERT(a->Equals(*b) && b->Equals(*a));
+        CPPUNIT_ASSERT(a->Hash() == b->Hash());
+        CPPUNIT_ASSERT(!a->Equals(*c) && !c->Equals(*a));
+        CPPUNIT_ASSERT(a->Hash() != c->Hash());
+        CPPUNIT_ASSERT(!a->Equals(*d) && !d->Equals(*a));
+        CPPUNIT_ASSERT(a->Hash() != d->Hash());
+
+        JSONNumber one(1);
+        JSONDouble onedbl(1.0);
+        JSONDouble zero(0.0);
+        JSONDouble negzero(-0.0);
+        CPPUNIT_ASSERT(!one.Equals(onedbl));
+        CPPUNIT_ASSERT(zero.Equals(negzero) && zero.Hash() == negzero.Hash());
+        CPPUNIT_ASSERT(JSONString("x").Equals(JSONString("x")));
+        CPPUNIT_ASSERT(!JSONString("x").Equals(JSONString("y")));
+        CPPUNIT_ASSERT(JSONArray().Equals(JSONArray()));
+        CPPUNIT_ASSERT(!JSONArray().Equals(JSONObject()));
+
+        // hashes of shared documents are cached, and dropped when a
+        // clone is modified
+
+        JSONDocument doc(a.release());
+        JSONDocument clone = doc.Clone();
+        uint64_t h = doc.GetRoot()->Hash();
+        CPPUNIT_ASSERT(clone.GetRoot()->Hash() == h);
+        static_cast<JSONNumber *>(clone.GetMutable(std::vector<int>{0}))->Set(2);
+        CPPUNIT_ASSERT(clone.GetRoot()->Hash() != h);
+        CPPUNIT_ASSERT(!clone.GetRoot()->Equals(*doc.GetRoot()));
+        static_cast<JSONNumber *>(clone.GetMutable(std::vector<int>{0}))->Set(1);
+        CPPUNIT_ASSERT(clone.GetRoot()->Hash() == h);
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*doc.GetRoot()));
+        CPPUNIT_ASSERT(doc.GetRoot()->Hash() == h);
+    }
+
+    void testJsonPatch()
+    {
+        JSONDocument doc(ParseDirect("{\"a\": {\"b\": [1, 2, 3]}, \"c\": \"x\", \"h\": [4, 5]}"));
+        std::unique_ptr<JSONValue> expected(ParseDirect("{\"a\": {\"b\": [10, 2, 3, 4]}, \"c\": \"y\", \"h\": [4, 5], \"f\": 1, \"d\": {}, \"g\": {\"b\": [10, 2, 3, 4]}, \"~/\": true}"));
+        JSONPatch patch;
+
+        CPPUNIT_ASSERT(doc.GetRoot() && expected);
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"add\", \"path\": \"/a/b/1\", \"value\": 10},"
+            "{\"op\": \"add\", \"path\": \"/a/b/-\", \"value\": 4},"
+            "{\"op\": \"replace\", \"path\": \"/c\", \"value\": \"y\"},"
+            "{\"op\": \"remove\", \"path\": \"/a/b/0\"},"
+            "{\"op\": \"add\", \"path\": \"/d\", \"value\": {\"e\": 1}},"
+            "{\"op\": \"move\", \"from\": \"/d/e\", \"path\": \"/f\"},"
+            "{\"op\": \"replace\", \"path\": \"/a/b/0\", \"value\": 10},"
+            "{\"op\": \"copy\", \"from\": \"/a\", \"path\": \"/g\"},"
+            "{\"op\": \"add\", \"path\": \"/~0~1\", \"value\": true},"
+            "{\"op\": \"test\", \"path\": \"/f\", \"value\": 1}"
+            "]")));
+        CPPUNIT_ASSERT(patch.GetSize() == 10);
+
+        // patch a clone, the original and untouched subtrees are shared
+
+        JSONDocument clone = doc.Clone();
+        CPPUNIT_ASSERT(patch.Apply(clone) == true);
+        CPPUNIT_ASSERT(patch.GetFailedOp() == -1);
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*expected));
+        CPPUNIT_ASSERT(!doc.GetRoot()->Equals(*expected));
+        CPPUNIT_ASSERT(clone.GetRoot()->Get(2) == doc.GetRoot()->Get(2));
+
+        // a failing test, or any other failing operation, undoes the
+        // whole patch
+
+        std::unique_ptr<JSONValue> before(clone.GetRoot()->Copy());
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"remove\", \"path\": \"/a/b/1\"},"
+            "{\"op\": \"replace\", \"path\": \"/c\", \"value\": \"z\"},"
+            "{\"op\": \"move\", \"from\": \"/g\", \"path\": \"/h/0\"},"
+            "{\"op\": \"add\", \"path\": \"/h/0/b/-\", \"value\": 5},"
+            "{\"op\": \"remove\", \"path\": \"/f\"},"
+            "{\"op\": \"replace\", \"path\": \"\", \"value\": [1]},"
+            "{\"op\": \"replace\", \"path\": \"/0\", \"value\": 2},"
+            "{\"op\": \"test\", \"path\": \"/0\", \"value\": 3}"
+            "]")));
+        CPPUNIT_ASSERT(patch.Apply(clone) == false);
+        CPPUNIT_ASSERT(patch.GetFailedOp() == 7);
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*before));
+
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"remove\", \"path\": \"/c\"},"
+            "{\"op\": \"add\", \"path\": \"/a/b/9\", \"value\": 1}"
+            "]")));
+        CPPUNIT_ASSERT(patch.Apply(clone) == false);
+        CPPUNIT_ASSERT(patch.GetFailedOp() == 1);
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*before));
+
+        // malformed patches
+
+        CPPUNIT_ASSERT(patch.Compile(std::string("[{\"op\": \"frob\", \"path\": \"/a\"}]")) == false);
+        CPPUNIT_ASSERT(patch.GetSize() == 0);
+        CPPUNIT_ASSERT(patch.Compile(std::string("[{\"op\": \"add\", \"path\": \"a\", \"value\": 1}]")) == false);
+        CPPUNIT_ASSERT(patch.Compile(std::string("[{\"op\": \"add\", \"path\": \"/a\"}]")) == false);
+        CPPUNIT_ASSERT(patch.Compile(std::string("[{\"op\": \"move\", \"path\": \"/a\"}]")) == false);
+        CPPUNIT_ASSERT(patch.Compile(std::string("{\"op\": \"remove\", \"path\": \"/a\"}")) == false);
+
+        // "test" compares numbers by value, and strings and keys by their
+        // text, whatever the escapes used to write it
+
+        JSONDocument values(JSONPackedArray::Pack(ParseDirect("{\"n\": 1, \"d\": 2.5, \"a\": [1, 2.0], \"p\": [1, 2], \"s\": \"A/b\", \"k\": {\"\\u00e9\": 1.0}}")));
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(values.GetRoot()->Get(3))->GetValue()->GetType() == JsonType_PackedArray);
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"test\", \"path\": \"/n\", \"value\": 1.0},"
+            "{\"op\": \"test\", \"path\": \"/d\", \"value\": 2.5},"
+            "{\"op\": \"test\", \"path\": \"/a\", \"value\": [1.0, 2]},"
+            "{\"op\": \"test\", \"path\": \"/p\", \"value\": [1, 2.0]},"
+            "{\"op\": \"test\", \"path\": \"/\\u0073\", \"value\": \"\\u0041\\/b\"},"
+            "{\"op\": \"test\", \"path\": \"/k/\\u00e9\", \"value\": 1},"
+            "{\"op\": \"test\", \"path\": \"/k\", \"value\": {\"\xc3\xa9\": 1}},"
+            "{\"op\": \"add\", \"path\": \"/q\\\"\", \"value\": 2},"
+            "{\"op\": \"test\", \"path\": \"/q\\u0022\", \"value\": 2}"
+            "]")));
+        CPPUNIT_ASSERT(patch.Apply(values) == true);
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(values.GetRoot()->Get(6))->GetKey() == "\"q\\\"\"");
+        const char *unequal[] = {
+            "[{\"op\": \"test\", \"path\": \"/n\", \"value\": 1.5}]",
+            "[{\"op\": \"test\", \"path\": \"/d\", \"value\": 2}]",
+            "[{\"op\": \"test\", \"path\": \"/p\", \"value\": [1, 3]}]",
+            "[{\"op\": \"test\", \"path\": \"/s\", \"value\": \"a/b\"}]",
+            "[{\"op\": \"test\", \"path\": \"/k\", \"value\": {\"e\": 1}}]",
+        };
+        for (const char *str : unequal) {
+            CPPUNIT_ASSERT(patch.Compile(std::string(str)));
+            CPPUNIT_ASSERT(patch.Apply(values) == false);
+        }
+    }
+
+    void testTapeParse()
+    {
+        std::string str("{\"Name\": {\"First\": 1, \"Last\": [2, 3.5, true, null, [], {}]}, \"Age\": \"Old\", \"Id\": -7}");
+        std::unique_ptr<JSONValue> val(ParseDirect(str.c_str()));
+        JsonParse parser;
+        JSONTape tape;
+
+        parser.SetTape(&tape);
+        parser.SetInput(str);
+        CPPUNIT_ASSERT(parser.Parse() == true);
+        CPPUNIT_ASSERT(parser.GetRoot() == NULL);
+        CPPUNIT_ASSERT(parser.GetType() == JsonType_Object);
+
+        // same output as the JSONValue tree
+
+        std::string expected, tapestr;
+        val->ToJSON(expected);
+        tape.GetRoot().ToJSON(tapestr);
+        CPPUNIT_ASSERT(tapestr == expected);
+
+        JSONTapeValue root = tape.GetRoot();
+        CPPUNIT_ASSERT(root.GetType() == JsonType_Object);
+        CPPUNIT_ASSERT(root.GetSize() == 3);
+        CPPUNIT_ASSERT(root.FindKey("Id") == 2);
+        CPPUNIT_ASSERT(root.FindKey("Nope") == -1);
+        JSONTapeValue tuple = root.Get(2);
+        CPPUNIT_ASSERT(tuple.GetType() == JsonType_Tuple);
+        CPPUNIT_ASSERT(strcmp(tuple.GetKey(), "\"Id\"") == 0);
+        CPPUNIT_ASSERT(tuple.GetValue().GetNumber() == -7);
+        CPPUNIT_ASSERT(strcmp(root.Get(1).GetValue().GetString(), "\"Old\"") == 0);
+        CPPUNIT_ASSERT(root.Get(1).GetValue().GetStringLength() == 5);
+        CPPUNIT_ASSERT(!root.Get(3).IsValid());
+
+        JSONTapeValue last = root.Get(0).GetValue().Get(1).GetValue();
+        CPPUNIT_ASSERT(last.GetType() == JsonType_Array);
+        CPPUNIT_ASSERT(last.GetSize() == 6);
+        CPPUNIT_ASSERT(last.Get(1).GetDouble() == 3.5);
+        CPPUNIT_ASSERT(last.Get(2).GetBoolean() == true);
+        CPPUNIT_ASSERT(last.Get(3).GetType() == JsonType_Null);
+        CPPUNIT_ASSERT(last.Get(4).GetSize() == 0);
+        CPPUNIT_ASSERT(last.Get(5).GetType() == JsonType_Object);
+
+        // the tape is reused by the next parse, and emptied on error
+
+        std::string str2("[1, 2");
+        parser.SetInput(str2);
+        CPPUNIT_ASSERT(parser.Parse() == false);
+        CPPUNIT_ASSERT(tape.IsEmpty());
+        CPPUNIT_ASSERT(!tape.GetRoot().IsValid());
+        std::string str3("\"Hello\"");
+        parser.SetInput(str3);
+        CPPUNIT_ASSERT(parser.Parse() == true);
+        CPPUNIT_ASSERT(tape.GetRoot().GetType() == JsonType_String);
+        CPPUNIT_ASSERT(tape.GetTapeSize() == 1);
+    }
+
+    void testSnapshot()
+    {
+        JSONDocument doc(ParseDirect("{\"Name\": {\"First\": 1, \"Last\": [2, 3.5, true, null]}, \"Age\": \"Old\"}"));
+        char path[] = "/tmp/jsonapitestXXXXXX";
+        std::string expected, str;
+        JSONTape tape;
+        FILE *fp;
+        int fd;
+
+        fd = mkstemp(path);
+        CPPUNIT_ASSERT(fd >= 0);
+        close(fd);
+
+        CPPUNIT_ASSERT(doc.SaveSnapshot(path) == true);
+        CPPUNIT_ASSERT(tape.LoadSnapshot(path, true) == true);
+        CPPUNIT_ASSERT(tape.IsMapped());
+        doc.ToJSON(expected);
+        tape.GetRoot().ToJSON(str);
+        CPPUNIT_ASSERT(str == expected);
+        CPPUNIT_ASSERT(tape.GetRoot().FindKey("Age") == 1);
+        CPPUNIT_ASSERT(tape.GetRoot().Get(0).GetValue().Get(1).GetValue().Get(1).GetDouble() == 3.5);
+
+        // a snapshot of a tape filled in by the parser
+
+        JSONTape parsed;
+        JsonParse parser;
+        std::string input("[1, \"two\", {\"three\": 3}]");
+        parser.SetTape(&parsed);
+        parser.SetInput(input);
+        CPPUNIT_ASSERT(parser.Parse() == true);
+        CPPUNIT_ASSERT(parsed.SaveSnapshot(path) == true);
+
+        // the file is replaced, not rewritten, so a tape that has the old
+        // snapshot loaded still reads it
+
+        std::string old;
+        tape.GetRoot().ToJSON(old);
+        CPPUNIT_ASSERT(old == expected);
+        CPPUNIT_ASSERT(tape.LoadSnapshot(path, true) == true);
+        CPPUNIT_ASSERT(tape.GetTapeSize() == parsed.GetTapeSize());
+        str = expected = "";
+        tape.GetRoot().ToJSON(str);
+        parsed.GetRoot().ToJSON(expected);
+        CPPUNIT_ASSERT(str == expected);
+
+        // corrupted and truncated snapshots are rejected
+
+        fp = fopen(path, "r+b");
+        CPPUNIT_ASSERT(fp != NULL);
+        fseek(fp, -3, SEEK_END);
+        fputc('X', fp);
+        fclose(fp);
+        CPPUNIT_ASSERT(tape.LoadSnapshot(path, true) == false);
+        CPPUNIT_ASSERT(tape.IsEmpty() && !tape.IsMapped());
+        CPPUNIT_ASSERT(tape.LoadSnapshot(path, false) == true);
+        CPPUNIT_ASSERT(truncate(path, 40) == 0);
+        CPPUNIT_ASSERT(tape.LoadSnapshot(path, false) == false);
+        unlink(path);
+        CPPUNIT_ASSERT(tape.LoadSnapshot(path, false) == false);
+    }
+
+    std::string MsgPack(JSONValue *val)
+    {
+        std::string str;
+
+        JSONMsgPack::Encode(val, str);
+        delete val;
+        return str;
+    }
+
+    void testMsgPack()
+    {
+        std::unique_ptr<JSONValue> doc(ParseDirect("{\"a\": [0, 127, 128, 255, 256, 65535, 65536, 4294967295, 4294967296, -1, -32, -33, -128, -129, -32768, -32769, -2147483648, -2147483649], \"b\": 2.5, \"c\": true, \"d\": false, \"e\": null, \"f\": {}}"));
+        JSONNumber *big = new JSONNumber();
+        JSONObject *wide = new JSONObject();
+        JSONArray *longarray = new JSONArray();
+        JSONTuple *tuple;
+        JSONValue *val;
+        std::string str;
+        size_t used;
+
+        CPPUNIT_ASSERT(doc);
+        big->SetUnsigned(18446744073709551615UL);
+        CPPUNIT_ASSERT(big->IsUnsigned());
+        doc->Append(new JSONTuple());
+        tuple = static_cast<JSONTuple *>(doc->Get(doc->GetSize() - 1));
+        tuple->SetKey("\"g\"");
+        tuple->SetValue(big);
+        for (int i = 0; i < 20; i++) {
+            char key[16];
+
+            snprintf(key, sizeof(key), "\"key%d\"", i);
+            tuple = new JSONTuple();
+            tuple->SetKey(key);
+            tuple->SetValue(new JSONString("\"" + std::string(i * 20, 'x') + "\""));
+            wide->Append(tuple);
+            longarray->Append(new JSONNumber(LONG_MAX - i));
+        }
+        tuple = new JSONTuple();
+        tuple->SetKey("\"h\"");
+        tuple->SetValue(wide);
+        doc->Append(tuple);
+        tuple = new JSONTuple();
+        tuple->SetKey("\"i\"");
+        tuple->SetValue(longarray);
+        doc->Append(tuple);
+
+        // round trip
+
+        JSONMsgPack::Encode(doc.get(), str);
+        CPPUNIT_ASSERT(JSONMsgPack::Decode(str.data(), str.size(), &val, &used) == true);
+        CPPUNIT_ASSERT(val != NULL && used == str.size());
+        CPPUNIT_ASSERT(val->Equals(*doc));
+        tuple = static_cast<JSONTuple *>(val->Get(val->FindKey("g")));
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(tuple->GetValue())->GetUnsigned() == 18446744073709551615UL);
+        delete val;
+
+        // smallest encodings
+
+        CPPUNIT_ASSERT(MsgPack(new JSONNumber(1)) == std::string("\x01", 1));
+        CPPUNIT_ASSERT(MsgPack(new JSONNumber(-1)) == std::string("\xff", 1));
+        CPPUNIT_ASSERT(MsgPack(new JSONNumber(200)) == std::string("\xcc\xc8", 2));
+        CPPUNIT_ASSERT(MsgPack(new JSONNumber(-200)) == std::string("\xd1\xff\x38", 3));
+        CPPUNIT_ASSERT(MsgPack(new JSONString("a")) == std::string("\xa1" "a", 2));
+        CPPUNIT_ASSERT(MsgPack(new JSONString(std::string(40, 'y'))).substr(0, 2) == std::string("\xd9\x28", 2));
+        CPPUNIT_ASSERT(MsgPack(new JSONArray()) == std::string("\x90", 1));
+        CPPUNIT_ASSERT(MsgPack(new JSONObject()) == std::string("\x80", 1));
+        CPPUNIT_ASSERT(MsgPack(new JSONNull()) == std::string("\xc0", 1));
+        CPPUNIT_ASSERT(MsgPack(new JSONBoolean(true)) == std::string("\xc3", 1));
+        CPPUNIT_ASSERT(MsgPack(new JSONDouble(1.5)) == std::string("\xcb\x3f\xf8\0\0\0\0\0\0", 9));
+
+        // float32 is decoded as a double
+
+        CPPUNIT_ASSERT(JSONMsgPack::Decode("\xca\x3f\xc0\0\0", 5, &val, &used) == true);
+        CPPUNIT_ASSERT(val && val->GetType() == JsonType_Double && used == 5);
+        CPPUNIT_ASSERT(static_cast<JSONDouble *>(val)->Get() == 1.5);
+        delete val;
+
+        // a stream of values, arriving in pieces
+
+        str = MsgPack(new JSONNumber(7)) + MsgPack(new JSONString("hello"));
+        CPPUNIT_ASSERT(JSONMsgPack::Decode(str.data(), 1, &val, &used) == true);
+        CPPUNIT_ASSERT(val && used == 1);
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(val)->Get() == 7);
+        delete val;
+        CPPUNIT_ASSERT(JSONMsgPack::Decode(str.data() + 1, 3, &val, &used) == true);
+        CPPUNIT_ASSERT(val == NULL && used == 0);
+        CPPUNIT_ASSERT(JSONMsgPack::Decode(str.data() + 1, str.size() - 1, &val, &used) == true);
+        CPPUNIT_ASSERT(val && used == 6);
+        CPPUNIT_ASSERT(static_cast<JSONString *>(val)->GetStr() == "\"hello\"");
+        delete val;
+
+        // strings and keys are encoded as their text, without the quotes
+        // and escapes of the parsed document, and decoded to the form the
+        // parser stores
+
+        val = ParseDirect("{\"a\": \"x\", \"q\\\"\": \"\\u00e9\\n\"}");
+        CPPUNIT_ASSERT(val != NULL);
+        str = MsgPack(val);
+        CPPUNIT_ASSERT(str == std::string("\x82\xa1" "a" "\xa1" "x" "\xa2" "q\"" "\xa3" "\xc3\xa9\n", 12));
+        CPPUNIT_ASSERT(JSONMsgPack::Decode(str.data(), str.size(), &val, &used) == true);
+        CPPUNIT_ASSERT(val && used == str.size());
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(val->Get(0))->GetKey() == "\"a\"");
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(val->Get(1))->GetKey() == "\"q\\\"\"");
+        CPPUNIT_ASSERT(static_cast<JSONString *>(static_cast<JSONTuple *>(val->Get(1))->GetValue())->GetStr() == "\"\xc3\xa9\\n\"");
+        CPPUNIT_ASSERT(MsgPack(val) == str);
+
+        // types that JSON cannot represent
+
+        CPPUNIT_ASSERT(JSONMsgPack::Decode("\xc1", 1, &val, &used) == false);
+        CPPUNIT_ASSERT(JSONMsgPack::Decode("\xc4\x01\x00", 3, &val, &used) == false);
+        CPPUNIT_ASSERT(JSONMsgPack::Decode("\x81\x01\x02", 3, &val, &used) == false);
+        CPPUNIT_ASSERT(val == NULL && used == 0);
+    }
 private:
+
+    std::string FromHex(const char *hex)
+    {
+        std::string str;
+
+        for (; hex[0] && hex[1]; hex += 2) {
+            char byte[3] = {hex[0], hex[1], '\0'};
+
+            str += (char) strtol(byte, NULL, 16);
+        }
+        return str;
+    }
+
+    void testCbor()
+    {
+        // RFC 8949 Appendix A, and whether our encoding of the decoded
+        // value is the same (it is not for bignums, tags, non-finite
+        // floats, indefinite lengths and integer keys)
+
+        static const struct {
+            const char *hex;
+            const char *events;
+            bool encode;
+        } vectors[] = {
+            {"00", "0 ", true},
+            {"01", "1 ", true},
+            {"0a", "10 ", true},
+            {"17", "23 ", true},
+            {"1818", "24 ", true},
+            {"1819", "25 ", true},
+            {"1864", "100 ", true},
+            {"1903e8", "1000 ", true},
+            {"1a000f4240", "1000000 ", true},
+            {"1b000000e8d4a51000", "1000000000000 ", true},
+            {"1bffffffffffffffff", "18446744073709551615 ", true},
+            {"c249010000000000000000", "\"AQAAAAAAAAAA\" ", false},
+            {"3bffffffffffffffff", "-1.844674407370955e+19 ", false},
+            {"c349010000000000000000", "\"~AQAAAAAAAAAA\" ", false},
+            {"20", "-1 ", true},
+            {"29", "-10 ", true},
+            {"3863", "-100 ", true},
+            {"3903e7", "-1000 ", true},
+            {"f90000", "0 ", true},
+            {"f98000", "-0 ", true},
+            {"f93c00", "1 ", true},
+            {"fb3ff199999999999a", "1.1 ", true},
+            {"f93e00", "1.5 ", true},
+            {"f97bff", "65504 ", true},
+            {"fa47c35000", "100000 ", true},
+            {"fa7f7fffff", "3.402823466385289e+38 ", true},
+            {"fb7e37e43c8800759c", "1e+300 ", true},
+            {"f90001", "5.960464477539062e-08 ", true},
+            {"f90400", "6.103515625e-05 ", true},
+            {"f9c400", "-4 ", true},
+            {"fbc010666666666666", "-4.1 ", true},
+            {"f97c00", "null ", false},
+            {"f97e00", "null ", false},
+            {"f9fc00", "null ", false},
+            {"fa7f800000", "null ", false},
+            {"fa7fc00000", "null ", false},
+            {"faff800000", "null ", false},
+            {"fb7ff0000000000000", "null ", false},
+            {"fb7ff8000000000000", "null ", false},
+            {"fbfff0000000000000", "null ", false},
+            {"f4", "false ", true},
+            {"f5", "true ", true},
+            {"f6", "null ", true},
+            {"f7", "null ", false},
+            {"f0", "null ", false},
+            {"f8ff", "null ", false},
+            {"c074323031332d30332d32315432303a30343a30305a",
+                "\"2013-03-21T20:04:00Z\" ", false},
+            {"c11a514b67b0", "1363896240 ", false},
+            {"c1fb41d452d9ec200000", "1363896240.5 ", false},
+            {"d74401020304", "\"AQIDBA\" ", false},
+            {"d818456449455446", "\"ZElFVEY\" ", false},
+            {"d82076687474703a2f2f7777772e6578616d706c652e636f6d",
+                "\"http://www.example.com\" ", false},
+            {"40", "\"\" ", false},
+            {"4401020304", "\"AQIDBA\" ", false},
+            {"60", "\"\" ", true},
+            {"6161", "\"a\" ", true},
+            {"6449455446", "\"IETF\" ", true},
+            {"62225c", "\"\"\\\" ", true},
+            {"62c3bc", "\"\xc3\xbc\" ", true},
+            {"63e6b0b4", "\"\xe6\xb0\xb4\" ", true},
+            {"64f0908591", "\"\xf0\x90\x85\x91\" ", true},
+            {"80", "[ ] ", true},
+            {"83010203", "[ 1 2 3 ] ", true},
+            {"8301820203820405", "[ 1 [ 2 3 ] [ 4 5 ] ] ", true},
+            {"98190102030405060708090a0b0c0d0e0f101112131415161718181819",
+                "[ 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 "
+                "23 24 25 ] ", true},
+            {"a0", "{ } ", true},
+            {"a201020304", "{ 1: 2 3: 4 } ", false},
+            {"a26161016162820203", "{ a: 1 b: [ 2 3 ] } ", true},
+            {"826161a161626163", "[ \"a\" { b: \"c\" } ] ", true},
+            {"a56161614161626142616361436164614461656145",
+                "{ a: \"A\" b: \"B\" c: \"C\" d: \"D\" e: \"E\" } ", true},
+            {"5f42010243030405ff", "\"AQIDBAU\" ", false},
+            {"7f657374726561646d696e67ff", "\"streaming\" ", false},
+            {"9fff", "[ ] ", false},
+            {"9f018202039f0405ffff", "[ 1 [ 2 3 ] [ 4 5 ] ] ", false},
+            {"9f01820203820405ff", "[ 1 [ 2 3 ] [ 4 5 ] ] ", false},
+            {"83018202039f0405ff", "[ 1 [ 2 3 ] [ 4 5 ] ] ", false},
+            {"83019f0203ff820405", "[ 1 [ 2 3 ] [ 4 5 ] ] ", false},
+            {"9f0102030405060708090a0b0c0d0e0f101112131415161718181819ff",
+                "[ 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 "
+                "23 24 25 ] ", false},
+            {"bf61610161629f0203ffff", "{ a: 1 b: [ 2 3 ] } ", false},
+            {"826161bf61626163ff", "[ \"a\" { b: \"c\" } ] ", false},
+            {"bf6346756ef563416d7421ff", "{ Fun: true Amt: -2 } ", false},
+        };
+
+        for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+            std::string data = FromHex(vectors[i].hex);
+            std::string pending;
+            std::string str;
+            JSONValue *val;
+            size_t used;
+            long ret;
+
+            // all at once, as events
+
+            {
+                EventRecorder events;
+                JSONCborDecoder decoder(&events);
+
+                ret = decoder.Feed(data.data(), data.size());
+                CPPUNIT_ASSERT(ret == (long) data.size());
+                CPPUNIT_ASSERT(decoder.IsComplete());
+                CPPUNIT_ASSERT(events.m_out == vectors[i].events);
+            }
+
+            // a byte at a time, keeping what is not consumed
+
+            {
+                EventRecorder events;
+                JSONCborDecoder decoder(&events);
+
+                for (size_t j = 0; j < data.size(); j++) {
+                    CPPUNIT_ASSERT(decoder.IsComplete() == false);
+                    pending += data[j];
+                    ret = decoder.Feed(pending.data(), pending.size());
+                    CPPUNIT_ASSERT(ret >= 0);
+                    pending.erase(0, ret);
+                }
+                CPPUNIT_ASSERT(decoder.IsComplete() && pending.empty());
+                CPPUNIT_ASSERT(events.m_out == vectors[i].events);
+            }
+
+            // into a tree, and back
+
+            CPPUNIT_ASSERT(JSONCbor::Decode(data.data(), data.size(), &val,
+                &used) == true);
+            CPPUNIT_ASSERT(val != NULL && used == data.size());
+            if (vectors[i].encode) {
+                JSONCbor::Encode(val, str);
+                CPPUNIT_ASSERT(str == data);
+            }
+            delete val;
+        }
+
+        // strings and keys of a parsed document are encoded as their
+        // text (the vectors above, from JSON text), and decoded to the
+        // form the parser stores
+
+        static const struct {
+            const char *json;
+            const char *hex;
+        } texts[] = {
+            {"\"a\"", "6161"},
+            {"\"\\\"\\\\\"", "62225c"},
+            {"\"\\u00fc\"", "62c3bc"},
+            {"\"\\u6c34\"", "63e6b0b4"},
+            {"\"\\ud800\\udd51\"", "64f0908591"},
+            {"{\"a\": 1, \"b\": [2, 3]}", "a26161016162820203"},
+            {"[\"a\", {\"b\": \"c\"}]", "826161a161626163"},
+        };
+
+        for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++) {
+            JSONValue *val = ParseDirect(texts[i].json);
+            std::string str;
+
+            CPPUNIT_ASSERT(val != NULL);
+            JSONCbor::Encode(val, str);
+            CPPUNIT_ASSERT(str == FromHex(texts[i].hex));
+            delete val;
+        }
+        {
+            std::string data = FromHex("a26161016162820203");
+            JSONValue *val;
+            size_t used;
+
+            CPPUNIT_ASSERT(JSONCbor::Decode(data.data(), data.size(), &val,
+                &used) == true);
+            CPPUNIT_ASSERT(static_cast<JSONTuple *>(val->Get(1))->GetKey() == "\"b\"");
+            delete val;
+            data = FromHex("62225c");
+            CPPUNIT_ASSERT(JSONCbor::Decode(data.data(), data.size(), &val,
+                &used) == true);
+            CPPUNIT_ASSERT(static_cast<JSONString *>(val)->GetStr() == "\"\\\"\\\\\"");
+            delete val;
+        }
+
+        // the items of an indefinite length array are delivered as they
+        // arrive, and the chunks of a string are consumed
+
+        EventRecorder events;
+        JSONCborDecoder decoder(&events);
+        std::string data = FromHex("9f0102");
+
+        CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == 3);
+        CPPUNIT_ASSERT(events.m_out == "[ 1 2 " && decoder.GetDepth() == 1);
+        data = FromHex("7f616162");
+        CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == 3);
+        CPPUNIT_ASSERT(decoder.GetDepth() == 2);
+        data = FromHex("626263ffff");
+        CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == 5);
+        CPPUNIT_ASSERT(events.m_out == "[ 1 2 \"abc\" ] ");
+        CPPUNIT_ASSERT(decoder.IsComplete());
+
+        // values one after another
+
+        data = FromHex("0182f5f6");
+        events.m_out.clear();
+        CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == 1);
+        CPPUNIT_ASSERT(decoder.Feed(data.data() + 1, 3) == 3);
+        CPPUNIT_ASSERT(events.m_out == "1 [ true null ] ");
+
+        // an incomplete value is not consumed by Decode()
+
+        JSONValue *val;
+        size_t used;
+
+        data = FromHex("83010203");
+        CPPUNIT_ASSERT(JSONCbor::Decode(data.data(), 3, &val, &used) == true);
+        CPPUNIT_ASSERT(val == NULL && used == 0);
+
+        // not well-formed, or not representable
+
+        static const char *invalid[] = {
+            "1c",           // reserved additional information
+            "1f",           // indefinite length integer
+            "ff",           // break outside of an indefinite length item
+            "f818",         // simple value below 32 in two bytes
+            "5f6161ff",     // text chunk in a byte string
+            "5f5f4101ffff", // indefinite length chunk
+            "a1800102",     // array key
+            "a1f500",       // boolean key
+            "a14101f6",     // byte string key
+            "bf6161ff",     // key without a value
+            "9fc0ff",       // tag without an item
+            "83ff",         // break in a definite length array
+        };
+
+        for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+            data = FromHex(invalid[i]);
+            decoder.Reset();
+            CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == -1);
+            CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == -1);
+            CPPUNIT_ASSERT(JSONCbor::Decode(data.data(), data.size(), &val,
+                &used) == false);
+        }
+
+        // nesting is limited
+
+        data = std::string(1000, (char) 0x81);
+        decoder.Reset();
+        CPPUNIT_ASSERT(decoder.Feed(data.data(), data.size()) == -1);
+    }
+
+    void testParseCache()
+    {
+        JSONParseCache cache(1024 * 1024, 4);
+        std::string input("{\"a\": [1, 2, 3], \"b\": \"a string long enough to be on the heap\"}");
+        JSONDocument doc1;
+        JSONDocument doc2;
+        JSONDocument doc3;
+        size_t size;
+
+        // the second lookup shares the tree parsed by the first
+
+        CPPUNIT_ASSERT(cache.Get(input, doc1) == true);
+        CPPUNIT_ASSERT(cache.GetMisses() == 1 && cache.GetHits() == 0);
+        CPPUNIT_ASSERT(cache.Get(input, doc2) == true);
+        CPPUNIT_ASSERT(cache.GetMisses() == 1 && cache.GetHits() == 1);
+        CPPUNIT_ASSERT(doc1.GetRoot() == doc2.GetRoot());
+        CPPUNIT_ASSERT(cache.GetCount() == 1);
+        CPPUNIT_ASSERT(cache.GetBytes() > input.size());
+
+        // modifying a document does not modify the cached one
+
+        doc2.GetMutableRoot()->Append(new JSONTuple());
+        CPPUNIT_ASSERT(doc1.GetRoot()->GetSize() == 2);
+        CPPUNIT_ASSERT(cache.Get(input, doc3) == true);
+        CPPUNIT_ASSERT(doc3.GetRoot() == doc1.GetRoot());
+
+        // inputs that do not parse are not cached
+
+        CPPUNIT_ASSERT(cache.Get("{\"a\": ", doc3) == false);
+        CPPUNIT_ASSERT(cache.GetCount() == 1 && cache.GetMisses() == 2);
+        cache.Clear();
+        CPPUNIT_ASSERT(cache.GetCount() == 0 && cache.GetBytes() == 0);
+        CPPUNIT_ASSERT(doc1.GetRoot()->GetSize() == 2);
+
+        // the least recently used entry is evicted
+
+        JSONParseCache one(1024 * 1024, 1);
+
+        CPPUNIT_ASSERT(one.Get("[1, 2, 3]", doc1));
+        size = one.GetBytes();
+        JSONParseCache lru(size * 2 + size / 2, 1);
+
+        CPPUNIT_ASSERT(lru.Get("[1, 2, 3]", doc1));
+        CPPUNIT_ASSERT(lru.Get("[4, 5, 6]", doc1));
+        CPPUNIT_ASSERT(lru.Get("[1, 2, 3]", doc1));
+        CPPUNIT_ASSERT(lru.Get("[7, 8, 9]", doc1));
+        CPPUNIT_ASSERT(lru.GetEvictions() == 1 && lru.GetCount() == 2);
+        CPPUNIT_ASSERT(lru.GetBytes() <= size * 2 + size / 2);
+        CPPUNIT_ASSERT(lru.Get("[1, 2, 3]", doc1));
+        CPPUNIT_ASSERT(lru.GetHits() == 2);
+        CPPUNIT_ASSERT(lru.Get("[4, 5, 6]", doc1));
+        CPPUNIT_ASSERT(lru.GetHits() == 2 && lru.GetEvictions() == 2);
+
+        // documents larger than a shard's budget are not cached
+
+        JSONParseCache small(size / 2, 1);
+
+        CPPUNIT_ASSERT(small.Get("[1, 2, 3]", doc1));
+        CPPUNIT_ASSERT(small.GetCount() == 0 && small.GetBytes() == 0);
+
+        // lookups from several threads
+
+        std::vector<std::thread> threads;
+        std::vector<std::string> inputs;
+        std::atomic<int> failed(0);
+
+        for (int i = 0; i < 32; i++) {
+            inputs.push_back("{\"id\": " + std::to_string(i) +
+                ", \"tags\": [\"x\", \"y\"]}");
+        }
+        for (int t = 0; t < 4; t++) {
+            threads.push_back(std::thread([&cache, &inputs, &failed, t]() {
+                for (int i = 0; i < 1000; i++) {
+                    JSONDocument doc;
+                    int n = (i * 7 + t) % inputs.size();
+
+                    if (cache.Get(inputs[n], doc) == false ||
+                        doc.GetMutableRoot()->GetSize() != 2) {
+                        failed++;
+                    }
+                    doc.GetMutableRoot()->Append(new JSONTuple());
+                }
+            }));
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        CPPUNIT_ASSERT(failed == 0);
+        CPPUNIT_ASSERT(cache.GetHits() + cache.GetMisses() == 4000 + 4);
+        CPPUNIT_ASSERT(cache.GetCount() == 32);
+    }
+
+    bool SameUsage(const JSONMemoryUsage &a, const JSONMemoryUsage &b)
+    {
+        return a.nodes == b.nodes && a.strings == b.strings &&
+            a.containers == b.containers && a.buffers == b.buffers;
+    }
+
+    void testMemoryUsage()
+    {
+        JSONMemoryUsage before = JSONMemory::GetLiveUsage();
+        JSONMemoryUsage usage;
+        JSONMemoryUsage live;
+        JSONObject *obj = new JSONObject();
+        JSONArray *array = new JSONArray();
+        JSONTuple *tuple = new JSONTuple();
+
+        array->Append(new JSONNumber(1));
+        array->Append(new JSONString(std::string(40, 'x')));
+        tuple->SetKey("a key too long to be stored inline");
+        tuple->SetValue(array);
+        obj->Append(tuple);
+
+        // exact, by category
+
+        usage = obj->MemoryUsage();
+        CPPUNIT_ASSERT(usage.nodes == sizeof(JSONObject) + sizeof(JSONTuple) +
+            sizeof(JSONArray) + sizeof(JSONNumber) + sizeof(JSONString));
+        CPPUNIT_ASSERT(usage.strings == 41 + 35);
+        CPPUNIT_ASSERT(usage.containers == 3 * JSONMemory::ListNodeSize);
+        CPPUNIT_ASSERT(usage.GetTotal() ==
+            usage.nodes + usage.strings + usage.containers);
+
+        // and the live counters agree
+
+        live = JSONMemory::GetLiveUsage();
+        CPPUNIT_ASSERT(live.nodes - before.nodes == usage.nodes);
+        CPPUNIT_ASSERT(live.strings - before.strings == usage.strings);
+        CPPUNIT_ASSERT(live.containers - before.containers == usage.containers);
+        delete obj;
+        CPPUNIT_ASSERT(SameUsage(JSONMemory::GetLiveUsage(), before));
+
+        // the internal tree of the parser, and the tree converted from it
+
+        JsonParse *parser = new JsonParse();
+        std::string input("{\"key\": [1, 2.5, true, \"a string long enough for the heap\"]}");
+        JSONValue *val;
+
+        parser->SetInput(input);
+        CPPUNIT_ASSERT(parser->Parse());
+        usage = parser->MemoryUsage();
+        live = JSONMemory::GetLiveUsage();
+        CPPUNIT_ASSERT(usage.nodes > 0 && usage.nodes == live.nodes - before.nodes);
+        CPPUNIT_ASSERT(usage.containers == live.containers - before.containers);
+        CPPUNIT_ASSERT(usage.strings >= input.size());
+        val = JSONAPI::GetValue(parser);
+        CPPUNIT_ASSERT(val);
+        usage = val->MemoryUsage();
+        CPPUNIT_ASSERT(JSONMemory::GetLiveUsage().nodes - live.nodes == usage.nodes);
+        delete parser;
+        CPPUNIT_ASSERT(SameUsage(JSONMemory::GetLiveUsage(),
+            JSONMemoryUsage(before) += usage));
+        delete val;
+        CPPUNIT_ASSERT(SameUsage(JSONMemory::GetLiveUsage(), before));
+
+        // memory freed by another thread than the one that allocated it
+
+        std::thread thread([&val]() {
+            val = new JSONString(std::string(100, 'y'));
+        });
+
+        thread.join();
+        CPPUNIT_ASSERT(JSONMemory::GetLiveBytes() ==
+            before.GetTotal() + val->MemoryUsage().GetTotal());
+        delete val;
+        CPPUNIT_ASSERT(JSONMemory::GetLiveBytes() == before.GetTotal());
+    }
+
+    void testAllocator()
+    {
+        LimitedAllocator allocator((size_t) -1);
+        JsonParse *parser = new JsonParse();
+        std::string input("{\"key\": [1, 2.5, true, \"a string long enough for the heap\"]}");
+        JSONValue *val;
+        std::string str;
+
+        // the parser, and the tree it hands out, allocate from the
+        // allocator of the parser, and give it all back
+
+        parser->SetAllocator(&allocator);
+        parser->SetInput(input);
+        CPPUNIT_ASSERT(allocator.m_bytes > input.size());
+        CPPUNIT_ASSERT(parser->Parse());
+        CPPUNIT_ASSERT(allocator.m_bytes >= parser->MemoryUsage().GetTotal());
+        val = JSONAPI::GetValue(parser);
+        CPPUNIT_ASSERT(val);
+        CPPUNIT_ASSERT(JSONAllocator::GetCurrent() == JSONAllocator::GetDefault());
+        delete parser;
+        CPPUNIT_ASSERT(allocator.m_bytes >= val->MemoryUsage().GetTotal());
+        CPPUNIT_ASSERT(val->ToJSON(str).find("long enough for the heap") !=
+            std::string::npos);
+        delete val;
+        CPPUNIT_ASSERT(allocator.m_bytes == 0);
+
+        // and so does anything allocated while the allocator is current
+
+        {
+            JSONAllocatorScope scope(&allocator);
+
+            CPPUNIT_ASSERT(JSONAllocator::GetCurrent() == &allocator);
+            val = new JSONString(std::string(100, 'x'));
+        }
+        CPPUNIT_ASSERT(JSONAllocator::GetCurrent() == JSONAllocator::GetDefault());
+        CPPUNIT_ASSERT(allocator.m_bytes >= val->MemoryUsage().GetTotal());
+        delete val;
+        CPPUNIT_ASSERT(allocator.m_bytes == 0);
+
+        // a limit makes the parse fail, not the process
+
+        LimitedAllocator limited(1024);
+        std::string big("[");
+
+        for (int i = 0; i < 200; i++) {
+            big += "1, ";
+        }
+        big += "2]";
+        parser = new JsonParse();
+        parser->SetAllocator(&limited);
+        parser->SetInput(big);
+        CPPUNIT_ASSERT(parser->Parse() == false);
+        CPPUNIT_ASSERT(JSONAPI::GetValue(parser) == NULL);
+        limited.m_limit = (size_t) -1;
+        CPPUNIT_ASSERT(parser->Parse());
+        val = JSONAPI::GetValue(parser);
+        CPPUNIT_ASSERT(val && val->GetSize() == 201);
+        delete val;
+        delete parser;
+
+        // the copies made to modify a document come from its allocator
+
+        JSONDocument doc(new JSONArray());
+        JSONDocument clone = doc.Clone();
+
+        clone.SetAllocator(&allocator);
+        clone.GetMutableRoot()->Append(new JSONNumber(1));
+        CPPUNIT_ASSERT(clone.GetRoot() != doc.GetRoot());
+        CPPUNIT_ASSERT(doc.GetRoot()->GetSize() == 0);
+        CPPUNIT_ASSERT(allocator.m_bytes >= sizeof(JSONArray));
+        clone.SetRoot(NULL);
+        CPPUNIT_ASSERT(allocator.m_bytes == 0);
+
+        limited.m_limit = limited.m_bytes;
+        clone = doc.Clone();
+        clone.SetAllocator(&limited);
+        try {
+            clone.GetMutableRoot();
+            CPPUNIT_ASSERT(false);
+        } catch (std::bad_alloc &) {
+        }
+        CPPUNIT_ASSERT(clone.GetRoot() == doc.GetRoot());
+    }
+
+    void testReadWithoutAllocating()
+    {
+        std::string input("{\"name\": \"a string long enough for the heap\", "
+            "\"id\": 42, \"ratio\": 0.5, \"ok\": true, \"list\": [1, 2, 3]}");
+        JsonParse parser;
+        LimitedAllocator none(0);
+        long count;
+
+        parser.SetInput(input);
+        CPPUNIT_ASSERT(parser.Parse());
+        const JSONDocument doc(JSONAPI::GetValue(&parser));
+
+        // with the library's allocator refusing everything, and
+        // operator new counted, walk the document
+
+        {
+            JSONAllocatorScope scope(&none);
+            const JSONValue *root = doc.GetRoot();
+            const JSONValue *list;
+            std::string_view str;
+            long sum = 0;
+
+            count = newCount;
+            CPPUNIT_ASSERT(root->GetType() == JsonType_Object);
+            CPPUNIT_ASSERT(root->GetSize() == 5);
+            CPPUNIT_ASSERT(root->FindKey("missing") == -1);
+
+            const JSONTuple *name = static_cast<const JSONTuple *>(
+                root->Get(root->FindKey("name")));
+            CPPUNIT_ASSERT(name->GetKeyView() == "\"name\"");
+            str = static_cast<const JSONString *>(name->GetValue())->GetView();
+            CPPUNIT_ASSERT(str.find("long enough") != std::string_view::npos);
+
+            const JSONTuple *id = static_cast<const JSONTuple *>(root->Get(1));
+            CPPUNIT_ASSERT(static_cast<const JSONNumber *>(id->GetValue())->Get() == 42);
+            const JSONTuple *ratio = static_cast<const JSONTuple *>(root->Get(2));
+            CPPUNIT_ASSERT(static_cast<const JSONDouble *>(ratio->GetValue())->Get() == 0.5);
+            const JSONTuple *ok = static_cast<const JSONTuple *>(root->Get(3));
+            CPPUNIT_ASSERT(static_cast<const JSONBoolean *>(ok->GetValue())->Get());
+
+            list = static_cast<const JSONTuple *>(
+                root->Get(root->FindKey("list")))->GetValue();
+            for (int i = 0; i < list->GetSize(); i++) {
+                sum += static_cast<const JSONNumber *>(list->Get(i))->Get();
+            }
+            CPPUNIT_ASSERT(sum == 6);
+            CPPUNIT_ASSERT(root->Equals(*root));
+            CPPUNIT_ASSERT(newCount == count);
+            CPPUNIT_ASSERT(none.m_bytes == 0);
+        }
+    }
+
+    void testStringWireCache()
+    {
+        JSONString *val = new JSONString("caf\xc3\xa9\nand a line long enough for the heap");
+        const std::string expected("\"caf\\u00E9\\nand a line long enough for the heap\"");
+        JSONMemoryUsage before = val->MemoryUsage();
+        std::string str;
+        long count;
+
+        // the first serialization keeps the escaped form, the next ones
+        // copy it and allocate nothing
+
+        CPPUNIT_ASSERT(val->ToJSON(str) == expected);
+        CPPUNIT_ASSERT(val->MemoryUsage().strings > before.strings);
+        str.clear();
+        str.reserve(256);
+        count = newCount;
+        CPPUNIT_ASSERT(val->ToJSON(str) == expected);
+        CPPUNIT_ASSERT(newCount == count);
+
+        // changing the string discards it
+
+        str.clear();
+        val->Set("caf\xc3\xa9\t");
+        CPPUNIT_ASSERT(SameUsage(val->MemoryUsage(), before) == false);
+        CPPUNIT_ASSERT(val->ToJSON(str) == "\"caf\\u00E9\\t\"");
+        str.clear();
+        val->Set(JsonStr("na\xc3\xafve\n"));
+        CPPUNIT_ASSERT(val->ToJSON(str) == "\"na\\u00EFve\\n\"");
+        std::string utf8(str);
+
+        // a moved string keeps it, a copy makes its own
+
+        JSONString moved(std::move(*val));
+        JSONValue *copy = moved.Copy();
+
+        str.clear();
+        CPPUNIT_ASSERT(moved.ToJSON(str) == utf8);
+        str.clear();
+        CPPUNIT_ASSERT(copy->ToJSON(str) == utf8);
+        delete copy;
+        delete val;
+
+        // a shared string serialized by several threads at once
+
+        JSONDocument doc(new JSONString("caf\xc3\xa9\nand a line long enough for the heap"));
+        std::vector<std::thread> threads;
+        std::atomic<int> good(0);
+
+        for (int i = 0; i < 4; i++) {
+            threads.push_back(std::thread([&doc, &expected, &good]() {
+                JSONDocument clone = doc.Clone();
+
+                for (int j = 0; j < 100; j++) {
+                    std::string out;
+
+                    if (clone.GetRoot()->ToJSON(out) == expected) {
+                        good++;
+                    }
+                }
+            }));
+        }
+        for (size_t i = 0; i < threads.size(); i++) {
+            threads[i].join();
+        }
+        CPPUNIT_ASSERT(good == 400);
+    }
+
+    void testShapes()
+    {
+        const char *input = "[{\"id\": 1, \"name\": \"a\", \"pos\": {\"x\": 1, \"y\": 2}}, {\"id\": 2, \"name\": \"b\", \"pos\": {\"x\": 3, \"y\": 4}}, {\"id\": 3, \"name\": \"c\", \"pos\": {\"x\": 5, \"y\": 6}}, {\"name\": \"d\"}]";
+        std::unique_ptr<JSONValue> plain(ParseDirect(input));
+        JSONShapeTable shapes;
+        JsonParse parser;
+        std::string str(input);
+        std::string a, b;
+
+        parser.SetDirect(true);
+        parser.SetShapes(&shapes);
+        parser.SetInput(str);
+        CPPUNIT_ASSERT(parser.Parse());
+        JSONDocument doc(JSONAPI::GetRootObject(&parser));
+        const JSONValue *root = doc.GetRoot();
+
+        // one shape per distinct sequence of keys, shared by the records
+
+        CPPUNIT_ASSERT(plain && root && root->GetType() == JsonType_Array);
+        CPPUNIT_ASSERT(shapes.GetCount() == 3);
+        CPPUNIT_ASSERT(root->Get(0)->GetType() == JsonType_Record);
+        CPPUNIT_ASSERT(static_cast<const JSONRecord *>(root->Get(0))->GetShape() ==
+            static_cast<const JSONRecord *>(root->Get(2))->GetShape());
+        CPPUNIT_ASSERT(root->Get(0)->FindKey("name") == 1);
+        CPPUNIT_ASSERT(root->Get(0)->FindKey("\"pos\"") == 2);
+        CPPUNIT_ASSERT(root->Get(0)->FindKey("nope") == -1);
+        CPPUNIT_ASSERT(root->Get(1)->Get(1)->GetType() == JsonType_String);
+        CPPUNIT_ASSERT(root->Get(2)->Get(2)->GetType() == JsonType_Record);
+
+        // records read, compare, hash and serialize as objects do, in
+        // less memory
+
+        CPPUNIT_ASSERT(doc.GetRoot()->ToJSON(a) == plain->ToJSON(b));
+        CPPUNIT_ASSERT(root->Equals(*plain) && plain->Equals(*root));
+        CPPUNIT_ASSERT(root->Get(3)->Equals(*plain->Get(3)));
+        CPPUNIT_ASSERT(!root->Get(0)->Equals(*plain->Get(1)));
+        CPPUNIT_ASSERT(!root->Get(0)->Equals(*root->Get(1)));
+        CPPUNIT_ASSERT(root->Hash() == plain->Hash());
+        CPPUNIT_ASSERT(root->MemoryUsage().GetTotal() <
+            plain->MemoryUsage().GetTotal());
+        a.clear();
+        b.clear();
+        CPPUNIT_ASSERT(JSONMsgPack::Encode(doc.GetRoot(), a) ==
+            JSONMsgPack::Encode(plain.get(), b));
+        a.clear();
+        b.clear();
+        CPPUNIT_ASSERT(JSONCbor::Encode(doc.GetRoot(), a) ==
+            JSONCbor::Encode(plain.get(), b));
+
+        // a record outlives the table
+
+        shapes.Clear();
+        CPPUNIT_ASSERT(shapes.GetCount() == 0);
+        CPPUNIT_ASSERT(root->Get(2)->FindKey("pos") == 2);
+
+        // a patch turns the records it modifies into objects, of a clone
+        // only
+
+        std::unique_ptr<JSONValue> expected(ParseDirect("[{\"id\": 1, \"name\": \"a\", \"pos\": {\"x\": 1, \"y\": 2}}, {\"id\": 2, \"name\": \"b\", \"pos\": {\"x\": 30, \"y\": 4}}, {\"id\": 3, \"name\": \"c\", \"pos\": {\"x\": 5, \"y\": 6}}, {\"name\": \"d\", \"id\": 4}]"));
+        JSONDocument clone = doc.Clone();
+        JSONPatch patch;
+
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"replace\", \"path\": \"/1/pos/x\", \"value\": 30},"
+            "{\"op\": \"add\", \"path\": \"/3/id\", \"value\": 4},"
+            "{\"op\": \"test\", \"path\": \"/2/pos/y\", \"value\": 6}"
+            "]")));
+        CPPUNIT_ASSERT(patch.Apply(clone) == true);
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*expected));
+        CPPUNIT_ASSERT(clone.GetRoot()->Get(1)->GetType() == JsonType_Object);
+        CPPUNIT_ASSERT(clone.GetRoot()->Get(0) == doc.GetRoot()->Get(0));
+        CPPUNIT_ASSERT(doc.GetRoot()->Equals(*plain));
+    }
+
+    void testIterators()
+    {
+        std::unique_ptr<JSONValue> obj(ParseDirect("{\"a\": [1, 2, 3], \"b\": \"x\", \"c\": null}"));
+        const JSONValue *array;
+        std::string keys;
+        long sum = 0;
+
+        CPPUNIT_ASSERT(obj);
+        array = static_cast<JSONTuple *>(obj->Get(0))->GetValue();
+
+        // elements, forwards and backwards
+
+        for (const JSONValue *val : *array) {
+            sum = sum * 10 + static_cast<const JSONNumber *>(val)->Get();
+        }
+        CPPUNIT_ASSERT(sum == 123);
+        JSONValue::const_iterator iter = array->end();
+        sum = 0;
+        while (iter != array->begin()) {
+            --iter;
+            sum = sum * 10 + static_cast<const JSONNumber *>(*iter)->Get();
+        }
+        CPPUNIT_ASSERT(sum == 321);
+        CPPUNIT_ASSERT(std::distance(array->begin(), array->end()) == 3);
+        CPPUNIT_ASSERT(std::distance(obj->begin(), obj->end()) == 3);
+        CPPUNIT_ASSERT((*obj->begin())->GetType() == JsonType_Tuple);
+
+        // a non-const iterator converts to a const one
+
+        JSONValue::iterator first = obj->begin();
+        JSONValue::const_iterator cfirst = first;
+        CPPUNIT_ASSERT(*cfirst == obj->Get(0));
+
+        // keys and values of an object
+
+        for (auto [key, value] : obj->Members()) {
+            keys += key;
+            CPPUNIT_ASSERT(value != NULL);
+        }
+        CPPUNIT_ASSERT(keys == "\"a\"\"b\"\"c\"");
+        CPPUNIT_ASSERT((*obj->Members().begin()).value == array);
+        CPPUNIT_ASSERT(array->Members().begin() == array->Members().end());
+
+        // and of a record, with the keys of its shape
+
+        JSONShapeTable shapes;
+        JSONValue *record = shapes.Compact(obj.release());
+        const JSONValue *crecord = record;
+        auto member = crecord->Members().end();
+
+        CPPUNIT_ASSERT(record->GetType() == JsonType_Record);
+        --member;
+        CPPUNIT_ASSERT((*member).key == "\"c\"");
+        CPPUNIT_ASSERT((*member).value->GetType() == JsonType_Null);
+        --member;
+        CPPUNIT_ASSERT((*member).key == "\"b\"");
+        CPPUNIT_ASSERT((*member).value == crecord->Get(1));
+        keys.clear();
+        for (const auto &m : record->Members()) {
+            keys += m.key;
+        }
+        CPPUNIT_ASSERT(keys == "\"a\"\"b\"\"c\"");
+        delete record;
+    }
+
+    void testBind()
+    {
+        BindMessage msg;
+        BindMessage copy;
+        std::string str;
+
+        // members in any order, unknown ones skipped, escapes decoded
+
+        msg.seq = -1;
+        CPPUNIT_ASSERT(JSONBind::Decode(std::string(" {\"temp\": 21.5, "
+            "\"device\": \"sensor-\\u00e9\\n\\ud83d\\ude00\", \"extra\": "
+            "{\"a\": [1, {\"b\": null}], \"c\": \"}\"}, \"level\": 3, \"ok\": true, "
+            "\"samples\": [1, -2, 3], \"path\": [{\"x\": 1, \"y\": 2}, "
+            "{\"y\": 4, \"x\": 3}], \"note\": \"hi\", \"seq\": 12345678901} "), msg));
+        CPPUNIT_ASSERT(msg.device == "sensor-\xc3\xa9\n\xf0\x9f\x98\x80");
+        CPPUNIT_ASSERT(msg.seq == 12345678901L && msg.level == 3 && msg.ok);
+        CPPUNIT_ASSERT(msg.temp == 21.5);
+        CPPUNIT_ASSERT(msg.samples.size() == 3 && msg.samples[1] == -2);
+        CPPUNIT_ASSERT(msg.path.size() == 2 && msg.path[1].x == 3 &&
+            msg.path[1].y == 4);
+        CPPUNIT_ASSERT(msg.note && *msg.note == "hi");
+
+        // and back, the encoding decodes to the same values
+
+        JSONBind::Encode(msg, str);
+        CPPUNIT_ASSERT(str == "{\"device\": \"sensor-\xc3\xa9\\n\xf0\x9f\x98\x80\","
+            "\"seq\": 12345678901,\"level\": 3,\"ok\": true,\"temp\": 21.5,"
+            "\"samples\": [1,-2,3],\"path\": [{\"x\": 1,\"y\": 2},{\"x\": 3,"
+            "\"y\": 4}],\"note\": \"hi\"}");
+        CPPUNIT_ASSERT(JSONBind::Decode(str, copy));
+        CPPUNIT_ASSERT(copy.device == msg.device && copy.seq == msg.seq &&
+            copy.temp == msg.temp && copy.path.size() == 2 && copy.note == msg.note);
+
+        // the DOM parser agrees that it is valid JSON
+
+        std::unique_ptr<JSONValue> val(ParseDirect(str.c_str()));
+        CPPUNIT_ASSERT(val && val->GetType() == JsonType_Object);
+
+        // null resets an optional, an empty one is not encoded
+
+        CPPUNIT_ASSERT(JSONBind::Decode(std::string("{\"note\": null}"), msg));
+        CPPUNIT_ASSERT(!msg.note && msg.seq == 12345678901L);
+        str.clear();
+        JSONBind::Encode(msg, str);
+        CPPUNIT_ASSERT(str.find("note") == std::string::npos);
+        str.clear();
+        msg.temp = 0.1;
+        JSONBind::Encode(msg, str);
+        CPPUNIT_ASSERT(JSONBind::Decode(str, copy) && copy.temp == 0.1);
+
+        // values that do not fit, and invalid JSON
+
+        const char *bad[] = {
+            "{\"level\": 256}", "{\"level\": -1}", "{\"seq\": 1.5}",
+            "{\"seq\": \"1\"}", "{\"ok\": 1}", "{\"device\": null}",
+            "{\"samples\": [1,]}", "{\"samples\": [1 2]}", "{\"x\": 1,}",
+            "{\"x\": 01}", "{\"x\": [}", "{\"x\": \"\\ud800\"}",
+            "{\"x\": \"\\q\"}", "{\"x\": \"a\nb\"}", "{} {}", "[]", "",
+            "{\"seq\": 99999999999999999999}", "{\"path\": [{\"x\": true}]}"
+        };
+        for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            CPPUNIT_ASSERT(JSONBind::Decode(std::string(bad[i]), copy) == false);
+        }
+        CPPUNIT_ASSERT(JSONBind::Decode(std::string("{}"), copy));
+
+        // decoding into a struct that already has its buffers allocates
+        // nothing
+
+        str.clear();
+        JSONBind::Encode(msg, str);
+        CPPUNIT_ASSERT(JSONBind::Decode(str, copy));
+        long count = newCount;
+        CPPUNIT_ASSERT(JSONBind::Decode(str, copy));
+        CPPUNIT_ASSERT(newCount == count);
+    }
+
+    void testSchema()
+    {
+        JSONSchema schema;
+        std::string err;
+
+        CPPUNIT_ASSERT(schema.Compile(std::string("{\"definitions\": "
+            "{\"point\": {\"type\": \"object\", \"properties\": "
+            "{\"x\": {\"type\": \"number\"}, \"y\": {\"type\": \"number\"}}, "
+            "\"required\": [\"x\", \"y\"], \"additionalProperties\": false}}, "
+            "\"type\": \"object\", \"properties\": {"
+            "\"id\": {\"type\": \"integer\", \"minimum\": 1}, "
+            "\"name\": {\"type\": \"string\", \"minLength\": 1, \"maxLength\": 8}, "
+            "\"kind\": {\"enum\": [\"user\", \"admin\"]}, "
+            "\"score\": {\"type\": \"number\", \"exclusiveMaximum\": 100, "
+            "\"multipleOf\": 0.5}, "
+            "\"tags\": {\"type\": \"array\", \"items\": {\"type\": \"string\"}, "
+            "\"maxItems\": 3}, "
+            "\"where\": {\"$ref\": \"#/definitions/point\"}, "
+            "\"path\": {\"type\": \"array\", \"items\": "
+            "{\"$ref\": \"#/definitions/point\"}}, "
+            "\"note\": {\"type\": [\"string\", \"null\"]}}, "
+            "\"required\": [\"id\", \"name\"]}")));
+        CPPUNIT_ASSERT(schema.IsCompiled());
+
+        // valid documents, as text and as trees of objects or records
+
+        const char *good[] = {
+            "{\"id\": 1, \"name\": \"a\"}",
+            "{\"name\": \"\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\\u00e9\", "
+            "\"id\": 7.0, \"extra\": [1, {}]}",
+            "{\"id\": 2, \"name\": \"b\", \"kind\": \"admin\", \"score\": 99.5, "
+            "\"tags\": [\"x\", \"y\"], \"where\": {\"y\": 2, \"x\": 1.5}, "
+            "\"path\": [{\"x\": 1, \"y\": 2}, {\"x\": 3, \"y\": 4}], \"note\": null}"
+        };
+        for (size_t i = 0; i < sizeof(good) / sizeof(good[0]); i++) {
+            std::string str(good[i]);
+            JSONShapeTable shapes;
+            JsonParse parser;
+
+            CPPUNIT_ASSERT(schema.Validate(str.data(), str.size(), &err));
+            std::unique_ptr<JSONValue> val(ParseDirect(good[i]));
+            CPPUNIT_ASSERT(val && schema.Validate(val.get(), &err));
+            parser.SetDirect(true);
+            parser.SetShapes(&shapes);
+            parser.SetInput(str);
+            CPPUNIT_ASSERT(parser.Parse());
+            JSONDocument doc(JSONAPI::GetRootObject(&parser));
+            CPPUNIT_ASSERT(schema.Validate(doc.GetRoot(), &err));
+        }
+
+        // invalid ones, with the same error from the text and the tree
+
+        const char *bad[][2] = {
+            {"[]", "expected object at the root"},
+            {"{\"name\": \"a\"}", "missing member id at the root"},
+            {"{\"id\": 0, \"name\": \"a\"}", "below the minimum at /id"},
+            {"{\"id\": 1.5, \"name\": \"a\"}", "expected integer at /id"},
+            {"{\"id\": 1, \"name\": \"\"}", "shorter than 1 at /name"},
+            {"{\"id\": 1, \"name\": \"\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9"
+             "\xc3\xa9\xc3\xa9\xc3\xa9\xc3\xa9\"}", "longer than 8 at /name"},
+            {"{\"id\": 1, \"name\": \"a\", \"kind\": \"root\"}",
+             "not one of the allowed values at /kind"},
+            {"{\"id\": 1, \"name\": \"a\", \"score\": 100}",
+             "above the maximum at /score"},
+            {"{\"id\": 1, \"name\": \"a\", \"tags\": [\"a\", \"b\", \"c\", \"d\"]}",
+             "more than 3 items at /tags/3"},
+            {"{\"id\": 1, \"name\": \"a\", \"tags\": [1]}",
+             "expected string at /tags/0"},
+            {"{\"id\": 1, \"name\": \"a\", \"where\": {\"x\": 1}}",
+             "missing member y at /where"},
+            {"{\"id\": 1, \"name\": \"a\", \"path\": [{\"x\": 1, \"y\": 2, "
+             "\"a/b\": 3}]}", "unexpected member at /path/0/a~1b"},
+            {"{\"id\": 1, \"name\": \"a\", \"note\": 1}",
+             "expected null or string at /note"}
+        };
+        for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+            std::string str(bad[i][0]);
+
+            err.clear();
+            CPPUNIT_ASSERT(schema.Validate(str.data(), str.size(), &err) == false);
+            CPPUNIT_ASSERT(err == bad[i][1]);
+            std::unique_ptr<JSONValue> val(ParseDirect(bad[i][0]));
+            err.clear();
+            CPPUNIT_ASSERT(val && schema.Validate(val.get(), &err) == false);
+            CPPUNIT_ASSERT(err == bad[i][1]);
+        }
+        CPPUNIT_ASSERT(schema.Validate("{\"id\": 1, \"name\": \"a\"} {}", 25,
+            &err) == false);
+        CPPUNIT_ASSERT(schema.Validate("{\"id\": 1, \"name\": ", 18,
+            &err) == false);
+
+        // the parser rejects an invalid document before building a tree
+
+        JsonParse parser;
+        std::string str(bad[2][0]);
+
+        parser.SetDirect(true);
+        parser.SetSchema(&schema);
+        parser.SetInput(str);
+        CPPUNIT_ASSERT(parser.Parse() == false);
+        CPPUNIT_ASSERT(parser.GetSchemaError() == bad[2][1]);
+        str = good[2];
+        parser.SetInput(str);
+        CPPUNIT_ASSERT(parser.Parse());
+        CPPUNIT_ASSERT(parser.GetSchemaError().empty());
+        std::unique_ptr<JSONValue> val(JSONAPI::GetValue(&parser));
+        CPPUNIT_ASSERT(val && val->GetType() == JsonType_Object);
+
+        // a decoder drives the validator directly
+
+        JSONSchemaValidator validator(schema);
+        JSONCborDecoder decoder(&validator);
+        const char cbor[] = "\xa2\x62id\x02\x64name\x61\x62";
+        const char cborBad[] = "\xa2\x62id\xfb\x3f\xf8\0\0\0\0\0\0\x64name\x61\x62";
+
+        CPPUNIT_ASSERT(decoder.Feed(cbor, sizeof(cbor) - 1) > 0);
+        CPPUNIT_ASSERT(validator.IsComplete());
+        validator.Reset();
+        decoder.Reset();
+        CPPUNIT_ASSERT(decoder.Feed(cborBad, sizeof(cborBad) - 1) < 0);
+        CPPUNIT_ASSERT(!validator.IsComplete());
+        CPPUNIT_ASSERT(validator.GetError() == "expected integer at /id");
+
+        // boolean schemas, and what is not supported
+
+        CPPUNIT_ASSERT(schema.Compile(std::string("true")));
+        CPPUNIT_ASSERT(schema.Validate("[1, {}]", 7));
+        CPPUNIT_ASSERT(schema.Compile(std::string("false")));
+        CPPUNIT_ASSERT(schema.Validate("1", 1) == false);
+        const char *unsupported[] = {
+            "{\"anyOf\": [{}, {}]}", "{\"pattern\": \"a*\"}",
+            "{\"items\": [{}, {}]}", "{\"$ref\": \"#/nope\"}",
+            "{\"$ref\": \"http://example.com/a.json\"}", "{\"type\": \"thing\"}",
+            "{\"enum\": [[1]]}", "[1]", "{"
+        };
+        for (size_t i = 0; i < sizeof(unsupported) / sizeof(unsupported[0]); i++) {
+            CPPUNIT_ASSERT(schema.Compile(std::string(unsupported[i])) == false);
+            CPPUNIT_ASSERT(!schema.IsCompiled() && !schema.GetError().empty());
+            CPPUNIT_ASSERT(schema.Validate("1", 1) == false);
+        }
+
+        // recursion through $ref
+
+        CPPUNIT_ASSERT(schema.Compile(std::string("{\"type\": \"object\", "
+            "\"properties\": {\"kids\": {\"type\": \"array\", "
+            "\"items\": {\"$ref\": \"#\"}}}}")));
+        CPPUNIT_ASSERT(schema.Validate("{\"kids\": [{\"kids\": [{}]}]}", 26));
+        CPPUNIT_ASSERT(schema.Validate("{\"kids\": [{\"kids\": [1]}]}", 25,
+            &err) == false);
+        CPPUNIT_ASSERT(err == "expected object at /kids/0/kids/0");
+
+        // a numeric exclusive limit is a limit of its own, whatever the
+        // order of the keys; a boolean one modifies minimum or maximum
+
+        const char *limits[][3] = {
+            {"{\"minimum\": 5, \"exclusiveMinimum\": 0}", "5", "1"},
+            {"{\"exclusiveMinimum\": 0, \"minimum\": 5}", "5", "1"},
+            {"{\"minimum\": 0, \"exclusiveMinimum\": 5}", "6", "5"},
+            {"{\"maximum\": 10, \"exclusiveMaximum\": 20}", "10", "15"},
+            {"{\"exclusiveMaximum\": 20, \"maximum\": 10}", "10", "15"},
+            {"{\"maximum\": 20, \"exclusiveMaximum\": 10}", "9", "10"},
+            {"{\"minimum\": 5, \"exclusiveMinimum\": true}", "6", "5"},
+            {"{\"exclusiveMaximum\": true, \"maximum\": 10}", "9", "10"},
+            {"{\"minimum\": 5, \"exclusiveMinimum\": false}", "5", "4"}
+        };
+        for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+            CPPUNIT_ASSERT(schema.Compile(std::string(limits[i][0])));
+            CPPUNIT_ASSERT(schema.Validate(limits[i][1], strlen(limits[i][1])));
+            CPPUNIT_ASSERT(schema.Validate(limits[i][2], strlen(limits[i][2]))
+                == false);
+        }
+    }
+
+    JSONValue *ParsePacked(const char *str, bool direct)
+    {
+        JsonParse parser;
+        std::string input(str);
+
+        parser.SetDirect(direct);
+        parser.SetPackArrays(true);
+        parser.SetInput(input);
+        if (parser.Parse() == false) {
+            return NULL;
+        }
+        return JSONAPI::GetRootObject(&parser);
+    }
+
+    void testPackedArrays()
+    {
+        const char *input = "{\"samples\": [1, -2, 3, 9007199254740993], "
+            "\"temps\": [1.5, -0.25, 2000.5], \"mixed\": [1, 2.5], \"strs\": [\"a\"], "
+            "\"empty\": [], \"nested\": [[1, 2], [3.5]], "
+            "\"flags\": [1, true]}";
+        std::unique_ptr<JSONValue> plain(ParseDirect(input));
+        std::string a, b;
+
+        for (int direct = 0; direct < 2; direct++) {
+            std::unique_ptr<JSONValue> val(ParsePacked(input, direct));
+            const JSONValue *samples, *temps, *nested;
+
+            // only arrays of all integers, or all doubles, are packed
+
+            CPPUNIT_ASSERT(val && val->GetType() == JsonType_Object);
+            samples = static_cast<JSONTuple *>(val->Get(val->FindKey("samples")))->GetValue();
+            temps = static_cast<JSONTuple *>(val->Get(val->FindKey("temps")))->GetValue();
+            nested = static_cast<JSONTuple *>(val->Get(val->FindKey("nested")))->GetValue();
+            CPPUNIT_ASSERT(samples->GetType() == JsonType_PackedArray);
+            CPPUNIT_ASSERT(temps->GetType() == JsonType_PackedArray);
+            CPPUNIT_ASSERT(nested->GetType() == JsonType_Array);
+            CPPUNIT_ASSERT(nested->Get(0)->GetType() == JsonType_PackedArray);
+            CPPUNIT_ASSERT(nested->Get(1)->GetType() == JsonType_PackedArray);
+            const char *generic[] = {"mixed", "strs", "empty", "flags"};
+            for (size_t i = 0; i < sizeof(generic) / sizeof(generic[0]); i++) {
+                CPPUNIT_ASSERT(static_cast<JSONTuple *>(val->Get(
+                    val->FindKey(generic[i])))->GetValue()->GetType() == JsonType_Array);
+            }
+
+            // the elements, in place
+
+            const JSONPackedArray *ints = static_cast<const JSONPackedArray *>(samples);
+            const JSONPackedArray *doubles = static_cast<const JSONPackedArray *>(temps);
+            JSONSpan<const int64_t> span = ints->GetIntegers();
+
+            CPPUNIT_ASSERT(ints->GetElementType() == JsonType_Number);
+            CPPUNIT_ASSERT(ints->GetCount() == 4 && span.size() == 4);
+            CPPUNIT_ASSERT(span[1] == -2 && span[3] == 9007199254740993L);
+            CPPUNIT_ASSERT(ints->GetDoubles().empty() && ints->GetSize() == 0);
+            CPPUNIT_ASSERT(doubles->GetElementType() == JsonType_Double);
+            CPPUNIT_ASSERT(doubles->GetDoubles().size() == 3 &&
+                doubles->GetDoubles()[2] == 2000.5 && doubles->GetIntegers().empty());
+
+            // the same document as far as anyone can tell, but smaller
+
+            a.clear();
+            b.clear();
+            val->ToJSON(a);
+            plain->ToJSON(b);
+            CPPUNIT_ASSERT(a == b);
+            CPPUNIT_ASSERT(val->Equals(*plain) && plain->Equals(*val));
+            CPPUNIT_ASSERT(val->Hash() == plain->Hash());
+            CPPUNIT_ASSERT(val->MemoryUsage().GetTotal() < plain->MemoryUsage().GetTotal());
+            a.clear();
+            b.clear();
+            JSONMsgPack::Encode(val.get(), a);
+            JSONMsgPack::Encode(plain.get(), b);
+            CPPUNIT_ASSERT(a == b);
+            a.clear();
+            b.clear();
+            JSONCbor::Encode(val.get(), a);
+            JSONCbor::Encode(plain.get(), b);
+            CPPUNIT_ASSERT(a == b);
+            JSONTape tape;
+            JSONDocument doc(val->Ref());
+            CPPUNIT_ASSERT(doc.ToTape(tape));
+            a.clear();
+            tape.GetRoot().ToJSON(a);
+            b.clear();
+            plain->ToJSON(b);
+            CPPUNIT_ASSERT(a == b);
+
+            // the elements are validated as those of any array
+
+            JSONSchema schema;
+            std::string err;
+
+            CPPUNIT_ASSERT(schema.Compile(std::string("{\"properties\": "
+                "{\"samples\": {\"items\": {\"type\": \"integer\", "
+                "\"maximum\": 5}}}}")));
+            CPPUNIT_ASSERT(schema.Validate(val.get(), &err) == false);
+            CPPUNIT_ASSERT(err == "above the maximum at /samples/3");
+        }
+
+        // appending elements, of the type of the array only
+
+        JSONPackedArray ints;
+        JSONPackedArray doubles(JsonType_Double);
+
+        ints.Reserve(3);
+        CPPUNIT_ASSERT(ints.AppendInteger(7) && ints.AppendInteger(-1));
+        CPPUNIT_ASSERT(ints.AppendDouble(1.5) == false && ints.GetCount() == 2);
+        CPPUNIT_ASSERT(doubles.AppendDouble(1.5) && !doubles.AppendInteger(1));
+        std::unique_ptr<JSONValue> elem(ints.MakeElement(1));
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(elem.get())->Get() == -1);
+        CPPUNIT_ASSERT(ints.MakeElement(2) == NULL);
+        std::unique_ptr<JSONArray> array(ints.ToArray());
+        CPPUNIT_ASSERT(array->GetSize() == 2 && array->Equals(ints) && ints.Equals(*array));
+        CPPUNIT_ASSERT(!doubles.Equals(ints) && !doubles.Equals(*array));
+        CPPUNIT_ASSERT(JSONPackedArray(JsonType_Double).Equals(JSONPackedArray()));
+
+        // the modifiers taking a value refuse it rather than lose it
+
+        std::unique_ptr<JSONValue> str(new JSONString("x"));
+        std::vector<long> more = {3, 4};
+        std::string json;
+
+        CPPUNIT_ASSERT(ints.Append(str.get()) == -1);
+        CPPUNIT_ASSERT(ints.Prepend(str.get()) == false);
+        CPPUNIT_ASSERT(ints.Insert(0, str.get()) == false);
+        CPPUNIT_ASSERT(ints.Insert(2, str.get()) == false);
+        CPPUNIT_ASSERT(ints.Set(0, str.get()) == false);
+        CPPUNIT_ASSERT(ints.Append(std::unique_ptr<JSONValue>(new JSONNumber(3))) == -1);
+        CPPUNIT_ASSERT(ints.Prepend(std::unique_ptr<JSONValue>(new JSONNull())) == false);
+        CPPUNIT_ASSERT(ints.Append(more.begin(), more.end()) == false);
+        CPPUNIT_ASSERT(ints.Emplace<JSONNumber>(3) == NULL);
+        CPPUNIT_ASSERT(ints.GetCount() == 2 && ints.GetSize() == 0);
+        CPPUNIT_ASSERT(ints.Equals(*array) && ints.ToJSON(json) == "[7,-1]");
+        CPPUNIT_ASSERT(array->Append(str.release()) == 2 && !ints.Equals(*array));
+
+        // a patch reads packed elements, and makes a packed array generic
+        // before modifying it; the clone it came from is left alone
+
+        JSONDocument doc(ParsePacked(input, true));
+        JSONDocument clone = doc.Clone();
+        JSONPatch patch;
+        std::unique_ptr<JSONValue> expected(ParseDirect("{\"samples\": [1, -2, "
+            "\"x\", 3, 9007199254740993], \"temps\": [1.5, -0.25, 4.0], "
+            "\"mixed\": [1, 2.5], \"strs\": [\"a\"], \"empty\": [], "
+            "\"nested\": [[1, 2], [3.5]], \"flags\": [1, true], "
+            "\"first\": 1}"));
+
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"test\", \"path\": \"/samples/1\", \"value\": -2},"
+            "{\"op\": \"add\", \"path\": \"/samples/2\", \"value\": \"x\"},"
+            "{\"op\": \"replace\", \"path\": \"/temps/2\", \"value\": 4.0},"
+            "{\"op\": \"copy\", \"from\": \"/nested/0/0\", \"path\": \"/first\"}"
+            "]")));
+        CPPUNIT_ASSERT(patch.Apply(doc));
+        CPPUNIT_ASSERT(doc.GetRoot()->Equals(*expected));
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*plain));
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"test\", \"path\": \"/samples/4\", \"value\": 1}]")));
+        CPPUNIT_ASSERT(patch.Apply(clone) == false);
+    }
+
+    static const JSONValue *GetMember(const JSONValue *obj, const char *key)
+    {
+        int index = obj ? obj->FindKey(key) : -1;
+
+        return index < 0 ? NULL :
+            static_cast<const JSONTuple *>(obj->Get(index))->GetValue();
+    }
+
+    void testDocumentHolder()
+    {
+        JSONDocumentHolder empty;
+
+        CPPUNIT_ASSERT(empty.Get().GetRoot() == NULL);
+        {
+            JSONDocumentHolder::ReadGuard guard(empty);
+
+            CPPUNIT_ASSERT(guard.GetRoot() == NULL);
+        }
+
+        // a published version does not change, whatever the writer does
+        // to its document
+
+        JSONDocument doc(ParseDirect("{\"n\": 0, \"pair\": [0, 0], \"name\": \"x\"}"));
+        std::unique_ptr<JSONValue> first(ParseDirect(
+            "{\"n\": 0, \"pair\": [0, 0], \"name\": \"x\"}"));
+        JSONDocumentHolder holder(doc);
+        JSONPatch patch;
+
+        CPPUNIT_ASSERT(patch.Compile(std::string("[{\"op\": \"replace\", "
+            "\"path\": \"/name\", \"value\": \"y\"}]")));
+        CPPUNIT_ASSERT(patch.Apply(doc));
+        CPPUNIT_ASSERT(holder.Get().GetRoot()->Equals(*first));
+        JSONDocument old = holder.Get();
+        holder.Publish(doc);
+        CPPUNIT_ASSERT(holder.Get().GetRoot()->Equals(*doc.GetRoot()));
+        CPPUNIT_ASSERT(old.GetRoot()->Equals(*first));
+
+        // a failed update publishes nothing
+
+        CPPUNIT_ASSERT(patch.Compile(std::string("[{\"op\": \"test\", "
+            "\"path\": \"/name\", \"value\": \"z\"}]")));
+        CPPUNIT_ASSERT(holder.Update(patch) == false);
+        CPPUNIT_ASSERT(holder.Get().GetRoot()->Equals(*doc.GetRoot()));
+
+        // readers see every version whole, and in order, while a writer
+        // updates the document; versions they keep outlive the holder's
+        // reference to them
+
+        std::atomic<bool> done(false);
+        std::atomic<int> failures(0);
+        std::vector<std::thread> readers;
+        const int versions = 200;
+
+        for (int t = 0; t < 8; t++) {
+            readers.emplace_back([&holder, &done, &failures]() {
+                long last = -1;
+                JSONDocument kept;
+
+                while (!done.load()) {
+                    JSONDocumentHolder::ReadGuard guard(holder);
+                    const JSONValue *n = GetMember(guard.GetRoot(), "n");
+                    const JSONValue *pair = GetMember(guard.GetRoot(), "pair");
+                    long val;
+
+                    if (n == NULL || pair == NULL || pair->GetSize() != 2) {
+                        failures++;
+                        break;
+                    }
+                    val = static_cast<const JSONNumber *>(n)->Get();
+                    if (val < last ||
+                        static_cast<const JSONNumber *>(pair->Get(0))->Get() != val ||
+                        static_cast<const JSONNumber *>(pair->Get(1))->Get() != val) {
+                        failures++;
+                        break;
+                    }
+                    last = val;
+                    if (val % 16 == 0) {
+                        kept = holder.Get();
+                    }
+                }
+                if (kept.GetRoot() && GetMember(kept.GetRoot(), "n") == NULL) {
+                    failures++;
+                }
+            });
+        }
+        for (int i = 1; i <= versions; i++) {
+            std::string n = std::to_string(i);
+
+            CPPUNIT_ASSERT(patch.Compile("[{\"op\": \"replace\", \"path\": "
+                "\"/n\", \"value\": " + n + "}, {\"op\": \"replace\", "
+                "\"path\": \"/pair\", \"value\": [" + n + ", " + n + "]}]"));
+            CPPUNIT_ASSERT(holder.Update(patch));
+        }
+        done = true;
+        for (std::thread &reader : readers) {
+            reader.join();
+        }
+        CPPUNIT_ASSERT(failures.load() == 0);
+        CPPUNIT_ASSERT(static_cast<const JSONNumber *>(GetMember(
+            holder.Get().GetRoot(), "n"))->Get() == versions);
+        CPPUNIT_ASSERT(old.GetRoot()->Equals(*first));
+    }
+
+    void testLazy()
+    {
+        const char *input = "{\"name\": \"x\", \"items\": [{\"id\": 1, "
+            "\"tags\": [\"a\", \"b\"]}, {\"id\": 2, \"tags\": []}], "
+            "\"meta\": {\"deep\": {\"deeper\": [1, 2.5, null, true]}}}";
+        JSONMemoryUsage before = JSONMemory::GetLiveUsage();
+        std::unique_ptr<JSONValue> plain(ParseDirect(input));
+        std::string a, b;
+        size_t eager, lazy;
+
+        {
+            JsonParse parser;
+            std::string str(input);
+
+            parser.SetInput(str);
+            CPPUNIT_ASSERT(parser.Parse());
+            size_t parsed = JSONMemory::GetLiveUsage().nodes;
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+            eager = JSONMemory::GetLiveUsage().nodes - parsed;
+        }
+        {
+            JsonParse parser;
+            std::string str(input);
+
+            parser.SetLazy(true);
+            parser.SetInput(str);
+            CPPUNIT_ASSERT(parser.Parse());
+            size_t parsed = JSONMemory::GetLiveUsage().nodes;
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+            lazy = JSONMemory::GetLiveUsage().nodes - parsed;
+
+            // only the root is converted, and the tree now belongs to it
+
+            CPPUNIT_ASSERT(lazy < eager);
+            CPPUNIT_ASSERT(parser.GetRoot() == NULL);
+            CPPUNIT_ASSERT(JSONAPI::GetRootObject(&parser) == NULL);
+            CPPUNIT_ASSERT(val->MemoryUsage().nodes > 0);
+            CPPUNIT_ASSERT(JSONMemory::GetLiveUsage().nodes - parsed == lazy);
+
+            // looking into a member converts the containers on the way
+            // to it, and no others
+
+            const JSONValue *meta = GetMember(val.get(), "meta");
+            const JSONValue *deeper = GetMember(GetMember(meta, "deep"), "deeper");
+
+            CPPUNIT_ASSERT(deeper && deeper->GetSize() == 4);
+            CPPUNIT_ASSERT(deeper->Get(1)->GetType() == JsonType_Double);
+            CPPUNIT_ASSERT(JSONMemory::GetLiveUsage().nodes - parsed < eager);
+
+            // the rest converts on demand, e.g., to compare, print or
+            // modify the tree
+
+            CPPUNIT_ASSERT(val->Equals(*plain));
+            CPPUNIT_ASSERT(val->Hash() == plain->Hash());
+            CPPUNIT_ASSERT(val->ToJSON(a) == plain->ToJSON(b));
+            JSONValue *items = const_cast<JSONValue *>(GetMember(val.get(), "items"));
+            items->Append(new JSONNull());
+            CPPUNIT_ASSERT(items->GetSize() == 3);
+        }
+
+        // a value kept after the rest of the tree is dropped unconverted
+        // keeps what it needs of the tree, and nothing is left once it
+        // goes
+
+        JSONMemoryUsage start = JSONMemory::GetLiveUsage();
+        {
+            JsonParse parser;
+            std::string str(input);
+
+            parser.SetLazy(true);
+            parser.SetInput(str);
+            CPPUNIT_ASSERT(parser.Parse());
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+            JSONValue *items = const_cast<JSONValue *>(GetMember(val.get(), "items"));
+            std::unique_ptr<JSONValue> first(items->Get(0)->Ref());
+
+            val.reset();
+            CPPUNIT_ASSERT(first->Equals(*GetMember(plain.get(), "items")->Get(0)));
+        }
+        CPPUNIT_ASSERT(SameUsage(JSONMemory::GetLiveUsage(), start));
+
+        // many threads looking into the same value convert it once
+
+        {
+            JsonParse parser;
+            std::string str(input);
+            std::vector<std::thread> readers;
+            std::atomic<int> failures(0);
+
+            parser.SetLazy(true);
+            parser.SetInput(str);
+            CPPUNIT_ASSERT(parser.Parse());
+            std::unique_ptr<const JSONValue> val(JSONAPI::GetRootObject(&parser));
+
+            for (int t = 0; t < 4; t++) {
+                readers.emplace_back([&val, &plain, &failures]() {
+                    if (!val->Equals(*plain) || val->Hash() != plain->Hash()) {
+                        failures++;
+                    }
+                });
+            }
+            for (std::thread &reader : readers) {
+                reader.join();
+            }
+            CPPUNIT_ASSERT(failures == 0);
+        }
+
+        // converting that runs out of memory part way through gives back
+        // what it took and leaves the value to be converted again
+
+        {
+            LimitedAllocator limited((size_t) -1);
+            JsonParse parser;
+            std::string str(input);
+            size_t used;
+            int failed = 0;
+
+            parser.SetAllocator(&limited);
+            parser.SetLazy(true);
+            parser.SetInput(str);
+            CPPUNIT_ASSERT(parser.Parse());
+            std::unique_ptr<JSONValue> val(JSONAPI::GetRootObject(&parser));
+
+            used = limited.m_bytes;
+            for (limited.m_limit = used; ; limited.m_limit += 8) {
+                try {
+                    CPPUNIT_ASSERT(val->GetSize() == 3);
+                    break;
+                } catch (std::bad_alloc &) {
+                    CPPUNIT_ASSERT(limited.m_bytes == used);
+                    failed++;
+                }
+            }
+            CPPUNIT_ASSERT(failed > 1);
+            limited.m_limit = (size_t) -1;
+            CPPUNIT_ASSERT(val->Equals(*plain));
+            val.reset();
+        }
+        plain.reset();
+        CPPUNIT_ASSERT(SameUsage(JSONMemory::GetLiveUsage(), before));
+    }
+
+    static JSONTuple *MakeTuple(const char *key, long val)
+    {
+        JSONTuple *tuple = new JSONTuple();
+
+        tuple->SetKey(key);
+        tuple->SetValue(new JSONNumber(val));
+        return tuple;
+    }
+
+    static long GetNumber(const JSONValue *obj, const char *key)
+    {
+        const JSONValue *val = GetMember(obj, key);
+
+        return val ? static_cast<const JSONNumber *>(val)->Get() : -1;
+    }
+
+    void testSortedKeys()
+    {
+        std::unique_ptr<JSONValue> val(ParseDirect(
+            "{\"b\": 1, \"a\": 2, \"c\": {\"z\": 3, \"y\": [{\"q\": 4, \"p\": 5}]}}"));
+        std::unique_ptr<JSONValue> plain(val->Copy());
+        JSONObject *obj = static_cast<JSONObject *>(val.get());
+        std::string a, b;
+
+        CPPUNIT_ASSERT(!obj->IsSorted());
+        obj->SortKeys();
+        CPPUNIT_ASSERT(obj->IsSorted());
+        CPPUNIT_ASSERT(obj->Equals(*plain) && obj->Hash() == plain->Hash());
+        CPPUNIT_ASSERT(obj->FindKey("a") == 0 && obj->FindKey("b") == 1 &&
+            obj->FindKey("c") == 2 && obj->FindKey("d") == -1);
+        CPPUNIT_ASSERT(GetNumber(obj, "a") == 2 && GetNumber(obj, "b") == 1);
+        CPPUNIT_ASSERT(obj->Get(3) == NULL && obj->Get(-1) == NULL);
+
+        // only the object itself is sorted
+
+        obj->ToJSON(a);
+        CPPUNIT_ASSERT(a.find("a") < a.find("b") && a.find("b") < a.find("c"));
+        CPPUNIT_ASSERT(a.find("z") < a.find("y") && a.find("q") < a.find("p"));
+
+        // tuples go where their key belongs, after those with the same key
+
+        JSONTuple *rejected = MakeTuple("e", 8);
+
+        obj->Append(MakeTuple("ab", 6));
+        CPPUNIT_ASSERT(obj->Insert(0, MakeTuple("d", 7)));
+        CPPUNIT_ASSERT(obj->Insert(9, rejected) == false);
+        delete rejected;
+        obj->Prepend(MakeTuple("a", 9));
+        CPPUNIT_ASSERT(obj->GetSize() == 6);
+        CPPUNIT_ASSERT(obj->FindKey("ab") == 2 && obj->FindKey("d") == 5);
+        CPPUNIT_ASSERT(obj->FindKey("a") == 0 && GetNumber(obj, "a") == 2);
+        CPPUNIT_ASSERT(static_cast<JSONTuple *>(obj->Get(1))->GetKeyView() == "a");
+        CPPUNIT_ASSERT(obj->Set(1, MakeTuple("0", 10)));
+        CPPUNIT_ASSERT(obj->FindKey("0") == 0 && obj->FindKey("a") == 1);
+        CPPUNIT_ASSERT(obj->Delete(obj->FindKey("ab")));
+        std::unique_ptr<JSONValue> detached(obj->Detach(obj->FindKey("d")));
+        CPPUNIT_ASSERT(detached && obj->GetSize() == 4 && obj->FindKey("d") == -1);
+        CPPUNIT_ASSERT(obj->FindKey("c") == 3 && GetNumber(obj, "b") == 1);
+
+        // copies and clones stay sorted; sorting a tree leaves the trees
+        // it shares values with alone
+
+        std::unique_ptr<JSONValue> copy(obj->Copy());
+        CPPUNIT_ASSERT(static_cast<JSONObject *>(copy.get())->IsSorted());
+        CPPUNIT_ASSERT(copy->Equals(*obj) && copy->FindKey("b") == 2);
+
+        JSONDocument doc(plain.release());
+        JSONDocument clone = doc.Clone();
+
+        JSONObject::SortAllKeys(clone.GetMutableRoot());
+        a = "";
+        doc.ToJSON(a);
+        clone.ToJSON(b);
+        CPPUNIT_ASSERT(a.find("z") < a.find("y") && b.find("y") < b.find("z"));
+        CPPUNIT_ASSERT(b.find("p") < b.find("q") && a.find("q") < a.find("p"));
+        CPPUNIT_ASSERT(clone.GetRoot()->Equals(*doc.GetRoot()));
+
+        // equal trees give the same JSON once sorted
+
+        std::unique_ptr<JSONValue> other(ParseDirect(
+            "{\"c\": {\"y\": [{\"p\": 5, \"q\": 4}], \"z\": 3}, \"a\": 2, \"b\": 1}"));
+        std::string c;
+
+        JSONObject::SortAllKeys(other.get());
+        other->ToJSON(c);
+        CPPUNIT_ASSERT(b == c);
+
+        // a patch that fails undoes an add to a sorted object, which put
+        // the new key where it belongs rather than at the end
+
+        JSONDocument sorted(ParseDirect("{\"a\": 1, \"c\": 2}"));
+        std::unique_ptr<JSONValue> before;
+        JSONPatch patch;
+
+        static_cast<JSONObject *>(sorted.GetMutableRoot())->SortKeys();
+        before.reset(sorted.GetRoot()->Copy());
+        CPPUNIT_ASSERT(patch.Compile(std::string("["
+            "{\"op\": \"add\", \"path\": \"/b\", \"value\": 3},"
+            "{\"op\": \"test\", \"path\": \"/b\", \"value\": 4}"
+            "]")));
+        CPPUNIT_ASSERT(patch.Apply(sorted) == false);
+        CPPUNIT_ASSERT(sorted.GetRoot()->FindKey("b") == -1);
+        CPPUNIT_ASSERT(sorted.GetRoot()->FindKey("c") == 1);
+        CPPUNIT_ASSERT(sorted.GetRoot()->Equals(*before));
+        a = b = "";
+        sorted.ToJSON(a);
+        before->ToJSON(b);
+        CPPUNIT_ASSERT(a == b);
+
+        // keys sort, and are found, by their text, escaped or not
+
+        std::unique_ptr<JSONValue> escaped(ParseDirect(
+            "{\"\\u0063\": 1, \"b\": 2, \"a\": 3}"));
+        JSONObject *esc = static_cast<JSONObject *>(escaped.get());
+
+        CPPUNIT_ASSERT(esc->FindKey("c") == 0 && GetNumber(esc, "c") == 1);
+        esc->SortKeys();
+        CPPUNIT_ASSERT(esc->FindKey("a") == 0 && esc->FindKey("b") == 1 &&
+            esc->FindKey("c") == 2 && GetNumber(esc, "c") == 1);
+        CPPUNIT_ASSERT(esc->Append(MakeTuple("bb", 4)) == 2);
+        CPPUNIT_ASSERT(esc->Append(MakeTuple("d", 5)) == 4);
+        CPPUNIT_ASSERT(esc->FindKey("c") == 3);
+        a = "";
+        esc->ToJSON(a);
+        CPPUNIT_ASSERT(a.find("\"b\"") < a.find("\\u0063") &&
+            a.find("\\u0063") < a.find("d"));
+    }
+
+    void testBulk()
+    {
+        std::vector<int> ints{1, -2};
+        std::vector<std::string> strs{"a", "b"};
+        const char *names[] = {"c"};
+        double doubles[] = {2.5};
+        JSONArray arr;
+
+        // ranges of numbers, strings and booleans become values
+
+        arr.Append(ints.begin(), ints.end());
+        arr.Append(strs.begin(), strs.end());
+        arr.Append(names, names + 1);
+        arr.Append(doubles, doubles + 1);
+        std::vector<bool> flags{true};
+        arr.Append(flags.begin(), flags.end());
+        std::vector<unsigned long> big{ULONG_MAX};
+        arr.Append(big.begin(), big.end());
+        CPPUNIT_ASSERT(arr.GetSize() == 8);
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(arr.Get(1))->Get() == -2);
+        CPPUNIT_ASSERT(static_cast<JSONString *>(arr.Get(3))->GetView() == "b");
+        CPPUNIT_ASSERT(static_cast<JSONString *>(arr.Get(4))->GetView() == "c");
+        CPPUNIT_ASSERT(static_cast<JSONDouble *>(arr.Get(5))->Get() == 2.5);
+        CPPUNIT_ASSERT(static_cast<JSONBoolean *>(arr.Get(6))->Get());
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(arr.Get(7))->IsUnsigned());
+        CPPUNIT_ASSERT(static_cast<JSONNumber *>(arr.Get(7))->GetUnsigned() == ULONG_MAX);
+
+        // elements made in place
+
+        JSONNumber *num = arr.Emplace<JSONNumber>(5L);
+        JSONArray *nested = arr.Emplace<JSONArray>();
+        JSONNull *null = arr.Emplace<JSONNull>();
+
+        nested->Append(ints.begin(), ints.end());
+        CPPUNIT_ASSERT(arr.Get(8) == num && num->Get() == 5);
+        CPPUNIT_ASSERT(arr.Get(9) == nested && nested->GetSize() == 2);
+        CPPUNIT_ASSERT(arr.Get(10) == null);
+
+        JSONObject obj, sorted;
+
+        obj.EmplaceMember<JSONString>("name", "x");
+        obj.EmplaceMember<JSONNumber>(std::string("n"), 3L);
+        CPPUNIT_ASSERT(obj.GetSize() == 2 && GetNumber(&obj, "n") == 3);
+        CPPUNIT_ASSERT(static_cast<const JSONString *>(GetMember(&obj, "name"))->GetView() == "x");
+        sorted.SortKeys();
+        sorted.Reserve(3);
+        for (long i = 3; i > 0; i--) {
+            sorted.EmplaceMember<JSONNumber>("k" + std::to_string(i), i);
+        }
+        CPPUNIT_ASSERT(sorted.FindKey("k1") == 0 && sorted.FindKey("k3") == 2);
+        CPPUNIT_ASSERT(GetNumber(&sorted, "k2") == 2);
+
+        // packed arrays take spans
+
+        std::vector<int64_t> samples{4, 5, 6};
+        JSONPackedArray packed, packedDoubles(JsonType_Double);
+
+        packed.Reserve(4);
+        CPPUNIT_ASSERT(packed.AppendInteger(3));
+        CPPUNIT_ASSERT(packed.AppendIntegers(JSONSpan<const int64_t>(samples.data(), samples.size())));
+        CPPUNIT_ASSERT(packed.AppendDoubles(JSONSpan<const double>(doubles, 1)) == false);
+        CPPUNIT_ASSERT(packed.GetCount() == 4 && packed.GetIntegers()[3] == 6);
+        CPPUNIT_ASSERT(packedDoubles.AppendDoubles(JSONSpan<const double>(doubles, 1)));
+        CPPUNIT_ASSERT(packedDoubles.AppendIntegers(JSONSpan<const int64_t>()) == false);
+        CPPUNIT_ASSERT(packedDoubles.GetCount() == 1 && packedDoubles.GetDoubles()[0] == 2.5);
+    }
+
+    void testSharedSnapshot()
+    {
+        JSONDocument doc(ParseDirect("{\"Name\": {\"First\": 1, \"Last\": [2, 3.5, true, null]}, \"Age\": \"Old\"}"));
+        std::string name = "/jsonapitest-" + std::to_string(getpid());
+        std::string expected, str;
+        JSONTape tape;
+        pid_t pid;
+        int status;
+        int fd;
+
+        JSONTape::RemoveShared(name.c_str());
+        CPPUNIT_ASSERT(doc.SaveShared(name.c_str()));
+        CPPUNIT_ASSERT(doc.SaveShared(name.c_str()) == false);
+        CPPUNIT_ASSERT(tape.AttachShared(name.c_str(), true));
+        CPPUNIT_ASSERT(tape.IsMapped());
+        doc.ToJSON(expected);
+        tape.GetRoot().ToJSON(str);
+        CPPUNIT_ASSERT(str == expected);
+
+        // another process sees the same document
+
+        pid = fork();
+        CPPUNIT_ASSERT(pid >= 0);
+        if (pid == 0) {
+            JSONTape attached;
+            std::string json;
+            bool ok = attached.AttachShared(name.c_str(), true);
+
+            attached.GetRoot().ToJSON(json);
+            _exit(ok && json == expected &&
+                attached.GetRoot().Get(0).GetValue().Get(1).GetValue().Get(1).GetDouble() == 3.5 ? 0 : 1);
+        }
+        CPPUNIT_ASSERT(waitpid(pid, &status, 0) == pid);
+        CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+        // removing the object leaves those attached to it alone
+
+        CPPUNIT_ASSERT(JSONTape::RemoveShared(name.c_str()));
+        CPPUNIT_ASSERT(JSONTape::RemoveShared(name.c_str()) == false);
+        str = "";
+        tape.GetRoot().ToJSON(str);
+        CPPUNIT_ASSERT(str == expected);
+        JSONTape other;
+        CPPUNIT_ASSERT(other.AttachShared(name.c_str(), false) == false);
+        CPPUNIT_ASSERT(other.IsEmpty());
+
+        // an object still being written is not attached
+
+        fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+        CPPUNIT_ASSERT(fd >= 0);
+        CPPUNIT_ASSERT(write(fd, "JSONSNAP", 8) == 8);
+        close(fd);
+        CPPUNIT_ASSERT(other.AttachShared(name.c_str(), false) == false);
+        CPPUNIT_ASSERT(JSONTape::RemoveShared(name.c_str()));
+
+        // a tape filled in by the parser
+
+        JSONTape parsed;
+        JsonParse parser;
+        std::string input("[1, \"two\", {\"three\": 3}]");
+
+        parser.SetTape(&parsed);
+        parser.SetInput(input);
+        CPPUNIT_ASSERT(parser.Parse());
+        CPPUNIT_ASSERT(parsed.SaveShared(name.c_str()));
+        CPPUNIT_ASSERT(other.AttachShared(name.c_str(), true));
+        CPPUNIT_ASSERT(other.GetRoot().Get(2).FindKey("three") == 0);
+        CPPUNIT_ASSERT(JSONTape::RemoveShared(name.c_str()));
+    }
 };
 
 #endif 